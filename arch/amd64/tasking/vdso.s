@@ -0,0 +1,303 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+	Hand-assembled vDSO image.
+
+	The kernel copies everything between _vdso_image_start and
+	_vdso_image_end into its own pages and maps them right after the vDSO
+	data page (see core/vdso.cpp). The code reaches the data page with a
+	RIP-relative load, so the image needs no relocations and no section
+	headers; glibc and musl only look at the program headers and the
+	dynamic section.
+*/
+
+.code64
+.section .rodata
+
+/* VDSO::DataPage, keep in sync with include/vdso.hpp */
+.set VD_SEQUENCE, 0
+.set VD_FLAGS, 4
+.set VD_TSC_BASE, 8
+.set VD_MONOTONIC_BASE, 16
+.set VD_REALTIME_OFFSET, 24
+.set VD_MULT, 32
+.set VD_SHIFT, 36
+
+.set VDF_TSC, 1
+.set VDF_RDTSCP, 2
+
+.set NR_gettimeofday, 96
+.set NR_time, 201
+.set NR_clock_gettime, 228
+.set NR_getcpu, 309
+
+/* CLOCK_MONOTONIC, CLOCK_MONOTONIC_RAW, CLOCK_MONOTONIC_COARSE, CLOCK_BOOTTIME */
+.set MONOTONIC_CLOCKS, 0xD2
+/* CLOCK_REALTIME, CLOCK_REALTIME_COARSE */
+.set REALTIME_CLOCKS, 0x21
+
+.macro vdso_sym name, value, end
+	.long \name - vdso_dynstr
+	.byte 0x12 /* STB_GLOBAL | STT_FUNC */
+	.byte 0 /* STV_DEFAULT */
+	.short 1 /* Anything but SHN_UNDEF and SHN_ABS */
+	.quad \value - vdso_base
+	.quad \end - \value
+.endm
+
+.balign 16
+.global _vdso_image_start
+_vdso_image_start:
+vdso_base:
+	.byte 0x7F, 'E', 'L', 'F'
+	.byte 2 /* ELFCLASS64 */
+	.byte 1 /* ELFDATA2LSB */
+	.byte 1 /* EV_CURRENT */
+	.byte 0 /* ELFOSABI_SYSV */
+	.zero 8
+	.short 3 /* ET_DYN */
+	.short 62 /* EM_X86_64 */
+	.long 1 /* EV_CURRENT */
+	.quad 0 /* e_entry */
+	.quad vdso_phdr - vdso_base /* e_phoff */
+	.quad 0 /* e_shoff */
+	.long 0 /* e_flags */
+	.short 64 /* e_ehsize */
+	.short 56 /* e_phentsize */
+	.short 2 /* e_phnum */
+	.short 64 /* e_shentsize */
+	.short 0 /* e_shnum */
+	.short 0 /* e_shstrndx */
+
+vdso_phdr:
+	.long 1 /* PT_LOAD */
+	.long 5 /* PF_R | PF_X */
+	.quad 0 /* p_offset */
+	.quad 0 /* p_vaddr */
+	.quad 0 /* p_paddr */
+	.quad _vdso_image_end - vdso_base /* p_filesz */
+	.quad _vdso_image_end - vdso_base /* p_memsz */
+	.quad 0x1000 /* p_align */
+
+	.long 2 /* PT_DYNAMIC */
+	.long 4 /* PF_R */
+	.quad vdso_dynamic - vdso_base
+	.quad vdso_dynamic - vdso_base
+	.quad vdso_dynamic - vdso_base
+	.quad vdso_dynamic_end - vdso_dynamic
+	.quad vdso_dynamic_end - vdso_dynamic
+	.quad 8
+
+.balign 8
+vdso_dynamic:
+	.quad 4, vdso_hash - vdso_base /* DT_HASH */
+	.quad 5, vdso_dynstr - vdso_base /* DT_STRTAB */
+	.quad 6, vdso_dynsym - vdso_base /* DT_SYMTAB */
+	.quad 10, vdso_dynstr_end - vdso_dynstr /* DT_STRSZ */
+	.quad 11, 24 /* DT_SYMENT */
+	.quad 14, str_soname - vdso_dynstr /* DT_SONAME */
+	.quad 0, 0 /* DT_NULL */
+vdso_dynamic_end:
+
+/* A single bucket: lookups walk every symbol, there are only a few. */
+vdso_hash:
+	.long 1 /* nbucket */
+	.long 9 /* nchain */
+	.long 1 /* bucket[0] */
+	.long 0, 2, 3, 4, 5, 6, 7, 8, 0 /* chain[] */
+
+.balign 8
+vdso_dynsym:
+	.zero 24
+	vdso_sym str_vdso_clock_gettime, vdso_clock_gettime, vdso_clock_gettime_end
+	vdso_sym str_clock_gettime, vdso_clock_gettime, vdso_clock_gettime_end
+	vdso_sym str_vdso_gettimeofday, vdso_gettimeofday, vdso_gettimeofday_end
+	vdso_sym str_gettimeofday, vdso_gettimeofday, vdso_gettimeofday_end
+	vdso_sym str_vdso_time, vdso_time, vdso_time_end
+	vdso_sym str_time, vdso_time, vdso_time_end
+	vdso_sym str_vdso_getcpu, vdso_getcpu, vdso_getcpu_end
+	vdso_sym str_getcpu, vdso_getcpu, vdso_getcpu_end
+
+/* The unprefixed names share the tail of the "__vdso_" ones. */
+vdso_dynstr:
+	.byte 0
+str_soname:
+	.asciz "linux-vdso.so.1"
+str_vdso_clock_gettime:
+	.asciz "__vdso_clock_gettime"
+str_vdso_gettimeofday:
+	.asciz "__vdso_gettimeofday"
+str_vdso_time:
+	.asciz "__vdso_time"
+str_vdso_getcpu:
+	.asciz "__vdso_getcpu"
+vdso_dynstr_end:
+
+.set str_clock_gettime, str_vdso_clock_gettime + 7
+.set str_gettimeofday, str_vdso_gettimeofday + 7
+.set str_time, str_vdso_time + 7
+.set str_getcpu, str_vdso_getcpu + 7
+
+/*
+	Read the monotonic clock in nanoseconds.
+
+	In: %r8 = data page
+	Out: %rax = monotonic ns, %r10 = realtime offset
+	Clobbers: %rcx, %rdx, %r9
+*/
+.balign 16
+vdso_read_ns:
+	movl VD_SEQUENCE(%r8), %r9d
+	testl $1, %r9d
+	jnz 2f
+	lfence
+	rdtsc
+	shlq $32, %rdx
+	orq %rdx, %rax
+	subq VD_TSC_BASE(%r8), %rax
+	jnc 1f
+	/* This core's TSC is slightly behind the one that calibrated */
+	xorl %eax, %eax
+1:
+	movl VD_MULT(%r8), %ecx
+	mulq %rcx
+	movl VD_SHIFT(%r8), %ecx
+	shrdq %cl, %rdx, %rax
+	addq VD_MONOTONIC_BASE(%r8), %rax
+	movq VD_REALTIME_OFFSET(%r8), %r10
+	cmpl VD_SEQUENCE(%r8), %r9d
+	jne vdso_read_ns
+	ret
+2:
+	pause
+	jmp vdso_read_ns
+
+/* int clock_gettime(clockid_t clockid, struct timespec *tp) */
+.balign 16
+vdso_clock_gettime:
+	leaq vdso_base - 0x1000(%rip), %r8
+	testl $VDF_TSC, VD_FLAGS(%r8)
+	jz 3f
+	cmpl $7, %edi
+	ja 3f
+	movl $MONOTONIC_CLOCKS, %eax
+	btl %edi, %eax
+	jc 1f
+	movl $REALTIME_CLOCKS, %eax
+	btl %edi, %eax
+	jnc 3f
+	call vdso_read_ns
+	addq %r10, %rax
+	jmp 2f
+1:
+	call vdso_read_ns
+2:
+	movl $1000000000, %ecx
+	xorl %edx, %edx
+	divq %rcx
+	movq %rax, (%rsi)
+	movq %rdx, 8(%rsi)
+	xorl %eax, %eax
+	ret
+3:
+	movl $NR_clock_gettime, %eax
+	syscall
+	ret
+vdso_clock_gettime_end:
+
+/* int gettimeofday(struct timeval *tv, struct timezone *tz) */
+.balign 16
+vdso_gettimeofday:
+	leaq vdso_base - 0x1000(%rip), %r8
+	testl $VDF_TSC, VD_FLAGS(%r8)
+	jz 3f
+	testq %rdi, %rdi
+	jz 1f
+	call vdso_read_ns
+	addq %r10, %rax
+	movl $1000000000, %ecx
+	xorl %edx, %edx
+	divq %rcx
+	movq %rax, (%rdi)
+	movq %rdx, %rax
+	movl $1000, %ecx
+	xorl %edx, %edx
+	divq %rcx
+	movq %rax, 8(%rdi)
+1:
+	testq %rsi, %rsi
+	jz 2f
+	/* tz_minuteswest and tz_dsttime */
+	movq $0, (%rsi)
+2:
+	xorl %eax, %eax
+	ret
+3:
+	movl $NR_gettimeofday, %eax
+	syscall
+	ret
+vdso_gettimeofday_end:
+
+/* time_t time(time_t *tloc) */
+.balign 16
+vdso_time:
+	leaq vdso_base - 0x1000(%rip), %r8
+	testl $VDF_TSC, VD_FLAGS(%r8)
+	jz 2f
+	call vdso_read_ns
+	addq %r10, %rax
+	movl $1000000000, %ecx
+	xorl %edx, %edx
+	divq %rcx
+	testq %rdi, %rdi
+	jz 1f
+	movq %rax, (%rdi)
+1:
+	ret
+2:
+	movl $NR_time, %eax
+	syscall
+	ret
+vdso_time_end:
+
+/* int getcpu(unsigned int *cpu, unsigned int *node, void *cache) */
+.balign 16
+vdso_getcpu:
+	leaq vdso_base - 0x1000(%rip), %r8
+	testl $VDF_RDTSCP, VD_FLAGS(%r8)
+	jz 3f
+	/* IA32_TSC_AUX holds the CPU ID, see CPU::InitializeFeatures */
+	rdtscp
+	testq %rdi, %rdi
+	jz 1f
+	movl %ecx, (%rdi)
+1:
+	testq %rsi, %rsi
+	jz 2f
+	movl $0, (%rsi)
+2:
+	xorl %eax, %eax
+	ret
+3:
+	movl $NR_getcpu, %eax
+	syscall
+	ret
+vdso_getcpu_end:
+
+.global _vdso_image_end
+_vdso_image_end:
@@ -34,6 +34,7 @@ using namespace CPU::x32;
 namespace CPU
 {
 	static bool SSEEnabled = false;
+	static bool RDTSCPEnabled = false;
 
 	const char *Vendor()
 	{
@@ -241,6 +242,7 @@ namespace CPU
 		bool UMIP = false;
 		bool SMEP = false;
 		bool SMAP = false;
+		bool RDTSCP = false;
 	};
 
 	SupportedFeat GetCPUFeat()
@@ -251,23 +253,27 @@ namespace CPU
 		{
 			CPU::x86::AMD::CPUID0x00000001 cpuid1;
 			CPU::x86::AMD::CPUID0x00000007_ECX_0 cpuid7;
+			CPU::x86::AMD::CPUID0x80000001 cpuid80000001;
 
 			feat.PGE = cpuid1.EDX.PGE;
 			feat.SSE = cpuid1.EDX.SSE;
 			feat.SMEP = cpuid7.EBX.SMEP;
 			feat.SMAP = cpuid7.EBX.SMAP;
 			feat.UMIP = cpuid7.ECX.UMIP;
+			feat.RDTSCP = cpuid80000001.EDX.RDTSCP;
 		}
 		else if (strcmp(CPU::Vendor(), x86_CPUID_VENDOR_INTEL) == 0)
 		{
 			CPU::x86::Intel::CPUID0x00000001 cpuid1;
 			CPU::x86::Intel::CPUID0x00000007_0 cpuid7_0;
+			CPU::x86::Intel::CPUID0x80000001 cpuid80000001;
 
 			feat.PGE = cpuid1.EDX.PGE;
 			feat.SSE = cpuid1.EDX.SSE;
 			feat.SMEP = cpuid7_0.EBX.SMEP;
 			feat.SMAP = cpuid7_0.EBX.SMAP;
 			feat.UMIP = cpuid7_0.ECX.UMIP;
+			feat.RDTSCP = cpuid80000001.EDX.RDTSCP;
 		}
 
 		return feat;
@@ -379,6 +385,12 @@ namespace CPU
 
 		debug("Enabling PAT support...");
 		wrmsr(MSR_CR_PAT, 0x6 | (0x0 << 8) | (0x1 << 16));
+
+		/* The vDSO getcpu reads the core ID back with RDTSCP */
+		if (feat.RDTSCP)
+			wrmsr(MSR_TSC_AUX, Core);
+		RDTSCPEnabled = feat.RDTSCP;
+
 		if (!BSP++)
 			trace("Features for BSP initialized.");
 		if (SSEEnableAfter)
@@ -405,6 +417,11 @@ namespace CPU
 		return Counter;
 	}
 
+	bool RDTSCPSupported()
+	{
+		return RDTSCPEnabled;
+	}
+
 	uint64_t CheckSIMD()
 	{
 		if (unlikely(!SSEEnabled))
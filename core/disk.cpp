@@ -17,177 +17,700 @@
 
 #include <disk.hpp>
 
+#include <waitqueue.hpp>
 #include <memory.hpp>
 #include <printf.h>
 
 #include "../kernel.h"
 
+/* Time a request may wait before it is served out of order, like mq-deadline */
+#define READ_EXPIRE 500000000ULL
+#define WRITE_EXPIRE 5000000000ULL
+
+/* Reads dispatched while writes wait, before a write goes */
+#define WRITES_STARVED 2
+
+/* Largest merged request */
+#define MAX_REQUEST_BYTES (1024 * 1024)
+
 namespace Disk
 {
-	void Manager::FetchDisks(unsigned long modUniqueID)
+	bool Queue::Merge(Bio *b)
+	{
+		std::vector<Request *> &list = Pending[b->Write];
+
+		/* First request that starts after the bio */
+		size_t lo = 0, hi = list.size();
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (list[mid]->Sector <= b->Sector)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		/* Back merge, the bio continues the request before it */
+		if (lo > 0)
+		{
+			Request *r = list[lo - 1];
+			if (r->Sector + r->Count == b->Sector &&
+				r->Count + b->Count <= MaxSectors)
+			{
+				foreach (auto &v in b->Vector)
+					r->Vector.push_back(v);
+				r->Count += b->Count;
+				r->Bios.push_back(b);
+				return true;
+			}
+		}
+
+		/* Front merge, the bio ends where the next request starts */
+		if (lo < list.size())
+		{
+			Request *r = list[lo];
+			if (b->Sector + b->Count == r->Sector &&
+				r->Count + b->Count <= MaxSectors)
+			{
+				std::vector<kiovec> vector = b->Vector;
+				foreach (auto &v in r->Vector)
+					vector.push_back(v);
+				r->Vector = vector;
+				r->Sector = b->Sector;
+				r->Count += b->Count;
+				r->Bios.push_back(b);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Queue::Insert(Request *r)
+	{
+		std::vector<Request *> &list = Pending[r->Write];
+		size_t lo = 0, hi = list.size();
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (list[mid]->Sector <= r->Sector)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		list.insert(list.begin() + lo, r);
+	}
+
+	Request *Queue::Next()
+	{
+		bool reads = !Pending[0].empty();
+		bool writes = !Pending[1].empty();
+		if (!reads && !writes)
+			return nullptr;
+
+		int direction;
+		if (reads && (!writes || WritesStarved < WRITES_STARVED))
+		{
+			direction = 0;
+			if (writes)
+				WritesStarved++;
+		}
+		else
+		{
+			direction = 1;
+			WritesStarved = 0;
+		}
+
+		std::vector<Request *> &list = Pending[direction];
+		size_t oldest = 0;
+		for (size_t i = 1; i < list.size(); i++)
+		{
+			if (list[i]->Deadline < list[oldest]->Deadline)
+				oldest = i;
+		}
+
+		size_t pick;
+		if (list[oldest]->Deadline <= TimeManager->GetNanosecondsSinceClassCreation())
+			pick = oldest;
+		else
+		{
+			/* Keep going the same way across the disk, then start over */
+			pick = 0;
+			while (pick < list.size() && list[pick]->Sector < Position)
+				pick++;
+			if (pick == list.size())
+				pick = 0;
+		}
+
+		Request *r = list[pick];
+		list.erase(list.begin() + pick);
+		Position = r->Sector + r->Count;
+		return r;
+	}
+
+	bool Queue::CanDispatch()
+	{
+		return Plugged == 0 && InFlight < Depth &&
+			   (!Pending[0].empty() || !Pending[1].empty());
+	}
+
+	void Queue::Start(Request *r)
 	{
-		/* KernelCallback */
-		// KernelCallback callback{};
-		// callback.Reason = QueryReason;
-		// DriverManager->IOCB(modUniqueID, &callback);
-		// this->AvailablePorts = callback.DiskCallback.Fetch.Ports;
-		// this->BytesPerSector = callback.DiskCallback.Fetch.BytesPerSector;
-		debug("AvailablePorts:%ld BytesPerSector:%ld", this->AvailablePorts, this->BytesPerSector);
+		Dispatched++;
+		r->Driver.Sector = r->Sector;
+		r->Driver.Count = r->Count;
+		r->Driver.Vector = r->Vector.data();
+		r->Driver.VectorCount = (int)r->Vector.size();
+		r->Driver.Write = r->Write;
+		r->Driver.KernelData = r;
 
-		if (this->AvailablePorts <= 0)
+		if (Disk->Ops)
+		{
+			int ret = Disk->Ops->Submit(Disk->DriverDevice, &r->Driver);
+			if (ret < 0)
+				Complete(r, ret);
 			return;
+		}
 
-		uint8_t *RWBuffer = (uint8_t *)KernelAllocator.RequestPages(TO_PAGES(this->BytesPerSector + 1));
-
-		for (unsigned char ItrPort = 0; ItrPort < this->AvailablePorts; ItrPort++)
-		{
-			Drive *drive = new Drive{};
-			sprintf(drive->Name, "sd%ld", modUniqueID);
-			debug("Drive Name: %s", drive->Name);
-			// TODO: Implement disk type detection. Very useful in the future.
-			drive->MechanicalDisk = true;
-
-			memset(RWBuffer, 0, this->BytesPerSector);
-			/* KernelCallback */
-			// callback.Reason = ReceiveReason;
-			// callback.DiskCallback.RW = {
-			// 	.Sector = 0,
-			// 	.SectorCount = 2,
-			// 	.Port = ItrPort,
-			// 	.Buffer = RWBuffer,
-			// 	.Write = false,
-			// };
-			// DriverManager->IOCB(modUniqueID, &callback);
-			memcpy(&drive->Table, RWBuffer, sizeof(PartitionTable));
-
-			/*
-			TODO: Add to devfs the disk
-			*/
-
-			if (drive->Table.GPT.Signature == GPT_MAGIC)
+		/* The driver can't queue, finish it right here */
+		off_t offset = (off_t)r->Sector * Disk->SectorSize;
+		size_t expected = r->Count * Disk->SectorSize;
+		ssize_t ret;
+		if (r->Write)
+		{
+			if (Disk->Legacy->WriteV)
+				ret = Disk->Legacy->WriteV(&Disk->LegacyNode, r->Vector.data(), (int)r->Vector.size(), offset);
+			else
 			{
-				drive->Style = GPT;
-				uint32_t Entries = 512 / drive->Table.GPT.EntrySize;
-				uint32_t Sectors = drive->Table.GPT.PartCount / Entries;
-				for (uint32_t Block = 0; Block < Sectors; Block++)
+				ret = 0;
+				foreach (auto &v in r->Vector)
 				{
-					memset(RWBuffer, 0, this->BytesPerSector);
-					/* KernelCallback */
-					// callback.Reason = ReceiveReason;
-					// callback.DiskCallback.RW = {
-					// 	.Sector = 2 + Block,
-					// 	.SectorCount = 1,
-					// 	.Port = ItrPort,
-					// 	.Buffer = RWBuffer,
-					// 	.Write = false,
-					// };
-					// DriverManager->IOCB(modUniqueID, &callback);
-
-					for (uint32_t e = 0; e < Entries; e++)
+					ssize_t n = Disk->Legacy->Write(&Disk->LegacyNode, v.iov_base, v.iov_len, offset + ret);
+					if (n < 0 || (size_t)n < v.iov_len)
 					{
-						GUIDPartitionTableEntry GPTPartition = reinterpret_cast<GUIDPartitionTableEntry *>(RWBuffer)[e];
-						if (memcmp(GPTPartition.PartitionType, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", sizeof(GPTPartition.PartitionType)) != 0)
-						{
-							debug("Partition Type: %02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
-								  GPTPartition.PartitionType[0], GPTPartition.PartitionType[1], GPTPartition.PartitionType[2], GPTPartition.PartitionType[3],
-								  GPTPartition.PartitionType[4], GPTPartition.PartitionType[5], GPTPartition.PartitionType[6], GPTPartition.PartitionType[7],
-								  GPTPartition.PartitionType[8], GPTPartition.PartitionType[9], GPTPartition.PartitionType[10], GPTPartition.PartitionType[11],
-								  GPTPartition.PartitionType[12], GPTPartition.PartitionType[13], GPTPartition.PartitionType[14], GPTPartition.PartitionType[15]);
-
-							debug("Unique Partition GUID: %02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
-								  GPTPartition.UniquePartitionGUID[0], GPTPartition.UniquePartitionGUID[1], GPTPartition.UniquePartitionGUID[2], GPTPartition.UniquePartitionGUID[3],
-								  GPTPartition.UniquePartitionGUID[4], GPTPartition.UniquePartitionGUID[5], GPTPartition.UniquePartitionGUID[6], GPTPartition.UniquePartitionGUID[7],
-								  GPTPartition.UniquePartitionGUID[8], GPTPartition.UniquePartitionGUID[9], GPTPartition.UniquePartitionGUID[10], GPTPartition.UniquePartitionGUID[11],
-								  GPTPartition.UniquePartitionGUID[12], GPTPartition.UniquePartitionGUID[13], GPTPartition.UniquePartitionGUID[14], GPTPartition.UniquePartitionGUID[15]);
-
-							Partition *partition = new Partition{};
-							memset(partition->Label, '\0', sizeof(partition->Label));
-							// TODO: Add support for UTF-16 partition names.
-							/* Convert utf16 to utf8 */
-							for (int i = 0; i < 36; i++)
-							{
-								uint16_t utf16 = GPTPartition.PartitionName[i];
-								if (utf16 == 0)
-									break;
-								if (utf16 < 0x80)
-									partition->Label[i] = (char)utf16;
-								else if (utf16 < 0x800)
-								{
-									partition->Label[i] = (char)(0xC0 | (utf16 >> 6));
-									partition->Label[i + 1] = (char)(0x80 | (utf16 & 0x3F));
-									i++;
-								}
-								else
-								{
-									partition->Label[i] = (char)(0xE0 | (utf16 >> 12));
-									partition->Label[i + 1] = (char)(0x80 | ((utf16 >> 6) & 0x3F));
-									partition->Label[i + 2] = (char)(0x80 | (utf16 & 0x3F));
-									i += 2;
-								}
-							}
-							partition->StartLBA = GPTPartition.FirstLBA;
-							partition->EndLBA = GPTPartition.LastLBA;
-							partition->Sectors = (size_t)(partition->EndLBA - partition->StartLBA);
-							partition->Port = ItrPort;
-							partition->Flags = Present;
-							partition->Style = GPT;
-							if (GPTPartition.Attributes & 1)
-								partition->Flags |= EFISystemPartition;
-							partition->Index = drive->Partitions.size();
-							trace("GPT partition \"%s\" found with %lld sectors",
-								  partition->Label, partition->Sectors);
-							drive->Partitions.push_back(partition);
-
-							char PartitionName[64];
-							sprintf(PartitionName, "sd%ldp%ld", drives.size(), partition->Index);
-							fixme("PartitionName: %s", PartitionName);
-
-							/*
-							TODO: Add to devfs the disk
-							*/
-						}
+						ret = n < 0 ? n : ret + n;
+						break;
 					}
+					ret += n;
 				}
-				trace("%d GPT partitions found.", drive->Partitions.size());
 			}
-			else if (drive->Table.MBR.Signature[0] == MBR_MAGIC0 &&
-					 drive->Table.MBR.Signature[1] == MBR_MAGIC1)
+		}
+		else
+		{
+			if (Disk->Legacy->ReadV)
+				ret = Disk->Legacy->ReadV(&Disk->LegacyNode, r->Vector.data(), (int)r->Vector.size(), offset);
+			else
 			{
-				drive->Style = MBR;
-				for (size_t p = 0; p < 4; p++)
-					if (drive->Table.MBR.Partitions[p].LBAFirst != 0)
+				ret = 0;
+				foreach (auto &v in r->Vector)
+				{
+					ssize_t n = Disk->Legacy->Read(&Disk->LegacyNode, v.iov_base, v.iov_len, offset + ret);
+					if (n < 0 || (size_t)n < v.iov_len)
 					{
-						Partition *partition = new Partition{};
-						partition->StartLBA = drive->Table.MBR.Partitions[p].LBAFirst;
-						partition->EndLBA = drive->Table.MBR.Partitions[p].LBAFirst + drive->Table.MBR.Partitions[p].Sectors;
-						partition->Sectors = drive->Table.MBR.Partitions[p].Sectors;
-						partition->Port = ItrPort;
-						partition->Flags = Present;
-						partition->Style = MBR;
-						partition->Index = drive->Partitions.size();
-						trace("MBR Partition %x found with %d sectors.",
-							  drive->Table.MBR.UniqueID, partition->Sectors);
-						drive->Partitions.push_back(partition);
-
-						char PartitionName[64];
-						sprintf(PartitionName, "sd%ldp%ld", drives.size(), partition->Index);
-						fixme("PartitionName: %s", PartitionName);
-
-						/*
-						TODO: Add to devfs the disk
-						*/
+						ret = n < 0 ? n : ret + n;
+						break;
 					}
-				trace("%d MBR partitions found.", drive->Partitions.size());
+					ret += n;
+				}
+			}
+		}
+
+		if (ret >= 0 && (size_t)ret != expected)
+			ret = -EIO;
+		Complete(r, ret < 0 ? (int)ret : 0);
+	}
+
+	void Queue::Submit(Bio *b)
+	{
+		Submitted++;
+
+		Request *r = new Request;
+		r->Sector = b->Sector;
+		r->Count = b->Count;
+		r->Write = b->Write;
+		r->Vector = b->Vector;
+		r->Bios.push_back(b);
+		r->Owner = this;
+		r->Deadline = TimeManager->GetNanosecondsSinceClassCreation() +
+					  (b->Write ? WRITE_EXPIRE : READ_EXPIRE);
+
+		bool merged;
+		{
+			SmartCriticalSection(QueueLock);
+			merged = Merge(b);
+			if (!merged)
+				Insert(r);
+		}
+
+		if (merged)
+		{
+			Merged++;
+			delete r;
+		}
+		Dispatch();
+	}
+
+	void Queue::Plug()
+	{
+		SmartCriticalSection(QueueLock);
+		Plugged++;
+	}
+
+	void Queue::Unplug()
+	{
+		{
+			SmartCriticalSection(QueueLock);
+			assert(Plugged > 0);
+			Plugged--;
+		}
+		Dispatch();
+	}
+
+	void Queue::Dispatch()
+	{
+		/* Drivers that finish inline call back in here, don't nest */
+		if (Dispatching.exchange(true))
+			return;
+
+		while (true)
+		{
+			Request *r = nullptr;
+			{
+				SmartCriticalSection(QueueLock);
+				if (CanDispatch())
+				{
+					r = Next();
+					InFlight++;
+				}
+			}
+
+			if (r)
+			{
+				Start(r);
+				continue;
+			}
+
+			Dispatching.store(false);
+
+			/* Something may have come in after we looked */
+			bool again;
+			{
+				SmartCriticalSection(QueueLock);
+				again = CanDispatch();
+			}
+			if (!again || Dispatching.exchange(true))
+				break;
+		}
+	}
+
+	void Queue::Complete(Request *r, int Status)
+	{
+		{
+			SmartCriticalSection(QueueLock);
+			assert(InFlight > 0);
+			InFlight--;
+		}
+
+		foreach (Bio *b in r->Bios)
+			b->Done(b, Status);
+		delete r;
+
+		Dispatch();
+	}
+
+	Queue::Queue(Device *Disk, size_t Depth)
+	{
+		this->Disk = Disk;
+		this->Depth = Depth ? Depth : 1;
+		this->MaxSectors = MAX(MAX_REQUEST_BYTES / Disk->SectorSize, (size_t)1);
+	}
+
+	Queue::~Queue()
+	{
+		assert(InFlight == 0);
+		assert(Pending[0].empty() && Pending[1].empty());
+	}
+
+	void Device::Submit(Bio *b)
+	{
+		Device *disk = this;
+		while (disk->Parent)
+		{
+			b->Sector += disk->Start;
+			disk = disk->Parent;
+		}
+		disk->IO->Submit(b);
+	}
+
+	struct Completion
+	{
+		std::atomic_size_t Remaining;
+		std::atomic_int Status = 0;
+		Tasking::WaitQueue Waiters;
+	};
+
+	int Device::SubmitAll(Bio *Bios, size_t Count)
+	{
+		Completion done;
+		done.Remaining = Count;
+
+		for (size_t i = 0; i < Count; i++)
+		{
+			if (Bios[i].Sector + Bios[i].Count > Sectors)
+				return -EINVAL;
+		}
+
+		Device *disk = this;
+		while (disk->Parent)
+			disk = disk->Parent;
+		Queue *queue = disk->IO;
+
+		queue->Plug();
+		for (size_t i = 0; i < Count; i++)
+		{
+			Bios[i].Private = &done;
+			Bios[i].Done = [](Bio *b, int Status)
+			{
+				Completion *c = (Completion *)b->Private;
+				if (Status < 0)
+					c->Status.store(Status);
+
+				/* Count down with the queue lock held, the
+				   waiter may free c as soon as it sees zero */
+				c->Waiters.WakeOne([c](Tasking::TCB *)
+								   { c->Remaining--; });
+			};
+			Submit(&Bios[i]);
+		}
+		queue->Unplug();
+
+		done.Waiters.Wait([&]
+						  { return done.Remaining.load() == 0; });
+		return done.Status.load();
+	}
+
+	ssize_t Device::Transfer(const struct kiovec *Vector, int Count, off_t Offset, bool Write)
+	{
+		size_t total = 0;
+		for (int i = 0; i < Count; i++)
+			total += Vector[i].iov_len;
+
+		off_t end = (off_t)(Sectors * SectorSize);
+		if (Offset < 0)
+			return -EINVAL;
+		if (Offset >= end)
+			return Write ? -ENOSPC : 0;
+		total = MIN(total, (size_t)(end - Offset));
+		if (total == 0)
+			return 0;
+
+		Bio b;
+		b.Write = Write;
+		if (Offset % SectorSize == 0 && total % SectorSize == 0)
+		{
+			/* Whole sectors, straight from and to the caller */
+			b.Sector = Offset / SectorSize;
+			b.Count = total / SectorSize;
+			size_t left = total;
+			for (int i = 0; i < Count && left; i++)
+			{
+				size_t n = MIN(left, Vector[i].iov_len);
+				b.Vector.push_back({Vector[i].iov_base, n});
+				left -= n;
+			}
+
+			int ret = SubmitAll(&b, 1);
+			return ret < 0 ? ret : (ssize_t)total;
+		}
+
+		/* Go through whole sectors in a buffer of our own */
+		off_t first = ALIGN_DOWN(Offset, (off_t)SectorSize);
+		off_t last = ALIGN_UP(Offset + (off_t)total, (off_t)SectorSize);
+		size_t length = last - first;
+		uint8_t *buffer = new uint8_t[length];
+
+		b.Sector = first / SectorSize;
+		b.Count = length / SectorSize;
+		b.Vector.push_back({buffer, length});
+		b.Write = false;
+		int ret = SubmitAll(&b, 1);
+
+		if (ret == 0)
+		{
+			size_t position = Offset - first;
+			for (int i = 0; i < Count && position < (size_t)(Offset - first) + total; i++)
+			{
+				size_t n = MIN(Vector[i].iov_len, (Offset - first) + total - position);
+				if (Write)
+					memcpy(buffer + position, Vector[i].iov_base, n);
+				else
+					memcpy(Vector[i].iov_base, buffer + position, n);
+				position += n;
+			}
+
+			if (Write)
+			{
+				Bio w;
+				w.Sector = b.Sector;
+				w.Count = b.Count;
+				w.Write = true;
+				w.Vector.push_back({buffer, length});
+				ret = SubmitAll(&w, 1);
+			}
+		}
+
+		delete[] buffer;
+		return ret < 0 ? ret : (ssize_t)total;
+	}
+
+	static ssize_t __disk_Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
+	{
+		struct kiovec vector = {Buffer, Size};
+		return ((Device *)Node->PrivateData)->Transfer(&vector, 1, Offset, false);
+	}
+
+	static ssize_t __disk_Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset)
+	{
+		struct kiovec vector = {(void *)Buffer, Size};
+		return ((Device *)Node->PrivateData)->Transfer(&vector, 1, Offset, true);
+	}
+
+	static ssize_t __disk_ReadV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset)
+	{
+		return ((Device *)Node->PrivateData)->Transfer(Vector, Count, Offset, false);
+	}
+
+	static ssize_t __disk_WriteV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset)
+	{
+		return ((Device *)Node->PrivateData)->Transfer(Vector, Count, Offset, true);
+	}
+
+	static int __disk_Stat(struct Inode *Node, struct kstat *Stat)
+	{
+		Device *d = (Device *)Node->PrivateData;
+		memset(Stat, 0, sizeof(struct kstat));
+		Stat->Device = Node->Device;
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		Stat->RawDevice = Node->RawDevice;
+		Stat->Size = d->Sectors * d->SectorSize;
+		Stat->BlockSize = d->SectorSize;
+		Stat->Blocks = Stat->Size / 512;
+		return 0;
+	}
+
+	void Manager::Publish(Device *d)
+	{
+		/* b rw- rw- --- */
+		d->Node.Mode = S_IFBLK | S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+		d->Node.Device = DeviceID;
+		d->Node.Flags = I_FLAG_CACHE_KEEP;
+		d->Node.PrivateData = d;
+
+		{
+			SmartLock(DevicesLock);
+			d->Node.Index = Devices.size() + 1;
+			Devices.push_back(d);
+		}
+
+		std::string path = "/dev/" + d->Name;
+		d->File = fs->Mount(fs->GetRoot(0), &d->Node, path.c_str());
+	}
+
+	Device *Manager::AddDisk(dev_t DriverID, const struct BlockOperations *Operations)
+	{
+		if (Operations == nullptr || Operations->Submit == nullptr ||
+			Operations->SectorSize == 0)
+			ReturnLogError(nullptr, "Invalid block operations from driver %d", DriverID);
+
+		Device *d = new Device;
+		{
+			SmartLock(DevicesLock);
+			d->DriverDevice = NextDisk++;
+			d->Name = "sd";
+			d->Name += (char)('a' + d->DriverDevice % 26);
+		}
+		d->SectorSize = Operations->SectorSize;
+		d->Sectors = Operations->Sectors;
+		d->Ops = Operations;
+		d->DriverID = DriverID;
+		d->IO = new Queue(d, Operations->QueueDepth);
+		Publish(d);
+		return d;
+	}
+
+	Device *Manager::AddDisk(dev_t DriverID, dev_t DriverDevice, const struct InodeOperations *Operations)
+	{
+		if (Operations == nullptr || Operations->Read == nullptr)
+			ReturnLogError(nullptr, "Driver %d can't read", DriverID);
+
+		Device *d = new Device;
+		{
+			SmartLock(DevicesLock);
+			d->Name = "sd";
+			d->Name += (char)('a' + NextDisk++ % 26);
+		}
+		d->Legacy = Operations;
+		d->DriverID = DriverID;
+		d->DriverDevice = DriverDevice;
+		d->LegacyNode.Mode = S_IFBLK;
+		d->LegacyNode.SetDevice((int)DriverID, (int)DriverDevice);
+
+		/* The size comes from the driver, if it knows it */
+		struct kstat stat{};
+		if (Operations->Stat && Operations->Stat(&d->LegacyNode, &stat) == 0 && stat.Size > 0)
+			d->Sectors = stat.Size / d->SectorSize;
+		else
+			d->Sectors = UINT64_MAX / d->SectorSize;
+
+		/* It finishes every request before it returns */
+		d->IO = new Queue(d, 1);
+		Publish(d);
+		return d;
+	}
+
+	void Manager::AddPartition(Device *Disk, size_t Index, uint64_t Start, uint64_t Sectors)
+	{
+		if (Sectors == 0 || Start >= Disk->Sectors || Sectors > Disk->Sectors - Start)
+		{
+			warn("%s: partition %ld is outside the disk", Disk->Name.c_str(), Index);
+			return;
+		}
+
+		Device *d = new Device;
+		d->Name = Disk->Name + std::to_string(Index);
+		d->SectorSize = Disk->SectorSize;
+		d->Sectors = Sectors;
+		d->Parent = Disk;
+		d->Start = Start;
+		Publish(d);
+		trace("%s: sectors %ld-%ld", d->Name.c_str(), Start, Start + Sectors - 1);
+	}
+
+	void Manager::ScanPartitions(Device *Disk)
+	{
+		size_t sectorSize = Disk->SectorSize;
+		uint8_t *buffer = new uint8_t[sectorSize * 2];
+		struct kiovec vector = {buffer, sectorSize * 2};
+		if (Disk->Transfer(&vector, 1, 0, false) != (ssize_t)(sectorSize * 2))
+		{
+			warn("%s: failed to read the partition table", Disk->Name.c_str());
+			delete[] buffer;
+			return;
+		}
+
+		MasterBootRecord *mbr = (MasterBootRecord *)buffer;
+		GUIDPartitionTable *gpt = (GUIDPartitionTable *)(buffer + sectorSize);
+		size_t found = 0;
+		if (gpt->Signature == GPT_MAGIC && gpt->EntrySize >= sizeof(GUIDPartitionTableEntry))
+		{
+			Disk->Style = GPT;
+			size_t count = MIN(gpt->PartCount, (uint32_t)128);
+			size_t length = ALIGN_UP(count * gpt->EntrySize, sectorSize);
+			uint8_t *entries = new uint8_t[length];
+			struct kiovec table = {entries, length};
+			if (Disk->Transfer(&table, 1, gpt->PartLBA * sectorSize, false) == (ssize_t)length)
+			{
+				static const uint8_t unused[16] = {};
+				for (size_t i = 0; i < count; i++)
+				{
+					GUIDPartitionTableEntry *e = (GUIDPartitionTableEntry *)(entries + i * gpt->EntrySize);
+					if (memcmp(e->PartitionType, unused, sizeof(unused)) == 0)
+						continue;
+
+					/* LastLBA is inclusive */
+					AddPartition(Disk, i + 1, e->FirstLBA, e->LastLBA - e->FirstLBA + 1);
+					found++;
+				}
 			}
 			else
-				warn("No partition table found on port %d!", ItrPort);
+				warn("%s: failed to read the GPT entries", Disk->Name.c_str());
+			delete[] entries;
+		}
+		else if (mbr->Signature[0] == MBR_MAGIC0 && mbr->Signature[1] == MBR_MAGIC1)
+		{
+			Disk->Style = MBR;
+			for (size_t i = 0; i < 4; i++)
+			{
+				MasterBootRecordPartition &p = mbr->Partitions[i];
+				if (p.Type == 0 || p.Sectors == 0)
+					continue;
+
+				/* Extended partitions are not followed */
+				if (p.Type == 0x05 || p.Type == 0x0F)
+				{
+					fixme("%s: extended partition %ld", Disk->Name.c_str(), i + 1);
+					continue;
+				}
+
+				AddPartition(Disk, i + 1, p.LBAFirst, p.Sectors);
+				found++;
+			}
+		}
+
+		if (Disk->Style != Unknown)
+			KPrint("%s: %s partition table, %ld partitions", Disk->Name.c_str(),
+				   Disk->Style == GPT ? "GPT" : "MBR", found);
+		delete[] buffer;
+	}
+
+	void Manager::ScanDisks()
+	{
+		static std::vector<Device *> scanned;
+		foreach (Device *d in GetDevices())
+		{
+			if (d->Parent)
+				continue;
 
-			drives.push_back(drive);
+			bool done = false;
+			foreach (Device *s in scanned)
+				done |= s == d;
+			if (done)
+				continue;
+
+			scanned.push_back(d);
+			ScanPartitions(d);
 		}
+	}
+
+	Device *Manager::Find(FileNode *File)
+	{
+		if (File == nullptr || File->Node->Device != DeviceID || File->Node == &Root)
+			return nullptr;
+		return (Device *)File->Node->PrivateData;
+	}
+
+	std::vector<Device *> Manager::GetDevices()
+	{
+		SmartLock(DevicesLock);
+		return Devices;
+	}
+
+	Manager::Manager()
+	{
+		FileSystemInfo *fsi = new FileSystemInfo;
+		fsi->Name = "Block Devices";
+		fsi->RootName = "block";
+		fsi->Flags = I_FLAG_CACHE_KEEP;
+		fsi->SuperOps = {};
+		fsi->Ops = {};
+		fsi->Ops.Read = __disk_Read;
+		fsi->Ops.Write = __disk_Write;
+		fsi->Ops.ReadV = __disk_ReadV;
+		fsi->Ops.WriteV = __disk_WriteV;
+		fsi->Ops.Stat = __disk_Stat;
 
-		KernelAllocator.FreePages(RWBuffer, TO_PAGES(this->BytesPerSector + 1));
+		Root.Mode = S_IFDIR | S_IRWXU;
+		Root.Flags = I_FLAG_CACHE_KEEP;
+		DeviceID = Root.Device = fs->RegisterFileSystem(fsi, &Root);
 	}
 
-	Manager::Manager() {}
-	Manager::~Manager() {}
+	Manager::~Manager()
+	{
+		foreach (Device *d in Devices)
+		{
+			delete d->IO;
+			delete d;
+		}
+	}
 }
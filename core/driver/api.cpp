@@ -22,6 +22,7 @@
 #include <interface/aip.h>
 #include <interface/input.h>
 #include <interface/pci.h>
+#include <poll.hpp>
 
 #include "../../kernel.h"
 
@@ -110,12 +111,10 @@ namespace v0
 	{
 		dbg_api("%d, %d, %#lx", DriverID, IRQ, Handler);
 
-		std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-			DriverManager->GetDrivers();
-		const auto it = drivers.find(DriverID);
-		if (it == drivers.end())
+		SmartReadLock(DriverManager->GetDriversLock());
+		const Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+		if (drv == nullptr)
 			ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
-		const Driver::DriverObject *drv = &it->second;
 
 		if (drv->InterruptHandlers->contains(IRQ))
 			return -EEXIST;
@@ -135,18 +134,21 @@ namespace v0
 		std::unordered_map<dev_t, Driver::DriverObject> &drivers =
 			DriverManager->GetDrivers();
 
-		for (auto &var : drivers)
 		{
-			Driver::DriverObject *drv = &var.second;
-			for (const auto &ih : *drv->InterruptHandlers)
+			SmartReadLock(DriverManager->GetDriversLock());
+			for (auto &var : drivers)
 			{
-				if (ih.first != IRQ)
-					continue;
+				Driver::DriverObject *drv = &var.second;
+				for (const auto &ih : *drv->InterruptHandlers)
+				{
+					if (ih.first != IRQ)
+						continue;
 
-				debug("Removing IRQ %d: %#lx for %s", IRQ, (uintptr_t)ih.second, drv->Path.c_str());
-				Interrupts::RemoveHandler((void (*)(CPU::TrapFrame *))ih.second, IRQ);
-				drv->InterruptHandlers->erase(IRQ);
-				break;
+					debug("Removing IRQ %d: %#lx for %s", IRQ, (uintptr_t)ih.second, drv->Path.c_str());
+					Interrupts::RemoveHandler((void (*)(CPU::TrapFrame *))ih.second, IRQ);
+					drv->InterruptHandlers->erase(IRQ);
+					break;
+				}
 			}
 		}
 
@@ -157,12 +159,10 @@ namespace v0
 	{
 		dbg_api("%d, %d, %#lx", DriverID, IRQ, Handler);
 
-		std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-			DriverManager->GetDrivers();
-		const auto it = drivers.find(DriverID);
-		if (it == drivers.end())
+		SmartReadLock(DriverManager->GetDriversLock());
+		const Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+		if (drv == nullptr)
 			ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
-		const Driver::DriverObject *drv = &it->second;
 
 		Interrupts::RemoveHandler((void (*)(CPU::TrapFrame *))Handler, IRQ);
 		auto ih = drv->InterruptHandlers;
@@ -174,12 +174,10 @@ namespace v0
 	{
 		dbg_api("%d, %#lx", DriverID, Handler);
 
-		std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-			DriverManager->GetDrivers();
-		const auto it = drivers.find(DriverID);
-		if (it == drivers.end())
+		SmartReadLock(DriverManager->GetDriversLock());
+		const Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+		if (drv == nullptr)
 			ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
-		const Driver::DriverObject *drv = &it->second;
 
 		for (auto &i : *drv->InterruptHandlers)
 		{
@@ -207,6 +205,14 @@ namespace v0
 		return fs->UnregisterFileSystem(Device);
 	}
 
+	int ReportPollEvent(dev_t DriverID, struct Inode *Node, short Events)
+	{
+		dbg_api("%d, %#lx, %#x", DriverID, Node, Events);
+
+		vfs::PollNotify(Node, Events);
+		return 0;
+	}
+
 	/* --------- */
 
 	pid_t CreateKernelProcess(dev_t DriverID, const char *Name)
@@ -431,13 +437,11 @@ namespace v0
 	{
 		dbg_api("%d, %d", DriverID, Pages);
 
-		std::unordered_map<dev_t, Driver::DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(DriverID);
-		assert(itr != Drivers.end());
+		SmartReadLock(DriverManager->GetDriversLock());
+		Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+		assert(drv != nullptr);
 
-		void *ptr = itr->second.vma->RequestPages(Pages);
+		void *ptr = drv->vma->RequestPages(Pages);
 		memset(ptr, 0, FROM_PAGES(Pages));
 		return ptr;
 	}
@@ -446,13 +450,11 @@ namespace v0
 	{
 		dbg_api("%d, %#lx, %d", DriverID, Pointer, Pages);
 
-		std::unordered_map<dev_t, Driver::DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(DriverID);
-		assert(itr != Drivers.end());
+		SmartReadLock(DriverManager->GetDriversLock());
+		Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+		assert(drv != nullptr);
 
-		itr->second.vma->FreePages(Pointer, Pages);
+		drv->vma->FreePages(Pointer, Pages);
 	}
 
 	void *MemoryCopy(dev_t DriverID, void *Destination, const void *Source, size_t Length)
@@ -542,11 +544,9 @@ namespace v0
 	{
 		dbg_api("%d, %#lx, %#lx", DriverID, _Vendors, _Devices);
 
-		std::unordered_map<dev_t, Driver::DriverObject> &Drivers =
-			DriverManager->GetDrivers();
-
-		auto itr = Drivers.find(DriverID);
-		if (itr == Drivers.end())
+		SmartReadLock(DriverManager->GetDriversLock());
+		Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+		if (drv == nullptr)
 			return nullptr;
 
 		std::list<uint16_t> VendorIDs;
@@ -561,7 +561,7 @@ namespace v0
 		if (Devices.empty())
 			return nullptr;
 
-		Memory::VirtualMemoryArea *vma = itr->second.vma;
+		Memory::VirtualMemoryArea *vma = drv->vma;
 		__PCIArray *head = nullptr;
 		__PCIArray *array = nullptr;
 
@@ -815,6 +815,24 @@ namespace v0
 		return DriverManager->UnregisterDevice(DriverID, Device);
 	}
 
+	dev_t RegisterBlockDevice(dev_t DriverID, DeviceType Type, const BlockOperations *Operations)
+	{
+		dbg_api("%d, %d, %#lx", DriverID, Type, Operations);
+
+		Disk::Device *disk = DiskManager->AddDisk(DriverID, Operations);
+		if (disk == nullptr)
+			return -EINVAL;
+		return disk->DriverDevice;
+	}
+
+	void CompleteBlockRequest(dev_t DriverID, BlockRequest *Request, int Status)
+	{
+		dbg_api("%d, %#lx, %d", DriverID, Request, Status);
+
+		Disk::Request *r = (Disk::Request *)Request->KernelData;
+		r->Owner->Complete(r, Status);
+	}
+
 	int ReportInputEvent(dev_t DriverID, InputReport *Report)
 	{
 		dbg_api("%d, %#lx", DriverID, Report);
@@ -843,6 +861,7 @@ static struct APISymbols APISymbols_v0[] = {
 
 	{"__RegisterFileSystem", (void *)v0::RegisterFileSystem},
 	{"__UnregisterFileSystem", (void *)v0::UnregisterFileSystem},
+	{"__ReportPollEvent", (void *)v0::ReportPollEvent},
 
 	{"__CreateKernelProcess", (void *)v0::CreateKernelProcess},
 	{"__CreateKernelThread", (void *)v0::CreateKernelThread},
@@ -886,6 +905,8 @@ static struct APISymbols APISymbols_v0[] = {
 
 	{"__RegisterDevice", (void *)v0::RegisterDevice},
 	{"__UnregisterDevice", (void *)v0::UnregisterDevice},
+	{"__RegisterBlockDevice", (void *)v0::RegisterBlockDevice},
+	{"__CompleteBlockRequest", (void *)v0::CompleteBlockRequest},
 	{"__ReportInputEvent", (void *)v0::ReportInputEvent},
 };
 
@@ -27,6 +27,7 @@
 #include <exec.hpp>
 #include <rand.hpp>
 #include <cwalk.h>
+#include <poll.hpp>
 #include <md5.h>
 
 #include "../../kernel.h"
@@ -57,6 +58,12 @@ namespace Driver
 
 	TTY::PTMXDevice *ptmx = nullptr;
 
+	/* Nodes that get readiness events from the global input rings */
+	static Inode *KconNode = nullptr;
+	static Inode *TtyNode = nullptr;
+	static Inode *KeyboardNode = nullptr;
+	static Inode *MouseNode = nullptr;
+
 	int __fs_Lookup(struct Inode *_Parent, const char *Name, struct Inode **Result)
 	{
 		func("%#lx %s %#lx", _Parent, Name, Result);
@@ -207,14 +214,15 @@ namespace Driver
 		}
 		default:
 		{
-			std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-				DriverManager->GetDrivers();
-			const auto it = drivers.find(Node->GetMajor());
-			if (it == drivers.end())
-				ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
-			const Driver::DriverObject *drv = &it->second;
+			std::unordered_map<dev_t, DriverHandlers> *dop;
+			{
+				SmartReadLock(DriverManager->GetDriversLock());
+				const Driver::DriverObject *drv = DriverManager->GetDriver(Node->GetMajor());
+				if (drv == nullptr)
+					ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
+				dop = drv->DeviceOperations;
+			}
 
-			auto dop = drv->DeviceOperations;
 			auto dOps = dop->find(Node->GetMinor());
 			if (dOps == dop->end())
 				ReturnLogError(-EINVAL, "Device %d not found", Node->GetMinor());
@@ -285,14 +293,15 @@ namespace Driver
 		}
 		default:
 		{
-			std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-				DriverManager->GetDrivers();
-			const auto it = drivers.find(Node->GetMajor());
-			if (it == drivers.end())
-				ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
-			const Driver::DriverObject *drv = &it->second;
+			std::unordered_map<dev_t, DriverHandlers> *dop;
+			{
+				SmartReadLock(DriverManager->GetDriversLock());
+				const Driver::DriverObject *drv = DriverManager->GetDriver(Node->GetMajor());
+				if (drv == nullptr)
+					ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
+				dop = drv->DeviceOperations;
+			}
 
-			auto dop = drv->DeviceOperations;
 			auto dOps = dop->find(Node->GetMinor());
 			if (dOps == dop->end())
 				ReturnLogError(-EINVAL, "Device %d not found", Node->GetMinor());
@@ -346,14 +355,15 @@ namespace Driver
 		}
 		default:
 		{
-			std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-				DriverManager->GetDrivers();
-			const auto it = drivers.find(Node->GetMajor());
-			if (it == drivers.end())
-				ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
-			const Driver::DriverObject *drv = &it->second;
+			std::unordered_map<dev_t, DriverHandlers> *dop;
+			{
+				SmartReadLock(DriverManager->GetDriversLock());
+				const Driver::DriverObject *drv = DriverManager->GetDriver(Node->GetMajor());
+				if (drv == nullptr)
+					ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
+				dop = drv->DeviceOperations;
+			}
 
-			auto dop = drv->DeviceOperations;
 			auto dOps = dop->find(Node->GetMinor());
 			if (dOps == dop->end())
 				ReturnLogError(-EINVAL, "Device %d not found", Node->GetMinor());
@@ -407,14 +417,15 @@ namespace Driver
 		}
 		default:
 		{
-			std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-				DriverManager->GetDrivers();
-			const auto it = drivers.find(Node->GetMajor());
-			if (it == drivers.end())
-				ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
-			const Driver::DriverObject *drv = &it->second;
+			std::unordered_map<dev_t, DriverHandlers> *dop;
+			{
+				SmartReadLock(DriverManager->GetDriversLock());
+				const Driver::DriverObject *drv = DriverManager->GetDriver(Node->GetMajor());
+				if (drv == nullptr)
+					ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
+				dop = drv->DeviceOperations;
+			}
 
-			auto dop = drv->DeviceOperations;
 			auto dOps = dop->find(Node->GetMinor());
 			if (dOps == dop->end())
 				ReturnLogError(-EINVAL, "Device %d not found", Node->GetMinor());
@@ -469,14 +480,15 @@ namespace Driver
 		}
 		default:
 		{
-			std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-				DriverManager->GetDrivers();
-			const auto it = drivers.find(Node->GetMajor());
-			if (it == drivers.end())
-				ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
-			const Driver::DriverObject *drv = &it->second;
+			std::unordered_map<dev_t, DriverHandlers> *dop;
+			{
+				SmartReadLock(DriverManager->GetDriversLock());
+				const Driver::DriverObject *drv = DriverManager->GetDriver(Node->GetMajor());
+				if (drv == nullptr)
+					ReturnLogError(-EINVAL, "Driver %d not found", Node->GetMajor());
+				dop = drv->DeviceOperations;
+			}
 
-			auto dop = drv->DeviceOperations;
 			auto dOps = dop->find(Node->GetMinor());
 			if (dOps == dop->end())
 				ReturnLogError(-EINVAL, "Device %d not found", Node->GetMinor());
@@ -487,6 +499,81 @@ namespace Driver
 		}
 	}
 
+	short __fs_Poll(struct Inode *Node, short Events)
+	{
+		func("%#lx %#x", Node, Events);
+
+		const short Always = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+		switch (Node->GetMajor())
+		{
+		case 0:
+		{
+			switch (Node->GetMinor())
+			{
+			case 2: /* /dev/null */
+			case 3: /* /dev/zero */
+			case 4: /* /dev/random */
+			case 5: /* /dev/mem */
+				return Events & Always;
+			case 6: /* /dev/kcon */
+				return KernelConsole::CurrentTerminal.load()->Poll(Events);
+			case 7: /* /dev/tty */
+			{
+				TTY::TeletypeDriver *tty = (TTY::TeletypeDriver *)thisProcess->tty;
+				if (tty == nullptr)
+					return POLLNVAL;
+				return tty->Poll(Events);
+			}
+			case 8: /* /dev/ptmx */
+				return POLLNVAL;
+			default:
+				return POLLNVAL;
+			};
+			break;
+		}
+		case 1:
+		{
+			switch (Node->GetMinor())
+			{
+			case 0: /* /dev/input/keyboard */
+			{
+				if (DriverManager->GlobalKeyboardInputReports.Count() == 0)
+					return 0;
+				return Events & (POLLIN | POLLRDNORM);
+			}
+			case 1: /* /dev/input/mouse */
+			{
+				if (DriverManager->GlobalMouseInputReports.Count() == 0)
+					return 0;
+				return Events & (POLLIN | POLLRDNORM);
+			}
+			default:
+				return POLLNVAL;
+			};
+		}
+		default:
+		{
+			std::unordered_map<dev_t, DriverHandlers> *dop;
+			{
+				SmartReadLock(DriverManager->GetDriversLock());
+				const Driver::DriverObject *drv = DriverManager->GetDriver(Node->GetMajor());
+				if (drv == nullptr)
+					return POLLNVAL;
+				dop = drv->DeviceOperations;
+			}
+
+			auto dOps = dop->find(Node->GetMinor());
+			if (dOps == dop->end())
+				return POLLNVAL;
+
+			/* Drivers that can't block don't have to implement it */
+			if (dOps->second.Ops == nullptr || dOps->second.Ops->Poll == nullptr)
+				return Events & Always;
+			return dOps->second.Ops->Poll(Node, Events);
+		}
+		}
+	}
+
 	__no_sanitize("alignment")
 		ssize_t __fs_Readdir(struct Inode *_Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
 	{
@@ -635,45 +722,29 @@ namespace Driver
 	dev_t Manager::RegisterBlockDevice(std::unordered_map<dev_t, DriverHandlers> *dop,
 									   dev_t DriverID, size_t i, const InodeOperations *Operations)
 	{
-		std::string prefix = "event";
-		for (size_t j = 0; j < 128; j++)
-		{
-			std::string deviceName = prefix + std::to_string(j);
-			FileNode *node = fs->GetByPath(deviceName.c_str(), devInputNode);
-			if (node)
-				continue;
-
-			/* c rwx r-- r-- */
-			mode_t mode = S_IRWXU |
-						  S_IRGRP |
-						  S_IROTH |
-						  S_IFBLK;
-
-			node = fs->ForceCreate(devInputNode, deviceName.c_str(), mode);
-			node->Node->SetDevice(DriverID, i);
-
-			DriverHandlers dh{};
-			dh.Ops = Operations;
-			dh.Node = node->Node;
-			dh.InputReports = new RingBuffer<InputReport>(16);
-			dop->insert({i, std::move(dh)});
-			return i;
-		}
-
-		ReturnLogError(-1, "No available slots for device %d", DriverID);
-		return -1; /* -Werror=return-type */
+		/* The block layer puts it in /dev and queues its requests */
+		Disk::Device *disk = DiskManager->AddDisk(DriverID, i, Operations);
+		if (disk == nullptr)
+			return -1;
+
+		DriverHandlers dh{};
+		dh.Ops = Operations;
+		dh.Node = &disk->LegacyNode;
+		dop->insert({i, std::move(dh)});
+		return i;
 	}
 
 	dev_t Manager::RegisterDevice(dev_t DriverID, DeviceType Type, const InodeOperations *Operations)
 	{
-		std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-			DriverManager->GetDrivers();
-		const auto it = drivers.find(DriverID);
-		if (it == drivers.end())
-			ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
-		const Driver::DriverObject *drv = &it->second;
-
-		auto dop = drv->DeviceOperations;
+		std::unordered_map<dev_t, DriverHandlers> *dop;
+		{
+			SmartReadLock(DriverManager->GetDriversLock());
+			const Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+			if (drv == nullptr)
+				ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
+			dop = drv->DeviceOperations;
+		}
+
 		for (size_t i = 0; i < 128; i++)
 		{
 			const auto dOps = dop->find(i);
@@ -698,14 +769,15 @@ namespace Driver
 
 	int Manager::UnregisterDevice(dev_t DriverID, dev_t Device)
 	{
-		std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-			DriverManager->GetDrivers();
-		const auto it = drivers.find(DriverID);
-		if (it == drivers.end())
-			ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
-		const Driver::DriverObject *drv = &it->second;
-
-		auto dop = drv->DeviceOperations;
+		std::unordered_map<dev_t, DriverHandlers> *dop;
+		{
+			SmartReadLock(DriverManager->GetDriversLock());
+			const Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+			if (drv == nullptr)
+				ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
+			dop = drv->DeviceOperations;
+		}
+
 		const auto dOps = dop->find(Device);
 		if (dOps == dop->end())
 			ReturnLogError(-EINVAL, "Device %d not found", Device);
@@ -717,19 +789,21 @@ namespace Driver
 
 	int Manager::ReportInputEvent(dev_t DriverID, InputReport *Report)
 	{
-		std::unordered_map<dev_t, Driver::DriverObject> &drivers =
-			DriverManager->GetDrivers();
-		const auto it = drivers.find(DriverID);
-		if (it == drivers.end())
-			ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
-		const Driver::DriverObject *drv = &it->second;
-
-		auto dop = drv->DeviceOperations;
+		std::unordered_map<dev_t, DriverHandlers> *dop;
+		{
+			SmartReadLock(DriverManager->GetDriversLock());
+			const Driver::DriverObject *drv = DriverManager->GetDriver(DriverID);
+			if (drv == nullptr)
+				ReturnLogError(-EINVAL, "Driver %d not found", DriverID);
+			dop = drv->DeviceOperations;
+		}
+
 		auto dOps = dop->find(Report->Device);
 		if (dOps == dop->end())
 			ReturnLogError(-EINVAL, "Device %d not found", Report->Device);
 
 		dOps->second.InputReports->Write(Report, 1);
+		PollNotify(dOps->second.Node, POLLIN | POLLRDNORM);
 
 		switch (Report->Type)
 		{
@@ -737,12 +811,16 @@ namespace Driver
 		{
 			KeyboardReport *kReport = &Report->Keyboard;
 			GlobalKeyboardInputReports.Write(kReport, 1);
+			PollNotify(KeyboardNode, POLLIN | POLLRDNORM);
+			PollNotify(KconNode, POLLIN | POLLRDNORM);
+			PollNotify(TtyNode, POLLIN | POLLRDNORM);
 			break;
 		}
 		case INPUT_TYPE_MOUSE:
 		{
 			MouseReport *mReport = &Report->Mouse;
 			GlobalMouseInputReports.Write(mReport, 1);
+			PollNotify(MouseNode, POLLIN | POLLRDNORM);
 			break;
 		}
 		default:
@@ -771,7 +849,8 @@ namespace Driver
 		FileSystemInfo *fsi = new FileSystemInfo;
 		fsi->Name = "Device Virtual File System";
 		fsi->RootName = "dev";
-		fsi->Flags = I_FLAG_ROOT | I_FLAG_MOUNTPOINT | I_FLAG_CACHE_KEEP;
+		/* Drivers add devices behind the VFS */
+		fsi->Flags = I_FLAG_ROOT | I_FLAG_MOUNTPOINT | I_FLAG_CACHE_KEEP | I_FLAG_VOLATILE;
 		fsi->SuperOps = {};
 		fsi->Ops.Lookup = __fs_Lookup;
 		fsi->Ops.Create = __fs_Create;
@@ -781,6 +860,7 @@ namespace Driver
 		fsi->Ops.Close = __fs_Close;
 		fsi->Ops.Ioctl = __fs_Ioctl;
 		fsi->Ops.ReadDir = __fs_Readdir;
+		fsi->Ops.Poll = __fs_Poll;
 
 		dev->Device = fs->RegisterFileSystem(fsi, dev);
 		dev->SetDevice(0, MinorID++);
@@ -818,6 +898,7 @@ namespace Driver
 			device->Node.Flags = I_FLAG_CACHE_KEEP;
 			device->Node.Offset = p1->Children.size();
 			p1->Children.push_back(device);
+			return &device->Node;
 		};
 
 		/* c rw- rw- rw- */
@@ -853,14 +934,14 @@ namespace Driver
 			   S_IRGRP |
 
 			   S_IFCHR;
-		createDevice(_dev, devNode, "kcon", 0, MinorID++, mode);
+		KconNode = createDevice(_dev, devNode, "kcon", 0, MinorID++, mode);
 
 		/* c rw- rw- rw- */
 		mode = S_IRUSR | S_IWUSR |
 			   S_IRGRP | S_IWGRP |
 			   S_IRUSR | S_IWUSR |
 			   S_IFCHR;
-		createDevice(_dev, devNode, "tty", 0, MinorID++, mode);
+		TtyNode = createDevice(_dev, devNode, "tty", 0, MinorID++, mode);
 
 		/* c rw- rw- rw- */
 		mode = S_IRUSR | S_IWUSR |
@@ -878,13 +959,13 @@ namespace Driver
 			   S_IRGRP |
 
 			   S_IFCHR;
-		createDevice(input, devInputNode, "keyboard", 1, MinorID++, mode);
+		KeyboardNode = createDevice(input, devInputNode, "keyboard", 1, MinorID++, mode);
 
 		/* c rw- r-- --- */
 		mode = S_IRUSR | S_IWUSR |
 			   S_IRGRP |
 
 			   S_IFCHR;
-		createDevice(input, devInputNode, "mouse", 1, MinorID++, mode);
+		MouseNode = createDevice(input, devInputNode, "mouse", 1, MinorID++, mode);
 	}
 }
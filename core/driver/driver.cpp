@@ -81,10 +81,20 @@ namespace Driver
 
 			debug("gdb: \"0x%lX\" %s", drvObj.BaseAddress, drvObj.Name);
 
+			SmartWriteLock(DriversLock);
 			Drivers.insert({DriverIDCounter++, drvObj});
 		}
 	}
 
+	DriverObject *Manager::GetDriver(dev_t DriverID)
+	{
+		assert(DriversLock.Readers() > 0 || DriversLock.WriteLocked());
+		auto it = Drivers.find(DriverID);
+		if (it == Drivers.end())
+			return nullptr;
+		return &it->second;
+	}
+
 	void Manager::LoadAllDrivers()
 	{
 		if (Drivers.empty())
@@ -171,6 +181,8 @@ namespace Driver
 				Drv->InterruptHandlers->clear();
 			}
 		}
+
+		SmartWriteLock(DriversLock);
 		Drivers.clear();
 	}
 
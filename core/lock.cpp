@@ -147,6 +147,8 @@ int LockClass::Lock(const char *FunctionName)
 {
 	LockData.AttemptingToGet = FunctionName;
 	LockData.StackPointerAttempt = (uintptr_t)__builtin_frame_address(0);
+	uint64_t StatStart = unlikely(LockStat::Enabled) ? CPU::Counter() : 0;
+	bool Contended = false;
 
 Retry:
 	int i = 0;
@@ -155,6 +157,7 @@ Retry:
 	{
 		this->Yield();
 	}
+	Contended |= i > 0;
 
 	if (i >= DEADLOCK_TIMEOUT)
 	{
@@ -172,12 +175,22 @@ Retry:
 
 	LocksCount.fetch_add(1);
 
+	if (unlikely(StatStart))
+		StatAcquiredAt = LockStat::Acquired(this, Name, FunctionName,
+											StatStart, Contended);
+
 	__sync;
 	return 0;
 }
 
 int LockClass::Unlock()
 {
+	if (unlikely(StatAcquiredAt))
+	{
+		LockStat::Released(this, StatAcquiredAt);
+		StatAcquiredAt = 0;
+	}
+
 	__sync;
 
 	IsLocked.store(false, std::memory_order_release);
@@ -222,6 +235,8 @@ int LockClass::TimeoutLock(const char *FunctionName, uint64_t Timeout)
 
 	LockData.AttemptingToGet.store(FunctionName);
 	LockData.StackPointerAttempt.store((uintptr_t)__builtin_frame_address(0));
+	uint64_t StatStart = unlikely(LockStat::Enabled) ? CPU::Counter() : 0;
+	bool Contended = false;
 
 	std::atomic_uint64_t Target = 0;
 Retry:
@@ -231,6 +246,7 @@ Retry:
 	{
 		this->Yield();
 	}
+	Contended |= i > 0;
 
 	if (i >= DEADLOCK_TIMEOUT)
 	{
@@ -251,6 +267,266 @@ Retry:
 
 	LocksCount.fetch_add(1);
 
+	if (unlikely(StatStart))
+		StatAcquiredAt = LockStat::Acquired(this, Name, FunctionName,
+											StatStart, Contended);
+
 	__sync;
 	return 0;
 }
+
+void RWLockClass::Yield()
+{
+	if (CPU::Interrupts(CPU::Check) && TaskManager &&
+		!TaskManager->IsPanic())
+	{
+		TaskManager->Yield();
+	}
+
+	CPU::Pause();
+}
+
+void RWLockClass::DeadLock(const char *FunctionName, bool Write)
+{
+	if (ForceUnlock)
+	{
+		warn("Force unlocking rw lock '%s' (writer '%s', %ld readers)...",
+			 FunctionName, CurrentWriter.load(), Readers());
+		this->DeadLocks = 0;
+		State.store(0, std::memory_order_release);
+		return;
+	}
+
+	CPUData *CoreData = GetCurrentCPU();
+	long CCore = 0xdead;
+	if (CoreData != nullptr)
+		CCore = CoreData->ID;
+
+	warn("Potential deadlock in rw lock '%s' (%s)! Writer '%s', %ld readers. Interrupts are %s. Core %ld. (%ld times happened)",
+		 FunctionName, Write ? "write" : "read", CurrentWriter.load(), Readers(),
+		 CPU::Interrupts(CPU::Check) ? "enabled" : "disabled", CCore, this->DeadLocks.load());
+
+	this->DeadLocks++;
+	this->Yield();
+}
+
+bool RWLockClass::TryReadLock()
+{
+	uint64_t s = State.load(std::memory_order_relaxed);
+	if (s & (WriterBit | WaitingBit))
+		return false;
+
+	if (!State.compare_exchange_strong(s, s + 1, std::memory_order_acquire))
+		return false;
+
+	LocksCount.fetch_add(1);
+	return true;
+}
+
+bool RWLockClass::TryWriteLock()
+{
+	uint64_t s = State.load(std::memory_order_relaxed);
+	if (s & ~WaitingBit)
+		return false;
+
+	if (!State.compare_exchange_strong(s, WriterBit, std::memory_order_acquire))
+		return false;
+
+	LocksCount.fetch_add(1);
+	return true;
+}
+
+int RWLockClass::ReadLock(const char *FunctionName)
+{
+	AttemptingToGet.store(FunctionName);
+	uint64_t StatStart = unlikely(LockStat::Enabled) ? CPU::Counter() : 0;
+	bool Contended = false;
+
+Retry:
+	int i = 0;
+	while (!TryReadLock() && ++i < DEADLOCK_TIMEOUT)
+		CPU::Pause();
+	Contended |= i > 0;
+
+	if (i >= DEADLOCK_TIMEOUT)
+	{
+		DeadLock(FunctionName, false);
+		goto Retry;
+	}
+
+	/* Readers overlap, only the wait time is recorded */
+	if (unlikely(StatStart))
+		LockStat::Acquired(this, Name, FunctionName, StatStart, Contended);
+	return 0;
+}
+
+int RWLockClass::ReadUnlock()
+{
+	assert((State.load() & ReadersMask) != 0);
+	State.fetch_sub(1, std::memory_order_release);
+	LocksCount.fetch_sub(1);
+	return 0;
+}
+
+int RWLockClass::WriteLock(const char *FunctionName)
+{
+	AttemptingToGet.store(FunctionName);
+	uint64_t StatStart = unlikely(LockStat::Enabled) ? CPU::Counter() : 0;
+	bool Contended = false;
+
+Retry:
+	int i = 0;
+	while (!TryWriteLock() && ++i < DEADLOCK_TIMEOUT)
+	{
+		/* Stop new readers from getting in */
+		if (!(State.load(std::memory_order_relaxed) & WaitingBit))
+			WriterWaiting();
+		CPU::Pause();
+	}
+	Contended |= i > 0;
+
+	if (i >= DEADLOCK_TIMEOUT)
+	{
+		DeadLock(FunctionName, true);
+		goto Retry;
+	}
+
+	CurrentWriter.store(FunctionName);
+	if (unlikely(StatStart))
+		StatAcquiredAt = LockStat::Acquired(this, Name, FunctionName,
+											StatStart, Contended);
+	return 0;
+}
+
+int RWLockClass::WriteUnlock()
+{
+	assert(State.load() & WriterBit);
+	if (unlikely(StatAcquiredAt))
+	{
+		LockStat::Released(this, StatAcquiredAt);
+		StatAcquiredAt = 0;
+	}
+
+	CurrentWriter.store("(nul)");
+	State.fetch_and(~WriterBit, std::memory_order_release);
+	LocksCount.fetch_sub(1);
+	return 0;
+}
+
+void RWSemaphoreClass::Sleep(const char *FunctionName, bool Write)
+{
+	Tasking::TCB *tcb = nullptr;
+	if (TaskManager && !TaskManager->IsPanic() &&
+		CPU::Interrupts(CPU::Check))
+		tcb = thisThread;
+
+	if (tcb == nullptr)
+	{
+		/* Scheduler is not running, we can only spin */
+		if (Write)
+			rw.WriteLock(FunctionName);
+		else
+			rw.ReadLock(FunctionName);
+		return;
+	}
+
+	while (true)
+	{
+		Waiter w{.Thread = tcb, .Next = nullptr};
+
+		WaitLock.Lock(FunctionName);
+		/* A sleeping writer must hold off new readers too,
+		   or a steady stream of them keeps it asleep. The
+		   bit is cleared when a writer takes the lock, so
+		   set it again on every attempt. */
+		if (Write)
+			rw.WriterWaiting();
+
+		/* Check again, the holder may have released
+		   the lock before we got on the queue. */
+		if (Write ? rw.TryWriteLock() : rw.TryReadLock())
+		{
+			WaitLock.Unlock();
+			return;
+		}
+
+		if (WaitTail)
+			WaitTail->Next = &w;
+		else
+			WaitHead = &w;
+		WaitTail = &w;
+		tcb->Block();
+		WaitLock.Unlock();
+
+		TaskManager->Yield();
+
+		/* WakeUp() removes us from the queue,
+		   but a spurious unblock might not. */
+		WaitLock.Lock(FunctionName);
+		Waiter **pp = &WaitHead;
+		Waiter *prev = nullptr;
+		while (*pp && *pp != &w)
+		{
+			prev = *pp;
+			pp = &(*pp)->Next;
+		}
+		if (*pp == &w)
+		{
+			*pp = w.Next;
+			if (WaitTail == &w)
+				WaitTail = prev;
+		}
+		WaitLock.Unlock();
+
+		if (Write ? rw.TryWriteLock() : rw.TryReadLock())
+			return;
+	}
+}
+
+void RWSemaphoreClass::WakeUp()
+{
+	WaitLock.Lock(__FUNCTION__);
+	/* Wake up everyone, readers will share the
+	   lock and writers will race for it. */
+	Waiter *w = WaitHead;
+	WaitHead = nullptr;
+	WaitTail = nullptr;
+	while (w)
+	{
+		Waiter *next = w->Next;
+		w->Thread->Unblock();
+		w = next;
+	}
+	WaitLock.Unlock();
+}
+
+int RWSemaphoreClass::ReadLock(const char *FunctionName)
+{
+	/* Fails while a writer is waiting, readers queue behind it */
+	if (!rw.TryReadLock())
+		this->Sleep(FunctionName, false);
+	return 0;
+}
+
+int RWSemaphoreClass::ReadUnlock()
+{
+	assert(rw.Readers() != 0);
+	rw.ReadUnlock();
+	if (rw.Readers() == 0)
+		this->WakeUp();
+	return 0;
+}
+
+int RWSemaphoreClass::WriteLock(const char *FunctionName)
+{
+	if (!rw.TryWriteLock())
+		this->Sleep(FunctionName, true);
+	return 0;
+}
+
+int RWSemaphoreClass::WriteUnlock()
+{
+	rw.WriteUnlock();
+	this->WakeUp();
+	return 0;
+}
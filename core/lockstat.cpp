@@ -0,0 +1,125 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <lock.hpp>
+
+#include <cpu.hpp>
+
+/* Must be a power of two */
+#define LOCKSTAT_ENTRIES 512
+#define LOCKSTAT_PROBES 16
+
+namespace LockStat
+{
+	bool Enabled = false;
+	static Entry Table[LOCKSTAT_ENTRIES];
+	static std::atomic_size_t Dropped = 0;
+
+	/**
+	 * Slots are claimed with a compare-exchange,
+	 * no lock is taken here because this is
+	 * called from inside the locks.
+	 */
+	static Entry *Find(const void *Lock, bool Create)
+	{
+		uint64_t h = uint64_t((uintptr_t)Lock >> 3) * 0x9E3779B97F4A7C15ULL;
+		size_t idx = h >> (64 - __builtin_ctzll(LOCKSTAT_ENTRIES));
+
+		for (size_t i = 0; i < LOCKSTAT_PROBES; i++)
+		{
+			Entry *e = &Table[(idx + i) & (LOCKSTAT_ENTRIES - 1)];
+			const void *owner = e->Lock.load(std::memory_order_acquire);
+			if (owner == Lock)
+				return e;
+
+			if (owner != nullptr || !Create)
+				continue;
+
+			if (e->Lock.compare_exchange_strong(owner, Lock,
+												std::memory_order_acq_rel))
+				return e;
+
+			/* Someone took it, maybe for the same lock */
+			if (owner == Lock)
+				return e;
+		}
+
+		if (Create)
+			Dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	uint64_t Acquired(const void *Lock, const char *Name, const char *Site,
+					  uint64_t Start, bool Contended)
+	{
+		uint64_t Now = CPU::Counter();
+		Entry *e = Find(Lock, true);
+		if (e == nullptr)
+			return 0;
+
+		uint64_t Wait = Now - Start;
+		e->Name.store(Name, std::memory_order_relaxed);
+		e->Acquisitions.fetch_add(1, std::memory_order_relaxed);
+		if (Contended)
+		{
+			e->Site.store(Site, std::memory_order_relaxed);
+			e->Contended.fetch_add(1, std::memory_order_relaxed);
+			e->WaitTotal.fetch_add(Wait, std::memory_order_relaxed);
+
+			uint64_t max = e->WaitMax.load(std::memory_order_relaxed);
+			while (Wait > max &&
+				   !e->WaitMax.compare_exchange_weak(max, Wait,
+													 std::memory_order_relaxed))
+				;
+		}
+		return Now;
+	}
+
+	void Released(const void *Lock, uint64_t AcquiredAt)
+	{
+		Entry *e = Find(Lock, false);
+		if (e == nullptr)
+			return;
+
+		e->HoldTotal.fetch_add(CPU::Counter() - AcquiredAt,
+							   std::memory_order_relaxed);
+	}
+
+	Entry *GetEntries(size_t &Count)
+	{
+		Count = LOCKSTAT_ENTRIES;
+		return Table;
+	}
+
+	size_t GetDropped() { return Dropped.load(); }
+
+	void Reset()
+	{
+		foreach (auto &e in Table)
+		{
+			e.Acquisitions.store(0);
+			e.Contended.store(0);
+			e.WaitTotal.store(0);
+			e.WaitMax.store(0);
+			e.HoldTotal.store(0);
+			e.Site.store(nullptr);
+			e.Name.store(nullptr);
+			e.Lock.store(nullptr);
+		}
+		Dropped.store(0);
+	}
+}
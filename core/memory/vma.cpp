@@ -466,6 +466,129 @@ namespace Memory
 		return -EFAULT;
 	}
 
+	/* Kernel alias of a user page, nullptr where a
+	   user mode access would fault */
+	void *VirtualMemoryArea::UserPage(uintptr_t Page, bool Write)
+	{
+		Virtual vmm(this->Table);
+		if (this->Table->Get((void *)Page) == nullptr ||
+			!vmm.Check((void *)Page, PTFlag::US))
+			return nullptr;
+
+		/* Same as the page fault handler would do */
+		if (Write && !vmm.Check((void *)Page, PTFlag::RW) &&
+			!this->HandleCoW(Page))
+			return nullptr;
+
+		return this->Table->Get((void *)Page);
+	}
+
+	int VirtualMemoryArea::CopyFromUser(void *Destination, const void *Source, size_t Length)
+	{
+		uintptr_t User = (uintptr_t)Source;
+		if (User + Length < User)
+			return -EFAULT;
+
+		uint8_t *Kernel = (uint8_t *)Destination;
+		while (Length)
+		{
+			uintptr_t Page = ALIGN_DOWN(User, PAGE_SIZE);
+			size_t Chunk = MIN(Length, (size_t)(Page + PAGE_SIZE - User));
+			uint8_t *p = (uint8_t *)this->UserPage(Page, false);
+			if (p == nullptr)
+				return -EFAULT;
+
+			memcpy(Kernel, p + (User - Page), Chunk);
+			Kernel += Chunk;
+			User += Chunk;
+			Length -= Chunk;
+		}
+		return 0;
+	}
+
+	int VirtualMemoryArea::CopyToUser(void *Destination, const void *Source, size_t Length)
+	{
+		uintptr_t User = (uintptr_t)Destination;
+		if (User + Length < User)
+			return -EFAULT;
+
+		const uint8_t *Kernel = (const uint8_t *)Source;
+		while (Length)
+		{
+			uintptr_t Page = ALIGN_DOWN(User, PAGE_SIZE);
+			size_t Chunk = MIN(Length, (size_t)(Page + PAGE_SIZE - User));
+			uint8_t *p = (uint8_t *)this->UserPage(Page, true);
+			if (p == nullptr)
+				return -EFAULT;
+
+			memcpy(p + (User - Page), Kernel, Chunk);
+			Kernel += Chunk;
+			User += Chunk;
+			Length -= Chunk;
+		}
+		return 0;
+	}
+
+	ssize_t VirtualMemoryArea::StrncpyFromUser(char *Destination, const char *Source, size_t Size)
+	{
+		uintptr_t User = (uintptr_t)Source;
+		size_t Copied = 0;
+		while (Copied < Size)
+		{
+			uintptr_t Page = ALIGN_DOWN(User, PAGE_SIZE);
+			size_t Chunk = MIN(Size - Copied, (size_t)(Page + PAGE_SIZE - User));
+			const char *p = (const char *)this->UserPage(Page, false);
+			if (p == nullptr)
+				return -EFAULT;
+
+			p += User - Page;
+			for (size_t i = 0; i < Chunk; i++)
+			{
+				Destination[Copied] = p[i];
+				if (p[i] == '\0')
+					return Copied;
+				Copied++;
+			}
+			User += Chunk;
+		}
+		return Size;
+	}
+
+	int VirtualMemoryArea::UserSegments(const void *Address, size_t Length, bool Write,
+										struct kiovec *Vector, int Max)
+	{
+		uintptr_t User = (uintptr_t)Address;
+		if (User + Length < User)
+			return -EFAULT;
+
+		int Count = 0;
+		while (Length)
+		{
+			uintptr_t Page = ALIGN_DOWN(User, PAGE_SIZE);
+			size_t Chunk = MIN(Length, (size_t)(Page + PAGE_SIZE - User));
+			uint8_t *p = (uint8_t *)this->UserPage(Page, Write);
+			if (p == nullptr)
+				return -EFAULT;
+			p += User - Page;
+
+			if (Count > 0 &&
+				(uint8_t *)Vector[Count - 1].iov_base + Vector[Count - 1].iov_len == p)
+				Vector[Count - 1].iov_len += Chunk;
+			else
+			{
+				if (Count == Max)
+					return -E2BIG;
+				Vector[Count].iov_base = p;
+				Vector[Count].iov_len = Chunk;
+				Count++;
+			}
+
+			User += Chunk;
+			Length -= Chunk;
+		}
+		return Count;
+	}
+
 	VirtualMemoryArea::VirtualMemoryArea(PageTable *_Table)
 		: Table(_Table)
 	{
@@ -0,0 +1,155 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <rcu.hpp>
+
+#include <lock.hpp>
+#include <smp.hpp>
+#include <cpu.hpp>
+#include <debug.h>
+
+#include "../kernel.h"
+
+NewLock(RCUCallbackLock);
+static rcu_head *CallbackHead = nullptr;
+static rcu_head **CallbackTail = &CallbackHead;
+static std::atomic_uint64_t CallbacksQueued = 0;
+static std::atomic_uint64_t CallbacksDone = 0;
+
+void rcu_read_lock()
+{
+	/* Don't get moved to another core between
+	   reading the CPU data and updating it. */
+	CriticalSection cs;
+	GetCurrentCPU()->RCUNesting++;
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+void rcu_read_unlock()
+{
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	CriticalSection cs;
+	CPUData *core = GetCurrentCPU();
+	assert(core->RCUNesting > 0);
+	core->RCUNesting--;
+}
+
+bool rcu_read_lock_held()
+{
+	CriticalSection cs;
+	return GetCurrentCPU()->RCUNesting > 0;
+}
+
+void synchronize_rcu()
+{
+	assert(!rcu_read_lock_held());
+
+	/* Nothing else runs before the scheduler starts */
+	if (TaskManager == nullptr || TaskManager->IsPanic())
+		return;
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	uint64_t *snapshot = new uint64_t[SMP::CPUCores];
+	for (int i = 0; i < SMP::CPUCores; i++)
+		snapshot[i] = GetCPU(i)->RCUQuiescent.load();
+
+	for (int i = 0; i < SMP::CPUCores; i++)
+	{
+		CPUData *core = GetCPU(i);
+		while (core->IsActive &&
+			   core->RCUQuiescent.load() == snapshot[i])
+		{
+			/* We are not in a read-side section,
+			   so the core we run on is quiescent. */
+			CPUData *self = nullptr;
+			{
+				CriticalSection cs;
+				self = GetCurrentCPU();
+			}
+			if (self == core)
+				break;
+
+			if (CPU::Interrupts(CPU::Check))
+				TaskManager->Yield();
+			else
+				CPU::Pause();
+		}
+	}
+
+	delete[] snapshot;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void call_rcu(rcu_head *head, void (*callback)(rcu_head *head))
+{
+	head->callback = callback;
+	head->next = nullptr;
+
+	SmartLock(RCUCallbackLock);
+	*CallbackTail = head;
+	CallbackTail = &head->next;
+	CallbacksQueued++;
+}
+
+void rcu_barrier()
+{
+	uint64_t target = CallbacksQueued.load();
+	while (CallbacksDone.load() < target)
+		TaskManager->Sleep(1);
+}
+
+namespace RCU
+{
+	nsa void QuiescentState(CPUData *Core)
+	{
+		Core->RCUQuiescent.fetch_add(1, std::memory_order_release);
+	}
+
+	void CallbackThread()
+	{
+		thisThread->SetPriority(Tasking::Low);
+		while (true)
+		{
+			rcu_head *list;
+			{
+				SmartLock(RCUCallbackLock);
+				list = CallbackHead;
+				CallbackHead = nullptr;
+				CallbackTail = &CallbackHead;
+			}
+
+			if (list == nullptr)
+			{
+				TaskManager->Sleep(10);
+				continue;
+			}
+
+			/* Everything in the batch was queued
+			   before this grace period started. */
+			synchronize_rcu();
+
+			while (list)
+			{
+				rcu_head *next = list->next;
+				list->callback(list);
+				CallbacksDone++;
+				list = next;
+			}
+		}
+	}
+}
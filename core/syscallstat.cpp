@@ -0,0 +1,200 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <syscalls.hpp>
+
+#include <filesystem.hpp>
+#include <task.hpp>
+#include <printf.h>
+#include <string>
+
+#include "../kernel.h"
+
+namespace SyscallStat
+{
+	bool Enabled = false;
+	static Entry Table[ABICount][SYSCALLSTAT_ENTRIES];
+	static const char *ABINames[ABICount] = {"native", "linux"};
+
+	static void RaiseMax(std::atomic_uint64_t &Max, uint64_t Value)
+	{
+		uint64_t max = Max.load(std::memory_order_relaxed);
+		while (Value > max &&
+			   !Max.compare_exchange_weak(max, Value,
+										  std::memory_order_relaxed))
+			;
+	}
+
+	void Account(ABI Abi, size_t Number, const char *Name,
+				 uint64_t StartedAt, long Result)
+	{
+		uint64_t Cycles = CPU::Counter() - StartedAt;
+		if (Number >= SYSCALLSTAT_ENTRIES)
+			return;
+
+		Entry *e = &Table[Abi][Number];
+		e->Name.store(Name, std::memory_order_relaxed);
+		e->Calls.fetch_add(1, std::memory_order_relaxed);
+		if (Result < 0 && Result > -4096)
+			e->Errors.fetch_add(1, std::memory_order_relaxed);
+		e->Cycles.fetch_add(Cycles, std::memory_order_relaxed);
+		RaiseMax(e->Max, Cycles);
+
+		int Bucket = 63 - __builtin_clzll(Cycles | 1);
+		if (Bucket >= SYSCALLSTAT_BUCKETS)
+			Bucket = SYSCALLSTAT_BUCKETS - 1;
+		e->Histogram[Bucket].fetch_add(1, std::memory_order_relaxed);
+
+		Tasking::PCB *pcb = thisProcess;
+		if (pcb == nullptr)
+			return;
+
+		Counters *c = pcb->SyscallCounters.load(std::memory_order_acquire);
+		if (c == nullptr)
+		{
+			/* Threads of the same process may race here */
+			Counters *New = new Counters;
+			if (pcb->SyscallCounters.compare_exchange_strong(c, New,
+															 std::memory_order_acq_rel))
+				c = New;
+			else
+				delete New;
+		}
+
+		auto &pe = c->Table[Abi][Number];
+		pe.Calls.fetch_add(1, std::memory_order_relaxed);
+		pe.Cycles.fetch_add(Cycles, std::memory_order_relaxed);
+		RaiseMax(pe.Max, Cycles);
+	}
+
+	Entry *GetEntries(ABI Abi, size_t &Count)
+	{
+		Count = SYSCALLSTAT_ENTRIES;
+		return Table[Abi];
+	}
+
+	void Reset()
+	{
+		for (size_t a = 0; a < ABICount; a++)
+		{
+			foreach (auto &e in Table[a])
+			{
+				e.Calls.store(0);
+				e.Errors.store(0);
+				e.Cycles.store(0);
+				e.Max.store(0);
+				foreach (auto &b in e.Histogram)
+					b.store(0);
+			}
+		}
+	}
+
+	int Percentile(Entry *e, int Percent)
+	{
+		uint64_t Total = 0;
+		foreach (auto &b in e->Histogram)
+			Total += b.load(std::memory_order_relaxed);
+		if (Total == 0)
+			return -1;
+
+		uint64_t Target = (Total * Percent + 99) / 100;
+		uint64_t Seen = 0;
+		for (int i = 0; i < SYSCALLSTAT_BUCKETS; i++)
+		{
+			Seen += e->Histogram[i].load(std::memory_order_relaxed);
+			if (Seen >= Target)
+				return i;
+		}
+		return SYSCALLSTAT_BUCKETS - 1;
+	}
+
+	/**
+	 * One line per used syscall:
+	 * abi nr name calls errors cycles max | histogram buckets
+	 */
+	static std::string Render()
+	{
+		std::string Out;
+		char Line[128];
+		Out = "# abi nr name calls errors cycles max | log2(cycles) histogram\n";
+		for (size_t a = 0; a < ABICount; a++)
+		{
+			for (size_t i = 0; i < SYSCALLSTAT_ENTRIES; i++)
+			{
+				Entry *e = &Table[a][i];
+				if (e->Calls.load() == 0)
+					continue;
+
+				const char *Name = e->Name.load();
+				int n = snprintf(Line, sizeof(Line), "%s %ld %s %ld %ld %ld %ld |",
+						 ABINames[a], i, Name ? Name : "?",
+						 e->Calls.load(), e->Errors.load(),
+						 e->Cycles.load(), e->Max.load());
+				Out.append((const char *)Line, (size_t)n);
+
+				foreach (auto &b in e->Histogram)
+				{
+					n = snprintf(Line, sizeof(Line), " %ld", b.load());
+					Out.append((const char *)Line, (size_t)n);
+				}
+				Out.append((size_t)1, '\n');
+			}
+		}
+		return Out;
+	}
+
+	static ssize_t __stat_Read(struct Inode *, void *Buffer, size_t Size, off_t Offset)
+	{
+		std::string Out = Render();
+		if (Offset < 0 || (size_t)Offset >= Out.size())
+			return 0;
+
+		Size = MIN(Size, Out.size() - Offset);
+		memcpy(Buffer, Out.c_str() + Offset, Size);
+		return Size;
+	}
+
+	static int __stat_Stat(struct Inode *Node, struct kstat *Stat)
+	{
+		memset(Stat, 0, sizeof(struct kstat));
+		Stat->Device = Node->Device;
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		Stat->BlockSize = PAGE_SIZE;
+		return 0;
+	}
+
+	static Inode StatNode;
+
+	void Initialize()
+	{
+		FileSystemInfo *fsi = new FileSystemInfo;
+		fsi->Name = "syscallstat";
+		fsi->RootName = "syscallstat";
+		fsi->Flags = 0;
+		fsi->SuperOps = {};
+		fsi->Ops.Read = __stat_Read;
+		fsi->Ops.Stat = __stat_Stat;
+
+		/* - r-- r-- r-- */
+		StatNode.Mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
+		StatNode.Flags = I_FLAG_CACHE_KEEP;
+		StatNode.Device = fs->RegisterFileSystem(fsi, &StatNode);
+		fs->Mount(fs->GetRoot(0), &StatNode, "/proc/syscallstat");
+	}
+}
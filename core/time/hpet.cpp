@@ -67,8 +67,11 @@ namespace Time
 		if (Subtraction <= 0 || this->clk <= 0)
 			return 0;
 
-		Subtraction *= ConvertUnit(Units::Nanoseconds);
-		return uint64_t(Subtraction / this->clk);
+		/* clk is the tick period in femtoseconds. Split the
+			multiplication so it doesn't overflow after a few hours. */
+		const uint64_t fsPerNs = ConvertUnit(Units::Nanoseconds);
+		return (Subtraction / fsPerNs) * this->clk +
+			   (Subtraction % fsPerNs) * this->clk / fsPerNs;
 #endif
 	}
 
@@ -53,7 +53,10 @@ namespace Time
 	uint64_t TimeStampCounter::GetNanosecondsSinceClassCreation()
 	{
 #if defined(a86)
-		return uint64_t((this->GetCounter() - this->ClassCreationTime) / this->clk);
+		/* clk is the number of ticks per millisecond */
+		uint64_t Ticks = this->GetCounter() - this->ClassCreationTime;
+		return (Ticks / this->clk) * 1000000 +
+			   (Ticks % this->clk) * 1000000 / this->clk;
 #endif
 	}
 
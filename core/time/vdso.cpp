@@ -0,0 +1,208 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <vdso.hpp>
+
+#include <memory/swap_pt.hpp>
+#include <memory.hpp>
+#include <time.hpp>
+#include <lock.hpp>
+#include <debug.h>
+#include <cpu.hpp>
+
+#include "../../kernel.h"
+
+#if defined(a64)
+extern "C" uint8_t _vdso_image_start[], _vdso_image_end[];
+#endif
+
+namespace VDSO
+{
+	static_assert(offsetof(DataPage, Sequence) == 0);
+	static_assert(offsetof(DataPage, Flags) == 4);
+	static_assert(offsetof(DataPage, TSCBase) == 8);
+	static_assert(offsetof(DataPage, MonotonicBase) == 16);
+	static_assert(offsetof(DataPage, RealtimeOffset) == 24);
+	static_assert(offsetof(DataPage, Mult) == 32);
+	static_assert(offsetof(DataPage, Shift) == 36);
+
+	/* The data page is mapped without RW in process page tables and
+	   SMAP keeps the kernel away from user pages, so the kernel
+	   reads its own copy and only ever writes the shared one. */
+	NewSeqLock(ClockLock);
+	static DataPage Clock{};
+	static DataPage *Shared = nullptr;
+
+	/* Data page followed by the image, physically contiguous */
+	static void *Pages = nullptr;
+	static size_t PageCount = 0;
+
+	static uint64_t UnixTimeFromRTC()
+	{
+		Time::Clock tm = Time::ReadClock();
+		int Year = tm.Year < 100 ? tm.Year + 2000 : tm.Year;
+
+		/* Days since 1970-01-01 in the proleptic Gregorian calendar */
+		int y = tm.Month <= 2 ? Year - 1 : Year;
+		int Era = y / 400;
+		int YearOfEra = y - Era * 400;
+		int DayOfYear = (153 * (tm.Month > 2 ? tm.Month - 3 : tm.Month + 9) + 2) / 5 + tm.Day - 1;
+		int DayOfEra = YearOfEra * 365 + YearOfEra / 4 - YearOfEra / 100 + DayOfYear;
+		int64_t Days = int64_t(Era) * 146097 + DayOfEra - 719468;
+
+		return uint64_t(Days * 86400 + tm.Hour * 3600 + tm.Minute * 60 + tm.Second);
+	}
+
+	static uint64_t ReadMonotonic(const DataPage &Data)
+	{
+		if (!(Data.Flags & TSCValid))
+			return TimeManager->GetNanosecondsSinceClassCreation();
+
+		uint64_t TSC = CPU::Counter();
+		uint64_t Delta = TSC > Data.TSCBase ? TSC - Data.TSCBase : 0;
+		unsigned __int128 Scaled = (unsigned __int128)Delta * Data.Mult;
+		return Data.MonotonicBase + uint64_t(Scaled >> Data.Shift);
+	}
+
+	/* Copy the kernel view to the shared page. ClockLock must be held. */
+	static void Publish()
+	{
+		if (Shared == nullptr)
+			return;
+
+		Memory::SwapPT swap(KernelPageTable, thisPageTable);
+		__atomic_fetch_add(&Shared->Sequence, 1, __ATOMIC_RELAXED);
+		std::atomic_thread_fence(std::memory_order_release);
+		Shared->Flags = Clock.Flags;
+		Shared->TSCBase = Clock.TSCBase;
+		Shared->MonotonicBase = Clock.MonotonicBase;
+		Shared->RealtimeOffset = Clock.RealtimeOffset;
+		Shared->Mult = Clock.Mult;
+		Shared->Shift = Clock.Shift;
+		__atomic_fetch_add(&Shared->Sequence, 1, __ATOMIC_RELEASE);
+	}
+
+	static void Calibrate()
+	{
+		uint64_t NsStart = TimeManager->GetNanosecondsSinceClassCreation();
+		uint64_t TSCStart = CPU::Counter();
+		TimeManager->Sleep(10, Time::Milliseconds);
+		uint64_t NsEnd = TimeManager->GetNanosecondsSinceClassCreation();
+		uint64_t TSCEnd = CPU::Counter();
+
+		if (NsEnd <= NsStart || TSCEnd <= TSCStart)
+		{
+			warn("Failed to calibrate the TSC, the vDSO will fall back to system calls");
+			return;
+		}
+
+		uint64_t Ns = NsEnd - NsStart;
+		uint64_t Ticks = TSCEnd - TSCStart;
+
+		/* Largest shift that keeps Mult in 32 bits */
+		uint32_t Shift = 32;
+		uint64_t Mult = 0;
+		for (; Shift > 0; Shift--)
+		{
+			Mult = (Ns << Shift) / Ticks;
+			if (Mult <= UINT32_MAX)
+				break;
+		}
+
+		Clock.TSCBase = TSCEnd;
+		Clock.MonotonicBase = NsEnd;
+		Clock.Mult = uint32_t(Mult);
+		Clock.Shift = Shift;
+		Clock.Flags |= TSCValid;
+		KPrint("TSC runs at %ld MHz", Ticks * 1000 / Ns);
+	}
+
+	void Initialize()
+	{
+#if defined(a64)
+		size_t ImageSize = _vdso_image_end - _vdso_image_start;
+		PageCount = 1 + TO_PAGES(ImageSize);
+		Pages = KernelAllocator.RequestPages(PageCount);
+		memset(Pages, 0, FROM_PAGES(PageCount));
+		memcpy((uint8_t *)Pages + PAGE_SIZE, _vdso_image_start, ImageSize);
+		Shared = (DataPage *)Pages;
+		debug("vDSO image is %ld bytes at %#lx", ImageSize, Pages);
+#endif
+
+		SmartWriteLock(ClockLock);
+		Calibrate();
+		if (CPU::RDTSCPSupported())
+			Clock.Flags |= RDTSCPValid;
+
+		Clock.RealtimeOffset = UnixTimeFromRTC() * 1000000000ULL - ReadMonotonic(Clock);
+		Publish();
+	}
+
+	uintptr_t Map(Memory::VirtualMemoryArea *vma)
+	{
+		if (Pages == nullptr)
+			return 0;
+
+		/* Identity mapped like every other user allocation, read-only */
+		int ret = vma->Map(Pages, Pages, FROM_PAGES(PageCount), Memory::US);
+		if (ret < 0)
+		{
+			error("Failed to map the vDSO: %d", ret);
+			return 0;
+		}
+		return uintptr_t(Pages) + PAGE_SIZE;
+	}
+
+	uint64_t Monotonic()
+	{
+		uint64_t seq, ret;
+		do
+		{
+			seq = ClockLock.ReadBegin();
+			ret = ReadMonotonic(Clock);
+		} while (ClockLock.ReadRetry(seq));
+		return ret;
+	}
+
+	uint64_t Realtime()
+	{
+		uint64_t seq, ret;
+		do
+		{
+			seq = ClockLock.ReadBegin();
+			ret = ReadMonotonic(Clock) + Clock.RealtimeOffset;
+		} while (ClockLock.ReadRetry(seq));
+		return ret;
+	}
+
+	uint64_t CyclesToNanoseconds(uint64_t Cycles)
+	{
+		/* Mult and Shift are only written once, by Initialize() */
+		if (!(Clock.Flags & TSCValid))
+			return 0;
+
+		unsigned __int128 Scaled = (unsigned __int128)Cycles * Clock.Mult;
+		return uint64_t(Scaled >> Clock.Shift);
+	}
+
+	void SetRealtime(uint64_t Nanoseconds)
+	{
+		SmartWriteLock(ClockLock);
+		Clock.RealtimeOffset = Nanoseconds - ReadMonotonic(Clock);
+		Publish();
+	}
+}
@@ -18,6 +18,7 @@
 #include <exec.hpp>
 
 #include <memory.hpp>
+#include <vdso.hpp>
 #include <lock.hpp>
 #include <msexec.h>
 #include <rand.hpp>
@@ -32,7 +33,47 @@ using namespace vfs;
 
 namespace Execute
 {
-	void ELFObject::GenerateAuxiliaryVector_x86_32(Memory::VirtualMemoryArea *vma,
+	/**
+	 * Map a read-only segment straight from the file data,
+	 * if the filesystem keeps it in memory.
+	 */
+	static bool MapSegmentInPlace(FileNode *fd, Memory::Virtual &vmm,
+								  Memory::VirtualMemoryArea *vma, Elf64_Phdr &Phdr)
+	{
+		if ((Phdr.p_flags & PF_W) || Phdr.p_filesz != Phdr.p_memsz)
+			return false;
+
+		uintptr_t vStart = ALIGN_DOWN(Phdr.p_vaddr, PAGE_SIZE);
+		off_t fStart = ALIGN_DOWN(Phdr.p_offset, PAGE_SIZE);
+		if (Phdr.p_vaddr - vStart != Phdr.p_offset - fStart)
+			return false;
+
+		size_t Length = Phdr.p_vaddr + Phdr.p_memsz - vStart;
+		const void *Data;
+		ssize_t Available = fd->MapPages(fStart, &Data);
+		if (Available < (ssize_t)Length)
+			return false;
+
+		size_t Whole = MIN((size_t)ALIGN_DOWN(Available, PAGE_SIZE),
+						   (size_t)ALIGN_UP(Length, PAGE_SIZE));
+		if (Whole)
+			vmm.Map((void *)vStart, (void *)Data, Whole, Memory::US);
+
+		/* The last page of the file is copied, so whatever
+			follows it in the archive is not exposed */
+		if (Whole < ALIGN_UP(Length, PAGE_SIZE))
+		{
+			void *Tail = vma->RequestPages(1);
+			memcpy(Tail, (const uint8_t *)Data + Whole, Available - Whole);
+			vmm.Map((void *)(vStart + Whole), Tail, PAGE_SIZE, Memory::US);
+		}
+
+		debug("Mapped segment %#lx-%#lx in place from %#lx",
+			  vStart, vStart + Length, Data);
+		return true;
+	}
+
+	void ELFObject::GenerateAuxiliaryVector_x86_32(Tasking::PCB *TargetProcess,
 												   FileNode *fd,
 												   Elf32_Ehdr ELFHeader,
 												   uint32_t EntryPoint,
@@ -41,13 +82,14 @@ namespace Execute
 		assert(!"Function not implemented");
 	}
 
-	void ELFObject::GenerateAuxiliaryVector_x86_64(Memory::VirtualMemoryArea *vma,
+	void ELFObject::GenerateAuxiliaryVector_x86_64(Tasking::PCB *TargetProcess,
 												   FileNode *fd,
 												   Elf64_Ehdr ELFHeader,
 												   uint64_t EntryPoint,
 												   uint64_t BaseAddress)
 	{
 #if defined(a64)
+		Memory::VirtualMemoryArea *vma = TargetProcess->vma;
 		char *aux_platform = (char *)vma->RequestPages(1, true); /* TODO: 4KiB is too much for this */
 		strcpy(aux_platform, "x86_64");
 
@@ -80,7 +122,14 @@ namespace Execute
 		// AT_CLKTCK 17
 		Elfauxv.push_back({.archaux = {.a_type = AT_PAGESZ, .a_un = {.a_val = (uint64_t)PAGE_SIZE}}});
 		// AT_HWCAP 16
-		// AT_SYSINFO_EHDR 33
+
+		if (TargetProcess->Info.Compatibility == Tasking::Linux)
+		{
+			uintptr_t vDSO = VDSO::Map(vma);
+			if (vDSO)
+				Elfauxv.push_back({.archaux = {.a_type = AT_SYSINFO_EHDR, .a_un = {.a_val = (uint64_t)vDSO}}});
+		}
+
 		// AT_MINSIGSTKSZ 51
 
 #ifdef DEBUG
@@ -157,6 +206,12 @@ namespace Execute
 					if (ProgramHeader.p_memsz == 0)
 						continue;
 
+					if (MapSegmentInPlace(fd, vmm, vma, ProgramHeader))
+					{
+						ProgramBreakHeader = ProgramHeader;
+						break;
+					}
+
 					void *pAddr = vma->RequestPages(TO_PAGES(ProgramHeader.p_memsz), true);
 					void *vAddr = (void *)ALIGN_DOWN(ProgramHeader.p_vaddr, ProgramHeader.p_align);
 					uintptr_t SegDestOffset = ProgramHeader.p_vaddr - uintptr_t(vAddr);
@@ -303,7 +358,7 @@ namespace Execute
 
 		debug("Entry Point: %#lx", EntryPoint);
 
-		this->GenerateAuxiliaryVector_x86_64(vma, fd, ELFHeader,
+		this->GenerateAuxiliaryVector_x86_64(TargetProcess, fd, ELFHeader,
 											 EntryPoint, 0);
 
 		this->ip = EntryPoint;
@@ -702,7 +757,7 @@ namespace Execute
 
 		debug("Entry Point: %#lx", EntryPoint);
 
-		this->GenerateAuxiliaryVector_x86_64(vma, fd, ELFHeader,
+		this->GenerateAuxiliaryVector_x86_64(TargetProcess, fd, ELFHeader,
 											 EntryPoint, BaseAddress);
 
 		this->ip = EntryPoint;
@@ -142,19 +142,19 @@ namespace Execute
 				if (unlikely(SearchNode == nullptr))
 					return false;
 
-				foreach (const auto &ffd in pfdt->FileMap)
-				{
-					if (ffd.second.Flags & O_CLOEXEC)
-						continue;
-
-					if (ffd.second.Node == SearchNode)
-					{
-						fdt->usr_open(ffd.second.Node->Path.c_str(),
-									  ffd.second.Flags, ffd.second.Mode);
-						return true;
-					}
-				}
-				return false;
+				bool found = false;
+				pfdt->ForEach([&](int Number, vfs::FileDescriptorTable::Fildes &ffd)
+							  {
+								  if (found || pfdt->GetDescriptorFlags(Number) & O_CLOEXEC)
+									  return;
+
+								  if (ffd.Node == SearchNode)
+								  {
+									  fdt->usr_open(ffd.Node->Path.c_str(),
+													ffd.Flags, ffd.Mode);
+									  found = true;
+								  } });
+				return found;
 			};
 
 			fixme("remove workarounds for stdio and tty");
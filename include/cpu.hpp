@@ -211,6 +211,9 @@ namespace CPU
 	/** @brief Get CPU counter value. */
 	uint64_t Counter();
 
+	/** @brief Check if RDTSCP works and IA32_TSC_AUX holds the core ID. */
+	bool RDTSCPSupported();
+
 	namespace x32
 	{
 		/**
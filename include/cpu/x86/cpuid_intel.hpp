@@ -1043,9 +1043,12 @@ namespace CPU
 						uint32_t SYSCALL : 1;
 						uint32_t Reserved1 : 8;
 						uint32_t ExecuteDisable : 1;
-						uint32_t Reserved2 : 8;
+						uint32_t Reserved2 : 5;
+						uint32_t Page1GB : 1;
+						uint32_t RDTSCP : 1;
+						uint32_t Reserved3 : 1;
 						uint32_t EMT64T : 1;
-						uint32_t Reserved3 : 2;
+						uint32_t Reserved4 : 2;
 					};
 					cpuid_t raw;
 				} EDX;
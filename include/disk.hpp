@@ -19,7 +19,13 @@
 #define __FENNIX_KERNEL_DISK_H__
 
 #include <types.h>
+
+#include <interface/device.h>
+#include <filesystem.hpp>
+#include <lock.hpp>
+#include <atomic>
 #include <vector>
+#include <string>
 
 namespace Disk
 {
@@ -36,13 +42,6 @@ namespace Disk
         GPT
     };
 
-    enum PartitionFlags
-    {
-        Present,
-        Bootable,
-        EFISystemPartition
-    };
-
     struct MasterBootRecordPartition
     {
         uint8_t Flags;
@@ -91,91 +90,177 @@ namespace Disk
         uint32_t PartCRC32;
     } __packed;
 
-    struct PartitionTable
+    class Device;
+    class Queue;
+
+    /**
+     * @brief One transfer of whole sectors.
+     *
+     * This is what filesystems submit. Bios that touch each other
+     * on the disk are merged into one Request before the driver
+     * sees them.
+     */
+    struct Bio
     {
-        MasterBootRecord MBR;
-        GUIDPartitionTable GPT;
+        /** First sector, relative to the device it is submitted to */
+        uint64_t Sector = 0;
+        size_t Count = 0;
+        bool Write = false;
+        std::vector<struct kiovec> Vector;
+
+        /**
+         * Called once the transfer is finished, maybe from
+         * an interrupt handler. Status is 0 or a negative error.
+         */
+        void (*Done)(Bio *b, int Status) = nullptr;
+        void *Private = nullptr;
     };
 
-    class Partition
+    /** Bios merged into one request for the driver */
+    struct Request
     {
+        struct BlockRequest Driver{};
+        uint64_t Sector = 0;
+        size_t Count = 0;
+        bool Write = false;
+        std::vector<struct kiovec> Vector;
+        std::vector<Bio *> Bios;
+        /** Served before the elevator order once this time passed */
+        uint64_t Deadline = 0;
+        Queue *Owner = nullptr;
+    };
+
+    /**
+     * @brief Request queue of a disk, with a deadline elevator.
+     *
+     * Pending requests are kept sorted by sector, one list for
+     * each direction, and sent in one sweep across the disk.
+     * Reads go before writes, unless writes were passed over
+     * too many times. A request whose deadline expired goes
+     * next, whatever its position.
+     *
+     * While the queue is plugged, requests are only collected
+     * so that a batch can merge before it is sent.
+     */
+    class Queue
+    {
+    private:
+        NewLock(QueueLock);
+        Device *Disk;
+        /** Sorted by sector, indexed by Request::Write */
+        std::vector<Request *> Pending[2];
+        size_t InFlight = 0;
+        size_t Depth;
+        size_t MaxSectors;
+        uint64_t Position = 0;
+        int WritesStarved = 0;
+        int Plugged = 0;
+        std::atomic_bool Dispatching = false;
+
+        bool Merge(Bio *b);
+        void Insert(Request *r);
+        Request *Next();
+        void Start(Request *r);
+        bool CanDispatch();
+
     public:
-        char Label[72] = "Unidentified Partition";
-        uint64_t StartLBA = 0xdeadbeef;
-        uint64_t EndLBA = 0xdeadbeef;
-        size_t Sectors = 0xdeadbeef;
-        size_t Flags = 0xdeadbeef;
-        unsigned char Port = 0;
-        PartitionStyle Style = PartitionStyle::Unknown;
-        size_t Index = 0;
-
-        size_t Read(size_t Offset, size_t Count, uint8_t *Buffer)
-        {
-            fixme("Read from partition %s", Label);
-            return 0;
-            UNUSED(Offset);
-            UNUSED(Count);
-            UNUSED(Buffer);
-        }
-
-        size_t Write(size_t Offset, size_t Count, uint8_t *Buffer)
-        {
-            fixme("Read from partition %s", Label);
-            return 0;
-            UNUSED(Offset);
-            UNUSED(Count);
-            UNUSED(Buffer);
-        }
-
-        Partition() {}
-        ~Partition() {}
+        std::atomic_size_t Submitted = 0;
+        std::atomic_size_t Merged = 0;
+        std::atomic_size_t Dispatched = 0;
+
+        void Submit(Bio *b);
+
+        /** Hold requests back until the matching Unplug() */
+        void Plug();
+        void Unplug();
+
+        /** Send pending requests while the driver takes them */
+        void Dispatch();
+
+        /** The driver finished @p r */
+        void Complete(Request *r, int Status);
+
+        Queue(Device *Disk, size_t Depth);
+        ~Queue();
     };
 
-    class Drive
+    /** A disk, or a partition of one */
+    class Device
     {
     public:
-        char Name[64] = "Unidentified Drive";
-        uint8_t *Buffer = nullptr;
-        PartitionTable Table;
-        PartitionStyle Style = PartitionStyle::Unknown;
-        std::vector<Partition *> Partitions;
-        bool MechanicalDisk = false;
-        size_t UniqueIdentifier = 0xdeadbeef;
-
-        size_t Read(size_t Offset, size_t Count, uint8_t *Buffer)
-        {
-            fixme("Read from disk %s", Name);
-            return 0;
-            UNUSED(Offset);
-            UNUSED(Count);
-            UNUSED(Buffer);
-        }
-
-        size_t Write(size_t Offset, size_t Count, uint8_t *Buffer)
-        {
-            fixme("Read from disk %s", Name);
-            return 0;
-            UNUSED(Offset);
-            UNUSED(Count);
-            UNUSED(Buffer);
-        }
-
-        Drive()
-        { // TODO: Allocate buffer
-        }
-        ~Drive() {}
+        std::string Name;
+        size_t SectorSize = 512;
+        uint64_t Sectors = 0;
+
+        /** The whole disk, only set for partitions */
+        Device *Parent = nullptr;
+        /** First sector on Parent */
+        uint64_t Start = 0;
+        /** Partition table found on a disk */
+        PartitionStyle Style = Unknown;
+
+        /** Only disks have a queue */
+        Queue *IO = nullptr;
+
+        /** Node in /dev */
+        struct Inode Node{};
+        FileNode *File = nullptr;
+
+        /** Drivers with a request interface */
+        const struct BlockOperations *Ops = nullptr;
+        dev_t DriverID = -1;
+        dev_t DriverDevice = -1;
+
+        /** Drivers that only have Read and Write */
+        const struct InodeOperations *Legacy = nullptr;
+        struct Inode LegacyNode{};
+
+        /** Submit @p b, partitions move it to their place on the disk */
+        void Submit(Bio *b);
+
+        /**
+         * Submit @p Count bios as one batch and wait
+         * until all of them are finished.
+         *
+         * @return 0 or the first error
+         */
+        int SubmitAll(Bio *Bios, size_t Count);
+
+        /**
+         * Read or write at any byte offset, partial sectors
+         * are read first and written back whole.
+         */
+        ssize_t Transfer(const struct kiovec *Vector, int Count, off_t Offset, bool Write);
     };
 
     class Manager
     {
     private:
-        unsigned char AvailablePorts = 0;
-        int BytesPerSector = 0;
+        NewLock(DevicesLock);
+        std::vector<Device *> Devices;
+        struct Inode Root{};
+        dev_t DeviceID = -1;
+        size_t NextDisk = 0;
 
-        std::vector<Drive *> drives;
+        void Publish(Device *d);
+        void AddPartition(Device *Disk, size_t Index, uint64_t Start, uint64_t Sectors);
+        void ScanPartitions(Device *Disk);
 
     public:
-        void FetchDisks(unsigned long modUniqueID);
+        /** Add a disk whose driver takes requests */
+        Device *AddDisk(dev_t DriverID, const struct BlockOperations *Operations);
+
+        /** Add a disk whose driver only reads and writes bytes */
+        Device *AddDisk(dev_t DriverID, dev_t DriverDevice, const struct InodeOperations *Operations);
+
+        /** Read the partition tables of the disks that were not scanned yet */
+        void ScanDisks();
+
+        /** The device behind a node in /dev, or nullptr */
+        Device *Find(FileNode *File);
+
+        std::vector<Device *> GetDevices();
+
         Manager();
         ~Manager();
     };
@@ -83,6 +83,7 @@ namespace Driver
 	{
 	private:
 		NewLock(ModuleInitLock);
+		NewRWLock(DriversLock);
 		std::unordered_map<dev_t, DriverObject> Drivers;
 
 		/**
@@ -93,7 +94,6 @@ namespace Driver
 		FileNode *devNode = nullptr;
 		FileNode *devInputNode = nullptr;
 
-
 		int LoadDriverFile(DriverObject &Drv, FileNode *File);
 
 		void InitializeDaemonFS();
@@ -114,9 +114,27 @@ namespace Driver
 			std::vector<DeviceInode *> Children;
 		};
 
+		/**
+		 * @note Hold GetDriversLock() for reading
+		 * while iterating over the drivers.
+		 */
 		std::unordered_map<dev_t, DriverObject> &
 		GetDrivers() { return Drivers; }
 
+		RWLockClass &GetDriversLock() { return DriversLock; }
+
+		/**
+		 * Find a driver by its ID.
+		 *
+		 * @note Hold GetDriversLock() for reading
+		 * while using the returned driver. Readers
+		 * don't exclude each other, so lookups can
+		 * run on all cores at the same time.
+		 *
+		 * @return nullptr if the driver is not loaded
+		 */
+		DriverObject *GetDriver(dev_t DriverID);
+
 		void Daemon();
 		void PreloadDrivers();
 		void LoadAllDrivers();
@@ -0,0 +1,166 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_EPOLL_H__
+#define __FENNIX_KERNEL_EPOLL_H__
+
+#include <types.h>
+
+#include <filesystem.hpp>
+#include <waitqueue.hpp>
+#include <unordered_map>
+#include <poll.hpp>
+#include <atomic>
+#include <mutex>
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+/* The event bits are the same as POLL* */
+#define EPOLLEXCLUSIVE (1U << 28)
+#define EPOLLWAKEUP (1U << 29)
+#define EPOLLONESHOT (1U << 30)
+#define EPOLLET (1U << 31)
+
+#define EPOLL_FLAGS (EPOLLEXCLUSIVE | EPOLLWAKEUP | \
+					 EPOLLONESHOT | EPOLLET)
+
+namespace vfs
+{
+	/**
+	 * An epoll instance
+	 *
+	 * Every watched file has an item with a PollWatcher on the
+	 * file's inode. When the inode posts an event, the item is
+	 * appended to the ready list and the waiters are woken up,
+	 * so Wait() only has to look at the files that changed.
+	 *
+	 * Level-triggered items stay on the ready list as long as
+	 * they report events, edge-triggered items are dropped until
+	 * the next event and one-shot items are disabled until they
+	 * are modified with EPOLL_CTL_MOD.
+	 *
+	 * The instance is reference counted, each file descriptor
+	 * that refers to it holds a reference.
+	 */
+	class EventPoll
+	{
+	public:
+		struct Event
+		{
+			uint32_t Events;
+			uint64_t Data;
+		};
+
+	private:
+		struct Item
+		{
+			PollWatcher Watcher;
+			EventPoll *Owner = nullptr;
+			FileNode *File = nullptr;
+			/* Dropped with its item when the last descriptor is closed */
+			FileDescriptorTable::Fildes *Description = nullptr;
+			uint32_t Events = 0;
+			uint64_t Data = 0;
+
+			/* Protected by ReadyLock */
+			bool Queued = false;
+			bool Overflow = false;
+			Item *Next = nullptr;
+			Item *Prev = nullptr;
+			Item *OverflowNext = nullptr;
+		};
+
+		/* Taken while items are added, removed or scanned.
+		   The global links lock is always taken first. */
+		std::mutex ItemsLock;
+		std::unordered_map<int, Item *> Items;
+
+		/* Taken from PollNotify(), so it is a critical section */
+		NewLock(ReadyLock);
+		Item *ReadyHead = nullptr;
+		Item *ReadyTail = nullptr;
+		/* Items that became ready while Wait() was scanning */
+		Item *OverflowHead = nullptr;
+		bool Scanning = false;
+		std::atomic_size_t ReadyCount = 0;
+
+		Tasking::WaitQueue Waiters;
+		std::atomic_int References = 1;
+
+		Inode Node;
+		FileNode *File = nullptr;
+		/* Tells our own watchers from inside Callback() */
+		PollDeferred Deferred;
+
+		static void Callback(PollWatcher *Watcher, short Events);
+
+		void Enqueue(Item *it);
+		void Dequeue(Item *it);
+		void Check(Item *it);
+		void Remove(Item *it);
+		int Collect(Event *Events, int MaxEvents);
+
+		~EventPoll();
+
+	public:
+		/** The node that represents this instance in a descriptor table */
+		FileNode *GetFile() { return File; }
+
+		/**
+		 * Add, modify or remove the watch on @p Description.
+		 *
+		 * @param Operation EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL
+		 * @param FileDescriptor The key of the watch, it only
+		 * matches while it still refers to @p Description
+		 */
+		int Control(int Operation, int FileDescriptor,
+					FileDescriptorTable::Fildes *Description,
+					uint32_t Events, uint64_t Data);
+
+		/**
+		 * Drop every watch on @p Description, in all instances.
+		 * Called once its last descriptor is closed.
+		 */
+		static void Release(FileDescriptorTable::Fildes *Description);
+
+		/**
+		 * Wait for events.
+		 *
+		 * @param Timeout Timeout in milliseconds, 0 does not
+		 * block and a negative value waits forever.
+		 * @return Number of events stored in @p Events
+		 */
+		int Wait(Event *Events, int MaxEvents, int Timeout);
+
+		bool HasEvents() { return ReadyCount.load() != 0; }
+
+		void Get() { References++; }
+		void Put();
+
+		/**
+		 * Get the instance behind a file,
+		 * or nullptr if it is not an epoll node.
+		 */
+		static EventPoll *FromFile(FileNode *File);
+
+		EventPoll();
+	};
+}
+
+#endif // !__FENNIX_KERNEL_EPOLL_H__
@@ -66,12 +66,12 @@ namespace Execute
 		Tasking::IP ip;
 		void *ELFProgramHeaders;
 
-		void GenerateAuxiliaryVector_x86_32(Memory::VirtualMemoryArea *vma,
+		void GenerateAuxiliaryVector_x86_32(Tasking::PCB *TargetProcess,
 											FileNode *fd, Elf32_Ehdr ELFHeader,
 											uint32_t EntryPoint,
 											uint32_t BaseAddress);
 
-		void GenerateAuxiliaryVector_x86_64(Memory::VirtualMemoryArea *vma,
+		void GenerateAuxiliaryVector_x86_64(Tasking::PCB *TargetProcess,
 											FileNode *fd, Elf64_Ehdr ELFHeader,
 											uint64_t EntryPoint,
 											uint64_t BaseAddress);
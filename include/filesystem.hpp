@@ -24,8 +24,11 @@
 #include <unordered_map>
 #include <lock.hpp>
 #include <errno.h>
+#include <rcu.hpp>
 #include <atomic>
 #include <string>
+#include <utility>
+#include <vector>
 #include <list>
 
 static_assert(DTTOIF(DT_FIFO) == S_IFIFO);
@@ -43,6 +46,10 @@ class FileNode
 {
 public:
 	std::string Name, Path;
+	/** DentryCache::HashName() of Name */
+	uint64_t NameHash = 0;
+	/** Odd while Name, Parent or Children are changing */
+	std::atomic_uint32_t Seq = 0;
 	FileNode *Parent;
 	std::vector<FileNode *> Children;
 	Inode *Node;
@@ -63,9 +70,37 @@ public:
 	int Create(const char *Name, mode_t Mode, Inode **Node) { __check_op(Create, EROFS, Name, Mode, Node); }
 	int Remove(const char *Name) { __check_op(Remove, EROFS, Name); }
 	int Rename(const char *OldName, const char *NewName) { __check_op(Rename, EROFS, OldName, NewName); }
-	ssize_t Read(auto Buffer, size_t Size, off_t Offset) { __check_op(Read, ENOTSUP, (void *)Buffer, Size, Offset); }
-	ssize_t Write(const auto Buffer, size_t Size, off_t Offset) { __check_op(Write, EROFS, (const void *)Buffer, Size, Offset); }
-	int Truncate(off_t Size) { __check_op(Truncate, EROFS, Size); }
+	int Link(const char *Name, Inode *Target) { __check_op(Link, EPERM, Name, Target); }
+
+	/** Data goes through vfs::PageCache */
+	bool IsCached() { return (fsi->Flags & I_FLAG_PAGE_CACHE) && IsRegularFile(); }
+
+	ssize_t CachedRead(void *Buffer, size_t Size, off_t Offset);
+	ssize_t CachedWrite(const void *Buffer, size_t Size, off_t Offset);
+	int CachedTruncate(off_t Size);
+	int CachedStat(struct kstat *Stat);
+
+	ssize_t Read(auto Buffer, size_t Size, off_t Offset)
+	{
+		if (IsCached())
+			return CachedRead((void *)Buffer, Size, Offset);
+		__check_op(Read, ENOTSUP, (void *)Buffer, Size, Offset);
+	}
+
+	ssize_t Write(const auto Buffer, size_t Size, off_t Offset)
+	{
+		if (IsCached())
+			return CachedWrite((const void *)Buffer, Size, Offset);
+		__check_op(Write, EROFS, (const void *)Buffer, Size, Offset);
+	}
+
+	int Truncate(off_t Size)
+	{
+		if (IsCached())
+			return CachedTruncate(Size);
+		__check_op(Truncate, EROFS, Size);
+	}
+
 	int Open(int Flags, mode_t Mode) { __check_op(Open, ENOTSUP, Flags, Mode); }
 	int Close() { __check_op(Close, ENOTSUP); }
 	int Ioctl(unsigned long Request, void *Argp) { __check_op(Ioctl, ENOTSUP, Request, Argp); }
@@ -75,7 +110,33 @@ public:
 	int SymLink(const char *Name, const char *Target, struct Inode **Result) { __check_op(SymLink, EROFS, Name, Target, Result); }
 	ssize_t ReadLink(auto Buffer, size_t Size) { __check_op(ReadLink, ENOTSUP, (char *)Buffer, Size); }
 	off_t Seek(off_t Offset) { __check_op(Seek, ENOTSUP, Offset); }
-	int Stat(struct kstat *Stat) { __check_op(Stat, ENOTSUP, Stat); }
+
+	int Stat(struct kstat *Stat)
+	{
+		if (IsCached())
+			return CachedStat(Stat);
+		__check_op(Stat, ENOTSUP, Stat);
+	}
+
+	ssize_t MapData(off_t Offset, const void **Data) { __check_op(MapData, ENOTSUP, Offset, Data); }
+
+	/**
+	 * Same as MapData(), for mapping the data in place.
+	 * Only succeeds if @p Offset and the data are page
+	 * aligned and the data stays where it is.
+	 */
+	ssize_t MapPages(off_t Offset, const void **Data);
+
+	ssize_t ReadV(const struct kiovec *Vector, int Count, off_t Offset);
+	ssize_t WriteV(const struct kiovec *Vector, int Count, off_t Offset);
+
+	short Poll(short Events)
+	{
+		/* Nodes that can't block are always ready */
+		if (fsi->Ops.Poll == nullptr)
+			return Events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+		return fsi->Ops.Poll(this->Node, Events);
+	}
 
 	~FileNode() = delete;
 };
@@ -92,10 +153,165 @@ namespace vfs
 		std::vector<Inode *> Children;
 	};
 
+	/**
+	 * Index of resolved path segments, keyed by the parent
+	 * node and the name. Names that failed to resolve are
+	 * kept as negative entries.
+	 *
+	 * Lookups are lock-free, hash chains are RCU protected.
+	 * Updates are serialized by CacheLock.
+	 */
+	class DentryCache
+	{
+	private:
+		struct Entry
+		{
+			rcu_head Rcu;
+			FileNode *Parent = nullptr;
+			/** nullptr for a negative entry */
+			std::atomic<FileNode *> Node = nullptr;
+			uint64_t Hash = 0;
+			std::string Name;
+			/** Used since the last eviction pass */
+			std::atomic_bool Referenced = false;
+
+			Entry *Next = nullptr;
+			Entry *Newer = nullptr, *Older = nullptr;
+		};
+
+		NewLock(CacheLock);
+		Entry **Buckets = nullptr;
+		/** Circular list in insertion order, LRU.Older is
+			the newest entry and LRU.Newer the oldest */
+		Entry LRU;
+		size_t Count = 0;
+		size_t Inserts = 0;
+
+		Entry **Find(FileNode *Parent, const char *Name, size_t Length, uint64_t Hash);
+		void Unlink(Entry **Slot);
+		void Shrink(size_t Target);
+		static void FreeEntry(rcu_head *head);
+
+	public:
+		std::atomic_uint64_t Hits = 0, NegativeHits = 0, Misses = 0;
+
+		static uint64_t HashName(const char *Name, size_t Length);
+
+		/**
+		 * @return true if the name is cached, @p Result is
+		 *         nullptr if it is known not to exist
+		 */
+		bool Lookup(FileNode *Parent, const char *Name, size_t Length,
+					uint64_t Hash, FileNode **Result);
+
+		/** Same as Lookup(), the caller holds rcu_read_lock() */
+		bool LookupRCU(FileNode *Parent, const char *Name, size_t Length,
+					   uint64_t Hash, FileNode **Result);
+
+		/** Add or replace an entry, @p Node is nullptr for a miss */
+		void Insert(FileNode *Parent, const char *Name, size_t Length,
+					uint64_t Hash, FileNode *Node);
+
+		/** Drop the entry of @p Node and everything cached below it */
+		void Forget(FileNode *Node);
+
+		size_t GetCount() { return Count; }
+
+		DentryCache();
+		~DentryCache();
+	};
+
+	/**
+	 * Cache of file data, in page sized blocks.
+	 *
+	 * Every cached inode has a mapping that holds its pages in
+	 * a radix tree indexed by the page number. Sequential reads
+	 * grow a readahead window so the filesystem is asked for
+	 * several pages at once. Writes only dirty the pages, they
+	 * reach the filesystem on sync, on eviction or from the
+	 * writeback thread.
+	 *
+	 * All pages are on one LRU list, the oldest ones are
+	 * dropped when free memory runs low.
+	 *
+	 * Only regular files of filesystems that set
+	 * I_FLAG_PAGE_CACHE go through the cache.
+	 */
+	class PageCache
+	{
+	private:
+		struct Page;
+		struct Mapping;
+
+		/* Protects Mappings and the LRU list */
+		NewLock(CacheLock);
+		std::unordered_map<Inode *, Mapping *> Mappings;
+		Page *Oldest = nullptr, *Newest = nullptr;
+		size_t Pages = 0;
+
+		Mapping *GetMapping(FileNode *File, bool Create);
+		void PutMapping(Mapping *m);
+
+		Page *NewPage(Mapping *m, uint64_t Index);
+		void Touch(Page *p);
+		void Unlink(Page *p);
+		void Release(Mapping *m, Page *p);
+
+		int Fill(Mapping *m, uint64_t Index, size_t Count);
+		int WritePage(Mapping *m, Page *p);
+		int Flush(Mapping *m);
+		size_t Evict(size_t Count, Mapping *Skip);
+
+	public:
+		std::atomic_uint64_t Hits = 0, Misses = 0, ReadAhead = 0;
+		std::atomic_uint64_t WrittenBack = 0, Reclaimed = 0;
+
+		ssize_t Read(FileNode *File, void *Buffer, size_t Size, off_t Offset);
+		ssize_t Write(FileNode *File, const void *Buffer, size_t Size, off_t Offset);
+		int Truncate(FileNode *File, off_t Size);
+
+		/** Stat the file, with the size of its cached data */
+		int Stat(FileNode *File, struct kstat *Stat);
+
+		/**
+		 * Write dirty pages back
+		 *
+		 * @param fsi Only pages of this filesystem, all if nullptr
+		 * @param Node Only pages of this inode, all if nullptr
+		 *
+		 * @return Zero or the first error the filesystem returned
+		 */
+		int Sync(FileSystemInfo *fsi, Inode *Node);
+
+		/** Drop the pages of @p Node without writing them back */
+		void Invalidate(Inode *Node);
+
+		/** Drop up to @p Count of the least recently used pages */
+		size_t Reclaim(size_t Count) { return Evict(Count, nullptr); }
+
+		size_t GetCount() { return Pages; }
+
+		static void WritebackThread();
+	};
+
 	class Virtual
 	{
 	private:
-		NewLock(VirtualLock);
+		NewRWLock(VirtualLock);
+		DentryCache Dentries;
+		/** Bumped around anything that moves nodes in the tree */
+		std::atomic_uint32_t RenameSeq = 0;
+
+		enum WalkResult
+		{
+			WalkFound,
+			WalkMissing,
+			WalkRetry,
+		};
+
+		void BeginNodeChange(FileNode *Node);
+		void EndNodeChange(FileNode *Node);
+		WalkResult WalkRCU(FileNode *Parent, const char *Path, FileNode **Result);
 
 		struct FSMountInfo
 		{
@@ -112,16 +328,25 @@ namespace vfs
 		std::unordered_map<dev_t, FSMountInfo> DeviceMap;
 		std::atomic_bool RegisterLock = false;
 
-		FileNode *CacheSearchReturnLast(FileNode *Parent, const char **Path);
+		FileNode *CacheChild(FileNode *Parent, const char *Name, size_t Length, bool *Missing);
+		FileNode *CacheSearchReturnLast(FileNode *Parent, const char **Path, bool *Missing);
 		FileNode *CacheRecursiveSearch(FileNode *Root, const char *NameOrPath, bool IsName);
 		FileNode *CacheLookup(const char *Path);
 		FileNode *CreateCacheNode(FileNode *Parent, Inode *Node, const char *Name, mode_t Mode);
 
 		int RemoveCacheNode(FileNode *Node);
 
+		/**
+		 * Find the directory that holds the last
+		 * component of @p Path and put that component
+		 * in @p Name.
+		 */
+		FileNode *ResolveParent(FileNode *Parent, const char *Path, std::string &Name);
+
 	public:
 		vfsInode *FileSystemRoots = nullptr;
 		std::unordered_map<ino_t, FileNode *> FileRoots;
+		PageCache Cache;
 
 		bool PathIsRelative(const char *Path);
 		bool PathIsAbsolute(const char *Path) { return !PathIsRelative(Path); }
@@ -142,6 +367,14 @@ namespace vfs
 		dev_t RegisterFileSystem(FileSystemInfo *fsi, Inode *Root);
 		int UnregisterFileSystem(dev_t Device);
 
+		/**
+		 * Write cached data and pending filesystem changes back
+		 *
+		 * @param fsi Filesystem to synchronize, all if nullptr
+		 * @param Node Only this inode, the whole filesystem if nullptr
+		 */
+		int Sync(FileSystemInfo *fsi, Inode *Node);
+
 		void AddRoot(Inode *Root);
 		FileNode *GetRoot(size_t Index);
 
@@ -155,18 +388,51 @@ namespace vfs
 		std::string GetByNode(FileNode *Node);
 		FileNode *CreateLink(const char *Path, FileNode *Parent, const char *Target);
 		FileNode *CreateLink(const char *Path, FileNode *Parent, FileNode *Target);
+
+		/** Give @p Target another name, @p Path must be on the same filesystem */
+		int Link(FileNode *Target, FileNode *Parent, const char *Path);
+
+		/**
+		 * Create a node that is not part of any directory,
+		 * like the one behind an epoll instance.
+		 */
+		FileNode *CreateAnonymous(const char *Name, Inode *Node, FileSystemInfo *fsi);
 		bool PathExists(const char *Path, FileNode *Parent);
 
+		/**
+		 * Copy up to @p Size bytes between two files without
+		 * going through user memory.
+		 *
+		 * Both offsets are advanced by the amount copied.
+		 *
+		 * @return Bytes copied, or a negative error if
+		 *         nothing could be copied
+		 */
+		ssize_t Transfer(FileNode *In, off_t &InOffset,
+						 FileNode *Out, off_t &OutOffset, size_t Size);
+
 		int Remove(FileNode *Node);
 
+		/** Rename @p Node inside its directory */
+		int Rename(FileNode *Node, const char *NewName);
+
 		void Initialize();
 		Virtual();
 		~Virtual();
 	};
 
+	class EventPoll;
+
 	class FileDescriptorTable
 	{
 	public:
+		/**
+		 * An open file description.
+		 *
+		 * Created by open() and friends, then shared by every
+		 * descriptor that dup() or fork() made from it, so they
+		 * all see the same offset and status flags.
+		 */
 		struct Fildes
 		{
 			enum FildesType
@@ -174,37 +440,159 @@ namespace vfs
 				FD_INODE,
 				FD_PIPE,
 				FD_SOCKET,
-			} Type;
+				FD_EPOLL,
+				FD_URING,
+			} Type = FD_INODE;
 			mode_t Mode = 0;
+			/** Status flags, O_CLOEXEC belongs to the descriptor */
 			int Flags = 0;
 			FileNode *Node = nullptr;
-			int References = 0;
+			/** Descriptors in all tables and operations in flight */
+			std::atomic_int References = 1;
+			/** Held across reads and writes that use Offset */
+			NewRWSemaphore(OffsetLock);
 			off_t Offset = 0;
+			/** Epoll instances watching this, once for every watch */
+			std::list<EventPoll *> EventPolls;
+
+			Fildes *Get()
+			{
+				References.fetch_add(1);
+				return this;
+			}
+
+			/** Drop a reference, the last one closes the file */
+			void Put();
+		};
+
+		/**
+		 * A reference to a description held for the length
+		 * of an operation, so closing the descriptor from
+		 * another thread can't free it under the operation.
+		 */
+		class FildesRef
+		{
+		private:
+			Fildes *fd = nullptr;
 
-			int operator==(const Fildes &other)
+		public:
+			Fildes *get() const { return fd; }
+			Fildes *operator->() const { return fd; }
+			Fildes &operator*() const { return *fd; }
+			bool operator==(std::nullptr_t) const { return fd == nullptr; }
+
+			FildesRef &operator=(FildesRef &&Other)
+			{
+				std::swap(fd, Other.fd);
+				return *this;
+			}
+
+			FildesRef(FildesRef &&Other) : fd(Other.fd) { Other.fd = nullptr; }
+			FildesRef(const FildesRef &) = delete;
+			explicit FildesRef(Fildes *fd = nullptr) : fd(fd) {}
+
+			~FildesRef()
 			{
-				return Type == other.Type &&
-					   Mode == other.Mode &&
-					   Flags == other.Flags &&
-					   Node == other.Node &&
-					   References == other.References &&
-					   Offset == other.Offset;
+				if (fd)
+					fd->Put();
 			}
 		};
 
+		/**
+		 * Holds the offset lock of one or two descriptions for
+		 * a scope. Only regular files and directories are locked,
+		 * like Linux, a terminal read can block for a long time.
+		 */
+		class OffsetGuard
+		{
+		private:
+			Fildes *First = nullptr;
+			Fildes *Second = nullptr;
+
+		public:
+			OffsetGuard(Fildes &fd, Fildes *Other = nullptr);
+			OffsetGuard(const OffsetGuard &) = delete;
+			~OffsetGuard();
+		};
+
 	private:
 		FileNode *fdDir = nullptr;
 		void *Owner;
 
+		/** Protects the arrays below, threads of a process share the table */
+		NewLock(TableLock);
+		/** Indexed by descriptor, nullptr if it is not open */
+		Fildes **Files = nullptr;
+		/** One bit for each open descriptor */
+		uint64_t *OpenMap = nullptr;
+		/** One bit for each word of OpenMap that has no zero bit */
+		uint64_t *FullMap = nullptr;
+		/** One bit for each descriptor with close-on-exec set */
+		uint64_t *CloseOnExec = nullptr;
+		size_t Capacity = 0;
+		/** Every descriptor below this one is open */
+		size_t NextFree = 0;
+
+		/* TableLock must be held for these */
+		int Expand(size_t Count);
+		Fildes *Lookup(int FileDescriptor);
+		void Install(int FileDescriptor, Fildes *fd, bool Cloexec);
+		Fildes *Uninstall(int FileDescriptor);
+		void Snapshot(std::vector<std::pair<int, Fildes *>> &Open);
+
+		/**
+		 * Install @p fd at the lowest free descriptor.
+		 *
+		 * @return The descriptor or a negative errno,
+		 * the reference is not taken on failure
+		 */
+		int Allocate(Fildes *fd, bool Cloexec);
+
 		int AddFileDescriptor(const char *AbsolutePath, mode_t Mode, int Flags);
 		int RemoveFileDescriptor(int FileDescriptor);
-		int GetFreeFileDescriptor();
 
 	public:
-		std::unordered_map<int, Fildes> FileMap;
+		/** @return A reference to the open descriptor or nullptr */
+		FildesRef GetDescriptor(int FileDescriptor);
+
+		/**
+		 * Call @p Callback(int, Fildes &) for every open descriptor, lowest first.
+		 *
+		 * @note Works on a snapshot, the table is not locked
+		 * while @p Callback runs.
+		 */
+		template <typename Fn>
+		void ForEach(Fn Callback)
+		{
+			std::vector<std::pair<int, Fildes *>> open;
+			{
+				SmartLock(this->TableLock);
+				this->Snapshot(open);
+			}
+
+			for (auto &it : open)
+			{
+				Callback(it.first, *it.second);
+				it.second->Put();
+			}
+		}
 
 		int GetFlags(int FileDescriptor);
 		int SetFlags(int FileDescriptor, int Flags);
+
+		/** @return O_CLOEXEC, 0 or a negative errno */
+		int GetDescriptorFlags(int FileDescriptor);
+		/** Only O_CLOEXEC can be set */
+		int SetDescriptorFlags(int FileDescriptor, int Flags);
+
+		/**
+		 * Install a descriptor for a node that has no path.
+		 *
+		 * @param Name Target of the /proc/<pid>/fd link
+		 * @return The new file descriptor or a negative errno
+		 */
+		int AddAnonymousDescriptor(FileNode *Node, Fildes::FildesType Type,
+								   int Flags, const char *Name);
 		void Fork(FileDescriptorTable *Parent);
 
 		int usr_open(const char *pathname, int flags, mode_t mode);
@@ -219,9 +607,17 @@ namespace vfs
 		int usr_dup(int oldfd);
 		int usr_dup2(int oldfd, int newfd);
 		int usr_ioctl(int fd, unsigned long request, void *argp);
+		int usr_pipe(int pipefd[2], int flags);
+		ssize_t usr_readv(int fd, const struct kiovec *iov, int iovcnt, bool NonBlocking = false);
+		ssize_t usr_writev(int fd, const struct kiovec *iov, int iovcnt, bool NonBlocking = false);
+		ssize_t usr_preadv(int fd, const struct kiovec *iov, int iovcnt, off_t offset, bool NonBlocking = false);
+		ssize_t usr_pwritev(int fd, const struct kiovec *iov, int iovcnt, off_t offset, bool NonBlocking = false);
+		ssize_t usr_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+		ssize_t usr_copy_file_range(int fd_in, off_t *off_in, int fd_out,
+									off_t *off_out, size_t len, unsigned int flags);
 
 		FileDescriptorTable(void *Owner);
-		~FileDescriptorTable() = default;
+		~FileDescriptorTable();
 	};
 }
 
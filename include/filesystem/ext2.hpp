@@ -21,6 +21,8 @@
 #include <types.h>
 
 #include <filesystem.hpp>
+#include <functional>
+#include <mutex>
 
 namespace vfs
 {
@@ -83,9 +85,197 @@ namespace vfs
 			uint32_t Reserved[190];
 		};
 
-		EXT2(void *partition);
+		struct GroupDescriptor
+		{
+			uint32_t BlockBitmap;
+			uint32_t InodeBitmap;
+			uint32_t InodeTable;
+			uint16_t FreeBlocks;
+			uint16_t FreeInodes;
+			uint16_t Directories;
+			uint16_t Padding;
+			uint32_t Reserved[3];
+		};
+
+		struct DiskInode
+		{
+			uint16_t Mode;
+			uint16_t UserID;
+			uint32_t Size;
+			uint32_t AccessTime;
+			uint32_t ChangeTime;
+			uint32_t ModifyTime;
+			uint32_t DeleteTime;
+			uint16_t GroupID;
+			uint16_t Links;
+			/** In 512 byte units, indirect blocks included */
+			uint32_t Sectors;
+			uint32_t Flags;
+			uint32_t OSD1;
+			uint32_t Block[15];
+			uint32_t Generation;
+			uint32_t FileACL;
+			/** Upper 32 bits of Size for regular files */
+			uint32_t SizeHigh;
+			uint32_t FragmentAddress;
+			uint8_t OSD2[12];
+		};
+
+		struct DirectoryEntry
+		{
+			uint32_t Inode;
+			uint16_t RecordLength;
+			uint8_t NameLength;
+			uint8_t FileType;
+			char Name[];
+		};
+
+		constexpr static uint16_t MAGIC = 0xEF53;
+		constexpr static uint32_t ROOT_INODE = 2;
+		constexpr static int DIRECT_BLOCKS = 12;
+
+		constexpr static uint32_t INCOMPAT_FILETYPE = 0x2;
+		constexpr static uint32_t RO_COMPAT_SPARSE_SUPER = 0x1;
+		constexpr static uint32_t RO_COMPAT_LARGE_FILE = 0x2;
+
+		struct EXT2Inode
+		{
+			struct Inode Node{};
+			DiskInode Raw{};
+		};
+
+	private:
+		/** A metadata block in memory */
+		struct Buffer
+		{
+			uint32_t Block = 0;
+			uint8_t *Data = nullptr;
+			bool Dirty = false;
+			/** Held buffers are not evicted */
+			int References = 0;
+			Buffer *Older = nullptr;
+			Buffer *Newer = nullptr;
+		};
+
+		/** Buffers kept before the oldest unused one is evicted */
+		constexpr static size_t MAX_BUFFERS = 256;
+
+		/** Taken by every operation, I/O included */
+		std::mutex Lock;
+
+		FileNode *Device = nullptr;
+		SuperBlock Super{};
+		GroupDescriptor *Groups = nullptr;
+		size_t GroupCount = 0;
+		bool SuperDirty = false;
+
+		size_t BlockSize = 0;
+		size_t InodeSize = 0;
+		uint32_t FirstInode = 0;
+		bool ReadOnly = false;
+
+		std::unordered_map<uint32_t, EXT2Inode *> Inodes;
+		std::unordered_map<uint32_t, Buffer *> Buffers;
+		Buffer *Oldest = nullptr;
+		Buffer *Newest = nullptr;
+
+		int DeviceRead(uint32_t Block, void *Data);
+		int DeviceWrite(uint32_t Block, const void *Data);
+
+		/**
+		 * Get @p Block from the buffer cache, it stays
+		 * in memory until it is given back with PutBuffer().
+		 *
+		 * @param Read Read the block from the disk if it is
+		 *             not cached, the caller fills it otherwise
+		 */
+		Buffer *GetBuffer(uint32_t Block, bool Read = true);
+		void PutBuffer(Buffer *b, bool Dirty);
+		/** Forget @p Block, it was freed */
+		void DropBuffer(uint32_t Block);
+		int WriteBuffer(Buffer *b);
+		int FlushBuffers();
+
+		uint32_t GroupOfBlock(uint32_t Block);
+		size_t BlocksInGroup(size_t Group);
+		uint32_t AllocateBlock(uint32_t Goal);
+		void FreeBlock(uint32_t Block);
+		uint32_t AllocateInode(uint32_t Parent, bool Directory);
+		void FreeInode(uint32_t Number, bool Directory);
+
+		EXT2Inode *GetInode(uint32_t Number);
+		void StoreInode(EXT2Inode *Node);
+		off_t GetSize(EXT2Inode *Node);
+		void SetSize(EXT2Inode *Node, off_t Size);
+
+		/**
+		 * Find the disk block of @p Logical
+		 *
+		 * @param Goal Block to allocate near, if it is missing
+		 * @return 0 for a hole, or if allocation failed
+		 *         and @p Error was set
+		 */
+		uint32_t MapBlock(EXT2Inode *Node, uint32_t Logical, bool Create, uint32_t Goal, int *Error);
+		bool FreeTree(EXT2Inode *Node, uint32_t Block, int Level, uint64_t Base, uint64_t From);
+		void FreeBlocksFrom(EXT2Inode *Node, uint64_t From);
+
+		/**
+		 * Move data between the file and @p Vector. Blocks that
+		 * follow each other on the disk go in one device request.
+		 */
+		ssize_t Transfer(EXT2Inode *Node, const struct kiovec *Vector, int Count, off_t Offset, bool Write);
+
+		using EntryCallback = std::function<bool(DirectoryEntry *Entry, DirectoryEntry *Previous, bool &Dirty)>;
+		int ForEachEntry(EXT2Inode *Directory, EntryCallback Callback);
+		uint32_t FindEntry(EXT2Inode *Directory, const char *Name, size_t Length);
+		int AddEntry(EXT2Inode *Directory, const char *Name, EXT2Inode *Node);
+		int RemoveEntry(EXT2Inode *Directory, const char *Name);
+		bool IsEmpty(EXT2Inode *Directory);
+
+		int NewInode(EXT2Inode *Parent, const char *Name, mode_t Mode, EXT2Inode **Result);
+		int Unlink(EXT2Inode *Parent, const char *Name, bool Directory, bool AnyType);
+		void Release(EXT2Inode *Node);
+		int Sync();
+
+	public:
+		dev_t DeviceID = -1;
+		FileSystemInfo *Info = nullptr;
+
+		int Lookup(struct Inode *Parent, const char *Name, struct Inode **Result);
+		int Create(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result);
+		int Remove(struct Inode *Parent, const char *Name);
+		int Rename(struct Inode *Parent, const char *OldName, const char *NewName);
+		ssize_t Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset);
+		ssize_t Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset);
+		int Truncate(struct Inode *Node, off_t Size);
+		ssize_t ReadDir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries);
+		int MkDir(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result);
+		int RmDir(struct Inode *Parent, const char *Name);
+		int SymLink(struct Inode *Parent, const char *Name, const char *Target, struct Inode **Result);
+		ssize_t ReadLink(struct Inode *Node, char *Buffer, size_t Size);
+		int Stat(struct Inode *Node, struct kstat *Stat);
+		int Link(struct Inode *Parent, const char *Name, struct Inode *Target);
+		ssize_t ReadV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset);
+		ssize_t WriteV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset);
+		int Synchronize(struct Inode *Node);
+
+		/** Read the superblock and group descriptors */
+		int Initialize();
+		bool IsReadOnly() { return ReadOnly; }
+		size_t GetBlockSize() { return BlockSize; }
+		size_t GetBlockCount() { return Super.Blocks; }
+
+		/** Write the dirty metadata of every mounted ext2 filesystem */
+		static void WritebackThread();
+
+		EXT2(FileNode *Device);
 		~EXT2();
 	};
 }
 
+/**
+ * @brief Mount @p Device at @p Path if it holds an ext2 filesystem
+ */
+bool TestAndInitializeEXT2(FileNode *Device, const char *Path);
+
 #endif // !__FENNIX_KERNEL_FILESYSTEM_EXT2_H__
@@ -0,0 +1,136 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_FILESYSTEM_TMPFS_H__
+#define __FENNIX_KERNEL_FILESYSTEM_TMPFS_H__
+
+#include <filesystem.hpp>
+#include <radix.hpp>
+
+namespace vfs
+{
+	/**
+	 * @brief Writable filesystem that lives only in memory.
+	 *
+	 * File data is kept in whole pages indexed by a radix tree,
+	 * pages that were never written are holes and read as zeros.
+	 */
+	class TmpFS
+	{
+	public:
+		constexpr static size_t MaxNameLength = 255;
+
+		struct TmpInode;
+
+		struct DirEntry
+		{
+			std::string Name;
+			/** DentryCache::HashName() of Name */
+			uint64_t Hash = 0;
+			TmpInode *Node = nullptr;
+			DirEntry *NextHash = nullptr;
+		};
+
+		struct TmpInode
+		{
+			struct Inode Node{};
+			/** Only set for directories */
+			TmpInode *Parent = nullptr;
+			nlink_t Links = 0;
+			off_t Size = 0;
+			uid_t UserID = 0;
+			gid_t GroupID = 0;
+
+			/** Data of regular files, one page per index */
+			RadixTree<uint8_t> Pages;
+			size_t PageCount = 0;
+
+			/** Children of directories, in creation order */
+			std::vector<DirEntry *> Entries{};
+			DirEntry **Buckets = nullptr;
+			size_t BucketCount = 0;
+
+			/** Target of symbolic links */
+			std::string Target{};
+		};
+
+	private:
+		NewRWLock(Lock);
+
+		/** Bytes the file data may use */
+		size_t Limit = 0;
+		size_t Used = 0;
+
+		ino_t NextInode = 0;
+		TmpInode *Root = nullptr;
+		/** Every inode, they are only freed with the filesystem */
+		std::vector<TmpInode *> Inodes;
+
+		TmpInode *NewInode(TmpInode *Parent, mode_t Mode);
+		DirEntry *FindEntry(TmpInode *Directory, const char *Name, size_t Length);
+		void AddEntry(TmpInode *Directory, const char *Name, TmpInode *Node);
+		void UnhashEntry(TmpInode *Directory, DirEntry *Entry);
+		void HashEntry(TmpInode *Directory, DirEntry *Entry);
+		void RemoveEntry(TmpInode *Directory, DirEntry *Entry);
+
+		/** Free the pages at @p From and above */
+		void FreePages(TmpInode *Node, uint64_t From);
+
+		/** Drop the data of @p Node once the last link is gone */
+		void Release(TmpInode *Node);
+
+		int NewChild(struct Inode *Parent, const char *Name, mode_t Mode, TmpInode **Result);
+		int RemoveChild(struct Inode *Parent, const char *Name, bool Directory);
+
+	public:
+		dev_t DeviceID = -1;
+
+		int Lookup(struct Inode *Parent, const char *Name, struct Inode **Result);
+		int Create(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result);
+		int Remove(struct Inode *Parent, const char *Name);
+		int Rename(struct Inode *Parent, const char *OldName, const char *NewName);
+		ssize_t Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset);
+		ssize_t Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset);
+		int Truncate(struct Inode *Node, off_t Size);
+		ssize_t ReadDir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries);
+		int MkDir(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result);
+		int RmDir(struct Inode *Parent, const char *Name);
+		int SymLink(struct Inode *Parent, const char *Name, const char *Target, struct Inode **Result);
+		ssize_t ReadLink(struct Inode *Node, char *Buffer, size_t Size);
+		int Stat(struct Inode *Node, struct kstat *Stat);
+		int Link(struct Inode *Parent, const char *Name, struct Inode *Target);
+
+		Inode *GetRoot() { return &Root->Node; }
+		size_t GetUsed() { return Used; }
+
+		/**
+		 * @param Limit Bytes of file data the filesystem
+		 *              may hold, 0 for no limit
+		 */
+		TmpFS(size_t Limit);
+		~TmpFS();
+	};
+}
+
+/**
+ * @brief Create a tmpfs and mount it at @p Path
+ *
+ * @param Limit Bytes of file data it may hold, 0 for half of the memory
+ */
+FileNode *MountTmpFS(const char *Path, size_t Limit);
+
+#endif // !__FENNIX_KERNEL_FILESYSTEM_TMPFS_H__
@@ -87,10 +87,46 @@ namespace vfs
 			std::vector<USTARInode *> Children;
 			bool Deleted;
 			int Checksum;
+
+			/** Hash index of Children, see IndexChild() */
+			USTARInode **Buckets = nullptr;
+			size_t BucketCount = 0;
+			size_t Indexed = 0;
+			/** DentryCache::HashName() of Name */
+			uint64_t Hash = 0;
+			USTARInode *NextHash = nullptr;
+
+			/** Headers of children not created yet, see Materialize() */
+			std::vector<FileHeader *> Pending{};
+			std::atomic_bool HasPending = false;
 		};
 
 	private:
 		std::unordered_map<ino_t, USTARInode *> Files;
+		USTARInode *Root = nullptr;
+
+		/* Taken while entries are created after the archive was read */
+		NewLock(IndexLock);
+		/** Directories by path, only while the archive is indexed */
+		std::unordered_map<uint64_t, USTARInode *> Directories;
+		size_t Deferred = 0;
+
+		void IndexChild(USTARInode *Parent, USTARInode *Child);
+		USTARInode *FindChild(USTARInode *Parent, const char *Name, size_t Length);
+
+		void SetMode(struct Inode &uNode, FileHeader *header);
+		USTARInode *NewNode(FileHeader *header);
+		void Attach(USTARInode *Parent, USTARInode *Child);
+		USTARInode *FindDirectory(const char *Path, size_t Length);
+
+		/** Create the children of @p Directory that were deferred */
+		void Materialize(USTARInode *Directory);
+
+		/**
+		 * Create only the directories of the archive,
+		 * the files in them are created on first use.
+		 */
+		void IndexArchive(uintptr_t Address, size_t Size);
 
 		inline uint32_t GetSize(const char *String)
 		{
@@ -122,10 +158,15 @@ namespace vfs
 		ssize_t ReadDir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries);
 		int SymLink(struct Inode *Node, const char *Name, const char *Target, struct Inode **Result);
 		ssize_t ReadLink(struct Inode *Node, char *Buffer, size_t Size);
+		ssize_t MapData(struct Inode *Node, off_t Offset, const void **Data);
+		ssize_t ReadV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset);
 		int Stat(struct Inode *Node, struct kstat *Stat);
 
 		bool TestArchive(uintptr_t Address);
-		void ReadArchive(uintptr_t Address, size_t Size);
+		void ReadArchive(uintptr_t Address, size_t Size, bool Lazy);
+
+		/** Entries of the archive that were not created yet */
+		size_t GetDeferred() { return Deferred; }
 
 		USTAR(){};
 		~USTAR(){};
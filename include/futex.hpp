@@ -0,0 +1,95 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_FUTEX_H__
+#define __FENNIX_KERNEL_FUTEX_H__
+
+#include <types.h>
+
+/**
+ * Fast userspace mutexes
+ *
+ * Waiters are kept in a hash table of queues keyed by the
+ * physical address of the futex word, so the same futex
+ * mapped in different processes (or at different addresses)
+ * is the same key.
+ *
+ * All addresses passed here are kernel accessible addresses
+ * of the futex word, as returned by UserCheckAndGetAddress().
+ *
+ * Errors are returned as negative errno values.
+ */
+namespace Futex
+{
+	/* Layout of a PI futex word */
+	constexpr uint32_t Waiters = 0x80000000;
+	constexpr uint32_t OwnerDied = 0x40000000;
+	constexpr uint32_t TIDMask = 0x3fffffff;
+
+	constexpr uint32_t BitsetMatchAny = 0xffffffff;
+
+	/**
+	 * Sleep if *Address is still @p Expected.
+	 *
+	 * @param Timeout Relative timeout in nanoseconds, 0 waits forever.
+	 * @return 0 when woken up, -EAGAIN if the value changed,
+	 * -ETIMEDOUT or -EINTR
+	 */
+	int Wait(uint32_t *Address, uint32_t Expected,
+			 uint64_t Timeout, uint32_t Bitset = BitsetMatchAny);
+
+	/**
+	 * Wake up to @p Count waiters whose bitset
+	 * intersects @p Bitset.
+	 *
+	 * @return Number of woken waiters
+	 */
+	int Wake(uint32_t *Address, int Count,
+			 uint32_t Bitset = BitsetMatchAny);
+
+	/**
+	 * Wake up to @p WakeCount waiters and move up to
+	 * @p RequeueCount of the rest to @p Target.
+	 *
+	 * @param Expected If not null, fail with -EAGAIN
+	 * unless *Address is equal to *Expected.
+	 * @return Number of woken and requeued waiters
+	 */
+	int Requeue(uint32_t *Address, uint32_t *Target,
+				int WakeCount, int RequeueCount,
+				const uint32_t *Expected = nullptr);
+
+	/**
+	 * Atomically apply the encoded operation to *Target, wake
+	 * @p Count waiters on @p Address and, if the old value of
+	 * *Target matches the encoded comparison, @p Count2 on
+	 * @p Target.
+	 */
+	int WakeOp(uint32_t *Address, uint32_t *Target,
+			   int Count, int Count2, uint32_t Op);
+
+	/**
+	 * Priority inheritance lock. The owner is boosted to
+	 * the priority of the waiters until it unlocks, and the
+	 * lock is handed to the first waiter in FIFO order.
+	 */
+	int LockPI(uint32_t *Address, uint64_t Timeout);
+	int TryLockPI(uint32_t *Address);
+	int UnlockPI(uint32_t *Address);
+}
+
+#endif // !__FENNIX_KERNEL_FUTEX_H__
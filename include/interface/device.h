@@ -72,4 +72,45 @@ typedef enum
 EXTERNC dev_t RegisterDevice(DeviceType Type, const struct InodeOperations *Operations);
 EXTERNC int UnregisterDevice(dev_t Device);
 
+/**
+ * A transfer the kernel asks a block driver to do.
+ * Adjacent requests were already merged by the kernel.
+ */
+struct BlockRequest
+{
+	/** First sector */
+	uint64_t Sector;
+	/** Sectors to transfer */
+	size_t Count;
+	/** Memory to transfer, Count sectors in total */
+	const struct kiovec *Vector;
+	int VectorCount;
+	int Write;
+
+	/** Owned by the kernel, do not change */
+	void *KernelData;
+};
+
+struct BlockOperations
+{
+	/** Size of a sector in bytes */
+	size_t SectorSize;
+	/** Sectors on the disk */
+	uint64_t Sectors;
+	/** Requests the driver can have in flight at once */
+	int QueueDepth;
+
+	/**
+	 * Start @p Request on @p Device, the value RegisterBlockDevice
+	 * returned. Call CompleteBlockRequest() once it is done, the
+	 * interrupt handler may do that.
+	 *
+	 * @return 0 if the request was started
+	 */
+	int (*Submit)(dev_t Device, struct BlockRequest *Request);
+};
+
+EXTERNC dev_t RegisterBlockDevice(DeviceType Type, const struct BlockOperations *Operations);
+EXTERNC void CompleteBlockRequest(struct BlockRequest *Request, int Status);
+
 #endif // !__FENNIX_API_DEVICE_H__
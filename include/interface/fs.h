@@ -102,9 +102,30 @@
 #define O_EXCL 0200
 #define O_TRUNC 01000
 #define O_APPEND 02000
+#define O_NONBLOCK 04000
+#define O_DIRECT 040000
 #define O_NOFOLLOW 0400000
 #define O_CLOEXEC 02000000
 
+/** There is data to read */
+#define POLLIN 0x001
+/** There is urgent data to read */
+#define POLLPRI 0x002
+/** Writing now will not block */
+#define POLLOUT 0x004
+/** Error condition (output only) */
+#define POLLERR 0x008
+/** Hung up (output only) */
+#define POLLHUP 0x010
+/** Invalid file descriptor (output only) */
+#define POLLNVAL 0x020
+#define POLLRDNORM 0x040
+#define POLLRDBAND 0x080
+#define POLLWRNORM 0x100
+#define POLLWRBAND 0x200
+/** The other end shut down writing */
+#define POLLRDHUP 0x2000
+
 #define S_ISDIR(mode) (((mode) & S_IFMT) == S_IFDIR)
 #define S_ISCHR(mode) (((mode) & S_IFMT) == S_IFCHR)
 #define S_ISBLK(mode) (((mode) & S_IFMT) == S_IFBLK)
@@ -251,6 +272,13 @@ struct kdirent
 	char d_name[];
 };
 
+/** One buffer of a scatter-gather list */
+struct kiovec
+{
+	void *iov_base;
+	size_t iov_len;
+};
+
 struct Inode
 {
 	dev_t Device, RawDevice;
@@ -330,11 +358,71 @@ struct InodeOperations
 	ssize_t (*ReadLink)(struct Inode *Node, char *Buffer, size_t Size);
 	off_t (*Seek)(struct Inode *Node, off_t Offset);
 	int (*Stat)(struct Inode *Node, struct kstat *Stat);
+
+	/**
+	 * Check which of @p Events are ready without blocking.
+	 *
+	 * When the state changes later, the filesystem or driver
+	 * must call ReportPollEvent() so sleeping waiters
+	 * can check again.
+	 *
+	 * If NULL, the node is always readable and writable.
+	 *
+	 * @return Mask of ready POLL* events
+	 */
+	short (*Poll)(struct Inode *Node, short Events);
+
+	/**
+	 * Get a pointer to the data at @p Offset, for
+	 * filesystems that keep whole files in memory.
+	 *
+	 * Lets in-kernel transfers like sendfile() copy
+	 * straight from the file instead of reading it
+	 * into a buffer first.
+	 *
+	 * If NULL, the data can only be read with Read.
+	 *
+	 * @return Number of bytes available at @p Data,
+	 *         0 at end of file
+	 */
+	ssize_t (*MapData)(struct Inode *Node, off_t Offset, const void **Data);
+
+	/**
+	 * Read into @p Count buffers, starting at @p Offset,
+	 * as one operation.
+	 *
+	 * If NULL, Read is called once for each buffer.
+	 *
+	 * @return Total bytes read
+	 */
+	ssize_t (*ReadV)(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset);
+
+	/**
+	 * Write from @p Count buffers, starting at @p Offset,
+	 * as one operation.
+	 *
+	 * If NULL, Write is called once for each buffer.
+	 *
+	 * @return Total bytes written
+	 */
+	ssize_t (*WriteV)(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset);
+
+	/**
+	 * Add @p Name in @p Parent as another name
+	 * of @p Target, both on this filesystem.
+	 *
+	 * If NULL, hard links are not supported.
+	 */
+	int (*Link)(struct Inode *Parent, const char *Name, struct Inode *Target);
 } __attribute__((packed));
 
 #define I_FLAG_ROOT 0x1
 #define I_FLAG_MOUNTPOINT 0x2
 #define I_FLAG_CACHE_KEEP 0x4
+/** Entries can appear without going through the VFS, misses are not cached */
+#define I_FLAG_VOLATILE 0x8
+/** Regular file data goes through the page cache, Stat must report the size */
+#define I_FLAG_PAGE_CACHE 0x10
 
 struct FileSystemInfo;
 struct SuperBlockOperations
@@ -379,4 +467,11 @@ struct FileSystemInfo
 dev_t RegisterFileSystem(struct FileSystemInfo *Info, struct Inode *Root);
 int UnregisterFileSystem(dev_t Device);
 
+/**
+ * Wake up everyone polling @p Node for any of @p Events.
+ *
+ * Safe to call from interrupt handlers.
+ */
+int ReportPollEvent(struct Inode *Node, short Events);
+
 #endif // !__FENNIX_API_FILESYSTEM_H__
@@ -108,6 +108,7 @@ namespace KernelConsole
 		ssize_t Read(void *Buffer, size_t Size, off_t Offset) final;
 		ssize_t Write(const void *Buffer, size_t Size, off_t Offset) final;
 		int Ioctl(unsigned long Request, void *Argp) final;
+		short Poll(short Events) final;
 
 		void Clear(unsigned short StartX, unsigned short StartY, unsigned short EndX, unsigned short EndY);
 		void Scroll(unsigned short Lines);
@@ -40,6 +40,7 @@ struct KernelConfig
 	bool UnlockDeadLock;
 	bool SIMD;
 	bool Quiet;
+	bool LazyInitrd;
 };
 
 void ParseConfig(char *ConfigString, KernelConfig *ModConfig);
@@ -25,6 +25,11 @@
 
 #ifdef __cplusplus
 
+namespace Tasking
+{
+	class TCB;
+}
+
 /* Enabled ONLY on crash. */
 extern bool ForceUnlock;
 
@@ -35,6 +40,41 @@ extern bool ForceUnlock;
  */
 size_t GetLocksCount();
 
+/**
+ * Lock contention statistics.
+ *
+ * Off by default, the "lockstat" kshell command turns it on.
+ * Locks are tracked per instance, times are in CPU::Counter()
+ * (TSC) cycles.
+ */
+namespace LockStat
+{
+	struct Entry
+	{
+		std::atomic<const void *> Lock = nullptr;
+		std::atomic<const char *> Name = nullptr;
+		/** Last call-site that had to wait */
+		std::atomic<const char *> Site = nullptr;
+		std::atomic_uint64_t Acquisitions = 0;
+		std::atomic_uint64_t Contended = 0;
+		std::atomic_uint64_t WaitTotal = 0;
+		std::atomic_uint64_t WaitMax = 0;
+		std::atomic_uint64_t HoldTotal = 0;
+	};
+
+	extern bool Enabled;
+
+	/** @return The current counter, to be passed to Released() */
+	uint64_t Acquired(const void *Lock, const char *Name, const char *Site,
+					  uint64_t Start, bool Contended);
+	void Released(const void *Lock, uint64_t AcquiredAt);
+
+	Entry *GetEntries(size_t &Count);
+	/** Locks that didn't fit in the table */
+	size_t GetDropped();
+	void Reset();
+}
+
 /** @brief Please use this macro to create a new lock. */
 class LockClass
 {
@@ -54,6 +94,8 @@ private:
 	SpinLockData LockData;
 	std::atomic_bool IsLocked = false;
 	std::atomic_ulong DeadLocks = 0;
+	const char *Name;
+	uint64_t StatAcquiredAt = 0;
 
 	void DeadLock(SpinLockData &Lock);
 	void TimeoutDeadLock(SpinLockData &Lock, uint64_t Timeout);
@@ -66,6 +108,167 @@ public:
 	int Unlock();
 
 	int TimeoutLock(const char *FunctionName, uint64_t Timeout);
+
+	const char *GetName() { return Name; }
+	LockClass(const char *Name = "(anon)") : Name(Name) {}
+};
+
+/**
+ * @brief Reader-writer spin lock.
+ *
+ * Any number of readers can hold the lock at the same time,
+ * writers get exclusive access. Writers have priority over
+ * new readers so they can't be starved by a constant stream
+ * of lookups.
+ *
+ * @note The lock is not recursive. Taking a read lock while
+ * already holding it can deadlock if a writer is waiting.
+ *
+ * @note Please use NewRWLock to create a new lock.
+ */
+class RWLockClass
+{
+private:
+	/* Bit 63: writer holds the lock.
+	   Bit 62: writer is waiting.
+	   The rest: number of readers. */
+	std::atomic_uint64_t State = 0;
+	std::atomic<const char *> CurrentWriter = "(nul)";
+	std::atomic<const char *> AttemptingToGet = "(nul)";
+	std::atomic_ulong DeadLocks = 0;
+	const char *Name;
+	uint64_t StatAcquiredAt = 0;
+
+	void DeadLock(const char *FunctionName, bool Write);
+	void Yield();
+
+public:
+	static constexpr uint64_t WriterBit = 1ULL << 63;
+	static constexpr uint64_t WaitingBit = 1ULL << 62;
+	static constexpr uint64_t ReadersMask = WaitingBit - 1;
+
+	bool Locked() { return (State.load() & ~WaitingBit) != 0; }
+	bool WriteLocked() { return State.load() & WriterBit; }
+	size_t Readers() { return State.load() & ReadersMask; }
+
+	bool TryReadLock();
+	bool TryWriteLock();
+
+	/* Keep new readers out until a writer gets the lock */
+	void WriterWaiting() { State.fetch_or(WaitingBit, std::memory_order_relaxed); }
+
+	int ReadLock(const char *FunctionName);
+	int ReadUnlock();
+	int WriteLock(const char *FunctionName);
+	int WriteUnlock();
+
+	const char *GetName() { return Name; }
+	RWLockClass(const char *Name = "(anon)") : Name(Name) {}
+};
+
+/**
+ * @brief Sleeping reader-writer semaphore.
+ *
+ * Same semantics as RWLockClass but threads that can't
+ * get the lock are blocked instead of spinning. Use it
+ * for sections that can take a long time or sleep.
+ *
+ * @note Falls back to spinning if the scheduler is not
+ * running yet.
+ */
+class RWSemaphoreClass
+{
+private:
+	struct Waiter
+	{
+		Tasking::TCB *Thread;
+		Waiter *Next;
+	};
+
+	RWLockClass rw;
+	LockClass WaitLock;
+	Waiter *WaitHead = nullptr;
+	Waiter *WaitTail = nullptr;
+
+	void Sleep(const char *FunctionName, bool Write);
+	void WakeUp();
+
+public:
+	bool Locked() { return rw.Locked(); }
+	bool WriteLocked() { return rw.WriteLocked(); }
+	size_t Readers() { return rw.Readers(); }
+
+	bool TryReadLock() { return rw.TryReadLock(); }
+	bool TryWriteLock() { return rw.TryWriteLock(); }
+
+	int ReadLock(const char *FunctionName);
+	int ReadUnlock();
+	int WriteLock(const char *FunctionName);
+	int WriteUnlock();
+
+	RWSemaphoreClass(const char *Name = "(anon)")
+		: rw(Name), WaitLock(Name) {}
+};
+
+/**
+ * @brief Sequence lock.
+ *
+ * Writers are serialized by a spin lock and bump the
+ * sequence number before and after the update. Readers
+ * never write to shared memory, they just retry if the
+ * sequence changed while they were reading:
+ *
+ * @code
+ * uint64_t seq;
+ * do
+ * {
+ *     seq = Lock.ReadBegin();
+ *     ...copy the data...
+ * } while (Lock.ReadRetry(seq));
+ * @endcode
+ *
+ * @note Readers must not follow pointers that a writer
+ * can free.
+ */
+class SeqLockClass
+{
+private:
+	std::atomic_uint64_t Sequence = 0;
+	LockClass WriterLock;
+
+public:
+	SeqLockClass(const char *Name = "(anon)") : WriterLock(Name) {}
+
+	bool Locked() { return WriterLock.Locked(); }
+	uint64_t GetSequence() { return Sequence.load(std::memory_order_acquire); }
+
+	uint64_t ReadBegin()
+	{
+		uint64_t seq;
+		while ((seq = Sequence.load(std::memory_order_acquire)) & 1)
+			CPU::Pause();
+		return seq;
+	}
+
+	bool ReadRetry(uint64_t Start)
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return Sequence.load(std::memory_order_relaxed) != Start;
+	}
+
+	int WriteLock(const char *FunctionName)
+	{
+		WriterLock.Lock(FunctionName);
+		Sequence.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		return 0;
+	}
+
+	int WriteUnlock()
+	{
+		Sequence.fetch_add(1, std::memory_order_release);
+		return WriterLock.Unlock();
+	}
 };
 
 class spin_lock
@@ -133,6 +336,45 @@ public:
 	~SmartLockClass() { this->LockPointer->Unlock(); }
 };
 
+/**
+ * Shared lock guard for RWLockClass and RWSemaphoreClass.
+ */
+template <class RW>
+class SmartReadLockClass
+{
+private:
+	RW *LockPointer = nullptr;
+
+public:
+	SmartReadLockClass(RW &Lock, const char *FunctionName)
+	{
+		this->LockPointer = &Lock;
+		this->LockPointer->ReadLock(FunctionName);
+	}
+
+	~SmartReadLockClass() { this->LockPointer->ReadUnlock(); }
+};
+
+/**
+ * Exclusive lock guard for RWLockClass,
+ * RWSemaphoreClass and SeqLockClass.
+ */
+template <class RW>
+class SmartWriteLockClass
+{
+private:
+	RW *LockPointer = nullptr;
+
+public:
+	SmartWriteLockClass(RW &Lock, const char *FunctionName)
+	{
+		this->LockPointer = &Lock;
+		this->LockPointer->WriteLock(FunctionName);
+	}
+
+	~SmartWriteLockClass() { this->LockPointer->WriteUnlock(); }
+};
+
 class SmartTimeoutLockClass
 {
 private:
@@ -213,7 +455,16 @@ public:
  *
  * @note Can be used with SmartCriticalSection
  */
-#define NewLock(Name) LockClass Name
+#define NewLock(Name) LockClass Name{#Name}
+
+/** Create a new reader-writer spin lock */
+#define NewRWLock(Name) RWLockClass Name{#Name}
+
+/** Create a new sleeping reader-writer semaphore */
+#define NewRWSemaphore(Name) RWSemaphoreClass Name{#Name}
+
+/** Create a new sequence lock */
+#define NewSeqLock(Name) SeqLockClass Name{#Name}
 
 /**
  * Simple lock that is automatically released
@@ -234,6 +485,24 @@ public:
 								 __FUNCTION__,   \
 								 Timeout)
 
+/**
+ * Shared (read) lock that is automatically
+ * released when the scope ends.
+ */
+#define SmartReadLock(LockClassName)                \
+	SmartReadLockClass                              \
+	CONCAT(rdlock##_, __COUNTER__)(LockClassName,   \
+								   __FUNCTION__)
+
+/**
+ * Exclusive (write) lock that is automatically
+ * released when the scope ends.
+ */
+#define SmartWriteLock(LockClassName)               \
+	SmartWriteLockClass                             \
+	CONCAT(wrlock##_, __COUNTER__)(LockClassName,   \
+								   __FUNCTION__)
+
 /**
  * Simple critical section that is
  * automatically released when the scope ends
@@ -55,6 +55,8 @@ namespace Memory
 		std::list<AllocatedPages> AllocatedPagesList;
 		std::list<SharedRegion> SharedRegions;
 
+		void *UserPage(uintptr_t Page, bool Write);
+
 	public:
 		PageTable *Table = nullptr;
 		uint64_t GetAllocatedMemorySize();
@@ -113,6 +115,45 @@ namespace Memory
 			return __UserCheck((void *)Address, Length);
 		}
 
+		/**
+		 * Copy from or to user memory, one page at a time,
+		 * so buffers that span discontiguous frames work.
+		 *
+		 * @return 0 or -EFAULT if a page is not accessible
+		 */
+		int CopyFromUser(void *Destination, const void *Source, size_t Length);
+		int CopyToUser(void *Destination, const void *Source, size_t Length);
+
+		/**
+		 * Copy a null-terminated user string of at most @p Size bytes
+		 *
+		 * @return The string length, @p Size if it was not
+		 * terminated, or -EFAULT
+		 */
+		ssize_t StrncpyFromUser(char *Destination, const char *Source, size_t Size);
+
+		/**
+		 * Translate a user buffer into kernel segments,
+		 * physically contiguous pages are merged.
+		 *
+		 * @return Number of segments, -EFAULT, or -E2BIG
+		 * if more than @p Max segments are needed
+		 */
+		int UserSegments(const void *Address, size_t Length, bool Write,
+						 struct kiovec *Vector, int Max);
+
+		template <typename T>
+		int CopyFromUser(T *Destination, const T *Source)
+		{
+			return CopyFromUser((void *)Destination, (const void *)Source, sizeof(T));
+		}
+
+		template <typename T>
+		int CopyToUser(T *Destination, const T *Source)
+		{
+			return CopyToUser((void *)Destination, (const void *)Source, sizeof(T));
+		}
+
 		VirtualMemoryArea(PageTable *Table);
 		~VirtualMemoryArea();
 	};
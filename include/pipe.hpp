@@ -0,0 +1,165 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_PIPE_H__
+#define __FENNIX_KERNEL_PIPE_H__
+
+#include <types.h>
+
+#include <filesystem.hpp>
+#include <waitqueue.hpp>
+#include <atomic>
+#include <mutex>
+
+/** Writes up to this size are atomic */
+#define PIPE_BUF 4096
+
+/** Default capacity of a pipe */
+#define PIPE_DEFAULT_SIZE (16 * PAGE_SIZE)
+
+/** Largest capacity F_SETPIPE_SZ can ask for */
+#define PIPE_MAX_SIZE (256 * PAGE_SIZE)
+
+namespace vfs
+{
+	/**
+	 * An anonymous pipe
+	 *
+	 * The data is kept in a ring of references to whole pages
+	 * instead of a ring of bytes. Pages are reference counted,
+	 * so tee() and splice() between pipes move or share pages
+	 * without copying the data, and splicing to a file writes
+	 * straight from the page.
+	 *
+	 * Each end is an anonymous FileNode. Every descriptor that
+	 * refers to an end holds a reference to it, and every
+	 * operation in progress holds a reference to the pipe.
+	 */
+	class Pipe
+	{
+	public:
+		struct Page
+		{
+			void *Address;
+			std::atomic_int References;
+		};
+
+		struct Buffer
+		{
+			Page *Data;
+			uint32_t Offset;
+			uint32_t Length;
+			/** One O_DIRECT write, read back as a whole */
+			bool Packet;
+		};
+
+	private:
+		/* Taken while the ring is accessed */
+		std::mutex PipeLock;
+		Buffer *Ring = nullptr;
+		std::atomic_size_t Slots = 0;
+		size_t Head = 0;
+		std::atomic_size_t Used = 0;
+		std::atomic_size_t Bytes = 0;
+		bool PacketMode = false;
+
+		std::atomic_int Readers = 0;
+		std::atomic_int Writers = 0;
+		std::atomic_int References = 1;
+
+		Tasking::WaitQueue ReadWait;
+		Tasking::WaitQueue WriteWait;
+
+		Inode ReadNode, WriteNode;
+		FileNode *ReadFile = nullptr;
+		FileNode *WriteFile = nullptr;
+
+		Buffer &At(size_t Index) { return Ring[(Head + Index) % Slots]; }
+		Buffer *Last() { return Used ? &At(Used - 1) : nullptr; }
+		void Push(const Buffer &b);
+		void Consume(size_t Size);
+		size_t SpaceLeft();
+
+		static Page *NewPage();
+		static void PutPage(Page *p);
+
+		void Wrote();
+		void Drained();
+		void Broken();
+
+		int WaitReadable();
+		int WaitWritable();
+
+		static void LockBoth(Pipe *a, Pipe *b);
+		static void UnlockBoth(Pipe *a, Pipe *b);
+
+		~Pipe();
+
+	public:
+		FileNode *GetReadEnd() { return ReadFile; }
+		FileNode *GetWriteEnd() { return WriteFile; }
+
+		ssize_t Read(void *Buffer, size_t Size, bool NonBlocking);
+		ssize_t Write(const void *Buffer, size_t Size, bool NonBlocking);
+		short Poll(bool ReadEnd, short Events);
+
+		/** Move up to @p Size bytes worth of pages to @p Out */
+		ssize_t Splice(Pipe *Out, size_t Size, bool NonBlocking);
+
+		/** Share up to @p Size bytes worth of pages with @p Out */
+		ssize_t Tee(Pipe *Out, size_t Size, bool NonBlocking);
+
+		/** Write up to @p Size bytes to @p Out straight from the pages */
+		ssize_t SpliceTo(FileNode *Out, off_t &Offset, size_t Size, bool NonBlocking);
+
+		/** Read up to @p Size bytes of @p In straight into new pages */
+		ssize_t SpliceFrom(FileNode *In, off_t &Offset, size_t Size, bool NonBlocking);
+
+		/**
+		 * Resize the ring (F_SETPIPE_SZ)
+		 *
+		 * @return The new size in bytes, -EBUSY if the data
+		 * doesn't fit or -EINVAL
+		 */
+		long SetSize(size_t Size);
+		long GetSize() { return long(Slots * PAGE_SIZE); }
+
+		void SetPacketMode(bool Enable) { PacketMode = Enable; }
+
+		/** A descriptor now refers to this end */
+		void Open(bool ReadEnd);
+		/** A descriptor that referred to this end is gone */
+		void Close(bool ReadEnd);
+
+		void Get() { References++; }
+		void Put();
+
+		/**
+		 * Get the pipe behind an end,
+		 * or nullptr if it is not a pipe node.
+		 */
+		static Pipe *FromFile(FileNode *File, bool *ReadEnd = nullptr);
+
+		/**
+		 * Create a pipe with no ends open.
+		 * Open() both ends before using it.
+		 */
+		Pipe(bool Packet = false);
+	};
+}
+
+#endif // !__FENNIX_KERNEL_PIPE_H__
@@ -0,0 +1,127 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_POLL_H__
+#define __FENNIX_KERNEL_POLL_H__
+
+#include <types.h>
+
+#include <interface/fs.h>
+
+class FileNode;
+
+/**
+ * Readiness notifications
+ *
+ * Whoever sleeps on a file (epoll, poll, select) registers
+ * a watcher on its inode. When the inode becomes ready,
+ * the filesystem or driver behind it calls PollNotify()
+ * and the callbacks of the matching watchers run.
+ *
+ * Watchers are kept in a hash table keyed by the inode
+ * address. Each bucket lock is taken as a critical section,
+ * so PollNotify() can be called from interrupt handlers.
+ */
+namespace vfs
+{
+	struct PollWatcher
+	{
+		/**
+		 * Called with the bucket lock held and interrupts
+		 * disabled. It must not sleep, register or unregister
+		 * watchers or call PollNotify().
+		 *
+		 * @param Events The events that were posted
+		 */
+		void (*Callback)(PollWatcher *Watcher, short Events) = nullptr;
+		void *Data = nullptr;
+
+		/** Events to be notified about, POLLERR and POLLHUP are implied */
+		short Events = 0;
+
+		Inode *Node = nullptr;
+		PollWatcher *Next = nullptr;
+		PollWatcher *Prev = nullptr;
+	};
+
+	void PollRegister(Inode *Node, PollWatcher *Watcher);
+
+	/**
+	 * Remove @p Watcher from its inode.
+	 *
+	 * When this returns, the callback is not running
+	 * on any CPU and will not be called again.
+	 */
+	void PollUnregister(PollWatcher *Watcher);
+
+	/**
+	 * Run the callbacks of everyone watching
+	 * @p Node for any of @p Events.
+	 */
+	void PollNotify(Inode *Node, short Events);
+
+	/**
+	 * A notification that a watcher callback can't post
+	 * itself, like an epoll telling its own watchers that
+	 * it became ready.
+	 */
+	struct PollDeferred
+	{
+		Inode *Node = nullptr;
+		short Events = 0;
+		bool Queued = false;
+		PollDeferred *Next = nullptr;
+	};
+
+	/**
+	 * Queue a PollNotify() from inside a watcher callback.
+	 * The PollNotify() that ran the callback posts it once
+	 * its bucket lock is dropped.
+	 */
+	void PollNotifyLater(PollDeferred *Deferred, Inode *Node, short Events);
+
+	/**
+	 * Take @p Deferred off the queue if it is still there,
+	 * call it before freeing it.
+	 */
+	void PollCancelDeferred(PollDeferred *Deferred);
+
+	struct PollRequest
+	{
+		/** nullptr for an invalid descriptor */
+		FileNode *File;
+		short Events;
+		short ReturnedEvents;
+		/** Left out of the scan, like a negative fd in poll() */
+		bool Ignored = false;
+	};
+
+	/**
+	 * Wait until at least one of @p Requests is ready.
+	 *
+	 * A watcher is registered on every inode for the whole call,
+	 * so the thread sleeps once no matter how many files there are.
+	 *
+	 * @param Timeout Timeout in milliseconds, 0 does not
+	 * block and a negative value waits forever.
+	 * @return Number of requests with ReturnedEvents set,
+	 * 0 on timeout or -EINTR
+	 */
+	int PollFiles(PollRequest *Requests, size_t Count, int Timeout);
+}
+
+#endif // !__FENNIX_KERNEL_POLL_H__
@@ -0,0 +1,171 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_RADIX_TREE_H__
+#define __FENNIX_KERNEL_RADIX_TREE_H__
+
+#include <types.h>
+#include <vector>
+
+/**
+ * @brief Sparse array of pointers indexed by a 64-bit number.
+ *
+ * Every level resolves 6 bits of the index, the tree only
+ * grows as high as the largest index needs. Not thread safe.
+ *
+ * @tparam T Type of the stored items, the tree doesn't own them.
+ */
+template <typename T>
+class RadixTree
+{
+private:
+	static constexpr int Shift = 6;
+	static constexpr size_t Slots = 1 << Shift;
+
+	struct Node
+	{
+		void *Slot[Slots] = {};
+	};
+
+	Node *Root = nullptr;
+	int Height = 0;
+
+	bool Fits(uint64_t Index)
+	{
+		return Height * Shift >= 64 || (Index >> (Height * Shift)) == 0;
+	}
+
+	void Collect(Node *n, int Level, uint64_t Base, uint64_t From,
+				 std::vector<T *> &Out, std::vector<uint64_t> *Indices)
+	{
+		uint64_t Span = 1ULL << (Level * Shift);
+		for (size_t i = 0; i < Slots; i++)
+		{
+			uint64_t Start = Base + i * Span;
+			if (n->Slot[i] == nullptr || Start + Span <= From)
+				continue;
+
+			if (Level == 0)
+			{
+				Out.push_back((T *)n->Slot[i]);
+				if (Indices)
+					Indices->push_back(Start);
+			}
+			else
+				Collect((Node *)n->Slot[i], Level - 1, Start, From, Out, Indices);
+		}
+	}
+
+	void Free(Node *n, int Level)
+	{
+		if (Level > 0)
+		{
+			for (size_t i = 0; i < Slots; i++)
+			{
+				if (n->Slot[i])
+					Free((Node *)n->Slot[i], Level - 1);
+			}
+		}
+		delete n;
+	}
+
+public:
+	/**
+	 * @brief Get the slot of @p Index.
+	 *
+	 * @param Create Add the missing levels
+	 * @return nullptr if the slot doesn't exist and @p Create is false
+	 */
+	T **Slot(uint64_t Index, bool Create)
+	{
+		if (Root == nullptr || !Fits(Index))
+		{
+			if (!Create)
+				return nullptr;
+
+			if (Root == nullptr)
+			{
+				Root = new Node;
+				Height = 1;
+			}
+
+			/* Add levels on top until the index fits */
+			while (!Fits(Index))
+			{
+				Node *n = new Node;
+				n->Slot[0] = Root;
+				Root = n;
+				Height++;
+			}
+		}
+
+		Node *n = Root;
+		for (int Level = Height - 1; Level > 0; Level--)
+		{
+			size_t i = (Index >> (Level * Shift)) & (Slots - 1);
+			if (n->Slot[i] == nullptr)
+			{
+				if (!Create)
+					return nullptr;
+				n->Slot[i] = new Node;
+			}
+			n = (Node *)n->Slot[i];
+		}
+		return (T **)&n->Slot[Index & (Slots - 1)];
+	}
+
+	T *Find(uint64_t Index)
+	{
+		T **s = Slot(Index, false);
+		return s ? *s : nullptr;
+	}
+
+	void Insert(uint64_t Index, T *Item) { *Slot(Index, true) = Item; }
+
+	void Erase(uint64_t Index)
+	{
+		T **s = Slot(Index, false);
+		if (s)
+			*s = nullptr;
+	}
+
+	/**
+	 * Append every item at @p From or above to @p Out, in index order.
+	 * The index of each item goes to @p Indices if it is given.
+	 */
+	void Collect(uint64_t From, std::vector<T *> &Out,
+				 std::vector<uint64_t> *Indices = nullptr)
+	{
+		if (Root)
+			Collect(Root, Height - 1, 0, From, Out, Indices);
+	}
+
+	/** Drop all levels, the items are left alone */
+	void Clear()
+	{
+		if (Root)
+			Free(Root, Height - 1);
+		Root = nullptr;
+		Height = 0;
+	}
+
+	RadixTree() = default;
+	RadixTree(const RadixTree &) = delete;
+	~RadixTree() { Clear(); }
+};
+
+#endif // !__FENNIX_KERNEL_RADIX_TREE_H__
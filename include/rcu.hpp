@@ -0,0 +1,107 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_RCU_H__
+#define __FENNIX_KERNEL_RCU_H__
+
+#include <types.h>
+#include <atomic>
+
+/**
+ * Read-copy-update
+ *
+ * Readers run between rcu_read_lock() and rcu_read_unlock()
+ * without taking any lock. Writers publish a new version with
+ * rcu_assign_pointer() and free the old one only after every
+ * reader that could still see it is gone, either by waiting in
+ * synchronize_rcu() or by deferring the free with call_rcu().
+ *
+ * A grace period ends when every CPU went through the scheduler
+ * outside of a read-side section. The scheduler doesn't switch
+ * away from a thread that is inside one, so read-side sections
+ * must be short and must not sleep.
+ */
+
+struct rcu_head
+{
+	rcu_head *next;
+	void (*callback)(rcu_head *head);
+};
+
+void rcu_read_lock();
+void rcu_read_unlock();
+
+/** @return true if the current CPU is inside a read-side section */
+bool rcu_read_lock_held();
+
+/**
+ * Wait until all read-side sections that were running
+ * when this was called are finished.
+ *
+ * @note Must not be called from a read-side section.
+ */
+void synchronize_rcu();
+
+/**
+ * Call @p callback after a grace period.
+ *
+ * The callback runs in the "RCU Callbacks" kernel thread.
+ * @p head is usually embedded in the object that is freed.
+ */
+void call_rcu(rcu_head *head, void (*callback)(rcu_head *head));
+
+/** Wait for all callbacks queued so far to run. */
+void rcu_barrier();
+
+template <typename T>
+static inline __always_inline T rcu_dereference(T &p)
+{
+	return __atomic_load_n(&p, __ATOMIC_CONSUME);
+}
+
+template <typename T, typename V>
+static inline __always_inline void rcu_assign_pointer(T &p, V v)
+{
+	__atomic_store_n(&p, (T)v, __ATOMIC_RELEASE);
+}
+
+struct CPUData;
+namespace RCU
+{
+	/**
+	 * Report a quiescent state for @p Core.
+	 *
+	 * @note Called by the scheduler on every context switch.
+	 */
+	void QuiescentState(CPUData *Core);
+
+	/** Runs the queued callbacks. */
+	void CallbackThread();
+}
+
+class SmartRCUReadClass
+{
+public:
+	SmartRCUReadClass() { rcu_read_lock(); }
+	~SmartRCUReadClass() { rcu_read_unlock(); }
+};
+
+/** Scoped rcu_read_lock()/rcu_read_unlock(). */
+#define SmartRCURead() \
+	SmartRCUReadClass CONCAT(rcu##_, __COUNTER__)
+
+#endif // !__FENNIX_KERNEL_RCU_H__
@@ -65,6 +65,12 @@ struct CPUData
 
 	/** Is CPU online? */
 	bool IsActive;
+
+	/** RCU read-side nesting depth. */
+	int RCUNesting;
+
+	/** Incremented on every RCU quiescent state. */
+	std::atomic_uint64_t RCUQuiescent;
 } __aligned(16);
 
 CPUData *GetCurrentCPU();
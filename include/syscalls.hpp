@@ -20,6 +20,9 @@
 
 #include <types.h>
 
+#include <cpu.hpp>
+#include <atomic>
+
 typedef struct SyscallsFrame
 {
 #if defined(a64)
@@ -68,6 +71,73 @@ typedef struct SyscallsFrame
 uintptr_t HandleNativeSyscalls(SyscallsFrame *Frame);
 uintptr_t HandleLinuxSyscalls(SyscallsFrame *Frame);
 
+/* Must be a power of two */
+#define SYSCALLSTAT_ENTRIES 512
+#define SYSCALLSTAT_BUCKETS 32
+
+namespace SyscallStat
+{
+	enum ABI
+	{
+		Native,
+		Linux,
+		ABICount
+	};
+
+	struct Entry
+	{
+		std::atomic<const char *> Name = nullptr;
+		std::atomic_uint64_t Calls = 0;
+		std::atomic_uint64_t Errors = 0;
+		std::atomic_uint64_t Cycles = 0;
+		std::atomic_uint64_t Max = 0;
+		/** Bucket n counts calls that took [2^n, 2^(n+1)) TSC cycles */
+		std::atomic_uint64_t Histogram[SYSCALLSTAT_BUCKETS] = {};
+	};
+
+	/** Per-process counters, allocated on the first recorded call */
+	struct Counters
+	{
+		struct
+		{
+			std::atomic_uint64_t Calls = 0;
+			std::atomic_uint64_t Cycles = 0;
+			std::atomic_uint64_t Max = 0;
+		} Table[ABICount][SYSCALLSTAT_ENTRIES];
+	};
+
+	extern bool Enabled;
+
+	/** @return The counter to pass to Record(), 0 if disabled */
+	static inline uint64_t Start()
+	{
+		if (likely(!Enabled))
+			return 0;
+		return CPU::Counter();
+	}
+
+	void Account(ABI Abi, size_t Number, const char *Name,
+				 uint64_t StartedAt, long Result);
+
+	/** Does nothing if @p StartedAt is 0 */
+	static inline void Record(ABI Abi, size_t Number, const char *Name,
+							  uint64_t StartedAt, long Result)
+	{
+		if (likely(StartedAt == 0))
+			return;
+		Account(Abi, Number, Name, StartedAt, Result);
+	}
+
+	Entry *GetEntries(ABI Abi, size_t &Count);
+	void Reset();
+
+	/** Bucket that holds the @p Percent percentile, -1 if there are no calls */
+	int Percentile(Entry *e, int Percent);
+
+	/** Creates /proc/syscallstat */
+	void Initialize();
+}
+
 /**
  * @brief Initialize syscalls for the current CPU. (Function is available on x32, x64 & aarch64)
  */
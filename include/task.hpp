@@ -216,6 +216,10 @@ namespace Tasking
 		uint64_t Year = 0, Month = 0, Day = 0, Hour = 0, Minute = 0, Second = 0;
 		bool Affinity[256] = {true}; // MAX_CPU
 		TaskPriority Priority = TaskPriority::Normal;
+
+		/** Priority before it was raised by priority
+		 * inheritance, UnknownPriority if not boosted. */
+		TaskPriority BasePriority = TaskPriority::UnknownPriority;
 		TaskArchitecture Architecture = TaskArchitecture::UnknownArchitecture;
 		TaskCompatibility Compatibility = TaskCompatibility::UnknownPlatform;
 		cwk_path_style PathStyle = CWK_STYLE_UNIX;
@@ -506,6 +510,7 @@ namespace Tasking
 
 		/* Other */
 		Signal Signals;
+		std::atomic<SyscallStat::Counters *> SyscallCounters = nullptr;
 		mode_t FileCreationMask = S_IRUSR | S_IWUSR |
 								  S_IRGRP | S_IWGRP |
 								  S_IROTH | S_IWOTH;
@@ -67,6 +67,7 @@ namespace TTY
 		virtual ssize_t Read(void *Buffer, size_t Size, off_t Offset);
 		virtual ssize_t Write(const void *Buffer, size_t Size, off_t Offset);
 		virtual int Ioctl(unsigned long Request, void *Argp);
+		virtual short Poll(short Events);
 
 		TeletypeDriver();
 		virtual ~TeletypeDriver();
@@ -0,0 +1,310 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_URING_H__
+#define __FENNIX_KERNEL_URING_H__
+
+#include <types.h>
+
+#include <filesystem.hpp>
+#include <waitqueue.hpp>
+#include <memory/vma.hpp>
+#include <task.hpp>
+#include <poll.hpp>
+#include <atomic>
+#include <mutex>
+#include <list>
+
+/* The ring layout and the operation codes are the same as io_uring */
+
+#define IORING_SETUP_CQSIZE (1U << 3)
+#define IORING_SETUP_CLAMP (1U << 4)
+
+#define IORING_ENTER_GETEVENTS (1U << 0)
+
+#define IORING_FEAT_SINGLE_MMAP (1U << 0)
+#define IORING_FEAT_SUBMIT_STABLE (1U << 2)
+#define IORING_FEAT_RW_CUR_POS (1U << 3)
+
+#define IORING_OFF_SQ_RING 0ULL
+#define IORING_OFF_CQ_RING 0x8000000ULL
+#define IORING_OFF_SQES 0x10000000ULL
+
+#define IOSQE_FIXED_FILE (1U << 0)
+#define IOSQE_IO_DRAIN (1U << 1)
+#define IOSQE_IO_LINK (1U << 2)
+#define IOSQE_IO_HARDLINK (1U << 3)
+#define IOSQE_ASYNC (1U << 4)
+#define IOSQE_BUFFER_SELECT (1U << 5)
+#define IOSQE_CQE_SKIP_SUCCESS (1U << 6)
+
+#define IORING_TIMEOUT_ABS (1U << 0)
+
+/** dirfd of IORING_OP_OPENAT for the working directory */
+#define IORING_AT_FDCWD (-100)
+
+#define IORING_MAX_ENTRIES 4096
+#define IORING_MAX_CQ_ENTRIES (2 * IORING_MAX_ENTRIES)
+
+enum IoRingOp
+{
+	IORING_OP_NOP = 0,
+	IORING_OP_READV = 1,
+	IORING_OP_WRITEV = 2,
+	IORING_OP_FSYNC = 3,
+	IORING_OP_POLL_ADD = 6,
+	IORING_OP_POLL_REMOVE = 7,
+	IORING_OP_TIMEOUT = 11,
+	IORING_OP_TIMEOUT_REMOVE = 12,
+	IORING_OP_ASYNC_CANCEL = 14,
+	IORING_OP_OPENAT = 18,
+	IORING_OP_CLOSE = 19,
+	IORING_OP_READ = 22,
+	IORING_OP_WRITE = 23,
+};
+
+struct io_uring_sqe
+{
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t ioprio;
+	int32_t fd;
+	uint64_t off;
+	uint64_t addr;
+	uint32_t len;
+	union
+	{
+		uint32_t rw_flags;
+		uint32_t poll32_events;
+		uint32_t timeout_flags;
+		uint32_t open_flags;
+		uint32_t cancel_flags;
+	};
+	uint64_t user_data;
+	uint16_t buf_index;
+	uint16_t personality;
+	int32_t splice_fd_in;
+	uint64_t __pad2[2];
+};
+static_assert(sizeof(io_uring_sqe) == 64);
+
+struct io_uring_cqe
+{
+	uint64_t user_data;
+	int32_t res;
+	uint32_t flags;
+};
+static_assert(sizeof(io_uring_cqe) == 16);
+
+struct io_sqring_offsets
+{
+	uint32_t head;
+	uint32_t tail;
+	uint32_t ring_mask;
+	uint32_t ring_entries;
+	uint32_t flags;
+	uint32_t dropped;
+	uint32_t array;
+	uint32_t resv1;
+	uint64_t resv2;
+};
+
+struct io_cqring_offsets
+{
+	uint32_t head;
+	uint32_t tail;
+	uint32_t ring_mask;
+	uint32_t ring_entries;
+	uint32_t overflow;
+	uint32_t cqes;
+	uint32_t flags;
+	uint32_t resv1;
+	uint64_t resv2;
+};
+
+struct io_uring_params
+{
+	uint32_t sq_entries;
+	uint32_t cq_entries;
+	uint32_t flags;
+	uint32_t sq_thread_cpu;
+	uint32_t sq_thread_idle;
+	uint32_t features;
+	uint32_t wq_fd;
+	uint32_t resv[3];
+	struct io_sqring_offsets sq_off;
+	struct io_cqring_offsets cq_off;
+};
+static_assert(sizeof(io_uring_params) == 120);
+
+namespace vfs
+{
+	/**
+	 * Asynchronous submission and completion rings
+	 *
+	 * The submission queue, the completion queue and the SQE
+	 * array are kernel pages that the owner maps into its
+	 * address space, so a single Enter() can consume any
+	 * number of requests and the completions are reaped
+	 * without a system call.
+	 *
+	 * Requests that can finish right away are completed
+	 * inline. The others register a PollWatcher on their
+	 * file and are retried when it reports readiness, the
+	 * next time the owner enters the ring. Timeouts are
+	 * checked the same way.
+	 *
+	 * The instance is reference counted, each file descriptor
+	 * that refers to it holds a reference.
+	 */
+	class IoRing
+	{
+	private:
+		/* Shared with user space, both queues live in one mapping */
+		struct Rings
+		{
+			uint32_t SqHead, SqTail;
+			uint32_t SqMask, SqEntries;
+			uint32_t SqFlags, SqDropped;
+			uint32_t CqHead, CqTail;
+			uint32_t CqMask, CqEntries;
+			uint32_t CqOverflow, CqFlags;
+		};
+
+		struct Request
+		{
+			io_uring_sqe Sqe;
+			IoRing *Owner = nullptr;
+
+			PollWatcher Watcher;
+			bool Watching = false;
+			std::atomic_bool Ready = false;
+
+			/* Set when the SQE was rejected while preparing it */
+			int Error = 0;
+
+			/* User buffers, translated again each time the request
+			   runs, the process can unmap or remap them meanwhile */
+			struct kiovec Single;
+			struct kiovec *Buffers = nullptr;
+			uint32_t BufferCount = 0;
+
+			/* Their kernel segments, at most one for each page */
+			struct kiovec Segment;
+			struct kiovec *Vector = nullptr;
+			int MaxSegments = 0;
+			int Count = 0;
+
+			/* IORING_OP_OPENAT */
+			char *Path = nullptr;
+
+			/* IORING_OP_TIMEOUT */
+			uint64_t Deadline = 0;
+			uint64_t Target = 0;
+
+			/* Rest of an IOSQE_IO_LINK chain */
+			Request *Link = nullptr;
+		};
+
+		Tasking::PCB *Process = nullptr;
+
+		/* Kernel copies, the shared ones can be overwritten by user space */
+		uint32_t SqEntries = 0, SqMask = 0, SqHead = 0;
+		uint32_t CqEntries = 0, CqMask = 0, CqTail = 0;
+
+		Rings *Shared = nullptr;
+		uint32_t *SqArray = nullptr;
+		io_uring_cqe *Cqes = nullptr;
+		size_t RingsSize = 0;
+		io_uring_sqe *Sqes = nullptr;
+		size_t SqesSize = 0;
+		bool Mapped = false;
+
+		/* Held while submitting and running pending requests */
+		std::mutex SubmitLock;
+		std::list<Request *> Pending;
+		uint64_t Completions = 0;
+
+		std::atomic_bool Triggered = false;
+		Tasking::WaitQueue Waiters;
+		std::atomic_int References = 1;
+
+		Inode Node;
+		FileNode *File = nullptr;
+
+		static void Callback(PollWatcher *Watcher, short Events);
+
+		uint32_t Ready() { return CqTail - __atomic_load_n(&Shared->CqHead, __ATOMIC_ACQUIRE); }
+		int Prepare(Request *req);
+		int Translate(Request *req);
+		bool Execute(Request *req, intptr_t *Result);
+		void Watch(Request *req, FileNode *Target, short Events);
+		void Issue(Request *req);
+		void Abort(Request *Chain);
+		void Complete(Request *req, intptr_t Result);
+		void Post(uint64_t UserData, intptr_t Result);
+		void Free(Request *req);
+		int Cancel(uint64_t UserData, int Opcode);
+		void RunPending();
+		uint64_t NextDeadline();
+
+		~IoRing();
+
+	public:
+		/** Converts the result of a request before it is posted */
+		intptr_t (*ConvertResult)(intptr_t Result) = nullptr;
+
+		/** The node that represents this instance in a descriptor table */
+		FileNode *GetFile() { return File; }
+
+		/**
+		 * Submit and wait for requests.
+		 *
+		 * @param ToSubmit How many SQEs to consume
+		 * @param MinComplete With IORING_ENTER_GETEVENTS, wait
+		 * until this many CQEs are ready
+		 * @return Number of SQEs consumed, or a negative
+		 * error if none were
+		 */
+		int Enter(uint32_t ToSubmit, uint32_t MinComplete, uint32_t Flags);
+
+		/**
+		 * Map the rings into the owner.
+		 *
+		 * @param Offset IORING_OFF_SQ_RING, IORING_OFF_CQ_RING
+		 * or IORING_OFF_SQES
+		 * @return The user address or a negative error
+		 */
+		intptr_t Map(uint64_t Offset, size_t Length, Memory::VirtualMemoryArea *vma);
+
+		/** POLLIN when completions are waiting, POLLOUT when SQEs can be queued */
+		short Poll(short Events);
+
+		void Get() { References++; }
+		void Put();
+
+		static IoRing *FromFile(FileNode *File);
+
+		/**
+		 * @param Entries Submission queue size
+		 * @param Params Filled with the sizes and the ring offsets
+		 */
+		IoRing(uint32_t Entries, io_uring_params *Params);
+	};
+}
+
+#endif // !__FENNIX_KERNEL_URING_H__
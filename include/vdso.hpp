@@ -0,0 +1,90 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_VDSO_H__
+#define __FENNIX_KERNEL_VDSO_H__
+
+#include <types.h>
+#include <memory/vma.hpp>
+
+namespace VDSO
+{
+	enum DataFlags
+	{
+		/** @brief The TSC calibration is valid, clocks can be read in user space */
+		TSCValid = 1 << 0,
+
+		/** @brief IA32_TSC_AUX holds the CPU ID, getcpu can use RDTSCP */
+		RDTSCPValid = 1 << 1,
+	};
+
+	/**
+	 * @brief Page shared read-only with every process that maps the vDSO.
+	 *
+	 * Monotonic nanoseconds are
+	 * MonotonicBase + (((TSC - TSCBase) * Mult) >> Shift)
+	 * and realtime adds RealtimeOffset on top.
+	 *
+	 * Readers retry while Sequence is odd or if it changed during the read.
+	 * The layout is hard-coded in arch/amd64/tasking/vdso.s.
+	 */
+	struct DataPage
+	{
+		uint32_t Sequence;
+		uint32_t Flags;
+		uint64_t TSCBase;
+		uint64_t MonotonicBase;
+		uint64_t RealtimeOffset;
+		uint32_t Mult;
+		uint32_t Shift;
+	};
+
+	/**
+	 * @brief Calibrate the TSC against the active timer and
+	 * build the vDSO pages. TimeManager must be ready.
+	 */
+	void Initialize();
+
+	/**
+	 * @brief Map the data page and the vDSO image into a process.
+	 *
+	 * @param vma The process' virtual memory area
+	 * @return The address of the ELF header (AT_SYSINFO_EHDR),
+	 * or 0 if there is no vDSO.
+	 */
+	uintptr_t Map(Memory::VirtualMemoryArea *vma);
+
+	/** @brief Nanoseconds since boot, same source as the vDSO. */
+	uint64_t Monotonic();
+
+	/** @brief Nanoseconds since the Unix epoch, same source as the vDSO. */
+	uint64_t Realtime();
+
+	/**
+	 * @brief Convert TSC cycles, as used for task time accounting,
+	 * to nanoseconds with the calibrated TSC frequency.
+	 *
+	 * @return The duration in nanoseconds, or 0 if the TSC
+	 * could not be calibrated.
+	 */
+	uint64_t CyclesToNanoseconds(uint64_t Cycles);
+
+	/** @brief Step the realtime clock to @p Nanoseconds since the Unix epoch. */
+	void SetRealtime(uint64_t Nanoseconds);
+}
+
+#endif // !__FENNIX_KERNEL_VDSO_H__
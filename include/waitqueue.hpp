@@ -0,0 +1,168 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FENNIX_KERNEL_WAIT_QUEUE_H__
+#define __FENNIX_KERNEL_WAIT_QUEUE_H__
+
+#include <types.h>
+#include <errno.h>
+#include <assert.h>
+#include <lock.hpp>
+#include <task.hpp>
+
+namespace Tasking
+{
+	struct WaitEntry
+	{
+		TCB *Thread = nullptr;
+		WaitEntry *Next = nullptr;
+		WaitEntry *Prev = nullptr;
+		bool Queued = false;
+	};
+
+	/**
+	 * A FIFO queue of sleeping threads.
+	 *
+	 * The wait condition is always checked with the queue
+	 * lock held, and wakers take the same lock, so a wake up
+	 * between the check and going to sleep can't be lost.
+	 * The lock is taken as a critical section, so it is safe
+	 * to wake threads from interrupt handlers.
+	 *
+	 * Entries live on the stack of the waiting thread,
+	 * nothing is allocated.
+	 */
+	class WaitQueue
+	{
+	private:
+		NewLock(QueueLock);
+		WaitEntry *Head = nullptr;
+		WaitEntry *Tail = nullptr;
+		size_t Count = 0;
+
+		void Append(WaitEntry *Entry);
+		void Remove(WaitEntry *Entry);
+		void Resume(WaitEntry *Entry);
+		void Block(WaitEntry *Entry, uint64_t Until);
+		void Reschedule(bool Sleep);
+		bool CanSleep();
+		TCB *CurrentThread();
+		uint64_t Deadline(uint64_t Timeout);
+		bool Expired(uint64_t Until);
+
+	public:
+		/**
+		 * Sleep until @p Condition returns true.
+		 *
+		 * @param Condition Called with the queue lock held,
+		 * it must not sleep or take this queue's lock.
+		 * @param Timeout Timeout in milliseconds, 0 waits forever.
+		 * @return 0 or -ETIMEDOUT
+		 */
+		template <typename Fn>
+		int Wait(Fn Condition, uint64_t Timeout = 0)
+		{
+			WaitEntry Entry;
+			Entry.Thread = this->CurrentThread();
+			/* Without a scheduler we can only spin */
+			bool Sleep = Entry.Thread && this->CanSleep();
+			uint64_t Until = Timeout ? this->Deadline(Timeout) : 0;
+
+			while (true)
+			{
+				{
+					SmartCriticalSection(QueueLock);
+					if (Entry.Queued)
+						this->Remove(&Entry);
+
+					if (Condition())
+						return 0;
+
+					if (Until && this->Expired(Until))
+						return -ETIMEDOUT;
+
+					if (Sleep)
+						this->Block(&Entry, Until);
+				}
+				this->Reschedule(Sleep);
+			}
+		}
+
+		/**
+		 * Wake up the first waiter.
+		 *
+		 * @param HandOff Called with the queue lock held and
+		 * the thread that is about to be woken up, or nullptr if
+		 * nobody is waiting. Used to pass ownership of a resource
+		 * directly to the next waiter.
+		 * @return The woken thread
+		 */
+		template <typename Fn>
+		TCB *WakeOne(Fn HandOff)
+		{
+			SmartCriticalSection(QueueLock);
+			WaitEntry *Entry = Head;
+			HandOff(Entry ? Entry->Thread : nullptr);
+			if (Entry == nullptr)
+				return nullptr;
+
+			this->Remove(Entry);
+			this->Resume(Entry);
+			return Entry->Thread;
+		}
+
+		/**
+		 * Wake up to @p Max waiters in FIFO order.
+		 *
+		 * @return Number of woken threads
+		 */
+		size_t Wake(size_t Max = 1);
+		size_t WakeAll() { return this->Wake(SIZE_MAX); }
+
+		/**
+		 * Iterate over the waiting threads with the queue lock held.
+		 */
+		template <typename Fn>
+		void ForEach(Fn Callback)
+		{
+			SmartCriticalSection(QueueLock);
+			for (WaitEntry *e = Head; e; e = e->Next)
+				Callback(e->Thread);
+		}
+
+		/**
+		 * Same as ForEach, for use from a Wait() condition or
+		 * a WakeOne() hand-off, which already hold the lock.
+		 */
+		template <typename Fn>
+		void ForEachLocked(Fn Callback)
+		{
+			assert(QueueLock.Locked());
+			for (WaitEntry *e = Head; e; e = e->Next)
+				Callback(e->Thread);
+		}
+
+		bool Empty() { return Count == 0; }
+		size_t Size() { return Count; }
+
+		WaitQueue() = default;
+		WaitQueue(const WaitQueue &) = delete;
+		~WaitQueue();
+	};
+}
+
+#endif // !__FENNIX_KERNEL_WAIT_QUEUE_H__
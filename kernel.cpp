@@ -25,6 +25,7 @@
 #include <lock.hpp>
 #include <uart.hpp>
 #include <kcon.hpp>
+#include <vdso.hpp>
 #include <debug.h>
 #include <smp.hpp>
 #include <cargs.h>
@@ -51,6 +52,7 @@ struct KernelConfig Config = {
 	.UnlockDeadLock = false,
 	.SIMD = false,
 	.Quiet = false,
+	.LazyInitrd = true,
 };
 
 Video::Display *Display = nullptr;
@@ -60,6 +62,7 @@ Time::time *TimeManager = nullptr;
 Tasking::Task *TaskManager = nullptr;
 PCI::Manager *PCIManager = nullptr;
 Driver::Manager *DriverManager = nullptr;
+Disk::Manager *DiskManager = nullptr;
 
 EXTERNC void putchar(char c)
 {
@@ -81,13 +84,13 @@ EXTERNC void _KPrint(const char *Format, va_list Args)
 		{
 #if defined(a64)
 			printf("\x1b[1;30m[\x1b[1;34m%lu.%07lu\x1b[1;30m]\x1b[0m ",
-				   Nanoseconds / 10000000, Nanoseconds % 10000000);
+				   Nanoseconds / 1000000000, (Nanoseconds % 1000000000) / 100);
 #elif defined(a32)
 			printf("\x1b[1;30m[\x1b[1;34m%llu.%07llu\x1b[1;30m]\x1b[0m ",
-				   Nanoseconds / 10000000, Nanoseconds % 10000000);
+				   Nanoseconds / 1000000000, (Nanoseconds % 1000000000) / 100);
 #elif defined(aa64)
 			printf("\x1b[1;30m[\x1b[1;34m%lu.%07lu\x1b[1;30m]\x1b[0m ",
-				   Nanoseconds / 10000000, Nanoseconds % 10000000);
+				   Nanoseconds / 1000000000, (Nanoseconds % 1000000000) / 100);
 #endif
 		}
 	}
@@ -236,6 +239,9 @@ EXTERNC NIF void Main()
 	KPrint("Initializing SMP");
 	SMP::Initialize(PowerManager->GetMADT());
 
+	KPrint("Initializing vDSO");
+	VDSO::Initialize();
+
 	KPrint("Initializing Filesystem");
 	KernelVFS();
 
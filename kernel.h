@@ -53,6 +53,7 @@ extern vfs::Virtual *fs;
 extern Tasking::Task *TaskManager;
 
 extern Driver::Manager *DriverManager;
+extern Disk::Manager *DiskManager;
 
 #endif // __cplusplus
 
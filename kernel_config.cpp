@@ -91,6 +91,12 @@ static struct cag_option ConfigOptions[] = {
 	 .value_name = "BOOL",
 	 .description = "Enable quiet boot"},
 
+	{.identifier = 'r',
+	 .access_letters = NULL,
+	 .access_name = "lazyinitrd",
+	 .value_name = "BOOL",
+	 .description = "Only index directories of the initrd at boot, files on first use"},
+
 	{.identifier = 'h',
 	 .access_letters = "h",
 	 .access_name = "help",
@@ -255,6 +261,14 @@ void ParseConfig(char *ConfigString, KernelConfig *ModConfig)
 			KPrint("Quiet boot: %s", value);
 			break;
 		}
+		case 'r':
+		{
+			value = cag_option_get_value(&context);
+			strcmp(value, "true") == 0 ? ModConfig->LazyInitrd = true
+									   : ModConfig->LazyInitrd = false;
+			KPrint("Lazy initrd: %s", value);
+			break;
+		}
 		case 'h':
 		{
 			KPrint("\n---------------------------------------------------------------------------\nUsage: fennix.elf [OPTION]...\nKernel configuration.");
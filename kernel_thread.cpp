@@ -21,6 +21,7 @@
 #endif
 
 #include <filesystem/ustar.hpp>
+#include <filesystem/ext2.hpp>
 #include <kshell.hpp>
 #include <power.hpp>
 #include <lock.hpp>
@@ -28,6 +29,7 @@
 #include <exec.hpp>
 #include <kcon.hpp>
 #include <cwalk.h>
+#include <rcu.hpp>
 #include <vm.hpp>
 #include <vector>
 
@@ -76,6 +78,14 @@ void KernelMainThread()
 	if (IsVirtualizedEnvironment())
 		KPrint("Running in a virtualized environment");
 
+	TaskManager->CreateThread(thisProcess, Tasking::IP(RCU::CallbackThread))
+		->Rename("RCU Callbacks");
+	TaskManager->CreateThread(thisProcess, Tasking::IP(vfs::PageCache::WritebackThread))
+		->Rename("Page Writeback");
+
+	KPrint("Initializing Disk Manager");
+	DiskManager = new Disk::Manager;
+
 	KPrint("Initializing Driver Manager");
 	DriverManager = new Driver::Manager;
 	TaskManager->CreateThread(thisProcess, Tasking::IP(Driver::ManagerDaemonWrapper))
@@ -85,6 +95,17 @@ void KernelMainThread()
 	DriverManager->PreloadDrivers();
 	DriverManager->LoadAllDrivers();
 
+	DiskManager->ScanDisks();
+	foreach (Disk::Device *device in DiskManager->GetDevices())
+	{
+		/* Mount the partitions, not the disk they are on */
+		if (device->Style != Disk::Unknown || device->File == nullptr)
+			continue;
+
+		std::string path = "/mnt/" + device->Name;
+		TestAndInitializeEXT2(device->File, path.c_str());
+	}
+
 	KernelConsole::LateInit();
 #ifdef DEBUG
 	// TaskManager->CreateThread(thisProcess,
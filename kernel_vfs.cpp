@@ -18,6 +18,8 @@
 #include "kernel.h"
 
 #include <filesystem/ustar.hpp>
+#include <filesystem/tmpfs.hpp>
+#include <syscalls.hpp>
 #include <memory.hpp>
 
 vfs::Virtual *fs = nullptr;
@@ -56,4 +58,7 @@ EXTERNC NIF void KernelVFS()
 	fs = new vfs::Virtual;
 	SearchForInitrd();
 	fs->Initialize();
+	MountTmpFS("/tmp", 0);
+	MountTmpFS("/run", 0);
+	SyscallStat::Initialize();
 }
@@ -44,6 +44,8 @@ void cmd_modinfo(const char *args);
 void cmd_panic(const char *args);
 void cmd_dump(const char *args);
 void cmd_theme(const char *args);
+void cmd_lockstat(const char *args);
+void cmd_syscallstat(const char *args);
 
 #define IF_ARG(x) strcmp(args, x) == 0
 
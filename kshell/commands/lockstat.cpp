@@ -0,0 +1,95 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../cmds.hpp"
+
+#include <lock.hpp>
+
+#include "../../kernel.h"
+
+#define LOCKSTAT_TOP 20
+
+void cmd_lockstat(const char *args)
+{
+	if (IF_ARG("on"))
+	{
+		LockStat::Enabled = true;
+		printf("Lock statistics enabled\n");
+		return;
+	}
+	else if (IF_ARG("off"))
+	{
+		LockStat::Enabled = false;
+		printf("Lock statistics disabled\n");
+		return;
+	}
+	else if (IF_ARG("reset"))
+	{
+		LockStat::Reset();
+		printf("Lock statistics cleared\n");
+		return;
+	}
+	else if (args[0] != '\0')
+	{
+		printf("Usage: lockstat [on|off|reset]\n");
+		return;
+	}
+
+	size_t Count;
+	LockStat::Entry *Entries = LockStat::GetEntries(Count);
+
+	/* Pick the locks we waited the most for */
+	LockStat::Entry *Top[LOCKSTAT_TOP] = {};
+	size_t TopCount = 0;
+	for (size_t i = 0; i < Count; i++)
+	{
+		LockStat::Entry *e = &Entries[i];
+		if (e->Lock.load() == nullptr || e->Acquisitions.load() == 0)
+			continue;
+
+		size_t pos = TopCount;
+		while (pos > 0 && Top[pos - 1]->WaitTotal.load() < e->WaitTotal.load())
+			pos--;
+		if (pos >= LOCKSTAT_TOP)
+			continue;
+
+		if (TopCount < LOCKSTAT_TOP)
+			TopCount++;
+		for (size_t j = TopCount - 1; j > pos; j--)
+			Top[j] = Top[j - 1];
+		Top[pos] = e;
+	}
+
+	printf("Lock statistics are %s, times are in TSC cycles\n",
+		   LockStat::Enabled ? "enabled" : "disabled");
+	printf("LOCK                 | SITE                 |   ACQUIRED |  CONTENDED |     WAIT TOTAL |   WAIT MAX |     HOLD TOTAL\n");
+	for (size_t i = 0; i < TopCount; i++)
+	{
+		LockStat::Entry *e = Top[i];
+		const char *Name = e->Name.load();
+		const char *Site = e->Site.load();
+		printf("%-20.20s | %-20.20s | %10ld | %10ld | %14ld | %10ld | %14ld\n",
+			   Name ? Name : "(anon)", Site ? Site : "-",
+			   e->Acquisitions.load(), e->Contended.load(),
+			   e->WaitTotal.load(), e->WaitMax.load(),
+			   e->HoldTotal.load());
+	}
+
+	if (LockStat::GetDropped())
+		printf("%ld lock acquisitions were not recorded, the table is full\n",
+			   LockStat::GetDropped());
+}
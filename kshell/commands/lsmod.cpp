@@ -21,8 +21,11 @@
 
 void cmd_lsmod(const char *)
 {
-	std::unordered_map<dev_t, Driver::DriverObject> drivers =
-		DriverManager->GetDrivers();
+	std::unordered_map<dev_t, Driver::DriverObject> drivers;
+	{
+		SmartReadLock(DriverManager->GetDriversLock());
+		drivers = DriverManager->GetDrivers();
+	}
 
 	printf("DRIVER          |    ID | INIT | MEMORY\n");
 
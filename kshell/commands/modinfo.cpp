@@ -29,8 +29,11 @@ void cmd_modinfo(const char *args)
 
 	dev_t id = atoi(args);
 
-	std::unordered_map<dev_t, Driver::DriverObject> drivers =
-		DriverManager->GetDrivers();
+	std::unordered_map<dev_t, Driver::DriverObject> drivers;
+	{
+		SmartReadLock(DriverManager->GetDriversLock());
+		drivers = DriverManager->GetDrivers();
+	}
 
 	if (drivers.find(id) == drivers.end())
 	{
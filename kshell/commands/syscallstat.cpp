@@ -0,0 +1,146 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../cmds.hpp"
+
+#include <syscalls.hpp>
+#include <task.hpp>
+
+#include "../../kernel.h"
+
+using namespace Tasking;
+
+#define SYSCALLSTAT_TOP 20
+
+static const char *ABINames[SyscallStat::ABICount] = {"native", "linux"};
+
+static void PrintProcess(PID pid)
+{
+	PCB *pcb = TaskManager->GetProcessByID(pid);
+	if (pcb == nullptr)
+	{
+		printf("No process with PID %d\n", pid);
+		return;
+	}
+
+	SyscallStat::Counters *c = pcb->SyscallCounters.load();
+	if (c == nullptr)
+	{
+		printf("No system calls recorded for %s(%d)\n", pcb->Name, pid);
+		return;
+	}
+
+	size_t Count;
+	printf("System calls of %s(%d), times are in TSC cycles\n", pcb->Name, pid);
+	printf("ABI    | SYSCALL              |      CALLS |         CYCLES |        MAX\n");
+	for (size_t a = 0; a < SyscallStat::ABICount; a++)
+	{
+		SyscallStat::Entry *Global = SyscallStat::GetEntries((SyscallStat::ABI)a, Count);
+		for (size_t i = 0; i < Count; i++)
+		{
+			auto &e = c->Table[a][i];
+			if (e.Calls.load() == 0)
+				continue;
+
+			const char *Name = Global[i].Name.load();
+			printf("%-6s | %-20.20s | %10ld | %14ld | %10ld\n",
+				   ABINames[a], Name ? Name : "?",
+				   e.Calls.load(), e.Cycles.load(), e.Max.load());
+		}
+	}
+}
+
+void cmd_syscallstat(const char *args)
+{
+	if (IF_ARG("on"))
+	{
+		SyscallStat::Enabled = true;
+		printf("System call statistics enabled\n");
+		return;
+	}
+	else if (IF_ARG("off"))
+	{
+		SyscallStat::Enabled = false;
+		printf("System call statistics disabled\n");
+		return;
+	}
+	else if (IF_ARG("reset"))
+	{
+		SyscallStat::Reset();
+		printf("System call statistics cleared\n");
+		return;
+	}
+	else if (args[0] >= '0' && args[0] <= '9')
+	{
+		PrintProcess(atoi(args));
+		return;
+	}
+	else if (args[0] != '\0')
+	{
+		printf("Usage: syscallstat [on|off|reset|<pid>]\n");
+		return;
+	}
+
+	/* Pick the syscalls we spent the most time in */
+	SyscallStat::Entry *Top[SYSCALLSTAT_TOP] = {};
+	int TopABI[SYSCALLSTAT_TOP] = {};
+	size_t TopCount = 0;
+	for (size_t a = 0; a < SyscallStat::ABICount; a++)
+	{
+		size_t Count;
+		SyscallStat::Entry *Entries = SyscallStat::GetEntries((SyscallStat::ABI)a, Count);
+		for (size_t i = 0; i < Count; i++)
+		{
+			SyscallStat::Entry *e = &Entries[i];
+			if (e->Calls.load() == 0)
+				continue;
+
+			size_t pos = TopCount;
+			while (pos > 0 && Top[pos - 1]->Cycles.load() < e->Cycles.load())
+				pos--;
+			if (pos >= SYSCALLSTAT_TOP)
+				continue;
+
+			if (TopCount < SYSCALLSTAT_TOP)
+				TopCount++;
+			for (size_t j = TopCount - 1; j > pos; j--)
+			{
+				Top[j] = Top[j - 1];
+				TopABI[j] = TopABI[j - 1];
+			}
+			Top[pos] = e;
+			TopABI[pos] = (int)a;
+		}
+	}
+
+	printf("System call statistics are %s, times are in TSC cycles\n",
+		   SyscallStat::Enabled ? "enabled" : "disabled");
+	printf("ABI    | SYSCALL              |      CALLS |     ERRORS |         CYCLES |        MAX |      P50 |      P99\n");
+	for (size_t i = 0; i < TopCount; i++)
+	{
+		SyscallStat::Entry *e = Top[i];
+		const char *Name = e->Name.load();
+		int p50 = SyscallStat::Percentile(e, 50);
+		int p99 = SyscallStat::Percentile(e, 99);
+		/* Upper bound of the bucket */
+		printf("%-6s | %-20.20s | %10ld | %10ld | %14ld | %10ld | <2^%-5d | <2^%-5d\n",
+			   ABINames[TopABI[i]], Name ? Name : "?",
+			   e->Calls.load(), e->Errors.load(),
+			   e->Cycles.load(), e->Max.load(),
+			   p50 + 1, p99 + 1);
+	}
+}
@@ -29,7 +29,7 @@ void cmd_uptime(const char *)
 	{
 		uint64_t Nanoseconds =
 			TimeManager->GetNanosecondsSinceClassCreation();
-		uint64_t Seconds = Nanoseconds / 10000000;
+		uint64_t Seconds = Nanoseconds / 1000000000;
 		uint64_t Minutes = Seconds / 60;
 		uint64_t Hours = Minutes / 60;
 		uint64_t Days = Hours / 24;
@@ -78,6 +78,8 @@ static Command commands[] = {
 	{"panic", cmd_panic},
 	{"dump", cmd_dump},
 	{"theme", cmd_theme},
+	{"lockstat", cmd_lockstat},
+	{"syscallstat", cmd_syscallstat},
 	{"builtin", __cmd_builtin},
 };
 
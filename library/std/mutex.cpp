@@ -25,28 +25,85 @@
 
 using namespace Tasking;
 
+/* How many times to retry before going to sleep
+   while the holder is running on another core. */
+#define MUTEX_SPIN_COUNT 1000
+
 namespace std
 {
-	void mutex::lock()
+	bool mutex::TryAcquire(TCB *tcb)
+	{
+		if (this->Locked.exchange(true, std::memory_order_acquire))
+			return false;
+
+		this->Holder.store(tcb, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool mutex::HolderRunning()
+	{
+		TCB *holder = this->Holder.load(std::memory_order_relaxed);
+		return holder && holder->State.load() == TaskState::Running;
+	}
+
+	void mutex::InheritPriority(TCB *tcb)
+	{
+		TCB *holder = this->Holder.load(std::memory_order_relaxed);
+		if (holder == nullptr ||
+			holder->Info.Priority >= tcb->Info.Priority)
+			return;
+
+		if (!this->Boosted)
+		{
+			this->HolderPriority = holder->Info.Priority;
+			this->Boosted = true;
+		}
+
+		debug("%#lx: Boosting task %d priority %d -> %d", this,
+			  holder->ID, holder->Info.Priority, tcb->Info.Priority);
+		holder->Info.Priority = tcb->Info.Priority;
+	}
+
+	void mutex::RestorePriority()
 	{
-	RetryLock:
-		bool Result = this->Locked.exchange(true, std::memory_order_acquire);
+		if (!this->Boosted)
+			return;
 
+		this->Holder.load(std::memory_order_relaxed)->Info.Priority = this->HolderPriority;
+		this->Boosted = false;
+	}
+
+	void mutex::lock()
+	{
 		TCB *tcb = thisThread;
 		assert(tcb != nullptr);
-		if (Result == true)
-		{
-			debug("%#lx: Mutex is locked, blocking task %d (\"%s\" : %d)", this,
-				  tcb->ID, tcb->Parent->Name, tcb->Parent->ID);
 
-			this->Waiting.push_back(tcb);
-			tcb->Block();
-			TaskManager->Yield();
-			goto RetryLock;
+		if (this->TryAcquire(tcb))
+			return;
+
+		/* The holder will probably release it soon */
+		for (int i = 0; i < MUTEX_SPIN_COUNT && this->HolderRunning(); i++)
+		{
+			if (!this->Locked.load(std::memory_order_relaxed) &&
+				this->TryAcquire(tcb))
+				return;
+			CPU::Pause();
 		}
 
-		this->Holder = tcb;
-		this->Waiting.remove(tcb);
+		debug("%#lx: Mutex is locked, blocking task %d (\"%s\" : %d)", this,
+			  tcb->ID, tcb->Parent->Name, tcb->Parent->ID);
+
+		this->Waiting.Wait([this, tcb]
+						   {
+							   /* unlock() handed it over to us */
+							   if (this->Holder.load(std::memory_order_relaxed) == tcb)
+								   return true;
+
+							   if (this->TryAcquire(tcb))
+								   return true;
+
+							   this->InheritPriority(tcb);
+							   return false; });
 
 		debug("%#lx: Mutex locked by task %d (\"%s\" : %d)", this,
 			  tcb->ID, tcb->Parent->Name, tcb->Parent->ID);
@@ -54,20 +111,15 @@ namespace std
 
 	bool mutex::try_lock()
 	{
-		bool Result = this->Locked.exchange(true, std::memory_order_acquire);
-
 		TCB *tcb = thisThread;
 		assert(tcb != nullptr);
-		if (Result == true)
+		if (!this->TryAcquire(tcb))
 		{
 			debug("%#lx: Mutex is locked, task %d (\"%s\" : %d) failed to lock", this,
 				  tcb->ID, tcb->Parent->Name, tcb->Parent->ID);
 			return false;
 		}
 
-		this->Holder = tcb;
-		this->Waiting.remove(tcb);
-
 		debug("%#lx: Mutex locked by task %d (\"%s\" : %d)", this,
 			  tcb->ID, tcb->Parent->Name, tcb->Parent->ID);
 		return true;
@@ -77,24 +129,37 @@ namespace std
 	{
 		TCB *tcb = thisThread;
 		assert(tcb != nullptr);
-		assert(this->Holder == tcb);
-
-		this->Holder = nullptr;
-		this->Locked.store(false, std::memory_order_release);
-
-		if (this->Waiting.empty())
+		assert(this->Holder.load() == tcb);
+
+		TCB *Next = this->Waiting.WakeOne([this](TCB *Next)
+										  {
+											  this->RestorePriority();
+											  if (Next)
+											  {
+												  /* Hand it over, Locked stays set
+													 so nobody can steal it. */
+												  this->Holder.store(Next, std::memory_order_relaxed);
+
+												  /* The waiters left in the queue boosted
+													 us, Next has to run at their priority now */
+												  this->Waiting.ForEachLocked([this, Next](TCB *t)
+																			  {
+																				  if (t != Next)
+																					  this->InheritPriority(t); });
+												  return;
+											  }
+
+											  this->Holder.store(nullptr, std::memory_order_relaxed);
+											  this->Locked.store(false, std::memory_order_release); });
+
+		if (Next == nullptr)
 		{
 			debug("%#lx: Mutex unlocked, no tasks to unblock", this);
 			return;
 		}
 
-		TCB *Next = this->Waiting.front();
-		this->Waiting.pop_front();
-
 		debug("%#lx: Mutex unlocked, task %d (\"%s\" : %d) unblocked", this,
 			  Next->ID, Next->Parent->Name, Next->Parent->ID);
-
-		Next->Unblock();
 	}
 
 	mutex::mutex()
@@ -105,7 +170,7 @@ namespace std
 	mutex::~mutex()
 	{
 		debug("%#lx: Destroying mutex", this);
-		assert(this->Holder == nullptr);
-		assert(this->Waiting.empty());
+		assert(this->Holder.load() == nullptr);
+		assert(this->Waiting.Empty());
 	}
 }
@@ -26,9 +26,129 @@
 
 namespace vfs
 {
-	FileNode *Virtual::CacheSearchReturnLast(FileNode *Parent, const char **Path)
+	void Virtual::BeginNodeChange(FileNode *Node)
+	{
+		RenameSeq.fetch_add(1, std::memory_order_relaxed);
+		Node->Seq.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	void Virtual::EndNodeChange(FileNode *Node)
+	{
+		std::atomic_thread_fence(std::memory_order_release);
+		Node->Seq.fetch_add(1, std::memory_order_relaxed);
+		RenameSeq.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Walk cached nodes without taking VirtualLock.
+	 *
+	 * Every node is checked against its sequence number after
+	 * it was searched, and the whole walk against RenameSeq at
+	 * the end. Anything the dentry cache doesn't know, ".", ".."
+	 * and a change while walking, is left to the locked walk.
+	 */
+	Virtual::WalkResult Virtual::WalkRCU(FileNode *Parent, const char *Path, FileNode **Result)
+	{
+		uint32_t Global = RenameSeq.load(std::memory_order_acquire);
+		if (Global & 1)
+			return WalkRetry;
+
+		const char *path = Path;
+		if (strncmp(path, "\x06root-", 6) == 0) /* FIXME: deduce the index */
+		{
+			path += 6;
+			while (*path != '\0' && *path != '\x06')
+				path++;
+			if (*path == '\x06')
+				path++;
+		}
+
+		struct cwk_segment segment;
+		if (!cwk_path_get_first_segment(path, &segment))
+			return WalkRetry;
+
+		SmartRCURead();
+		FileNode *Node = Parent;
+		if (this->PathIsAbsolute(path))
+		{
+			while (Node->Parent)
+				Node = Node->Parent;
+		}
+
+		uint32_t Seq = Node->Seq.load(std::memory_order_acquire);
+		if (Seq & 1)
+			return WalkRetry;
+
+		FileNode *Next = nullptr;
+		do
+		{
+			if (segment.begin[0] == '.' &&
+				(segment.size == 1 || (segment.size == 2 && segment.begin[1] == '.')))
+				return WalkRetry;
+
+			uint64_t Hash = DentryCache::HashName(segment.begin, segment.size);
+			if (!Dentries.LookupRCU(Node, segment.begin, segment.size, Hash, &Next))
+				return WalkRetry;
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (Node->Seq.load(std::memory_order_relaxed) != Seq)
+				return WalkRetry;
+
+			if (Next == nullptr)
+				break;
+
+			Node = Next;
+			Seq = Node->Seq.load(std::memory_order_acquire);
+			if (Seq & 1)
+				return WalkRetry;
+		} while (cwk_path_get_next_segment(&segment));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (RenameSeq.load(std::memory_order_relaxed) != Global)
+			return WalkRetry;
+
+		if (Next == nullptr)
+			return WalkMissing;
+
+		if (Node->Seq.load(std::memory_order_relaxed) != Seq)
+			return WalkRetry;
+
+		*Result = Node;
+		return WalkFound;
+	}
+
+	/* One path segment, through the dentry cache first */
+	FileNode *Virtual::CacheChild(FileNode *Parent, const char *Name, size_t Length, bool *Missing)
+	{
+		uint64_t Hash = DentryCache::HashName(Name, Length);
+		FileNode *fn;
+		*Missing = false;
+		if (Dentries.Lookup(Parent, Name, Length, Hash, &fn))
+		{
+			*Missing = fn == nullptr;
+			return fn;
+		}
+
+		/* Evicted, the node tree still has it. Newer
+		   nodes win, a mount hides what was there. */
+		for (auto it = Parent->Children.rbegin(); it != Parent->Children.rend(); ++it)
+		{
+			FileNode *c = *it;
+			if (c->NameHash != Hash || c->Name.size() != Length ||
+				memcmp(c->Name.c_str(), Name, Length) != 0)
+				continue;
+
+			Dentries.Insert(Parent, Name, Length, Hash, c);
+			return c;
+		}
+		return nullptr;
+	}
+
+	FileNode *Virtual::CacheSearchReturnLast(FileNode *Parent, const char **Path, bool *Missing)
 	{
 		assert(Parent != nullptr);
+		SmartReadLock(VirtualLock);
 
 		struct cwk_segment segment;
 		if (!cwk_path_get_first_segment(*Path, &segment))
@@ -65,30 +185,20 @@ namespace vfs
 				__Parent = __Parent->Parent;
 		}
 
+		*Missing = false;
 		cwk_path_get_first_segment(tmpPath, &segment);
 		do
 		{
-			std::string segmentName(segment.begin, segment.size);
-
-			bool found = false;
-			for (FileNode *fn : __Parent->Children)
-			{
-				if (fn->Name != segmentName)
-					continue;
-
-				cwk_segment __seg = segment;
-				assert(cwk_path_get_next_segment(&__seg)); /* There's something wrong */
-
-				__Parent = fn;
-				found = true;
-				break;
-			}
-
-			if (!found)
+			FileNode *fn = CacheChild(__Parent, segment.begin, segment.size, Missing);
+			if (fn == nullptr)
 			{
 				*Path = segment.begin;
 				break;
 			}
+
+			cwk_segment __seg = segment;
+			assert(cwk_path_get_next_segment(&__seg)); /* There's something wrong */
+			__Parent = fn;
 		} while (cwk_path_get_next_segment(&segment));
 
 		return __Parent;
@@ -99,6 +209,7 @@ namespace vfs
 		if (Root == nullptr)
 			return nullptr;
 
+		SmartReadLock(VirtualLock);
 		debug("%s cache search for \"%s\" in \"%s\"",
 			  IsName ? "Relative" : "Absolute",
 			  NameOrPath,
@@ -116,13 +227,12 @@ namespace vfs
 		while (cwk_path_get_next_segment(&segment))
 			segments++;
 
+		bool Missing;
 		if (IsName && segments == 0)
 		{
-			for (FileNode *fn : Root->Children)
-			{
-				if (fn->Name == NameOrPath)
-					return fn;
-			}
+			FileNode *fn = CacheChild(Root, NameOrPath, strlen(NameOrPath), &Missing);
+			if (fn)
+				return fn;
 
 			ReturnLogError(nullptr, "Failed to find \"%s\" in \"%s\"", NameOrPath, Root->Path.c_str());
 		}
@@ -150,25 +260,14 @@ namespace vfs
 		cwk_path_get_first_segment(path, &segment);
 		do
 		{
-			std::string segmentName(segment.begin, segment.size);
-
-			bool found = false;
-			for (FileNode *fn : __Parent->Children)
-			{
-				if (fn->Name != segmentName)
-					continue;
-
-				cwk_segment __seg = segment;
-				if (!cwk_path_get_next_segment(&__seg))
-					return fn;
-
-				__Parent = fn;
-				found = true;
+			FileNode *fn = CacheChild(__Parent, segment.begin, segment.size, &Missing);
+			if (fn == nullptr)
 				break;
-			}
 
-			if (!found)
-				break;
+			cwk_segment __seg = segment;
+			if (!cwk_path_get_next_segment(&__seg))
+				return fn;
+			__Parent = fn;
 		} while (cwk_path_get_next_segment(&segment));
 
 		debug("Failed to find \"%s\" in \"%s\"", NameOrPath, Root->Path.c_str());
@@ -190,8 +289,34 @@ namespace vfs
 
 	FileNode *Virtual::CreateCacheNode(FileNode *Parent, Inode *Node, const char *Name, mode_t Mode)
 	{
+		SmartWriteLock(VirtualLock);
+
+		size_t Length = strlen(Name);
+		uint64_t Hash = DentryCache::HashName(Name, Length);
+		if (Parent)
+		{
+			/* Another thread might have resolved
+			   the same inode while we were looking it up */
+			FileNode *fn = nullptr;
+			if (!Dentries.Lookup(Parent, Name, Length, Hash, &fn))
+			{
+				for (auto it = Parent->Children.rbegin(); it != Parent->Children.rend(); ++it)
+				{
+					if ((*it)->Name == Name)
+					{
+						fn = *it;
+						break;
+					}
+				}
+			}
+
+			if (fn && fn->Node == Node)
+				return fn;
+		}
+
 		FileNode *fn = new FileNode;
 		fn->Name = Name;
+		fn->NameHash = Hash;
 		if (Parent)
 		{
 			fn->Path = Parent->Path + "/" + Name;
@@ -205,6 +330,9 @@ namespace vfs
 		if (fn->fsi == nullptr)
 			warn("Failed to find filesystem for device %d", Node->Device);
 
+		if (Parent)
+			Dentries.Insert(Parent, Name, Length, Hash, fn);
+
 		debug("Created cache node %s", fn->Path.c_str());
 		return fn;
 	}
@@ -214,12 +342,16 @@ namespace vfs
 		if (Node == nullptr)
 			return -EINVAL;
 
+		SmartWriteLock(VirtualLock);
+		BeginNodeChange(Node);
+		Dentries.Forget(Node);
 		if (Node->Parent)
 		{
 			Node->Parent->Children.erase(std::find(Node->Parent->Children.begin(), Node->Parent->Children.end(), Node));
 			// delete Node;
 			fixme("Node deletion is disabled for now (for debugging purposes)");
 		}
+		EndNodeChange(Node);
 
 		return 0;
 	}
@@ -0,0 +1,214 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <filesystem.hpp>
+
+#include <memory.hpp>
+#include <rcu.hpp>
+
+#include "../kernel.h"
+
+/* Must be a power of two */
+#define DCACHE_BUCKETS 4096
+#define DCACHE_MAX_ENTRIES 16384
+/* How often to look at the free memory */
+#define DCACHE_PRESSURE_CHECK 256
+
+namespace vfs
+{
+	uint64_t DentryCache::HashName(const char *Name, size_t Length)
+	{
+		/* FNV-1a */
+		uint64_t h = 0xCBF29CE484222325ULL;
+		for (size_t i = 0; i < Length; i++)
+		{
+			h ^= (uint8_t)Name[i];
+			h *= 0x100000001B3ULL;
+		}
+		return h;
+	}
+
+	static inline size_t Bucket(FileNode *Parent, uint64_t Hash)
+	{
+		uint64_t h = (Hash ^ (uintptr_t)Parent) * 0x9E3779B97F4A7C15ULL;
+		return h >> (64 - __builtin_ctzll(DCACHE_BUCKETS));
+	}
+
+	void DentryCache::FreeEntry(rcu_head *head)
+	{
+		/* Rcu is the first member */
+		delete (DentryCache::Entry *)head;
+	}
+
+	DentryCache::Entry **DentryCache::Find(FileNode *Parent, const char *Name,
+										   size_t Length, uint64_t Hash)
+	{
+		Entry **Slot = &Buckets[Bucket(Parent, Hash)];
+		for (; *Slot; Slot = &(*Slot)->Next)
+		{
+			Entry *e = *Slot;
+			if (e->Parent == Parent && e->Hash == Hash &&
+				e->Name.size() == Length &&
+				memcmp(e->Name.c_str(), Name, Length) == 0)
+				return Slot;
+		}
+		return Slot;
+	}
+
+	void DentryCache::Unlink(Entry **Slot)
+	{
+		Entry *e = *Slot;
+		/* Readers that are on e can still follow e->Next */
+		rcu_assign_pointer(*Slot, e->Next);
+		e->Newer->Older = e->Older;
+		e->Older->Newer = e->Newer;
+		Count--;
+		call_rcu(&e->Rcu, FreeEntry);
+	}
+
+	void DentryCache::Shrink(size_t Target)
+	{
+		/* Second chance, entries used since the last
+		   pass go back to the newest end once */
+		size_t Passes = Count;
+		while (Count > Target)
+		{
+			Entry *e = LRU.Newer; /* Oldest */
+			if (Passes > 0 && e->Referenced.exchange(false, std::memory_order_relaxed))
+			{
+				Passes--;
+				e->Newer->Older = e->Older;
+				e->Older->Newer = e->Newer;
+				e->Older = LRU.Older;
+				e->Newer = &LRU;
+				LRU.Older->Newer = e;
+				LRU.Older = e;
+				continue;
+			}
+
+			Entry **Slot = Find(e->Parent, e->Name.c_str(), e->Name.size(), e->Hash);
+			assert(*Slot == e);
+			Unlink(Slot);
+		}
+	}
+
+	bool DentryCache::LookupRCU(FileNode *Parent, const char *Name, size_t Length,
+								uint64_t Hash, FileNode **Result)
+	{
+		Entry *e = rcu_dereference(Buckets[Bucket(Parent, Hash)]);
+		for (; e; e = rcu_dereference(e->Next))
+		{
+			if (e->Parent == Parent && e->Hash == Hash &&
+				e->Name.size() == Length &&
+				memcmp(e->Name.c_str(), Name, Length) == 0)
+				break;
+		}
+
+		if (e == nullptr)
+		{
+			Misses.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		if (!e->Referenced.load(std::memory_order_relaxed))
+			e->Referenced.store(true, std::memory_order_relaxed);
+
+		*Result = e->Node.load(std::memory_order_acquire);
+		if (*Result)
+			Hits.fetch_add(1, std::memory_order_relaxed);
+		else
+			NegativeHits.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool DentryCache::Lookup(FileNode *Parent, const char *Name, size_t Length,
+							 uint64_t Hash, FileNode **Result)
+	{
+		SmartRCURead();
+		return LookupRCU(Parent, Name, Length, Hash, Result);
+	}
+
+	void DentryCache::Insert(FileNode *Parent, const char *Name, size_t Length,
+							 uint64_t Hash, FileNode *Node)
+	{
+		SmartLock(CacheLock);
+		Entry **Slot = Find(Parent, Name, Length, Hash);
+		if (*Slot)
+		{
+			(*Slot)->Node.store(Node, std::memory_order_release);
+			return;
+		}
+
+		Entry *e = new Entry;
+		e->Parent = Parent;
+		e->Node = Node;
+		e->Hash = Hash;
+		e->Name = std::string(Name, Length);
+		e->Older = LRU.Older;
+		e->Newer = &LRU;
+		LRU.Older->Newer = e;
+		LRU.Older = e;
+		/* Fully built before readers can see it */
+		rcu_assign_pointer(*Slot, e);
+		Count++;
+
+		size_t Target = DCACHE_MAX_ENTRIES;
+		if (++Inserts % DCACHE_PRESSURE_CHECK == 0 &&
+			KernelAllocator.GetFreeMemory() < KernelAllocator.GetTotalMemory() / 32)
+		{
+			debug("Memory is low, shrinking %ld dentries", Count);
+			Target = Count / 2;
+		}
+		Shrink(Target);
+	}
+
+	void DentryCache::Forget(FileNode *Node)
+	{
+		SmartLock(CacheLock);
+		if (Node->Parent)
+		{
+			Entry **Slot = Find(Node->Parent, Node->Name.c_str(),
+								Node->Name.size(), Node->NameHash);
+			if (*Slot)
+				Unlink(Slot);
+		}
+
+		for (size_t i = 0; i < DCACHE_BUCKETS; i++)
+		{
+			Entry **Slot = &Buckets[i];
+			while (*Slot)
+			{
+				if ((*Slot)->Parent == Node || (*Slot)->Node.load() == Node)
+					Unlink(Slot);
+				else
+					Slot = &(*Slot)->Next;
+			}
+		}
+	}
+
+	DentryCache::DentryCache()
+	{
+		Buckets = new Entry *[DCACHE_BUCKETS]();
+		LRU.Newer = LRU.Older = &LRU;
+	}
+
+	DentryCache::~DentryCache()
+	{
+		Shrink(0);
+		delete[] Buckets;
+	}
+}
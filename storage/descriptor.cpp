@@ -18,6 +18,9 @@
 #include <filesystem.hpp>
 
 #include <convert.h>
+#include <epoll.hpp>
+#include <pipe.hpp>
+#include <uring.hpp>
 #include <stropts.h>
 #include <task.hpp>
 #include <printf.h>
@@ -28,22 +31,189 @@
 
 namespace vfs
 {
+	/* Drop the reference the description has on what it points to */
+	static bool ReleaseDescriptor(FileDescriptorTable::Fildes &fd)
+	{
+		if (fd.Type == FileDescriptorTable::Fildes::FD_EPOLL)
+			EventPoll::FromFile(fd.Node)->Put();
+		else if (fd.Type == FileDescriptorTable::Fildes::FD_URING)
+			IoRing::FromFile(fd.Node)->Put();
+		else if (fd.Type == FileDescriptorTable::Fildes::FD_PIPE)
+		{
+			bool ReadEnd;
+			Pipe::FromFile(fd.Node, &ReadEnd)->Close(ReadEnd);
+		}
+		else
+			return false;
+		return true;
+	}
+
+	/* Move data between two descriptors without a user buffer */
+	static ssize_t TransferDescriptor(FileDescriptorTable::Fildes &In, off_t &InOffset,
+									  FileDescriptorTable::Fildes &Out, off_t &OutOffset,
+									  size_t Size)
+	{
+		if (In.Type == FileDescriptorTable::Fildes::FD_EPOLL ||
+			Out.Type == FileDescriptorTable::Fildes::FD_EPOLL ||
+			In.Type == FileDescriptorTable::Fildes::FD_URING ||
+			Out.Type == FileDescriptorTable::Fildes::FD_URING)
+			return -EINVAL;
+
+		bool InRead = false, OutRead = false;
+		Pipe *pIn = In.Type == FileDescriptorTable::Fildes::FD_PIPE
+						? Pipe::FromFile(In.Node, &InRead)
+						: nullptr;
+		Pipe *pOut = Out.Type == FileDescriptorTable::Fildes::FD_PIPE
+						 ? Pipe::FromFile(Out.Node, &OutRead)
+						 : nullptr;
+
+		if ((pIn && !InRead) || (pOut && OutRead))
+			return -EBADF;
+
+		if (pIn == nullptr && pOut == nullptr)
+			return fs->Transfer(In.Node, InOffset, Out.Node, OutOffset, Size);
+
+		/* Pipes already hold their data in pages, let them do the work */
+		bool NonBlocking = (In.Flags | Out.Flags) & O_NONBLOCK;
+		Pipe *p = pIn ? pIn : pOut;
+		ssize_t ret;
+		p->Get();
+		if (pIn && pOut)
+		{
+			pOut->Get();
+			ret = pIn->Splice(pOut, Size, NonBlocking);
+			pOut->Put();
+		}
+		else if (pIn)
+			ret = pIn->SpliceTo(Out.Node, OutOffset, Size, NonBlocking);
+		else
+			ret = pOut->SpliceFrom(In.Node, InOffset, Size, NonBlocking);
+		p->Put();
+		return ret;
+	}
+
+	/* Writes with O_APPEND always go to the end of the file */
+	static void AppendOffset(FileDescriptorTable::Fildes &fd)
+	{
+		if (!(fd.Flags & O_APPEND) || fd.Type != FileDescriptorTable::Fildes::FD_INODE)
+			return;
+
+		struct kstat stat{};
+		if (fd.Node->Stat(&stat) == 0)
+			fd.Offset = stat.Size;
+	}
+
+	/* The /proc/<pid>/fd link of a descriptor */
+	static void LinkDescriptor(FileNode *fdDir, int fd, const char *Target)
+	{
+		char linkName[64];
+		snprintf(linkName, 64, "%d", fd);
+		if (fs->CreateLink(linkName, fdDir, Target) == nullptr)
+		{
+			debug("Failed to create fd link for %s", Target);
+		}
+	}
+
+	static void UnlinkDescriptor(FileNode *fdDir, int fd)
+	{
+		char linkName[64];
+		snprintf(linkName, 64, "%d", fd);
+		FileNode *link = fs->GetByPath(linkName, fdDir);
+		if (link)
+			fs->Remove(link);
+	}
+
+	/* Read or write a whole scatter-gather list in one go */
+	static ssize_t VectorDescriptor(FileDescriptorTable::Fildes &fd, const struct kiovec *iov,
+									int iovcnt, off_t *Offset, bool Write, bool NonBlocking)
+	{
+		if (fd.Type == FileDescriptorTable::Fildes::FD_EPOLL ||
+			fd.Type == FileDescriptorTable::Fildes::FD_URING)
+			return -EINVAL;
+
+		if (fd.Type != FileDescriptorTable::Fildes::FD_PIPE)
+		{
+			if (Write && Offset == &fd.Offset)
+				AppendOffset(fd);
+
+			ssize_t ret = Write ? fd.Node->WriteV(iov, iovcnt, *Offset)
+								: fd.Node->ReadV(iov, iovcnt, *Offset);
+			if (ret > 0)
+				*Offset += ret;
+			return ret;
+		}
+
+		if (Offset != &fd.Offset)
+			return -ESPIPE;
+
+		/* Pipes only block until the first buffer is done */
+		Pipe *p = Pipe::FromFile(fd.Node);
+		NonBlocking |= fd.Flags & O_NONBLOCK;
+		ssize_t Total = 0;
+		p->Get();
+		for (int i = 0; i < iovcnt; i++)
+		{
+			if (iov[i].iov_len == 0)
+				continue;
+
+			ssize_t n = Write ? p->Write(iov[i].iov_base, iov[i].iov_len, NonBlocking)
+							  : p->Read(iov[i].iov_base, iov[i].iov_len, NonBlocking);
+			if (n < 0)
+			{
+				if (Total == 0)
+					Total = n;
+				break;
+			}
+
+			Total += n;
+			if ((size_t)n < iov[i].iov_len)
+				break;
+			NonBlocking = true;
+		}
+		p->Put();
+		return Total;
+	}
+
 	int FileDescriptorTable::GetFlags(int FileDescriptor)
 	{
-		auto it = this->FileMap.find(FileDescriptor);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(FileDescriptor);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
 
-		return it->second.Flags;
+		return it->Flags;
 	}
 
 	int FileDescriptorTable::SetFlags(int FileDescriptor, int Flags)
 	{
-		auto it = this->FileMap.find(FileDescriptor);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(FileDescriptor);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
 
-		it->second.Flags = Flags;
+		it->Flags = Flags;
+		return 0;
+	}
+
+	int FileDescriptorTable::GetDescriptorFlags(int FileDescriptor)
+	{
+		SmartLock(this->TableLock);
+		if (this->Lookup(FileDescriptor) == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
+
+		bool cloexec = this->CloseOnExec[FileDescriptor / 64] & (1ULL << (FileDescriptor % 64));
+		return cloexec ? O_CLOEXEC : 0;
+	}
+
+	int FileDescriptorTable::SetDescriptorFlags(int FileDescriptor, int Flags)
+	{
+		SmartLock(this->TableLock);
+		if (this->Lookup(FileDescriptor) == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
+
+		uint64_t bit = 1ULL << (FileDescriptor % 64);
+		if (Flags & O_CLOEXEC)
+			this->CloseOnExec[FileDescriptor / 64] |= bit;
+		else
+			this->CloseOnExec[FileDescriptor / 64] &= ~bit;
 		return 0;
 	}
 
@@ -104,11 +274,6 @@ namespace vfs
 			}
 		}
 
-		if (Flags & O_CLOEXEC)
-		{
-			fixme("O_CLOEXEC");
-		}
-
 		FileNode *File = fs->GetByPath(AbsolutePath, pcb->CWD);
 
 		if (!File)
@@ -123,73 +288,267 @@ namespace vfs
 			File->Truncate(0);
 		}
 
-		Fildes fd{};
-
+		Fildes *fd = new Fildes;
+		fd->Mode = Mode;
+		fd->Flags = Flags & ~O_CLOEXEC;
+		fd->Node = File;
 		if (Flags & O_APPEND)
 		{
 			debug("Appending to file %s", AbsolutePath);
-			struct kstat stat;
-			File->Stat(&stat);
-			fd.Offset = File->Seek(stat.Size);
+			AppendOffset(*fd);
 		}
 
-		fd.Mode = Mode;
-		fd.Flags = Flags;
-		fd.Node = File;
-
-		int fdn = this->GetFreeFileDescriptor();
+		int fdn = this->Allocate(fd, Flags & O_CLOEXEC);
 		if (fdn < 0)
+		{
+			delete fd;
 			return fdn;
+		}
 
-		this->FileMap.insert({fdn, fd});
-
-		char linkName[64];
-		snprintf(linkName, 64, "%d", fdn);
-		assert(fs->CreateLink(linkName, this->fdDir, AbsolutePath) != nullptr);
+		LinkDescriptor(this->fdDir, fdn, AbsolutePath);
 
 		File->Open(Flags, Mode);
 		return fdn;
 	}
 
+	int FileDescriptorTable::AddAnonymousDescriptor(FileNode *Node, Fildes::FildesType Type,
+													int Flags, const char *Name)
+	{
+		Fildes *fd = new Fildes;
+		fd->Type = Type;
+		fd->Mode = Node->Node->Mode;
+		fd->Flags = Flags & ~O_CLOEXEC;
+		fd->Node = Node;
+
+		int fdn = this->Allocate(fd, Flags & O_CLOEXEC);
+		if (fdn < 0)
+		{
+			delete fd;
+			return fdn;
+		}
+
+		LinkDescriptor(this->fdDir, fdn, Name);
+
+		return fdn;
+	}
+
 	int FileDescriptorTable::RemoveFileDescriptor(int FileDescriptor)
 	{
-		auto it = this->FileMap.find(FileDescriptor);
-		if (it == this->FileMap.end())
+		Fildes *fd;
+		{
+			SmartLock(this->TableLock);
+			fd = this->Uninstall(FileDescriptor);
+		}
+
+		if (fd == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", FileDescriptor);
 
-		fs->Remove(it->second.Node);
-		this->FileMap.erase(it);
+		UnlinkDescriptor(this->fdDir, FileDescriptor);
+		fd->Put();
 		return 0;
 	}
 
-	int FileDescriptorTable::GetFreeFileDescriptor()
+	void FileDescriptorTable::Fildes::Put()
 	{
-		Tasking::PCB *pcb = thisProcess;
+		if (this->References.fetch_sub(1) != 1)
+			return;
+
+		/* That was the last reference to this description */
+		if (!this->EventPolls.empty())
+			EventPoll::Release(this);
+		if (!ReleaseDescriptor(*this))
+			this->Node->Close();
+		delete this;
+	}
+
+	static bool LocksOffset(FileDescriptorTable::Fildes *fd)
+	{
+		return fd && fd->Type == FileDescriptorTable::Fildes::FD_INODE &&
+			   (fd->Node->IsRegularFile() || fd->Node->IsDirectory());
+	}
+
+	FileDescriptorTable::OffsetGuard::OffsetGuard(Fildes &fd, Fildes *Other)
+	{
+		this->First = LocksOffset(&fd) ? &fd : nullptr;
+		this->Second = LocksOffset(Other) && Other != &fd ? Other : nullptr;
+
+		/* Always lock in the same order */
+		if (this->First == nullptr || (this->Second && this->Second < this->First))
+			std::swap(this->First, this->Second);
+
+		if (this->First)
+			this->First->OffsetLock.WriteLock(__FUNCTION__);
+		if (this->Second)
+			this->Second->OffsetLock.WriteLock(__FUNCTION__);
+	}
+
+	FileDescriptorTable::OffsetGuard::~OffsetGuard()
+	{
+		if (this->Second)
+			this->Second->OffsetLock.WriteUnlock();
+		if (this->First)
+			this->First->OffsetLock.WriteUnlock();
+	}
+
+	/* First zero bit at or after From, or Words * 64 */
+	static size_t FindZeroBit(const uint64_t *Map, size_t Words, size_t From)
+	{
+		size_t w = From / 64;
+		if (w >= Words)
+			return Words * 64;
 
-		for (size_t i = 0; i < pcb->SoftLimits.OpenFiles; i++)
+		uint64_t word = Map[w] | ((1ULL << (From % 64)) - 1);
+		while (word == ~0ULL)
 		{
-			auto it = this->FileMap.find(i);
-			if (it == this->FileMap.end())
-				return i;
+			if (++w == Words)
+				return Words * 64;
+			word = Map[w];
 		}
+		return w * 64 + __builtin_ctzll(~word);
+	}
 
-		return -EMFILE;
+	int FileDescriptorTable::Expand(size_t Count)
+	{
+		if (Count <= this->Capacity)
+			return 0;
+
+		size_t newCapacity = MAX(this->Capacity, (size_t)64);
+		while (newCapacity < Count)
+			newCapacity *= 2;
+
+		size_t words = this->Capacity / 64;
+		size_t newWords = newCapacity / 64;
+		size_t fullWords = ALIGN_UP(words, 64) / 64;
+		size_t newFullWords = ALIGN_UP(newWords, 64) / 64;
+
+		Fildes **files = new Fildes *[newCapacity]();
+		uint64_t *openMap = new uint64_t[newWords]();
+		uint64_t *fullMap = new uint64_t[newFullWords]();
+		uint64_t *closeOnExec = new uint64_t[newWords]();
+		if (this->Files)
+		{
+			memcpy(files, this->Files, this->Capacity * sizeof(Fildes *));
+			memcpy(openMap, this->OpenMap, words * sizeof(uint64_t));
+			memcpy(fullMap, this->FullMap, fullWords * sizeof(uint64_t));
+			memcpy(closeOnExec, this->CloseOnExec, words * sizeof(uint64_t));
+			delete[] this->Files;
+			delete[] this->OpenMap;
+			delete[] this->FullMap;
+			delete[] this->CloseOnExec;
+		}
+
+		this->Files = files;
+		this->OpenMap = openMap;
+		this->FullMap = fullMap;
+		this->CloseOnExec = closeOnExec;
+		this->Capacity = newCapacity;
+		return 0;
 	}
 
-	void FileDescriptorTable::Fork(FileDescriptorTable *Parent)
+	void FileDescriptorTable::Install(int FileDescriptor, Fildes *fd, bool Cloexec)
+	{
+		size_t w = FileDescriptor / 64;
+		assert((size_t)FileDescriptor < this->Capacity);
+		assert(this->Files[FileDescriptor] == nullptr);
+
+		this->Files[FileDescriptor] = fd;
+		this->OpenMap[w] |= 1ULL << (FileDescriptor % 64);
+		if (this->OpenMap[w] == ~0ULL)
+			this->FullMap[w / 64] |= 1ULL << (w % 64);
+		if (Cloexec)
+			this->CloseOnExec[w] |= 1ULL << (FileDescriptor % 64);
+
+		if ((size_t)FileDescriptor == this->NextFree)
+			this->NextFree++;
+	}
+
+	FileDescriptorTable::Fildes *FileDescriptorTable::Lookup(int FileDescriptor)
+	{
+		/* Negative ones wrap around to huge numbers */
+		if ((size_t)FileDescriptor >= this->Capacity)
+			return nullptr;
+		return this->Files[FileDescriptor];
+	}
+
+	FileDescriptorTable::FildesRef FileDescriptorTable::GetDescriptor(int FileDescriptor)
 	{
-		this->FileMap = Parent->FileMap;
+		SmartLock(this->TableLock);
+		Fildes *fd = this->Lookup(FileDescriptor);
+		return FildesRef(fd ? fd->Get() : nullptr);
+	}
 
-		for (const auto &fd : this->FileMap)
+	void FileDescriptorTable::Snapshot(std::vector<std::pair<int, Fildes *>> &Open)
+	{
+		for (size_t w = 0; w < this->Capacity / 64; w++)
 		{
-			if (fd.second.Flags & O_CLOEXEC)
+			uint64_t word = this->OpenMap[w];
+			while (word)
 			{
-				debug("O_CLOEXEC flag set, removing fd %d", fd.first);
-				this->FileMap.erase(fd.first);
+				int fd = (int)(w * 64 + __builtin_ctzll(word));
+				word &= word - 1;
+				Open.push_back({fd, this->Files[fd]->Get()});
 			}
 		}
 	}
 
+	FileDescriptorTable::Fildes *FileDescriptorTable::Uninstall(int FileDescriptor)
+	{
+		Fildes *fd = this->Lookup(FileDescriptor);
+		if (fd == nullptr)
+			return nullptr;
+
+		size_t w = FileDescriptor / 64;
+		this->Files[FileDescriptor] = nullptr;
+		this->OpenMap[w] &= ~(1ULL << (FileDescriptor % 64));
+		this->FullMap[w / 64] &= ~(1ULL << (w % 64));
+		this->CloseOnExec[w] &= ~(1ULL << (FileDescriptor % 64));
+		this->NextFree = MIN(this->NextFree, (size_t)FileDescriptor);
+		return fd;
+	}
+
+	int FileDescriptorTable::Allocate(Fildes *fd, bool Cloexec)
+	{
+		Tasking::PCB *pcb = (Tasking::PCB *)this->Owner;
+		SmartLock(this->TableLock);
+
+		/* Skip words that are full, then look inside the first one that isn't */
+		size_t words = this->Capacity / 64;
+		size_t w = FindZeroBit(this->FullMap, ALIGN_UP(words, 64) / 64, this->NextFree / 64);
+		size_t fdn = this->Capacity;
+		if (w < words)
+			fdn = FindZeroBit(this->OpenMap, words, MAX(this->NextFree, w * 64));
+
+		if (fdn >= pcb->SoftLimits.OpenFiles)
+			return -EMFILE;
+
+		if (this->Expand(fdn + 1) < 0)
+			return -ENOMEM;
+
+		/* Taken under the same lock, no other thread can pick it */
+		this->Install((int)fdn, fd, Cloexec);
+		return (int)fdn;
+	}
+
+	void FileDescriptorTable::Fork(FileDescriptorTable *Parent)
+	{
+		/* The child shares every open file description with the parent */
+		Parent->ForEach([this, Parent](int Number, Fildes &fd)
+						{
+							if (Parent->GetDescriptorFlags(Number) & O_CLOEXEC)
+							{
+								debug("O_CLOEXEC flag set, removing fd %d", Number);
+								return;
+							}
+
+							{
+								SmartLock(this->TableLock);
+								if (this->Expand(Number + 1) < 0)
+									return;
+								this->Install(Number, fd.Get(), false);
+							}
+							LinkDescriptor(this->fdDir, Number, fd.Node->Path.c_str()); });
+	}
+
 	int FileDescriptorTable::usr_open(const char *pathname, int flags, mode_t mode)
 	{
 		if (pathname == nullptr)
@@ -205,26 +564,53 @@ namespace vfs
 
 	ssize_t FileDescriptorTable::usr_read(int fd, void *buf, size_t count)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		return it->second.Node->Read(buf, count, it->second.Offset);
+		if (it->Type == Fildes::FD_PIPE)
+		{
+			Pipe *p = Pipe::FromFile(it->Node);
+			p->Get();
+			ssize_t ret = p->Read(buf, count, it->Flags & O_NONBLOCK);
+			p->Put();
+			return ret;
+		}
+
+		OffsetGuard guard(*it);
+		ssize_t ret = it->Node->Read(buf, count, it->Offset);
+		if (ret > 0)
+			it->Offset += ret;
+		return ret;
 	}
 
 	ssize_t FileDescriptorTable::usr_write(int fd, const void *buf, size_t count)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		return it->second.Node->Write(buf, count, it->second.Offset);
+		if (it->Type == Fildes::FD_PIPE)
+		{
+			Pipe *p = Pipe::FromFile(it->Node);
+			p->Get();
+			ssize_t ret = p->Write(buf, count, it->Flags & O_NONBLOCK);
+			p->Put();
+			return ret;
+		}
+
+		OffsetGuard guard(*it);
+		AppendOffset(*it);
+		ssize_t ret = it->Node->Write(buf, count, it->Offset);
+		if (ret > 0)
+			it->Offset += ret;
+		return ret;
 	}
 
 	int FileDescriptorTable::usr_close(int fd)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
 		return RemoveFileDescriptor(fd);
@@ -232,22 +618,28 @@ namespace vfs
 
 	off_t FileDescriptorTable::usr_lseek(int fd, off_t offset, int whence)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		off_t &newOffset = it->second.Offset;
+		if (it->Type == Fildes::FD_PIPE ||
+			it->Type == Fildes::FD_EPOLL ||
+			it->Type == Fildes::FD_URING)
+			return -ESPIPE;
+
+		OffsetGuard guard(*it);
+		off_t &newOffset = it->Offset;
 
 		switch (whence)
 		{
 		case SEEK_SET:
 		{
-			newOffset = it->second.Node->Seek(offset);
+			newOffset = it->Node->Seek(offset);
 			break;
 		}
 		case SEEK_CUR:
 		{
-			newOffset = it->second.Node->Seek(newOffset + offset);
+			newOffset = it->Node->Seek(newOffset + offset);
 			break;
 		}
 		case SEEK_END:
@@ -255,8 +647,8 @@ namespace vfs
 			struct kstat stat
 			{
 			};
-			it->second.Node->Stat(&stat);
-			newOffset = it->second.Node->Seek(stat.Size + offset);
+			it->Node->Stat(&stat);
+			newOffset = it->Node->Seek(stat.Size + offset);
 			break;
 		}
 		default:
@@ -292,11 +684,11 @@ namespace vfs
 
 	int FileDescriptorTable::usr_fstat(int fd, struct kstat *statbuf)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		vfs::FileDescriptorTable::Fildes &fildes = it->second;
+		vfs::FileDescriptorTable::Fildes &fildes = *it;
 
 		return fildes.Node->Stat(statbuf);
 	}
@@ -312,19 +704,19 @@ namespace vfs
 
 	int FileDescriptorTable::usr_dup(int oldfd)
 	{
-		auto it = this->FileMap.find(oldfd);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(oldfd);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", oldfd);
 
-		int newfd = this->GetFreeFileDescriptor();
+		/* Both share the offset and flags, close-on-exec starts cleared */
+		int newfd = this->Allocate(it->Get(), false);
 		if (newfd < 0)
+		{
+			it->Put();
 			return -EMFILE;
+		}
 
-		Fildes new_dfd{};
-		new_dfd.Node = it->second.Node;
-		new_dfd.Mode = it->second.Mode;
-
-		this->FileMap.insert({newfd, new_dfd});
+		LinkDescriptor(this->fdDir, newfd, it->Node->Path.c_str());
 
 		debug("Duplicated file descriptor %d to %d", oldfd, newfd);
 		return newfd;
@@ -335,32 +727,213 @@ namespace vfs
 		if (newfd < 0)
 			ReturnLogError(-EBADF, "Invalid newfd %d", newfd);
 
-		auto it = this->FileMap.find(oldfd);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(oldfd);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid oldfd %d", oldfd);
 
 		if (newfd == oldfd)
 			return newfd;
 
-		/* Even if it's not valid we ignore it. */
-		this->usr_close(newfd);
+		Tasking::PCB *pcb = (Tasking::PCB *)this->Owner;
+		if ((size_t)newfd >= pcb->SoftLimits.OpenFiles)
+			ReturnLogError(-EBADF, "Invalid newfd %d", newfd);
+
+		/* Silently close newfd if it is open, in the
+		   same step so no other thread can take it */
+		Fildes *old;
+		{
+			SmartLock(this->TableLock);
+			if (this->Expand(newfd + 1) < 0)
+				return -ENOMEM;
 
-		Fildes new_dfd{};
-		new_dfd.Node = it->second.Node;
-		new_dfd.Mode = it->second.Mode;
+			old = this->Uninstall(newfd);
+			this->Install(newfd, it->Get(), false);
+		}
+
+		if (old)
+		{
+			UnlinkDescriptor(this->fdDir, newfd);
+			old->Put();
+		}
 
-		this->FileMap.insert({newfd, new_dfd});
+		LinkDescriptor(this->fdDir, newfd, it->Node->Path.c_str());
 		debug("Duplicated file descriptor %d to %d", oldfd, newfd);
 		return newfd;
 	}
 
+	int FileDescriptorTable::usr_pipe(int pipefd[2], int flags)
+	{
+		if (flags & ~(O_CLOEXEC | O_DIRECT | O_NONBLOCK))
+			return -EINVAL;
+
+		Pipe *p = new Pipe(flags & O_DIRECT);
+		int Extra = flags & (O_CLOEXEC | O_NONBLOCK);
+
+		p->Open(true);
+		int rfd = this->AddAnonymousDescriptor(p->GetReadEnd(), Fildes::FD_PIPE,
+											   O_RDONLY | Extra, "pipe");
+		if (rfd < 0)
+		{
+			p->Close(true);
+			p->Put();
+			return rfd;
+		}
+
+		p->Open(false);
+		int wfd = this->AddAnonymousDescriptor(p->GetWriteEnd(), Fildes::FD_PIPE,
+											   O_WRONLY | Extra, "pipe");
+		if (wfd < 0)
+		{
+			p->Close(false);
+			this->RemoveFileDescriptor(rfd);
+			p->Put();
+			return wfd;
+		}
+
+		/* The descriptors own the pipe now */
+		p->Put();
+		pipefd[0] = rfd;
+		pipefd[1] = wfd;
+		return 0;
+	}
+
+	ssize_t FileDescriptorTable::usr_readv(int fd, const struct kiovec *iov, int iovcnt, bool NonBlocking)
+	{
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", fd);
+
+		OffsetGuard guard(*it);
+		return VectorDescriptor(*it, iov, iovcnt, &it->Offset, false, NonBlocking);
+	}
+
+	ssize_t FileDescriptorTable::usr_writev(int fd, const struct kiovec *iov, int iovcnt, bool NonBlocking)
+	{
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", fd);
+
+		OffsetGuard guard(*it);
+		return VectorDescriptor(*it, iov, iovcnt, &it->Offset, true, NonBlocking);
+	}
+
+	ssize_t FileDescriptorTable::usr_preadv(int fd, const struct kiovec *iov, int iovcnt,
+											off_t offset, bool NonBlocking)
+	{
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", fd);
+
+		if (offset < 0)
+			return -EINVAL;
+
+		/* The file position is left alone */
+		return VectorDescriptor(*it, iov, iovcnt, &offset, false, NonBlocking);
+	}
+
+	ssize_t FileDescriptorTable::usr_pwritev(int fd, const struct kiovec *iov, int iovcnt,
+											 off_t offset, bool NonBlocking)
+	{
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd %d", fd);
+
+		if (offset < 0)
+			return -EINVAL;
+
+		return VectorDescriptor(*it, iov, iovcnt, &offset, true, NonBlocking);
+	}
+
+	ssize_t FileDescriptorTable::usr_sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+	{
+		auto itIn = this->GetDescriptor(in_fd);
+		if (itIn == nullptr)
+			ReturnLogError(-EBADF, "Invalid in_fd %d", in_fd);
+
+		auto itOut = this->GetDescriptor(out_fd);
+		if (itOut == nullptr)
+			ReturnLogError(-EBADF, "Invalid out_fd %d", out_fd);
+
+		OffsetGuard guard(*itIn, itOut.get());
+
+		/* With an offset, the input file position is left alone */
+		off_t InOffset = offset ? *offset : itIn->Offset;
+		if (InOffset < 0)
+			return -EINVAL;
+
+		if (count == 0)
+			return 0;
+
+		ssize_t ret = TransferDescriptor(*itIn, InOffset,
+										 *itOut, itOut->Offset, count);
+
+		if (offset)
+			*offset = InOffset;
+		else
+			itIn->Offset = InOffset;
+		return ret;
+	}
+
+	ssize_t FileDescriptorTable::usr_copy_file_range(int fd_in, off_t *off_in, int fd_out,
+													 off_t *off_out, size_t len, unsigned int flags)
+	{
+		if (flags != 0)
+			return -EINVAL;
+
+		auto itIn = this->GetDescriptor(fd_in);
+		if (itIn == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd_in %d", fd_in);
+
+		auto itOut = this->GetDescriptor(fd_out);
+		if (itOut == nullptr)
+			ReturnLogError(-EBADF, "Invalid fd_out %d", fd_out);
+
+		Fildes &In = *itIn;
+		Fildes &Out = *itOut;
+		if (In.Node->IsDirectory() || Out.Node->IsDirectory())
+			return -EISDIR;
+
+		/* Only between regular files */
+		if (In.Type != Fildes::FD_INODE || Out.Type != Fildes::FD_INODE)
+			return -EINVAL;
+
+		OffsetGuard guard(In, &Out);
+		off_t InOffset = off_in ? *off_in : In.Offset;
+		off_t OutOffset = off_out ? *off_out : Out.Offset;
+		if (InOffset < 0 || OutOffset < 0)
+			return -EINVAL;
+
+		/* The ranges overlap if they start less than len apart,
+			comparing unsigned so a huge len can't overflow */
+		uint64_t Gap = InOffset > OutOffset ? uint64_t(InOffset - OutOffset)
+											: uint64_t(OutOffset - InOffset);
+		if (In.Node == Out.Node && Gap < len)
+			return -EINVAL;
+
+		if (len == 0)
+			return 0;
+
+		ssize_t ret = fs->Transfer(In.Node, InOffset, Out.Node, OutOffset, len);
+
+		if (off_in)
+			*off_in = InOffset;
+		else
+			In.Offset = InOffset;
+
+		if (off_out)
+			*off_out = OutOffset;
+		else
+			Out.Offset = OutOffset;
+		return ret;
+	}
+
 	int FileDescriptorTable::usr_ioctl(int fd, unsigned long request, void *argp)
 	{
-		auto it = this->FileMap.find(fd);
-		if (it == this->FileMap.end())
+		auto it = this->GetDescriptor(fd);
+		if (it == nullptr)
 			ReturnLogError(-EBADF, "Invalid fd %d", fd);
 
-		return it->second.Node->Ioctl(request, argp);
+		return it->Node->Ioctl(request, argp);
 	}
 
 	FileDescriptorTable::FileDescriptorTable(void *_Owner)
@@ -375,4 +948,21 @@ namespace vfs
 
 		this->fdDir = fs->Create(((Tasking::PCB *)_Owner)->ProcDirectory, "fd", Mode);
 	}
+
+	FileDescriptorTable::~FileDescriptorTable()
+	{
+		debug("- %#lx", this);
+
+		/* Nobody else can use the table anymore */
+		for (size_t i = 0; i < this->Capacity; i++)
+		{
+			if (this->Files[i])
+				this->Files[i]->Put();
+		}
+
+		delete[] this->Files;
+		delete[] this->OpenMap;
+		delete[] this->FullMap;
+		delete[] this->CloseOnExec;
+	}
 }
@@ -0,0 +1,466 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <epoll.hpp>
+
+#include <lock.hpp>
+#include <task.hpp>
+
+#include "../kernel.h"
+
+namespace vfs
+{
+	static short __ep_Poll(struct Inode *Node, short Events)
+	{
+		EventPoll *ep = (EventPoll *)Node->PrivateData;
+		if (!ep->HasEvents())
+			return 0;
+		return Events & (POLLIN | POLLRDNORM);
+	}
+
+	static int __ep_Stat(struct Inode *Node, struct kstat *Stat)
+	{
+		memset(Stat, 0, sizeof(struct kstat));
+		Stat->Device = Node->Device;
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		return 0;
+	}
+
+	static FileSystemInfo *EventPollFS = nullptr;
+	static NewLock(EventPollFSLock);
+
+	static FileSystemInfo *GetEventPollFS()
+	{
+		SmartLock(EventPollFSLock);
+		if (EventPollFS)
+			return EventPollFS;
+
+		FileSystemInfo *fsi = new FileSystemInfo;
+		fsi->Name = "eventpoll";
+		fsi->RootName = "eventpoll";
+		fsi->Flags = 0;
+		fsi->SuperOps = {};
+		fsi->Ops.Stat = __ep_Stat;
+		fsi->Ops.Poll = __ep_Poll;
+		EventPollFS = fsi;
+		return fsi;
+	}
+
+	void EventPoll::Enqueue(Item *it)
+	{
+		if (it->Queued)
+			return;
+
+		it->Queued = true;
+		it->Next = nullptr;
+		it->Prev = ReadyTail;
+		if (ReadyTail)
+			ReadyTail->Next = it;
+		else
+			ReadyHead = it;
+		ReadyTail = it;
+		ReadyCount++;
+	}
+
+	void EventPoll::Dequeue(Item *it)
+	{
+		if (!it->Queued)
+			return;
+
+		if (it->Prev)
+			it->Prev->Next = it->Next;
+		else
+			ReadyHead = it->Next;
+
+		if (it->Next)
+			it->Next->Prev = it->Prev;
+		else
+			ReadyTail = it->Prev;
+
+		it->Queued = false;
+		it->Next = it->Prev = nullptr;
+		ReadyCount--;
+	}
+
+	void EventPoll::Callback(PollWatcher *Watcher, short Events)
+	{
+		Item *it = (Item *)Watcher->Data;
+		EventPoll *ep = it->Owner;
+		bool WasQueued;
+
+		{
+			SmartCriticalSection(ep->ReadyLock);
+
+			/* Disabled by EPOLLONESHOT */
+			if (!(it->Events & ~EPOLL_FLAGS))
+				return;
+
+			if (ep->Scanning)
+			{
+				/* Wait() is looking at the ready list right
+				   now, let it pick this up when it is done */
+				if (!it->Overflow)
+				{
+					it->Overflow = true;
+					it->OverflowNext = ep->OverflowHead;
+					ep->OverflowHead = it;
+				}
+				return;
+			}
+
+			WasQueued = it->Queued;
+			ep->Enqueue(it);
+		}
+
+		ep->Waiters.WakeAll();
+
+		/* We are inside PollNotify(), it posts this for us.
+		   Only for new events, or two epolls watching each
+		   other would notify one another forever. */
+		if (!WasQueued)
+			PollNotifyLater(&ep->Deferred, &ep->Node, POLLIN | POLLRDNORM);
+	}
+
+	void EventPoll::Check(Item *it)
+	{
+		if (!(it->Events & ~EPOLL_FLAGS))
+			return;
+
+		short Events = it->File->Poll(short(it->Events & ~EPOLL_FLAGS));
+		if (!(Events & (it->Events | POLLERR | POLLHUP)))
+			return;
+
+		bool WasQueued;
+		{
+			SmartCriticalSection(ReadyLock);
+			WasQueued = it->Queued;
+			this->Enqueue(it);
+		}
+
+		Waiters.WakeAll();
+		if (!WasQueued)
+			PollNotify(&Node, POLLIN | POLLRDNORM);
+	}
+
+	/* Links between descriptions and the items that watch them */
+	static std::mutex LinksLock;
+
+	void EventPoll::Remove(Item *it)
+	{
+		/* No callback can run after this */
+		PollUnregister(&it->Watcher);
+
+		/* The caller holds LinksLock */
+		std::list<EventPoll *> &polls = it->Description->EventPolls;
+		for (auto i = polls.begin(); i != polls.end(); ++i)
+		{
+			if (*i == this)
+			{
+				polls.erase(i);
+				break;
+			}
+		}
+
+		{
+			SmartCriticalSection(ReadyLock);
+			this->Dequeue(it);
+		}
+
+		delete it;
+	}
+
+	int EventPoll::Control(int Operation, int FileDescriptor,
+						   FileDescriptorTable::Fildes *Description,
+						   uint32_t Events, uint64_t Data)
+	{
+		if (Description == nullptr || Description->Node == nullptr)
+			return -EBADF;
+
+		FileNode *Target = Description->Node;
+		if (Target == this->File)
+			return -EINVAL;
+
+		std::lock_guard<std::mutex> links(LinksLock);
+		std::lock_guard<std::mutex> guard(ItemsLock);
+		auto itr = Items.find(FileDescriptor);
+
+		/* The number was closed and reused for another file */
+		bool stale = itr != Items.end() && itr->second->Description != Description;
+
+		switch (Operation)
+		{
+		case EPOLL_CTL_ADD:
+		{
+			if (itr != Items.end())
+			{
+				if (!stale)
+					return -EEXIST;
+
+				this->Remove(itr->second);
+				Items.erase(itr);
+			}
+
+			Item *it = new Item;
+			it->Owner = this;
+			it->File = Target;
+			it->Description = Description;
+			Description->EventPolls.push_back(this);
+			it->Events = Events | POLLERR | POLLHUP;
+			it->Data = Data;
+			it->Watcher.Callback = Callback;
+			it->Watcher.Data = it;
+			it->Watcher.Events = short(it->Events & ~EPOLL_FLAGS);
+			Items[FileDescriptor] = it;
+
+			PollRegister(Target->Node, &it->Watcher);
+			this->Check(it);
+			return 0;
+		}
+		case EPOLL_CTL_MOD:
+		{
+			if (itr == Items.end() || stale)
+				return -ENOENT;
+
+			if (Events & EPOLLEXCLUSIVE)
+				return -EINVAL;
+
+			Item *it = itr->second;
+			{
+				SmartCriticalSection(ReadyLock);
+				it->Events = Events | POLLERR | POLLHUP;
+				it->Data = Data;
+				it->Watcher.Events = short(it->Events & ~EPOLL_FLAGS);
+			}
+
+			this->Check(it);
+			return 0;
+		}
+		case EPOLL_CTL_DEL:
+		{
+			if (itr == Items.end() || stale)
+				return -ENOENT;
+
+			this->Remove(itr->second);
+			Items.erase(itr);
+			return 0;
+		}
+		default:
+			return -EINVAL;
+		}
+	}
+
+	int EventPoll::Collect(Event *Events, int MaxEvents)
+	{
+		std::lock_guard<std::mutex> guard(ItemsLock);
+
+		Item *list;
+		{
+			SmartCriticalSection(ReadyLock);
+			list = ReadyHead;
+			ReadyHead = ReadyTail = nullptr;
+			ReadyCount = 0;
+			Scanning = true;
+		}
+
+		/* The items keep Queued set while they are on
+		   our private list, callbacks go to the overflow
+		   list until we are done */
+		int n = 0;
+		Item *KeepHead = nullptr;
+		Item *KeepTail = nullptr;
+		while (list)
+		{
+			Item *it = list;
+			list = it->Next;
+			it->Next = it->Prev = nullptr;
+
+			bool Keep = true;
+			if (n < MaxEvents)
+			{
+				short Mask = short(it->Events & ~EPOLL_FLAGS);
+				uint32_t Ready = Mask ? it->File->Poll(Mask) : 0;
+				Ready &= it->Events | POLLERR | POLLHUP;
+
+				if (Ready == 0)
+					Keep = false;
+				else
+				{
+					Events[n].Events = Ready;
+					Events[n].Data = it->Data;
+					n++;
+
+					if (it->Events & EPOLLONESHOT)
+					{
+						it->Events &= EPOLL_FLAGS;
+						it->Watcher.Events = 0;
+						Keep = false;
+					}
+					else if (it->Events & EPOLLET)
+						Keep = false;
+				}
+			}
+
+			if (!Keep)
+			{
+				it->Queued = false;
+				continue;
+			}
+
+			/* Level-triggered, or didn't fit in the buffer */
+			if (KeepTail)
+				KeepTail->Next = it;
+			else
+				KeepHead = it;
+			KeepTail = it;
+		}
+
+		bool Wake = false;
+		{
+			SmartCriticalSection(ReadyLock);
+			Scanning = false;
+
+			while (KeepHead)
+			{
+				Item *it = KeepHead;
+				KeepHead = it->Next;
+				it->Queued = false;
+				this->Enqueue(it);
+			}
+
+			while (OverflowHead)
+			{
+				Item *it = OverflowHead;
+				OverflowHead = it->OverflowNext;
+				it->OverflowNext = nullptr;
+				it->Overflow = false;
+				this->Enqueue(it);
+				Wake = true;
+			}
+		}
+
+		if (Wake)
+		{
+			Waiters.WakeAll();
+			PollNotify(&Node, POLLIN | POLLRDNORM);
+		}
+		return n;
+	}
+
+	int EventPoll::Wait(Event *Events, int MaxEvents, int Timeout)
+	{
+		if (MaxEvents <= 0)
+			return -EINVAL;
+
+		Tasking::PCB *pcb = thisProcess;
+		uint64_t Until = 0;
+		if (Timeout > 0)
+			Until = TimeManager->GetNanosecondsSinceClassCreation() +
+					uint64_t(Timeout) * 1000000;
+
+		while (true)
+		{
+			int n = this->Collect(Events, MaxEvents);
+			if (n != 0 || Timeout == 0)
+				return n;
+
+			uint64_t Left = 0;
+			if (Timeout > 0)
+			{
+				uint64_t Now = TimeManager->GetNanosecondsSinceClassCreation();
+				if (Now >= Until)
+					return 0;
+				Left = (Until - Now + 999999) / 1000000;
+			}
+
+			if (pcb && pcb->Signals.HasPendingSignal())
+				return -EINTR;
+
+			int ret = Waiters.Wait([this, pcb]
+								   { return this->HasEvents() ||
+											(pcb && pcb->Signals.HasPendingSignal()); },
+								   Left);
+
+			if (ret == -ETIMEDOUT)
+				return this->Collect(Events, MaxEvents);
+		}
+	}
+
+	void EventPoll::Put()
+	{
+		if (--References == 0)
+			delete this;
+	}
+
+	void EventPoll::Release(FileDescriptorTable::Fildes *Description)
+	{
+		/* An instance can't be freed while we hold the links,
+		   its destructor takes them too */
+		std::lock_guard<std::mutex> links(LinksLock);
+		while (!Description->EventPolls.empty())
+		{
+			EventPoll *ep = Description->EventPolls.front();
+			std::lock_guard<std::mutex> guard(ep->ItemsLock);
+			bool found = false;
+			for (auto itr = ep->Items.begin(); itr != ep->Items.end(); ++itr)
+			{
+				if (itr->second->Description != Description)
+					continue;
+
+				/* Also takes ep off the list */
+				ep->Remove(itr->second);
+				ep->Items.erase(itr);
+				found = true;
+				break;
+			}
+
+			if (!found)
+			{
+				warn("Epoll %#lx has no item for %#lx", ep, Description);
+				Description->EventPolls.pop_front();
+			}
+		}
+	}
+
+	EventPoll *EventPoll::FromFile(FileNode *File)
+	{
+		if (File == nullptr || EventPollFS == nullptr ||
+			File->fsi != EventPollFS)
+			return nullptr;
+		return (EventPoll *)File->Node->PrivateData;
+	}
+
+	EventPoll::EventPoll()
+	{
+		Node.Mode = S_IRUSR | S_IWUSR;
+		Node.PrivateData = this;
+		File = fs->CreateAnonymous("anon_inode:[eventpoll]", &Node, GetEventPollFS());
+	}
+
+	EventPoll::~EventPoll()
+	{
+		/* The last reference is gone, only Release() can still
+		   reach the items through their descriptions */
+		std::lock_guard<std::mutex> links(LinksLock);
+		std::lock_guard<std::mutex> guard(ItemsLock);
+		foreach (auto &it in Items)
+			this->Remove(it.second);
+		Items.clear();
+		PollCancelDeferred(&Deferred);
+	}
+}
@@ -33,22 +33,32 @@ namespace vfs
 
 	void Virtual::AddRoot(Inode *Root)
 	{
-		SmartLock(VirtualLock);
+		SmartWriteLock(VirtualLock);
 		FileSystemRoots->Children.push_back(Root);
 	}
 
 	FileNode *Virtual::GetRoot(size_t Index)
 	{
-		assert(Index < FileSystemRoots->Children.size());
+		Inode *rootNode;
+		{
+			SmartReadLock(VirtualLock);
+			assert(Index < FileSystemRoots->Children.size());
 
-		auto it = FileRoots.find(Index);
-		if (it != FileRoots.end())
-			return it->second;
+			auto it = FileRoots.find(Index);
+			if (it != FileRoots.end())
+				return it->second;
+
+			rootNode = FileSystemRoots->Children[Index];
+		}
 
-		Inode *rootNode = FileSystemRoots->Children[Index];
 		char rootName[128]{};
 		snprintf(rootName, sizeof(rootName), "\x06root-%ld\x06", Index);
 		FileNode *ret = this->CreateCacheNode(nullptr, rootNode, rootName, 0);
+
+		SmartWriteLock(VirtualLock);
+		auto it = FileRoots.find(Index);
+		if (it != FileRoots.end())
+			return it->second; /* Someone else created it first */
 		FileRoots.insert({Index, ret});
 		return ret;
 	}
@@ -65,6 +75,12 @@ namespace vfs
 			Parent = thisProcess->Info.RootNode;
 		}
 
+		/* The new node belongs to the filesystem of its directory */
+		std::string baseName;
+		Parent = this->ResolveParent(Parent, Name, baseName);
+		if (Parent == nullptr)
+			ReturnLogError(nullptr, "Directory of %s not found", Name);
+
 		auto it = DeviceMap.find(Parent->Node->Device);
 		if (it == DeviceMap.end())
 			ReturnLogError(nullptr, "Device %d not found", Parent->Node->Device);
@@ -73,11 +89,11 @@ namespace vfs
 		if (it->second.fsi->Ops.Create == NULL)
 			ReturnLogError(nullptr, "Create not supported for %d", it->first);
 
-		int ret = it->second.fsi->Ops.Create(Parent->Node, Name, Mode, &Node);
+		int ret = it->second.fsi->Ops.Create(Parent->Node, baseName.c_str(), Mode, &Node);
 		if (ret < 0)
 			ReturnLogError(nullptr, "Create for %d failed with %d", it->first, ret);
 
-		return this->CreateCacheNode(Parent, Node, Name, Mode);
+		return this->CreateCacheNode(Parent, Node, baseName.c_str(), Mode);
 	}
 
 	FileNode *Virtual::ForceCreate(FileNode *Parent, const char *Name, mode_t Mode)
@@ -86,6 +102,26 @@ namespace vfs
 		return this->Create(Parent, Name, Mode);
 	}
 
+	FileNode *Virtual::ResolveParent(FileNode *Parent, const char *Path, std::string &Name)
+	{
+		const char *base;
+		size_t length;
+		cwk_path_get_basename(Path, &base, &length);
+		if (base == nullptr)
+			return nullptr;
+
+		Name.assign(base, length);
+		if (base == Path)
+			return Parent;
+
+		size_t directoryLength = base - Path;
+		while (directoryLength > 1 && Path[directoryLength - 1] == '/')
+			directoryLength--;
+
+		std::string directory(Path, directoryLength);
+		return this->GetByPath(directory.c_str(), Parent);
+	}
+
 	FileNode *Virtual::Mount(FileNode *Parent, Inode *Node, const char *Path)
 	{
 		char *path = strdup(Path);
@@ -122,7 +158,19 @@ namespace vfs
 		if (strcmp(Path, "..") == 0)
 			return Parent->Parent ? Parent->Parent : Parent;
 
-		FileNode *fn = this->CacheRecursiveSearch(Parent, Path, this->PathIsRelative(Path));
+		FileNode *fn;
+		switch (this->WalkRCU(Parent, Path, &fn))
+		{
+		case WalkFound:
+			return fn;
+		case WalkMissing:
+			debug("\"%s\" is a cached miss", Path);
+			return nullptr;
+		default:
+			break;
+		}
+
+		fn = this->CacheRecursiveSearch(Parent, Path, this->PathIsRelative(Path));
 		if (fn)
 			return fn;
 
@@ -135,7 +183,13 @@ namespace vfs
 				Path++;
 		}
 
-		FileNode *__Parent = CacheSearchReturnLast(Parent, &Path);
+		bool Missing;
+		FileNode *__Parent = CacheSearchReturnLast(Parent, &Path, &Missing);
+		if (Missing)
+		{
+			debug("\"%s\" is a cached miss", Path);
+			return nullptr;
+		}
 
 		struct cwk_segment segment;
 		if (!cwk_path_get_first_segment(Path, &segment))
@@ -172,6 +226,12 @@ namespace vfs
 
 			std::string segmentName(segment.begin, segment.size);
 			int ret = it->second.fsi->Ops.Lookup(__Parent->Node, segmentName.c_str(), &Node);
+			if (ret == -ENOENT && !(it->second.fsi->Flags & I_FLAG_VOLATILE))
+			{
+				Dentries.Insert(__Parent, segment.begin, segment.size,
+								DentryCache::HashName(segment.begin, segment.size),
+								nullptr);
+			}
 			if (ret < 0)
 				ReturnLogError(nullptr, "Lookup for \"%s\"(%d) failed with %d", segmentName.c_str(), it->first, ret);
 			__Parent = this->CreateCacheNode(__Parent, Node, segmentName.c_str(), 0);
@@ -255,6 +315,41 @@ namespace vfs
 		return this->CreateLink(Path, Parent, Target->Path.c_str());
 	}
 
+	int Virtual::Link(FileNode *Target, FileNode *Parent, const char *Path)
+	{
+		if (this->GetByPath(Path, Parent) != nullptr)
+			return -EEXIST;
+
+		std::string baseName;
+		Parent = this->ResolveParent(Parent, Path, baseName);
+		if (Parent == nullptr)
+			return -ENOENT;
+		if (!Parent->IsDirectory())
+			return -ENOTDIR;
+		if (Target->IsDirectory())
+			return -EPERM;
+		if (Parent->Node->Device != Target->Node->Device)
+			return -EXDEV;
+
+		int ret = Parent->Link(baseName.c_str(), Target->Node);
+		if (ret < 0)
+			ReturnLogError(ret, "Link of %s failed with %d", Path, ret);
+
+		this->CreateCacheNode(Parent, Target->Node, baseName.c_str(), Target->Node->Mode);
+		return 0;
+	}
+
+	FileNode *Virtual::CreateAnonymous(const char *Name, Inode *Node, FileSystemInfo *fsi)
+	{
+		FileNode *fn = new FileNode;
+		fn->Name = Name;
+		fn->Path = Name;
+		fn->Parent = nullptr;
+		fn->Node = Node;
+		fn->fsi = fsi;
+		return fn;
+	}
+
 	bool Virtual::PathExists(const char *Path, FileNode *Parent)
 	{
 		FileNode *fn = this->CacheLookup(Path);
@@ -267,6 +362,72 @@ namespace vfs
 		return false;
 	}
 
+	ssize_t Virtual::Transfer(FileNode *In, off_t &InOffset,
+							  FileNode *Out, off_t &OutOffset, size_t Size)
+	{
+		size_t Done = 0;
+		ssize_t Error = 0;
+
+		/* In-memory files are written out straight from their data */
+		const void *Data;
+		ssize_t Mapped = In->MapData(InOffset, &Data);
+		if (Mapped != -ENOTSUP)
+		{
+			while (Done < Size && Mapped > 0)
+			{
+				size_t n = MIN(Size - Done, (size_t)Mapped);
+				ssize_t w = Out->Write(Data, n, OutOffset);
+				if (w <= 0)
+				{
+					Error = w;
+					break;
+				}
+
+				InOffset += w;
+				OutOffset += w;
+				Done += w;
+				if ((size_t)w < n)
+					break;
+
+				Mapped = In->MapData(InOffset, &Data);
+			}
+
+			if (Mapped < 0)
+				Error = Mapped;
+			return Done ? (ssize_t)Done : Error;
+		}
+
+		/* Otherwise bounce through a kernel page */
+		void *Buffer = KernelAllocator.RequestPage();
+		while (Done < Size)
+		{
+			size_t n = MIN(Size - Done, (size_t)PAGE_SIZE);
+			ssize_t r = In->Read(Buffer, n, InOffset);
+			if (r <= 0)
+			{
+				Error = r;
+				break;
+			}
+
+			ssize_t w = Out->Write(Buffer, r, OutOffset);
+			if (w <= 0)
+			{
+				Error = w;
+				break;
+			}
+
+			/* The rest of what was read is read again next time */
+			InOffset += w;
+			OutOffset += w;
+			Done += w;
+			if (w < r || (size_t)r < n)
+				break;
+		}
+		KernelAllocator.FreePage(Buffer);
+
+		return Done ? (ssize_t)Done : Error;
+	}
+
 	int Virtual::Remove(FileNode *Node)
 	{
 		auto it = DeviceMap.find(Node->Node->Device);
@@ -280,9 +441,129 @@ namespace vfs
 		if (ret < 0)
 			ReturnLogError(ret, "Remove for %d failed with %d", it->first, ret);
 
+		if (Node->IsRegularFile())
+			Cache.Invalidate(Node->Node);
 		this->RemoveCacheNode(Node);
 		return 0;
 	}
+
+	int Virtual::Rename(FileNode *Node, const char *NewName)
+	{
+		FileNode *Parent = Node->Parent;
+		if (Parent == nullptr)
+			return -EBUSY;
+
+		int ret = Parent->Rename(Node->Name.c_str(), NewName);
+		if (ret < 0)
+			ReturnLogError(ret, "Rename of %s failed with %d", Node->Path.c_str(), ret);
+
+		SmartWriteLock(VirtualLock);
+		BeginNodeChange(Node);
+		Dentries.Forget(Node);
+		Node->Name = NewName;
+		Node->NameHash = DentryCache::HashName(NewName, strlen(NewName));
+		Node->Path = Parent->Path + "/" + NewName;
+		Dentries.Insert(Parent, NewName, strlen(NewName), Node->NameHash, Node);
+
+		/* Cached descendants still have the old prefix */
+		std::vector<FileNode *> Pending(Node->Children);
+		while (!Pending.empty())
+		{
+			FileNode *Child = Pending.back();
+			Pending.pop_back();
+
+			BeginNodeChange(Child);
+			Child->Path = Child->Parent->Path + "/" + Child->Name;
+			EndNodeChange(Child);
+
+			foreach (auto Grandchild in Child->Children)
+				Pending.push_back(Grandchild);
+		}
+		EndNodeChange(Node);
+		return 0;
+	}
+}
+
+ssize_t FileNode::ReadV(const struct kiovec *Vector, int Count, off_t Offset)
+{
+	if (fsi->Ops.ReadV && !IsCached())
+		return fsi->Ops.ReadV(this->Node, Vector, Count, Offset);
+
+	ssize_t Total = 0;
+	for (int i = 0; i < Count; i++)
+	{
+		if (Vector[i].iov_len == 0)
+			continue;
+
+		ssize_t n = this->Read(Vector[i].iov_base, Vector[i].iov_len, Offset + Total);
+		if (n < 0)
+			return Total ? Total : n;
+
+		Total += n;
+		if ((size_t)n < Vector[i].iov_len)
+			break;
+	}
+	return Total;
+}
+
+ssize_t FileNode::WriteV(const struct kiovec *Vector, int Count, off_t Offset)
+{
+	if (fsi->Ops.WriteV && !IsCached())
+		return fsi->Ops.WriteV(this->Node, Vector, Count, Offset);
+
+	ssize_t Total = 0;
+	for (int i = 0; i < Count; i++)
+	{
+		if (Vector[i].iov_len == 0)
+			continue;
+
+		ssize_t n = this->Write(Vector[i].iov_base, Vector[i].iov_len, Offset + Total);
+		if (n < 0)
+			return Total ? Total : n;
+
+		Total += n;
+		if ((size_t)n < Vector[i].iov_len)
+			break;
+	}
+	return Total;
+}
+
+ssize_t FileNode::MapPages(off_t Offset, const void **Data)
+{
+	/* Cached pages can be evicted under the mapping */
+	if (IsCached() || Offset < 0 || Offset % PAGE_SIZE)
+		return -EINVAL;
+
+	const void *Address;
+	ssize_t ret = this->MapData(Offset, &Address);
+	if (ret <= 0)
+		return ret ? ret : -EINVAL;
+
+	if ((uintptr_t)Address % PAGE_SIZE)
+		return -EINVAL;
+
+	*Data = Address;
+	return ret;
+}
+
+ssize_t FileNode::CachedRead(void *Buffer, size_t Size, off_t Offset)
+{
+	return fs->Cache.Read(this, Buffer, Size, Offset);
+}
+
+ssize_t FileNode::CachedWrite(const void *Buffer, size_t Size, off_t Offset)
+{
+	return fs->Cache.Write(this, Buffer, Size, Offset);
+}
+
+int FileNode::CachedTruncate(off_t Size)
+{
+	return fs->Cache.Truncate(this, Size);
+}
+
+int FileNode::CachedStat(struct kstat *Stat)
+{
+	return fs->Cache.Stat(this, Stat);
 }
 
 std::string FileNode::GetName()
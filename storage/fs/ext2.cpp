@@ -0,0 +1,1758 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <filesystem/ext2.hpp>
+
+#include <memory.hpp>
+#include <debug.h>
+
+#include "../../kernel.h"
+
+/* How long dirty metadata may stay in memory */
+#define EXT2_WRITEBACK_INTERVAL 5000
+
+/* Most buffers given to the device in one request */
+#define EXT2_MAX_RUN 64
+
+static_assert(sizeof(vfs::EXT2::SuperBlock) == 1024);
+static_assert(sizeof(vfs::EXT2::GroupDescriptor) == 32);
+static_assert(sizeof(vfs::EXT2::DiskInode) == 128);
+
+namespace vfs
+{
+	NewLock(MountedLock);
+	static std::vector<EXT2 *> Mounted;
+
+	static size_t FindZeroBit(const uint8_t *Bitmap, size_t Bits, size_t From)
+	{
+		size_t i = From;
+		while (i < Bits)
+		{
+			/* Skip full words at once */
+			if (i % 64 == 0 && i + 64 <= Bits)
+			{
+				uint64_t word;
+				memcpy(&word, Bitmap + i / 8, sizeof(word));
+				if (word == ~0ULL)
+				{
+					i += 64;
+					continue;
+				}
+				return i + __builtin_ctzll(~word);
+			}
+
+			if (!(Bitmap[i / 8] & (1 << (i % 8))))
+				return i;
+			i++;
+		}
+		return Bits;
+	}
+
+	static uint8_t ModeToType(mode_t Mode)
+	{
+		switch (Mode & S_IFMT)
+		{
+		case S_IFREG:
+			return 1;
+		case S_IFDIR:
+			return 2;
+		case S_IFCHR:
+			return 3;
+		case S_IFBLK:
+			return 4;
+		case S_IFIFO:
+			return 5;
+		case S_IFSOCK:
+			return 6;
+		case S_IFLNK:
+			return 7;
+		default:
+			return 0;
+		}
+	}
+
+	int EXT2::DeviceRead(uint32_t Block, void *Data)
+	{
+		ssize_t ret = Device->Read(Data, BlockSize, (off_t)Block * BlockSize);
+		if (ret < 0)
+			return (int)ret;
+		return (size_t)ret == BlockSize ? 0 : -EIO;
+	}
+
+	int EXT2::DeviceWrite(uint32_t Block, const void *Data)
+	{
+		ssize_t ret = Device->Write(Data, BlockSize, (off_t)Block * BlockSize);
+		if (ret < 0)
+			return (int)ret;
+		return (size_t)ret == BlockSize ? 0 : -EIO;
+	}
+
+	EXT2::Buffer *EXT2::GetBuffer(uint32_t Block, bool Read)
+	{
+		Buffer *b;
+		auto it = Buffers.find(Block);
+		if (it != Buffers.end())
+		{
+			b = it->second;
+
+			/* Move to the newest end */
+			if (b != Newest)
+			{
+				if (b->Older)
+					b->Older->Newer = b->Newer;
+				else
+					Oldest = b->Newer;
+				b->Newer->Older = b->Older;
+
+				b->Older = Newest;
+				b->Newer = nullptr;
+				Newest->Newer = b;
+				Newest = b;
+			}
+
+			b->References++;
+			return b;
+		}
+
+		/* Evict the oldest buffers nobody holds */
+		Buffer *victim = Oldest;
+		while (Buffers.size() >= MAX_BUFFERS && victim)
+		{
+			Buffer *next = victim->Newer;
+			if (victim->References == 0 && WriteBuffer(victim) == 0)
+			{
+				if (victim->Older)
+					victim->Older->Newer = victim->Newer;
+				else
+					Oldest = victim->Newer;
+				if (victim->Newer)
+					victim->Newer->Older = victim->Older;
+				else
+					Newest = victim->Older;
+
+				Buffers.erase(victim->Block);
+				delete[] victim->Data;
+				delete victim;
+			}
+			victim = next;
+		}
+
+		b = new Buffer;
+		b->Block = Block;
+		b->Data = new uint8_t[BlockSize];
+		if (Read && DeviceRead(Block, b->Data) < 0)
+		{
+			error("Failed to read block %d", Block);
+			delete[] b->Data;
+			delete b;
+			return nullptr;
+		}
+
+		b->References = 1;
+		b->Older = Newest;
+		if (Newest)
+			Newest->Newer = b;
+		else
+			Oldest = b;
+		Newest = b;
+		Buffers[Block] = b;
+		return b;
+	}
+
+	void EXT2::PutBuffer(Buffer *b, bool Dirty)
+	{
+		assert(b->References > 0);
+		if (Dirty)
+			b->Dirty = true;
+		b->References--;
+	}
+
+	void EXT2::DropBuffer(uint32_t Block)
+	{
+		auto it = Buffers.find(Block);
+		if (it == Buffers.end())
+			return;
+
+		/* Never write a freed block back over its next owner */
+		Buffer *b = it->second;
+		assert(b->References == 0);
+		if (b->Older)
+			b->Older->Newer = b->Newer;
+		else
+			Oldest = b->Newer;
+		if (b->Newer)
+			b->Newer->Older = b->Older;
+		else
+			Newest = b->Older;
+
+		Buffers.erase(it);
+		delete[] b->Data;
+		delete b;
+	}
+
+	int EXT2::WriteBuffer(Buffer *b)
+	{
+		if (!b->Dirty)
+			return 0;
+
+		int ret = DeviceWrite(b->Block, b->Data);
+		if (ret < 0)
+			ReturnLogError(ret, "Failed to write block %d", b->Block);
+		b->Dirty = false;
+		return 0;
+	}
+
+	int EXT2::FlushBuffers()
+	{
+		Disk::Device *disk = DiskManager ? DiskManager->Find(Device) : nullptr;
+		if (disk && BlockSize % disk->SectorSize == 0)
+		{
+			size_t count = 0;
+			for (Buffer *b = Oldest; b; b = b->Newer)
+				count += b->Dirty;
+			if (count == 0)
+				return 0;
+
+			/* One batch, so the disk queue merges neighbouring blocks */
+			Disk::Bio *bios = new Disk::Bio[count];
+			Buffer **submitted = new Buffer *[count];
+			size_t i = 0;
+			size_t sectors = BlockSize / disk->SectorSize;
+			for (Buffer *b = Oldest; b; b = b->Newer)
+			{
+				if (!b->Dirty)
+					continue;
+
+				bios[i].Sector = (uint64_t)b->Block * sectors;
+				bios[i].Count = sectors;
+				bios[i].Write = true;
+				bios[i].Vector.push_back({b->Data, BlockSize});
+
+				/* Cleaned before the write starts, so a buffer dirtied
+				   while in flight stays dirty for the next flush; the
+				   reference keeps it from being evicted meanwhile */
+				b->Dirty = false;
+				b->References++;
+				submitted[i++] = b;
+			}
+
+			int ret = disk->SubmitAll(bios, count);
+			for (i = 0; i < count; i++)
+			{
+				if (ret < 0)
+					submitted[i]->Dirty = true;
+				submitted[i]->References--;
+			}
+
+			delete[] submitted;
+			delete[] bios;
+			if (ret < 0)
+				ReturnLogError(ret, "Failed to write %ld blocks", count);
+			return 0;
+		}
+
+		int result = 0;
+		for (Buffer *b = Oldest; b; b = b->Newer)
+		{
+			int ret = WriteBuffer(b);
+			if (ret < 0 && result == 0)
+				result = ret;
+		}
+		return result;
+	}
+
+	uint32_t EXT2::GroupOfBlock(uint32_t Block)
+	{
+		return (Block - Super.FirstDataBlock) / Super.BlocksPerGroup;
+	}
+
+	size_t EXT2::BlocksInGroup(size_t Group)
+	{
+		size_t first = Group * Super.BlocksPerGroup;
+		return MIN((size_t)Super.BlocksPerGroup, Super.Blocks - Super.FirstDataBlock - first);
+	}
+
+	uint32_t EXT2::AllocateBlock(uint32_t Goal)
+	{
+		if (Super.FreeBlock == 0)
+			return 0;
+
+		size_t start = 0, goalBit = 0;
+		if (Goal >= Super.FirstDataBlock && Goal < Super.Blocks)
+		{
+			start = GroupOfBlock(Goal);
+			goalBit = (Goal - Super.FirstDataBlock) % Super.BlocksPerGroup;
+		}
+
+		for (size_t n = 0; n < GroupCount; n++)
+		{
+			size_t group = (start + n) % GroupCount;
+			if (Groups[group].FreeBlocks == 0)
+				continue;
+
+			Buffer *b = GetBuffer(Groups[group].BlockBitmap);
+			if (b == nullptr)
+				return 0;
+
+			/* Right after the goal first, so files stay contiguous */
+			size_t bits = BlocksInGroup(group);
+			size_t bit = bits;
+			if (n == 0 && goalBit)
+				bit = FindZeroBit(b->Data, bits, goalBit);
+			if (bit == bits)
+				bit = FindZeroBit(b->Data, bits, 0);
+
+			if (bit == bits)
+			{
+				/* The descriptor was wrong */
+				warn("Group %ld has no free blocks", group);
+				Groups[group].FreeBlocks = 0;
+				PutBuffer(b, false);
+				continue;
+			}
+
+			b->Data[bit / 8] |= (uint8_t)(1 << (bit % 8));
+			PutBuffer(b, true);
+
+			Groups[group].FreeBlocks--;
+			Super.FreeBlock--;
+			SuperDirty = true;
+			return (uint32_t)(Super.FirstDataBlock + group * Super.BlocksPerGroup + bit);
+		}
+		return 0;
+	}
+
+	void EXT2::FreeBlock(uint32_t Block)
+	{
+		if (Block < Super.FirstDataBlock || Block >= Super.Blocks)
+		{
+			warn("Freeing invalid block %d", Block);
+			return;
+		}
+
+		DropBuffer(Block);
+
+		size_t group = GroupOfBlock(Block);
+		size_t bit = (Block - Super.FirstDataBlock) % Super.BlocksPerGroup;
+		Buffer *b = GetBuffer(Groups[group].BlockBitmap);
+		if (b == nullptr)
+			return;
+
+		b->Data[bit / 8] &= (uint8_t)~(1 << (bit % 8));
+		PutBuffer(b, true);
+
+		Groups[group].FreeBlocks++;
+		Super.FreeBlock++;
+		SuperDirty = true;
+	}
+
+	uint32_t EXT2::AllocateInode(uint32_t Parent, bool Directory)
+	{
+		if (Super.FreeInodes == 0)
+			return 0;
+
+		size_t start = (Parent - 1) / Super.InodesPerGroup;
+		for (size_t n = 0; n < GroupCount; n++)
+		{
+			size_t group = (start + n) % GroupCount;
+			if (Groups[group].FreeInodes == 0)
+				continue;
+
+			Buffer *b = GetBuffer(Groups[group].InodeBitmap);
+			if (b == nullptr)
+				return 0;
+
+			/* The first inodes are reserved */
+			size_t first = group == 0 ? FirstInode - 1 : 0;
+			size_t bit = FindZeroBit(b->Data, Super.InodesPerGroup, first);
+			if (bit == Super.InodesPerGroup)
+			{
+				PutBuffer(b, false);
+				continue;
+			}
+
+			b->Data[bit / 8] |= (uint8_t)(1 << (bit % 8));
+			PutBuffer(b, true);
+
+			Groups[group].FreeInodes--;
+			if (Directory)
+				Groups[group].Directories++;
+			Super.FreeInodes--;
+			SuperDirty = true;
+			return (uint32_t)(group * Super.InodesPerGroup + bit + 1);
+		}
+		return 0;
+	}
+
+	void EXT2::FreeInode(uint32_t Number, bool Directory)
+	{
+		size_t group = (Number - 1) / Super.InodesPerGroup;
+		size_t bit = (Number - 1) % Super.InodesPerGroup;
+		Buffer *b = GetBuffer(Groups[group].InodeBitmap);
+		if (b == nullptr)
+			return;
+
+		b->Data[bit / 8] &= (uint8_t)~(1 << (bit % 8));
+		PutBuffer(b, true);
+
+		Groups[group].FreeInodes++;
+		if (Directory)
+			Groups[group].Directories--;
+		Super.FreeInodes++;
+		SuperDirty = true;
+	}
+
+	EXT2::EXT2Inode *EXT2::GetInode(uint32_t Number)
+	{
+		auto it = Inodes.find(Number);
+		if (it != Inodes.end())
+			return it->second;
+
+		if (Number == 0 || Number > Super.Inodes)
+			return nullptr;
+
+		size_t group = (Number - 1) / Super.InodesPerGroup;
+		size_t offset = ((Number - 1) % Super.InodesPerGroup) * InodeSize;
+		Buffer *b = GetBuffer(Groups[group].InodeTable + (uint32_t)(offset / BlockSize));
+		if (b == nullptr)
+			return nullptr;
+
+		EXT2Inode *node = new EXT2Inode;
+		memcpy(&node->Raw, b->Data + offset % BlockSize, sizeof(DiskInode));
+		PutBuffer(b, false);
+
+		node->Node.Device = DeviceID;
+		node->Node.Index = Number;
+		node->Node.Mode = node->Raw.Mode;
+		node->Node.Flags = I_FLAG_CACHE_KEEP;
+		node->Node.PrivateData = this;
+		Inodes[Number] = node;
+		return node;
+	}
+
+	void EXT2::StoreInode(EXT2Inode *Node)
+	{
+		uint32_t Number = (uint32_t)Node->Node.Index;
+		size_t group = (Number - 1) / Super.InodesPerGroup;
+		size_t offset = ((Number - 1) % Super.InodesPerGroup) * InodeSize;
+		Buffer *b = GetBuffer(Groups[group].InodeTable + (uint32_t)(offset / BlockSize));
+		if (b == nullptr)
+			return;
+
+		/* Bytes past the rev 0 inode are left as they are */
+		memcpy(b->Data + offset % BlockSize, &Node->Raw, sizeof(DiskInode));
+		PutBuffer(b, true);
+	}
+
+	off_t EXT2::GetSize(EXT2Inode *Node)
+	{
+		off_t size = Node->Raw.Size;
+		if (S_ISREG(Node->Raw.Mode))
+			size |= (off_t)Node->Raw.SizeHigh << 32;
+		return size;
+	}
+
+	void EXT2::SetSize(EXT2Inode *Node, off_t Size)
+	{
+		Node->Raw.Size = (uint32_t)Size;
+		if (!S_ISREG(Node->Raw.Mode))
+			return;
+
+		Node->Raw.SizeHigh = (uint32_t)((uint64_t)Size >> 32);
+		if (Node->Raw.SizeHigh && !(Super.FeatureRoCompatibility & RO_COMPAT_LARGE_FILE))
+		{
+			Super.FeatureRoCompatibility |= RO_COMPAT_LARGE_FILE;
+			SuperDirty = true;
+		}
+	}
+
+	uint32_t EXT2::MapBlock(EXT2Inode *Node, uint32_t Logical, bool Create, uint32_t Goal, int *Error)
+	{
+		uint32_t sectors = (uint32_t)(BlockSize / 512);
+		uint64_t perBlock = BlockSize / 4;
+
+		if (Logical < DIRECT_BLOCKS)
+		{
+			uint32_t &slot = Node->Raw.Block[Logical];
+			if (slot || !Create)
+				return slot;
+
+			slot = AllocateBlock(Goal);
+			if (slot == 0)
+			{
+				*Error = -ENOSPC;
+				return 0;
+			}
+			Node->Raw.Sectors += sectors;
+			return slot;
+		}
+
+		/* Find how many indirect levels lead to the block */
+		uint64_t index = Logical - DIRECT_BLOCKS;
+		int depth = 1;
+		uint64_t span = perBlock;
+		while (index >= span)
+		{
+			index -= span;
+			span *= perBlock;
+			if (++depth > 3)
+			{
+				*Error = -EFBIG;
+				return 0;
+			}
+		}
+
+		uint32_t *slot = &Node->Raw.Block[DIRECT_BLOCKS + depth - 1];
+		uint32_t block = *slot;
+		if (block == 0)
+		{
+			if (!Create)
+				return 0;
+
+			block = AllocateBlock(Goal);
+			if (block == 0)
+			{
+				*Error = -ENOSPC;
+				return 0;
+			}
+
+			Buffer *z = GetBuffer(block, false);
+			memset(z->Data, 0, BlockSize);
+			PutBuffer(z, true);
+			*slot = block;
+			Node->Raw.Sectors += sectors;
+		}
+
+		for (int level = depth - 1; level >= 0; level--)
+		{
+			span /= perBlock;
+			size_t i = (size_t)(index / span) % perBlock;
+
+			Buffer *b = GetBuffer(block);
+			if (b == nullptr)
+			{
+				*Error = -EIO;
+				return 0;
+			}
+
+			uint32_t *entries = (uint32_t *)b->Data;
+			uint32_t next = entries[i];
+			bool dirty = false;
+			if (next == 0 && Create)
+			{
+				next = AllocateBlock(Goal);
+				if (next == 0)
+				{
+					PutBuffer(b, false);
+					*Error = -ENOSPC;
+					return 0;
+				}
+
+				/* Another table, it must start empty */
+				if (level > 0)
+				{
+					Buffer *z = GetBuffer(next, false);
+					memset(z->Data, 0, BlockSize);
+					PutBuffer(z, true);
+				}
+
+				entries[i] = next;
+				Node->Raw.Sectors += sectors;
+				dirty = true;
+			}
+
+			PutBuffer(b, dirty);
+			if (next == 0)
+				return 0;
+			block = next;
+		}
+		return block;
+	}
+
+	bool EXT2::FreeTree(EXT2Inode *Node, uint32_t Block, int Level, uint64_t Base, uint64_t From)
+	{
+		uint32_t sectors = (uint32_t)(BlockSize / 512);
+		uint64_t perBlock = BlockSize / 4;
+
+		if (Level > 0)
+		{
+			uint64_t childSpan = 1;
+			for (int i = 1; i < Level; i++)
+				childSpan *= perBlock;
+
+			Buffer *b = GetBuffer(Block);
+			if (b == nullptr)
+				return false;
+
+			uint32_t *entries = (uint32_t *)b->Data;
+			bool empty = true, dirty = false;
+			for (size_t i = 0; i < perBlock; i++)
+			{
+				if (entries[i] == 0)
+					continue;
+
+				uint64_t childBase = Base + i * childSpan;
+				if (childBase + childSpan > From &&
+					FreeTree(Node, entries[i], Level - 1, childBase, From))
+				{
+					entries[i] = 0;
+					dirty = true;
+				}
+				else
+					empty = false;
+			}
+			PutBuffer(b, dirty);
+
+			if (!empty)
+				return false;
+		}
+		else if (Base < From)
+			return false;
+
+		FreeBlock(Block);
+		Node->Raw.Sectors -= sectors;
+		return true;
+	}
+
+	void EXT2::FreeBlocksFrom(EXT2Inode *Node, uint64_t From)
+	{
+		uint32_t sectors = (uint32_t)(BlockSize / 512);
+		uint64_t perBlock = BlockSize / 4;
+
+		for (uint64_t i = From; i < DIRECT_BLOCKS; i++)
+		{
+			if (Node->Raw.Block[i] == 0)
+				continue;
+			FreeBlock(Node->Raw.Block[i]);
+			Node->Raw.Block[i] = 0;
+			Node->Raw.Sectors -= sectors;
+		}
+
+		uint64_t base = DIRECT_BLOCKS, span = perBlock;
+		for (int level = 1; level <= 3; level++)
+		{
+			uint32_t &root = Node->Raw.Block[DIRECT_BLOCKS + level - 1];
+			if (root && base + span > From &&
+				FreeTree(Node, root, level, base, From))
+				root = 0;
+
+			base += span;
+			span *= perBlock;
+		}
+	}
+
+	ssize_t EXT2::Transfer(EXT2Inode *Node, const struct kiovec *Vector, int Count, off_t Offset, bool Write)
+	{
+		size_t total = 0;
+		for (int i = 0; i < Count; i++)
+			total += Vector[i].iov_len;
+
+		if (!Write)
+		{
+			off_t size = GetSize(Node);
+			if (Offset >= size)
+				return 0;
+			total = MIN(total, (size_t)(size - Offset));
+		}
+
+		/* Where the next byte of the caller goes or comes from */
+		int vi = 0;
+		size_t vo = 0;
+		auto Take = [&](size_t Length, struct kiovec *Out, int &OutCount) -> size_t
+		{
+			size_t taken = 0;
+			while (taken < Length && vi < Count && OutCount < EXT2_MAX_RUN)
+			{
+				size_t n = MIN(Length - taken, Vector[vi].iov_len - vo);
+				if (n)
+				{
+					Out[OutCount].iov_base = (uint8_t *)Vector[vi].iov_base + vo;
+					Out[OutCount].iov_len = n;
+					OutCount++;
+					taken += n;
+					vo += n;
+				}
+				if (vo == Vector[vi].iov_len)
+				{
+					vi++;
+					vo = 0;
+				}
+			}
+			return taken;
+		};
+
+		/* Bytes that were transferred to or from the disk */
+		size_t done = 0;
+		struct kiovec run[EXT2_MAX_RUN];
+		int runCount = 0;
+		off_t runOffset = 0;
+		size_t runLength = 0;
+		auto Submit = [&]() -> int
+		{
+			if (runCount == 0)
+				return 0;
+
+			ssize_t ret = Write ? Device->WriteV(run, runCount, runOffset)
+								: Device->ReadV(run, runCount, runOffset);
+			runCount = 0;
+			if (ret < 0)
+				return (int)ret;
+			if ((size_t)ret != runLength)
+				return -EIO;
+			done += runLength;
+			return 0;
+		};
+
+		uint8_t *bounce = nullptr;
+		uint32_t goal = 0;
+		/* Bytes walked through, the last run may not be submitted yet */
+		size_t queued = 0;
+		int error = 0;
+		while (queued < total)
+		{
+			off_t position = Offset + queued;
+			uint32_t logical = (uint32_t)(position / BlockSize);
+			size_t inBlock = position % BlockSize;
+			size_t length = MIN(total - queued, BlockSize - inBlock);
+
+			/* Place new blocks after the one before them, or near the inode */
+			if (goal == 0 && Write)
+			{
+				uint32_t previous = logical ? MapBlock(Node, logical - 1, false, 0, &error) : 0;
+				size_t group = (Node->Node.Index - 1) / Super.InodesPerGroup;
+				goal = previous ? previous + 1 : Groups[group].InodeTable;
+			}
+
+			bool wasHole = Write && MapBlock(Node, logical, false, 0, &error) == 0;
+			uint32_t block = MapBlock(Node, logical, Write, goal, &error);
+			if (error < 0)
+				break;
+			goal = block + 1;
+
+			if (block == 0)
+			{
+				/* A hole reads as zeros */
+				if ((error = Submit()) < 0)
+					break;
+				struct kiovec zero[EXT2_MAX_RUN];
+				size_t taken = 0;
+				while (taken < length)
+				{
+					int zeroCount = 0;
+					taken += Take(length - taken, zero, zeroCount);
+					for (int i = 0; i < zeroCount; i++)
+						memset(zero[i].iov_base, 0, zero[i].iov_len);
+				}
+				queued += length;
+				done += length;
+				continue;
+			}
+
+			if (Write && length != BlockSize)
+			{
+				/* Part of a block, the rest must stay as it is */
+				if ((error = Submit()) < 0)
+					break;
+				if (bounce == nullptr)
+					bounce = new uint8_t[BlockSize];
+
+				if (wasHole)
+					memset(bounce, 0, BlockSize);
+				else if ((error = DeviceRead(block, bounce)) < 0)
+					break;
+
+				struct kiovec part[EXT2_MAX_RUN];
+				size_t copied = 0;
+				while (copied < length)
+				{
+					int partCount = 0;
+					Take(length - copied, part, partCount);
+					for (int i = 0; i < partCount; i++)
+					{
+						memcpy(bounce + inBlock + copied, part[i].iov_base, part[i].iov_len);
+						copied += part[i].iov_len;
+					}
+				}
+
+				if ((error = DeviceWrite(block, bounce)) < 0)
+					break;
+				queued += length;
+				done += length;
+				continue;
+			}
+
+			off_t deviceOffset = (off_t)block * BlockSize + inBlock;
+			if (runCount && ((uint64_t)deviceOffset - (uint64_t)runOffset != runLength ||
+							 runCount >= EXT2_MAX_RUN - 1))
+			{
+				if ((error = Submit()) < 0)
+					break;
+			}
+
+			if (runCount == 0)
+			{
+				runOffset = deviceOffset;
+				runLength = 0;
+			}
+
+			/* Blocks that follow each other on the disk join the run */
+			size_t taken = 0;
+			while (taken < length)
+			{
+				if (runCount == EXT2_MAX_RUN)
+				{
+					if ((error = Submit()) < 0)
+						break;
+					runOffset = deviceOffset + taken;
+					runLength = 0;
+				}
+
+				size_t n = Take(length - taken, run, runCount);
+				runLength += n;
+				taken += n;
+			}
+			if (error < 0)
+				break;
+			queued += length;
+		}
+
+		if (error == 0)
+			error = Submit();
+		delete[] bounce;
+
+		/* Only what reached the disk counts, the rest is a short transfer */
+		if (error < 0)
+		{
+			if (done == 0)
+				return error;
+			warn("Inode %d: %s failed after %ld bytes with %d", Node->Node.Index,
+				 Write ? "write" : "read", done, error);
+		}
+
+		if (Write)
+		{
+			if (Offset + (off_t)done > GetSize(Node))
+				SetSize(Node, Offset + done);
+			StoreInode(Node);
+		}
+		return done;
+	}
+
+	int EXT2::ForEachEntry(EXT2Inode *Directory, EntryCallback Callback)
+	{
+		off_t size = GetSize(Directory);
+		for (uint32_t logical = 0; (off_t)logical * (off_t)BlockSize < size; logical++)
+		{
+			int error = 0;
+			uint32_t block = MapBlock(Directory, logical, false, 0, &error);
+			if (block == 0)
+				continue;
+
+			Buffer *b = GetBuffer(block);
+			if (b == nullptr)
+				return -EIO;
+
+			bool dirty = false, found = false;
+			DirectoryEntry *previous = nullptr;
+			for (size_t offset = 0; offset < BlockSize;)
+			{
+				DirectoryEntry *entry = (DirectoryEntry *)(b->Data + offset);
+				if (entry->RecordLength < sizeof(DirectoryEntry) ||
+					offset + entry->RecordLength > BlockSize)
+				{
+					warn("Corrupted directory %d at block %d", Directory->Node.Index, block);
+					break;
+				}
+
+				if (Callback(entry, previous, dirty))
+				{
+					found = true;
+					break;
+				}
+
+				previous = entry;
+				offset += entry->RecordLength;
+			}
+
+			PutBuffer(b, dirty);
+			if (found)
+				return 1;
+		}
+		return 0;
+	}
+
+	uint32_t EXT2::FindEntry(EXT2Inode *Directory, const char *Name, size_t Length)
+	{
+		uint32_t result = 0;
+		ForEachEntry(Directory, [&](DirectoryEntry *Entry, DirectoryEntry *, bool &)
+					 {
+						 if (Entry->Inode == 0 || Entry->NameLength != Length ||
+							 memcmp(Entry->Name, Name, Length) != 0)
+							 return false;
+						 result = Entry->Inode;
+						 return true; });
+		return result;
+	}
+
+	int EXT2::AddEntry(EXT2Inode *Directory, const char *Name, EXT2Inode *Node)
+	{
+		size_t length = strlen(Name);
+		uint16_t needed = (uint16_t)ALIGN_UP(sizeof(DirectoryEntry) + length, 4);
+		uint8_t type = (Super.FeatureIncompatibility & INCOMPAT_FILETYPE) ? ModeToType(Node->Raw.Mode) : 0;
+
+		auto Fill = [&](DirectoryEntry *Entry)
+		{
+			Entry->Inode = (uint32_t)Node->Node.Index;
+			Entry->NameLength = (uint8_t)length;
+			Entry->FileType = type;
+			memcpy(Entry->Name, Name, length);
+		};
+
+		/* Space left at the end of an entry first */
+		int ret = ForEachEntry(Directory, [&](DirectoryEntry *Entry, DirectoryEntry *, bool &Dirty)
+							   {
+								   uint16_t used = Entry->Inode ? (uint16_t)ALIGN_UP(sizeof(DirectoryEntry) + Entry->NameLength, 4) : 0;
+								   if (Entry->RecordLength - used < needed)
+									   return false;
+
+								   if (used)
+								   {
+									   DirectoryEntry *next = (DirectoryEntry *)((uint8_t *)Entry + used);
+									   next->RecordLength = Entry->RecordLength - used;
+									   Entry->RecordLength = used;
+									   Entry = next;
+								   }
+
+								   Fill(Entry);
+								   Dirty = true;
+								   return true; });
+		if (ret != 0)
+			return ret < 0 ? ret : 0;
+
+		/* Directory is full, add a block */
+		off_t size = GetSize(Directory);
+		int error = 0;
+		uint32_t block = MapBlock(Directory, (uint32_t)(size / BlockSize), true, 0, &error);
+		if (block == 0)
+			return error;
+
+		Buffer *b = GetBuffer(block, false);
+		memset(b->Data, 0, BlockSize);
+		DirectoryEntry *entry = (DirectoryEntry *)b->Data;
+		entry->RecordLength = (uint16_t)BlockSize;
+		Fill(entry);
+		PutBuffer(b, true);
+
+		SetSize(Directory, size + BlockSize);
+		StoreInode(Directory);
+		return 0;
+	}
+
+	int EXT2::RemoveEntry(EXT2Inode *Directory, const char *Name)
+	{
+		size_t length = strlen(Name);
+		int ret = ForEachEntry(Directory, [&](DirectoryEntry *Entry, DirectoryEntry *Previous, bool &Dirty)
+							   {
+								   if (Entry->Inode == 0 || Entry->NameLength != length ||
+									   memcmp(Entry->Name, Name, length) != 0)
+									   return false;
+
+								   /* The entry before takes its space */
+								   if (Previous)
+									   Previous->RecordLength += Entry->RecordLength;
+								   else
+									   Entry->Inode = 0;
+								   Dirty = true;
+								   return true; });
+		if (ret == 0)
+			return -ENOENT;
+		return ret < 0 ? ret : 0;
+	}
+
+	bool EXT2::IsEmpty(EXT2Inode *Directory)
+	{
+		int ret = ForEachEntry(Directory, [&](DirectoryEntry *Entry, DirectoryEntry *, bool &)
+							   {
+								   if (Entry->Inode == 0)
+									   return false;
+								   if (Entry->NameLength == 1 && Entry->Name[0] == '.')
+									   return false;
+								   if (Entry->NameLength == 2 && Entry->Name[0] == '.' && Entry->Name[1] == '.')
+									   return false;
+								   return true; });
+		return ret == 0;
+	}
+
+	int EXT2::NewInode(EXT2Inode *Parent, const char *Name, mode_t Mode, EXT2Inode **Result)
+	{
+		if (ReadOnly)
+			return -EROFS;
+		if (!S_ISDIR(Parent->Raw.Mode))
+			return -ENOTDIR;
+		if (Parent->Raw.Links == 0)
+			return -ENOENT;
+
+		size_t length = strlen(Name);
+		if (length == 0 || strchr(Name, '/'))
+			return -EINVAL;
+		if (length > 255)
+			return -ENAMETOOLONG;
+		if (FindEntry(Parent, Name, length))
+			return -EEXIST;
+
+		bool directory = S_ISDIR(Mode);
+		uint32_t number = AllocateInode((uint32_t)Parent->Node.Index, directory);
+		if (number == 0)
+			return -ENOSPC;
+
+		/* A freed inode may still be around for its old FileNodes */
+		Inodes.erase(number);
+		EXT2Inode *node = new EXT2Inode;
+		node->Raw.Mode = (uint16_t)Mode;
+		node->Raw.Links = directory ? 2 : 1;
+		node->Node.Device = DeviceID;
+		node->Node.Index = number;
+		node->Node.Mode = Mode;
+		node->Node.Flags = I_FLAG_CACHE_KEEP;
+		node->Node.PrivateData = this;
+		Inodes[number] = node;
+
+		if (directory)
+		{
+			int error = 0;
+			uint32_t block = MapBlock(node, 0, true, Groups[(number - 1) / Super.InodesPerGroup].InodeTable, &error);
+			if (block == 0)
+			{
+				FreeInode(number, true);
+				Inodes.erase(number);
+				return error;
+			}
+
+			Buffer *b = GetBuffer(block, false);
+			memset(b->Data, 0, BlockSize);
+			DirectoryEntry *dot = (DirectoryEntry *)b->Data;
+			dot->Inode = number;
+			dot->RecordLength = 12;
+			dot->NameLength = 1;
+			dot->FileType = (Super.FeatureIncompatibility & INCOMPAT_FILETYPE) ? 2 : 0;
+			dot->Name[0] = '.';
+
+			DirectoryEntry *dotdot = (DirectoryEntry *)(b->Data + 12);
+			dotdot->Inode = (uint32_t)Parent->Node.Index;
+			dotdot->RecordLength = (uint16_t)(BlockSize - 12);
+			dotdot->NameLength = 2;
+			dotdot->FileType = dot->FileType;
+			dotdot->Name[0] = '.';
+			dotdot->Name[1] = '.';
+			PutBuffer(b, true);
+			SetSize(node, BlockSize);
+		}
+		StoreInode(node);
+
+		int ret = AddEntry(Parent, Name, node);
+		if (ret < 0)
+		{
+			Release(node);
+			return ret;
+		}
+
+		if (directory)
+		{
+			Parent->Raw.Links++;
+			StoreInode(Parent);
+		}
+
+		*Result = node;
+		return 0;
+	}
+
+	void EXT2::Release(EXT2Inode *Node)
+	{
+		/* Open FileNodes keep the struct, the disk inode is free */
+		FreeBlocksFrom(Node, 0);
+		SetSize(Node, 0);
+		Node->Raw.Links = 0;
+		/* No wall clock yet, any non-zero time marks it deleted */
+		Node->Raw.DeleteTime = Super.LastWrittenTime ? Super.LastWrittenTime : 1;
+		StoreInode(Node);
+
+		uint32_t number = (uint32_t)Node->Node.Index;
+		FreeInode(number, S_ISDIR(Node->Raw.Mode));
+		Inodes.erase(number);
+	}
+
+	int EXT2::Unlink(EXT2Inode *Parent, const char *Name, bool Directory, bool AnyType)
+	{
+		if (ReadOnly)
+			return -EROFS;
+		if (!S_ISDIR(Parent->Raw.Mode))
+			return -ENOTDIR;
+
+		EXT2Inode *node = GetInode(FindEntry(Parent, Name, strlen(Name)));
+		if (node == nullptr)
+			return -ENOENT;
+
+		bool isDirectory = S_ISDIR(node->Raw.Mode);
+		if (!AnyType && isDirectory != Directory)
+			return isDirectory ? -EISDIR : -ENOTDIR;
+		if (isDirectory && !IsEmpty(node))
+			return -ENOTEMPTY;
+
+		int ret = RemoveEntry(Parent, Name);
+		if (ret < 0)
+			return ret;
+
+		if (isDirectory)
+		{
+			Parent->Raw.Links--;
+			StoreInode(Parent);
+			Release(node);
+			return 0;
+		}
+
+		if (--node->Raw.Links == 0)
+			Release(node);
+		else
+			StoreInode(node);
+		return 0;
+	}
+
+	int EXT2::Lookup(struct Inode *_Parent, const char *Name, struct Inode **Result)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Parent = (EXT2Inode *)_Parent;
+		if (Parent == nullptr || strcmp(Name, "/") == 0)
+		{
+			EXT2Inode *root = GetInode(ROOT_INODE);
+			if (root == nullptr)
+				return -EIO;
+			*Result = &root->Node;
+			return 0;
+		}
+
+		if (!S_ISDIR(Parent->Raw.Mode))
+			return -ENOTDIR;
+
+		EXT2Inode *node = GetInode(FindEntry(Parent, Name, strlen(Name)));
+		if (node == nullptr)
+			return -ENOENT;
+
+		*Result = &node->Node;
+		return 0;
+	}
+
+	int EXT2::Create(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		if ((Mode & S_IFMT) == 0)
+			Mode |= S_IFREG;
+
+		EXT2Inode *node;
+		int ret = NewInode((EXT2Inode *)Parent, Name, Mode, &node);
+		if (ret < 0)
+			return ret;
+
+		*Result = &node->Node;
+		return 0;
+	}
+
+	int EXT2::Remove(struct Inode *Parent, const char *Name)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		return Unlink((EXT2Inode *)Parent, Name, false, true);
+	}
+
+	int EXT2::Rename(struct Inode *_Parent, const char *OldName, const char *NewName)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Parent = (EXT2Inode *)_Parent;
+		if (ReadOnly)
+			return -EROFS;
+		if (!S_ISDIR(Parent->Raw.Mode))
+			return -ENOTDIR;
+
+		EXT2Inode *node = GetInode(FindEntry(Parent, OldName, strlen(OldName)));
+		if (node == nullptr)
+			return -ENOENT;
+
+		size_t length = strlen(NewName);
+		if (length == 0 || strchr(NewName, '/'))
+			return -EINVAL;
+		if (length > 255)
+			return -ENAMETOOLONG;
+
+		uint32_t target = FindEntry(Parent, NewName, length);
+		if (target == node->Node.Index)
+			return 0;
+
+		/* The new name replaces what was there before */
+		if (target)
+		{
+			int ret = Unlink(Parent, NewName, S_ISDIR(node->Raw.Mode), false);
+			if (ret < 0)
+				return ret;
+		}
+
+		int ret = AddEntry(Parent, NewName, node);
+		if (ret < 0)
+			return ret;
+		return RemoveEntry(Parent, OldName);
+	}
+
+	ssize_t EXT2::Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
+	{
+		struct kiovec vector = {Buffer, Size};
+		return ReadV(Node, &vector, 1, Offset);
+	}
+
+	ssize_t EXT2::Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset)
+	{
+		struct kiovec vector = {(void *)Buffer, Size};
+		return WriteV(Node, &vector, 1, Offset);
+	}
+
+	ssize_t EXT2::ReadV(struct Inode *_Node, const struct kiovec *Vector, int Count, off_t Offset)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Node = (EXT2Inode *)_Node;
+		if (S_ISDIR(Node->Raw.Mode))
+			return -EISDIR;
+		if (Offset < 0)
+			return -EINVAL;
+		return Transfer(Node, Vector, Count, Offset, false);
+	}
+
+	ssize_t EXT2::WriteV(struct Inode *_Node, const struct kiovec *Vector, int Count, off_t Offset)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Node = (EXT2Inode *)_Node;
+		if (ReadOnly)
+			return -EROFS;
+		if (S_ISDIR(Node->Raw.Mode))
+			return -EISDIR;
+		if (Offset < 0)
+			return -EINVAL;
+		return Transfer(Node, Vector, Count, Offset, true);
+	}
+
+	int EXT2::Truncate(struct Inode *_Node, off_t Size)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Node = (EXT2Inode *)_Node;
+		if (ReadOnly)
+			return -EROFS;
+		if (S_ISDIR(Node->Raw.Mode))
+			return -EISDIR;
+		if (!S_ISREG(Node->Raw.Mode))
+			return -EINVAL;
+		if (Size < 0)
+			return -EINVAL;
+
+		/* Growing only moves the end, the new range is a hole */
+		if (Size < GetSize(Node))
+		{
+			FreeBlocksFrom(Node, ALIGN_UP((uint64_t)Size, BlockSize) / BlockSize);
+
+			/* What is left of the last block must read as zeros later */
+			size_t tail = Size % BlockSize;
+			int error = 0;
+			uint32_t block = tail ? MapBlock(Node, (uint32_t)(Size / BlockSize), false, 0, &error) : 0;
+			if (block)
+			{
+				uint8_t *data = new uint8_t[BlockSize];
+				if (DeviceRead(block, data) == 0)
+				{
+					memset(data + tail, 0, BlockSize - tail);
+					DeviceWrite(block, data);
+				}
+				delete[] data;
+			}
+		}
+
+		SetSize(Node, Size);
+		StoreInode(Node);
+		return 0;
+	}
+
+	ssize_t EXT2::ReadDir(struct Inode *_Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Node = (EXT2Inode *)_Node;
+		if (!S_ISDIR(Node->Raw.Mode))
+			return -ENOTDIR;
+
+		/* Offset counts the used entries, "." and ".." come first */
+		off_t index = 0, entries = 0;
+		size_t totalSize = 0;
+		bool full = false;
+		ForEachEntry(Node, [&](DirectoryEntry *Entry, DirectoryEntry *, bool &)
+					 {
+						 if (Entry->Inode == 0)
+							 return false;
+						 if (index++ < Offset)
+							 return false;
+						 if (entries >= Entries)
+							 return true;
+
+						 uint16_t reclen = (uint16_t)(offsetof(struct kdirent, d_name) + Entry->NameLength + 1);
+						 if (totalSize + reclen > Size)
+						 {
+							 full = true;
+							 return true;
+						 }
+
+						 struct kdirent *ent = (struct kdirent *)((uintptr_t)Buffer + totalSize);
+						 ent->d_ino = Entry->Inode;
+						 ent->d_off = index - 1;
+						 ent->d_reclen = reclen;
+						 if (Super.FeatureIncompatibility & INCOMPAT_FILETYPE)
+						 {
+							 static const uint8_t types[] = {DT_UNKNOWN, DT_REG, DT_DIR, DT_CHR, DT_BLK, DT_FIFO, DT_SOCK, DT_LNK};
+							 ent->d_type = Entry->FileType < sizeof(types) ? types[Entry->FileType] : DT_UNKNOWN;
+						 }
+						 else
+							 ent->d_type = DT_UNKNOWN;
+						 memcpy(ent->d_name, Entry->Name, Entry->NameLength);
+						 ent->d_name[Entry->NameLength] = '\0';
+						 totalSize += reclen;
+						 entries++;
+						 return false; });
+
+		if (full && totalSize == 0)
+			return -EINVAL;
+		return totalSize;
+	}
+
+	int EXT2::MkDir(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result)
+	{
+		return Create(Parent, Name, (Mode & ~S_IFMT) | S_IFDIR, Result);
+	}
+
+	int EXT2::RmDir(struct Inode *Parent, const char *Name)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		return Unlink((EXT2Inode *)Parent, Name, true, false);
+	}
+
+	int EXT2::SymLink(struct Inode *Parent, const char *Name, const char *Target, struct Inode **Result)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		EXT2Inode *node;
+		int ret = NewInode((EXT2Inode *)Parent, Name, S_IFLNK | 0777, &node);
+		if (ret < 0)
+			return ret;
+
+		/* Short targets live in the block pointers */
+		size_t length = strlen(Target);
+		if (length < sizeof(node->Raw.Block))
+		{
+			memcpy(node->Raw.Block, Target, length);
+			SetSize(node, length);
+			StoreInode(node);
+		}
+		else
+		{
+			struct kiovec vector = {(void *)Target, length};
+			ssize_t written = Transfer(node, &vector, 1, 0, true);
+			if (written < 0 || (size_t)written != length)
+			{
+				Unlink((EXT2Inode *)Parent, Name, false, false);
+				return written < 0 ? (int)written : -ENOSPC;
+			}
+		}
+
+		*Result = &node->Node;
+		return 0;
+	}
+
+	ssize_t EXT2::ReadLink(struct Inode *_Node, char *Buffer, size_t Size)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Node = (EXT2Inode *)_Node;
+		if (!S_ISLNK(Node->Raw.Mode))
+			return -EINVAL;
+
+		size_t length = MIN(Size, (size_t)GetSize(Node));
+		if (Node->Raw.Sectors == 0)
+		{
+			memcpy(Buffer, Node->Raw.Block, MIN(length, sizeof(Node->Raw.Block)));
+			return MIN(length, sizeof(Node->Raw.Block));
+		}
+
+		struct kiovec vector = {Buffer, length};
+		return Transfer(Node, &vector, 1, 0, false);
+	}
+
+	int EXT2::Stat(struct Inode *_Node, struct kstat *Stat)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Node = (EXT2Inode *)_Node;
+
+		memset(Stat, 0, sizeof(struct kstat));
+		Stat->Device = DeviceID;
+		Stat->Index = Node->Node.Index;
+		Stat->Mode = Node->Raw.Mode;
+		Stat->HardLinks = Node->Raw.Links;
+		Stat->UserID = Node->Raw.UserID;
+		Stat->GroupID = Node->Raw.GroupID;
+		Stat->Size = GetSize(Node);
+		Stat->AccessTime = Node->Raw.AccessTime;
+		Stat->ModifyTime = Node->Raw.ModifyTime;
+		Stat->ChangeTime = Node->Raw.ChangeTime;
+		Stat->BlockSize = BlockSize;
+		Stat->Blocks = Node->Raw.Sectors;
+		return 0;
+	}
+
+	int EXT2::Link(struct Inode *_Parent, const char *Name, struct Inode *_Target)
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		auto Parent = (EXT2Inode *)_Parent;
+		auto Target = (EXT2Inode *)_Target;
+		if (ReadOnly)
+			return -EROFS;
+		if (!S_ISDIR(Parent->Raw.Mode))
+			return -ENOTDIR;
+		if (S_ISDIR(Target->Raw.Mode))
+			return -EPERM;
+		if (Target->Raw.Links == 0)
+			return -ENOENT;
+		if (Target->Raw.Links == UINT16_MAX)
+			return -EMLINK;
+
+		size_t length = strlen(Name);
+		if (length == 0 || strchr(Name, '/'))
+			return -EINVAL;
+		if (length > 255)
+			return -ENAMETOOLONG;
+		if (FindEntry(Parent, Name, length))
+			return -EEXIST;
+
+		int ret = AddEntry(Parent, Name, Target);
+		if (ret < 0)
+			return ret;
+
+		Target->Raw.Links++;
+		StoreInode(Target);
+		return 0;
+	}
+
+	int EXT2::Sync()
+	{
+		if (ReadOnly)
+			return 0;
+
+		int result = FlushBuffers();
+		if (!SuperDirty)
+			return result;
+
+		/* Only the primary copies, backups are left for fsck */
+		size_t tableSize = ALIGN_UP(GroupCount * sizeof(GroupDescriptor), BlockSize);
+		uint8_t *table = new uint8_t[tableSize]();
+		memcpy(table, Groups, GroupCount * sizeof(GroupDescriptor));
+		uint32_t first = Super.FirstDataBlock + 1;
+		for (size_t i = 0; i < tableSize / BlockSize; i++)
+		{
+			int ret = DeviceWrite(first + (uint32_t)i, table + i * BlockSize);
+			if (ret < 0 && result == 0)
+				result = ret;
+		}
+		delete[] table;
+
+		ssize_t ret = Device->Write(&Super, sizeof(SuperBlock), 1024);
+		if (ret != sizeof(SuperBlock) && result == 0)
+			result = ret < 0 ? (int)ret : -EIO;
+
+		if (result == 0)
+			SuperDirty = false;
+		return result;
+	}
+
+	int EXT2::Synchronize(struct Inode *)
+	{
+		/* Metadata is shared, syncing one inode syncs all */
+		std::lock_guard<std::mutex> guard(Lock);
+		return Sync();
+	}
+
+	int EXT2::Initialize()
+	{
+		ssize_t ret = Device->Read(&Super, sizeof(SuperBlock), 1024);
+		if (ret != sizeof(SuperBlock))
+			return ret < 0 ? (int)ret : -EIO;
+
+		if (Super.Magic != MAGIC)
+			return -EINVAL;
+
+		if (Super.LogBlockSize > 6 || Super.BlocksPerGroup == 0 ||
+			Super.InodesPerGroup == 0 || Super.FirstDataBlock >= Super.Blocks)
+			ReturnLogError(-EINVAL, "Invalid superblock");
+
+		BlockSize = 1024 << Super.LogBlockSize;
+		InodeSize = Super.RevLevel >= 1 ? Super.InodeSize : 128;
+		FirstInode = Super.RevLevel >= 1 ? Super.FirstInode : 11;
+		if (InodeSize < sizeof(DiskInode) || InodeSize > BlockSize)
+			ReturnLogError(-EINVAL, "Invalid inode size %ld", InodeSize);
+
+		uint32_t incompatible = Super.FeatureIncompatibility & ~INCOMPAT_FILETYPE;
+		if (incompatible)
+			ReturnLogError(-ENOTSUP, "Unsupported features %#x", incompatible);
+
+		/* Unknown read-only features can still be read */
+		uint32_t roIncompatible = Super.FeatureRoCompatibility &
+								  ~(RO_COMPAT_SPARSE_SUPER | RO_COMPAT_LARGE_FILE);
+		if (roIncompatible)
+		{
+			warn("Features %#x are not supported, mounting read-only", roIncompatible);
+			ReadOnly = true;
+		}
+
+		GroupCount = (Super.Blocks - Super.FirstDataBlock + Super.BlocksPerGroup - 1) / Super.BlocksPerGroup;
+		size_t tableSize = ALIGN_UP(GroupCount * sizeof(GroupDescriptor), BlockSize);
+		uint8_t *table = new uint8_t[tableSize];
+		for (size_t i = 0; i < tableSize / BlockSize; i++)
+		{
+			int err = DeviceRead(Super.FirstDataBlock + 1 + (uint32_t)i, table + i * BlockSize);
+			if (err < 0)
+			{
+				delete[] table;
+				return err;
+			}
+		}
+
+		Groups = new GroupDescriptor[GroupCount];
+		memcpy(Groups, table, GroupCount * sizeof(GroupDescriptor));
+		delete[] table;
+
+		if (!ReadOnly)
+		{
+			Super.MountedTimes++;
+			SuperDirty = true;
+		}
+		return 0;
+	}
+
+	void EXT2::WritebackThread()
+	{
+		thisThread->SetPriority(Tasking::Low);
+		while (true)
+		{
+			TaskManager->Sleep(EXT2_WRITEBACK_INTERVAL);
+
+			std::vector<EXT2 *> list;
+			{
+				SmartLock(MountedLock);
+				list = Mounted;
+			}
+
+			/* File data from the page cache first, then the metadata */
+			foreach (EXT2 *ext2 in list)
+			{
+				int ret = fs->Sync(ext2->Info, nullptr);
+				if (ret < 0)
+					warn("ext2 writeback failed with %d", ret);
+			}
+		}
+	}
+
+	EXT2::EXT2(FileNode *Device) { this->Device = Device; }
+
+	EXT2::~EXT2()
+	{
+		{
+			SmartLock(MountedLock);
+			for (auto it = Mounted.begin(); it != Mounted.end(); ++it)
+			{
+				if (*it != this)
+					continue;
+				Mounted.erase(it);
+				break;
+			}
+		}
+
+		Sync();
+		foreach (auto &it in Buffers)
+		{
+			delete[] it.second->Data;
+			delete it.second;
+		}
+
+		foreach (auto &it in Inodes)
+			delete it.second;
+		delete[] Groups;
+	}
+}
+
+O2 int __ext2_Lookup(struct Inode *Parent, const char *Name, struct Inode **Result)
+{
+	return ((vfs::EXT2 *)Parent->PrivateData)->Lookup(Parent, Name, Result);
+}
+
+O2 int __ext2_Create(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result)
+{
+	return ((vfs::EXT2 *)Parent->PrivateData)->Create(Parent, Name, Mode, Result);
+}
+
+O2 int __ext2_Remove(struct Inode *Parent, const char *Name)
+{
+	return ((vfs::EXT2 *)Parent->PrivateData)->Remove(Parent, Name);
+}
+
+O2 int __ext2_Rename(struct Inode *Parent, const char *OldName, const char *NewName)
+{
+	return ((vfs::EXT2 *)Parent->PrivateData)->Rename(Parent, OldName, NewName);
+}
+
+O2 ssize_t __ext2_Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
+{
+	return ((vfs::EXT2 *)Node->PrivateData)->Read(Node, Buffer, Size, Offset);
+}
+
+O2 ssize_t __ext2_Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset)
+{
+	return ((vfs::EXT2 *)Node->PrivateData)->Write(Node, Buffer, Size, Offset);
+}
+
+O2 int __ext2_Truncate(struct Inode *Node, off_t Size)
+{
+	return ((vfs::EXT2 *)Node->PrivateData)->Truncate(Node, Size);
+}
+
+O2 ssize_t __ext2_ReadDir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
+{
+	return ((vfs::EXT2 *)Node->PrivateData)->ReadDir(Node, Buffer, Size, Offset, Entries);
+}
+
+O2 int __ext2_MkDir(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result)
+{
+	return ((vfs::EXT2 *)Parent->PrivateData)->MkDir(Parent, Name, Mode, Result);
+}
+
+O2 int __ext2_RmDir(struct Inode *Parent, const char *Name)
+{
+	return ((vfs::EXT2 *)Parent->PrivateData)->RmDir(Parent, Name);
+}
+
+O2 int __ext2_SymLink(struct Inode *Parent, const char *Name, const char *Target, struct Inode **Result)
+{
+	return ((vfs::EXT2 *)Parent->PrivateData)->SymLink(Parent, Name, Target, Result);
+}
+
+O2 ssize_t __ext2_ReadLink(struct Inode *Node, char *Buffer, size_t Size)
+{
+	return ((vfs::EXT2 *)Node->PrivateData)->ReadLink(Node, Buffer, Size);
+}
+
+O2 int __ext2_Stat(struct Inode *Node, struct kstat *Stat)
+{
+	return ((vfs::EXT2 *)Node->PrivateData)->Stat(Node, Stat);
+}
+
+O2 int __ext2_Link(struct Inode *Parent, const char *Name, struct Inode *Target)
+{
+	return ((vfs::EXT2 *)Parent->PrivateData)->Link(Parent, Name, Target);
+}
+
+O2 ssize_t __ext2_ReadV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset)
+{
+	return ((vfs::EXT2 *)Node->PrivateData)->ReadV(Node, Vector, Count, Offset);
+}
+
+O2 ssize_t __ext2_WriteV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset)
+{
+	return ((vfs::EXT2 *)Node->PrivateData)->WriteV(Node, Vector, Count, Offset);
+}
+
+int __ext2_Synchronize(FileSystemInfo *fsi, Inode *Node)
+{
+	return ((vfs::EXT2 *)fsi->PrivateData)->Synchronize(Node);
+}
+
+int __ext2_Destroy(FileSystemInfo *fsi)
+{
+	assert(fsi->PrivateData);
+	delete (vfs::EXT2 *)fsi->PrivateData;
+	delete fsi;
+	return 0;
+}
+
+bool TestAndInitializeEXT2(FileNode *Device, const char *Path)
+{
+	vfs::EXT2 *ext2 = new vfs::EXT2(Device);
+	int ret = ext2->Initialize();
+	if (ret < 0)
+	{
+		debug("%s is not ext2: %d", Device->Path.c_str(), ret);
+		delete ext2;
+		return false;
+	}
+
+	Inode *root = nullptr;
+	if (ext2->Lookup(nullptr, "/", &root) < 0)
+	{
+		error("Failed to read the root of %s", Device->Path.c_str());
+		delete ext2;
+		return false;
+	}
+
+	FileSystemInfo *fsi = new FileSystemInfo;
+	fsi->Name = "ext2";
+	fsi->RootName = "ext2";
+	fsi->Flags = I_FLAG_ROOT | I_FLAG_MOUNTPOINT | I_FLAG_CACHE_KEEP | I_FLAG_PAGE_CACHE;
+	fsi->SuperOps = {};
+	fsi->Ops = {};
+	fsi->SuperOps.Synchronize = __ext2_Synchronize;
+	fsi->SuperOps.Destroy = __ext2_Destroy;
+	fsi->Ops.Lookup = __ext2_Lookup;
+	fsi->Ops.Create = __ext2_Create;
+	fsi->Ops.Remove = __ext2_Remove;
+	fsi->Ops.Rename = __ext2_Rename;
+	fsi->Ops.Read = __ext2_Read;
+	fsi->Ops.Write = __ext2_Write;
+	fsi->Ops.Truncate = __ext2_Truncate;
+	fsi->Ops.ReadDir = __ext2_ReadDir;
+	fsi->Ops.MkDir = __ext2_MkDir;
+	fsi->Ops.RmDir = __ext2_RmDir;
+	fsi->Ops.SymLink = __ext2_SymLink;
+	fsi->Ops.ReadLink = __ext2_ReadLink;
+	fsi->Ops.Stat = __ext2_Stat;
+	fsi->Ops.Link = __ext2_Link;
+	fsi->Ops.ReadV = __ext2_ReadV;
+	fsi->Ops.WriteV = __ext2_WriteV;
+	fsi->PrivateData = ext2;
+	ext2->Info = fsi;
+
+	ext2->DeviceID = root->Device = fs->RegisterFileSystem(fsi, root);
+	fs->Mount(fs->GetRoot(0), root, Path);
+
+	static bool writeback = false;
+	{
+		SmartLock(vfs::MountedLock);
+		vfs::Mounted.push_back(ext2);
+		if (!writeback)
+		{
+			TaskManager->CreateThread(thisProcess, Tasking::IP(vfs::EXT2::WritebackThread))
+				->Rename("ext2 Writeback");
+			writeback = true;
+		}
+	}
+
+	KPrint("ext2: %s mounted on %s, %ld blocks of %ld bytes%s",
+		   Device->Path.c_str(), Path, ext2->GetBlockCount(),
+		   ext2->GetBlockSize(), ext2->IsReadOnly() ? ", read-only" : "");
+	return true;
+}
@@ -0,0 +1,705 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <filesystem/tmpfs.hpp>
+
+#include <memory.hpp>
+#include <debug.h>
+
+#include "../../kernel.h"
+
+namespace vfs
+{
+	TmpFS::TmpInode *TmpFS::NewInode(TmpInode *Parent, mode_t Mode)
+	{
+		TmpInode *node = new TmpInode;
+		node->Node.Device = DeviceID;
+		node->Node.Index = NextInode++;
+		node->Node.Mode = Mode;
+		node->Node.Flags = I_FLAG_CACHE_KEEP;
+		node->Node.PrivateData = this;
+		if (S_ISDIR(Mode))
+		{
+			node->Parent = Parent ? Parent : node;
+			node->Links = 1; /* "." */
+		}
+
+		Inodes.push_back(node);
+		return node;
+	}
+
+	TmpFS::DirEntry *TmpFS::FindEntry(TmpInode *Directory, const char *Name, size_t Length)
+	{
+		if (Directory->BucketCount == 0)
+			return nullptr;
+
+		uint64_t hash = DentryCache::HashName(Name, Length);
+		DirEntry *entry = Directory->Buckets[hash & (Directory->BucketCount - 1)];
+		for (; entry; entry = entry->NextHash)
+		{
+			if (entry->Hash == hash &&
+				entry->Name.size() == Length &&
+				memcmp(entry->Name.c_str(), Name, Length) == 0)
+				return entry;
+		}
+		return nullptr;
+	}
+
+	void TmpFS::HashEntry(TmpInode *Directory, DirEntry *Entry)
+	{
+		Entry->Hash = DentryCache::HashName(Entry->Name.c_str(), Entry->Name.size());
+
+		/* Keep the chains short, the load factor stays below 1 */
+		if (Directory->Entries.size() > Directory->BucketCount)
+		{
+			size_t count = Directory->BucketCount ? Directory->BucketCount * 2 : 8;
+			DirEntry **buckets = new DirEntry *[count]();
+			for (size_t i = 0; i < Directory->BucketCount; i++)
+			{
+				DirEntry *entry = Directory->Buckets[i];
+				while (entry)
+				{
+					DirEntry *next = entry->NextHash;
+					size_t slot = entry->Hash & (count - 1);
+					entry->NextHash = buckets[slot];
+					buckets[slot] = entry;
+					entry = next;
+				}
+			}
+
+			delete[] Directory->Buckets;
+			Directory->Buckets = buckets;
+			Directory->BucketCount = count;
+		}
+
+		size_t slot = Entry->Hash & (Directory->BucketCount - 1);
+		Entry->NextHash = Directory->Buckets[slot];
+		Directory->Buckets[slot] = Entry;
+	}
+
+	void TmpFS::UnhashEntry(TmpInode *Directory, DirEntry *Entry)
+	{
+		DirEntry **link = &Directory->Buckets[Entry->Hash & (Directory->BucketCount - 1)];
+		while (*link != Entry)
+			link = &(*link)->NextHash;
+		*link = Entry->NextHash;
+		Entry->NextHash = nullptr;
+	}
+
+	void TmpFS::AddEntry(TmpInode *Directory, const char *Name, TmpInode *Node)
+	{
+		DirEntry *entry = new DirEntry;
+		entry->Name = Name;
+		entry->Node = Node;
+		Directory->Entries.push_back(entry);
+		HashEntry(Directory, entry);
+
+		Node->Links++;
+		if (S_ISDIR(Node->Node.Mode))
+			Directory->Links++; /* ".." of the child */
+	}
+
+	void TmpFS::RemoveEntry(TmpInode *Directory, DirEntry *Entry)
+	{
+		UnhashEntry(Directory, Entry);
+		std::vector<DirEntry *> &entries = Directory->Entries;
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			if (*it != Entry)
+				continue;
+			entries.erase(it);
+			break;
+		}
+
+		TmpInode *node = Entry->Node;
+		delete Entry;
+
+		node->Links--;
+		if (S_ISDIR(node->Node.Mode))
+		{
+			Directory->Links--;
+			node->Links = 0; /* "." goes with the last name */
+		}
+
+		if (node->Links == 0)
+			Release(node);
+	}
+
+	void TmpFS::FreePages(TmpInode *Node, uint64_t From)
+	{
+		std::vector<uint8_t *> pages;
+		std::vector<uint64_t> indices;
+		Node->Pages.Collect(From, pages, &indices);
+
+		for (size_t i = 0; i < pages.size(); i++)
+		{
+			Node->Pages.Erase(indices[i]);
+			KernelAllocator.FreePage(pages[i]);
+		}
+
+		Node->PageCount -= pages.size();
+		Used -= FROM_PAGES(pages.size());
+		if (Node->PageCount == 0)
+			Node->Pages.Clear();
+	}
+
+	void TmpFS::Release(TmpInode *Node)
+	{
+		/* The inode itself stays, FileNodes may still point to it */
+		FreePages(Node, 0);
+		Node->Size = 0;
+		Node->Target.clear();
+
+		delete[] Node->Buckets;
+		Node->Buckets = nullptr;
+		Node->BucketCount = 0;
+	}
+
+	int TmpFS::NewChild(struct Inode *_Parent, const char *Name, mode_t Mode, TmpInode **Result)
+	{
+		auto Parent = (TmpInode *)_Parent;
+		if (!S_ISDIR(Parent->Node.Mode))
+			return -ENOTDIR;
+
+		/* The directory was removed while it was still open */
+		if (Parent->Links == 0)
+			return -ENOENT;
+
+		size_t length = strlen(Name);
+		if (length == 0)
+			return -EINVAL;
+		if (strchr(Name, '/'))
+			return -EINVAL;
+		if (length > MaxNameLength)
+			return -ENAMETOOLONG;
+
+		if (FindEntry(Parent, Name, length))
+			return -EEXIST;
+
+		TmpInode *node = NewInode(Parent, Mode);
+		AddEntry(Parent, Name, node);
+		*Result = node;
+		return 0;
+	}
+
+	int TmpFS::RemoveChild(struct Inode *_Parent, const char *Name, bool Directory)
+	{
+		auto Parent = (TmpInode *)_Parent;
+		if (!S_ISDIR(Parent->Node.Mode))
+			return -ENOTDIR;
+
+		DirEntry *entry = FindEntry(Parent, Name, strlen(Name));
+		if (entry == nullptr)
+			return -ENOENT;
+
+		TmpInode *node = entry->Node;
+		if (S_ISDIR(node->Node.Mode))
+		{
+			if (!node->Entries.empty())
+				return -ENOTEMPTY;
+		}
+		else if (Directory)
+			return -ENOTDIR;
+
+		RemoveEntry(Parent, entry);
+		return 0;
+	}
+
+	int TmpFS::Lookup(struct Inode *_Parent, const char *Name, struct Inode **Result)
+	{
+		SmartReadLock(Lock);
+		auto Parent = (TmpInode *)_Parent;
+		if (Parent == nullptr)
+			Parent = Root;
+
+		if (!S_ISDIR(Parent->Node.Mode))
+			return -ENOTDIR;
+
+		if (strcmp(Name, "/") == 0 || strcmp(Name, ".") == 0)
+		{
+			*Result = &Parent->Node;
+			return 0;
+		}
+
+		if (strcmp(Name, "..") == 0)
+		{
+			*Result = &Parent->Parent->Node;
+			return 0;
+		}
+
+		DirEntry *entry = FindEntry(Parent, Name, strlen(Name));
+		if (entry == nullptr)
+			return -ENOENT;
+
+		*Result = &entry->Node->Node;
+		return 0;
+	}
+
+	int TmpFS::Create(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result)
+	{
+		if ((Mode & S_IFMT) == 0)
+			Mode |= S_IFREG;
+
+		if (S_ISDIR(Mode))
+			return MkDir(Parent, Name, Mode, Result);
+
+		SmartWriteLock(Lock);
+		TmpInode *node;
+		int ret = NewChild(Parent, Name, Mode, &node);
+		if (ret < 0)
+			return ret;
+
+		*Result = &node->Node;
+		return 0;
+	}
+
+	int TmpFS::Remove(struct Inode *Parent, const char *Name)
+	{
+		SmartWriteLock(Lock);
+		return RemoveChild(Parent, Name, false);
+	}
+
+	int TmpFS::Rename(struct Inode *_Parent, const char *OldName, const char *NewName)
+	{
+		SmartWriteLock(Lock);
+		auto Parent = (TmpInode *)_Parent;
+		if (!S_ISDIR(Parent->Node.Mode))
+			return -ENOTDIR;
+
+		DirEntry *entry = FindEntry(Parent, OldName, strlen(OldName));
+		if (entry == nullptr)
+			return -ENOENT;
+
+		size_t length = strlen(NewName);
+		if (length == 0 || strchr(NewName, '/'))
+			return -EINVAL;
+		if (length > MaxNameLength)
+			return -ENAMETOOLONG;
+
+		DirEntry *target = FindEntry(Parent, NewName, length);
+		if (target == entry)
+			return 0;
+
+		if (target)
+		{
+			/* The new name replaces what was there before */
+			bool isDirectory = S_ISDIR(entry->Node->Node.Mode);
+			if (S_ISDIR(target->Node->Node.Mode))
+			{
+				if (!isDirectory)
+					return -EISDIR;
+				if (!target->Node->Entries.empty())
+					return -ENOTEMPTY;
+			}
+			else if (isDirectory)
+				return -ENOTDIR;
+
+			RemoveEntry(Parent, target);
+		}
+
+		UnhashEntry(Parent, entry);
+		entry->Name = NewName;
+		HashEntry(Parent, entry);
+		return 0;
+	}
+
+	ssize_t TmpFS::Read(struct Inode *_Node, void *Buffer, size_t Size, off_t Offset)
+	{
+		SmartReadLock(Lock);
+		auto Node = (TmpInode *)_Node;
+		if (S_ISDIR(Node->Node.Mode))
+			return -EISDIR;
+		if (!S_ISREG(Node->Node.Mode))
+			return -EINVAL;
+		if (Offset < 0)
+			return -EINVAL;
+
+		if (Offset >= Node->Size)
+			return 0;
+		Size = MIN(Size, (size_t)(Node->Size - Offset));
+
+		size_t done = 0;
+		while (done < Size)
+		{
+			off_t position = Offset + done;
+			size_t pageOffset = position % PAGE_SIZE;
+			size_t count = MIN(Size - done, PAGE_SIZE - pageOffset);
+
+			/* Holes read as zeros */
+			uint8_t *page = Node->Pages.Find(position / PAGE_SIZE);
+			if (page)
+				memcpy((uint8_t *)Buffer + done, page + pageOffset, count);
+			else
+				memset((uint8_t *)Buffer + done, 0, count);
+			done += count;
+		}
+		return done;
+	}
+
+	ssize_t TmpFS::Write(struct Inode *_Node, const void *Buffer, size_t Size, off_t Offset)
+	{
+		SmartWriteLock(Lock);
+		auto Node = (TmpInode *)_Node;
+		if (S_ISDIR(Node->Node.Mode))
+			return -EISDIR;
+		if (!S_ISREG(Node->Node.Mode))
+			return -EINVAL;
+		if (Offset < 0 || Offset + (off_t)Size < Offset)
+			return -EINVAL;
+
+		size_t done = 0;
+		ssize_t error = 0;
+		while (done < Size)
+		{
+			off_t position = Offset + done;
+			size_t pageOffset = position % PAGE_SIZE;
+			size_t count = MIN(Size - done, PAGE_SIZE - pageOffset);
+
+			uint8_t *page = Node->Pages.Find(position / PAGE_SIZE);
+			if (page == nullptr)
+			{
+				if (Limit && Used + PAGE_SIZE > Limit)
+				{
+					error = -ENOSPC;
+					break;
+				}
+
+				page = (uint8_t *)KernelAllocator.RequestPage();
+				if (page == nullptr)
+				{
+					error = -ENOMEM;
+					break;
+				}
+
+				if (count != PAGE_SIZE)
+					memset(page, 0, PAGE_SIZE);
+				Node->Pages.Insert(position / PAGE_SIZE, page);
+				Node->PageCount++;
+				Used += PAGE_SIZE;
+			}
+
+			memcpy(page + pageOffset, (const uint8_t *)Buffer + done, count);
+			done += count;
+		}
+
+		if (Offset + (off_t)done > Node->Size)
+			Node->Size = Offset + done;
+		return done ? (ssize_t)done : error;
+	}
+
+	int TmpFS::Truncate(struct Inode *_Node, off_t Size)
+	{
+		SmartWriteLock(Lock);
+		auto Node = (TmpInode *)_Node;
+		if (S_ISDIR(Node->Node.Mode))
+			return -EISDIR;
+		if (!S_ISREG(Node->Node.Mode))
+			return -EINVAL;
+		if (Size < 0)
+			return -EINVAL;
+
+		/* Growing only moves the end, the new range is a hole */
+		if (Size < Node->Size)
+		{
+			FreePages(Node, TO_PAGES(Size));
+
+			/* What is left of the last page must read as zeros later */
+			size_t tail = Size % PAGE_SIZE;
+			uint8_t *page = tail ? Node->Pages.Find(Size / PAGE_SIZE) : nullptr;
+			if (page)
+				memset(page + tail, 0, PAGE_SIZE - tail);
+		}
+
+		Node->Size = Size;
+		return 0;
+	}
+
+	ssize_t TmpFS::ReadDir(struct Inode *_Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
+	{
+		SmartReadLock(Lock);
+		auto Node = (TmpInode *)_Node;
+		if (!S_ISDIR(Node->Node.Mode))
+			return -ENOTDIR;
+
+		size_t totalSize = 0;
+		off_t entries = 0;
+		for (; entries < Entries; Offset++, entries++)
+		{
+			const char *name;
+			TmpInode *child;
+			if (Offset == 0)
+			{
+				name = ".";
+				child = Node;
+			}
+			else if (Offset == 1)
+			{
+				name = "..";
+				child = Node->Parent;
+			}
+			else if ((size_t)(Offset - 2) < Node->Entries.size())
+			{
+				DirEntry *entry = Node->Entries[Offset - 2];
+				name = entry->Name.c_str();
+				child = entry->Node;
+			}
+			else
+				break;
+
+			uint16_t reclen = (uint16_t)(offsetof(struct kdirent, d_name) + strlen(name) + 1);
+			if (totalSize + reclen > Size)
+			{
+				if (totalSize == 0)
+					return -EINVAL;
+				break;
+			}
+
+			struct kdirent *ent = (struct kdirent *)((uintptr_t)Buffer + totalSize);
+			ent->d_ino = child->Node.Index;
+			ent->d_off = Offset;
+			ent->d_reclen = reclen;
+			ent->d_type = IFTODT(child->Node.Mode);
+			strcpy(ent->d_name, name);
+			totalSize += reclen;
+		}
+
+		return totalSize;
+	}
+
+	int TmpFS::MkDir(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result)
+	{
+		SmartWriteLock(Lock);
+		TmpInode *node;
+		int ret = NewChild(Parent, Name, (Mode & ~S_IFMT) | S_IFDIR, &node);
+		if (ret < 0)
+			return ret;
+
+		*Result = &node->Node;
+		return 0;
+	}
+
+	int TmpFS::RmDir(struct Inode *Parent, const char *Name)
+	{
+		SmartWriteLock(Lock);
+		return RemoveChild(Parent, Name, true);
+	}
+
+	int TmpFS::SymLink(struct Inode *Parent, const char *Name, const char *Target, struct Inode **Result)
+	{
+		SmartWriteLock(Lock);
+		TmpInode *node;
+		int ret = NewChild(Parent, Name, S_IFLNK | 0777, &node);
+		if (ret < 0)
+			return ret;
+
+		node->Target = Target;
+		node->Size = node->Target.size();
+		*Result = &node->Node;
+		return 0;
+	}
+
+	ssize_t TmpFS::ReadLink(struct Inode *_Node, char *Buffer, size_t Size)
+	{
+		SmartReadLock(Lock);
+		auto Node = (TmpInode *)_Node;
+		if (!S_ISLNK(Node->Node.Mode))
+			return -EINVAL;
+
+		size_t length = MIN(Size, Node->Target.size());
+		memcpy(Buffer, Node->Target.c_str(), length);
+		return length;
+	}
+
+	int TmpFS::Stat(struct Inode *_Node, struct kstat *Stat)
+	{
+		SmartReadLock(Lock);
+		auto Node = (TmpInode *)_Node;
+
+		/* Everything is in the inode, nothing to look up */
+		memset(Stat, 0, sizeof(struct kstat));
+		Stat->Device = DeviceID;
+		Stat->Index = Node->Node.Index;
+		Stat->Mode = Node->Node.Mode;
+		Stat->HardLinks = Node->Links;
+		Stat->UserID = Node->UserID;
+		Stat->GroupID = Node->GroupID;
+		Stat->RawDevice = Node->Node.RawDevice;
+		Stat->Size = S_ISDIR(Node->Node.Mode) ? (off_t)Node->Entries.size() : Node->Size;
+		Stat->BlockSize = PAGE_SIZE;
+		Stat->Blocks = Node->PageCount * (PAGE_SIZE / 512);
+		return 0;
+	}
+
+	int TmpFS::Link(struct Inode *_Parent, const char *Name, struct Inode *_Target)
+	{
+		SmartWriteLock(Lock);
+		auto Parent = (TmpInode *)_Parent;
+		auto Target = (TmpInode *)_Target;
+		if (!S_ISDIR(Parent->Node.Mode))
+			return -ENOTDIR;
+		if (S_ISDIR(Target->Node.Mode))
+			return -EPERM;
+		if (Target->Links == 0)
+			return -ENOENT;
+		if (Parent->Links == 0)
+			return -ENOENT;
+
+		size_t length = strlen(Name);
+		if (length == 0 || strchr(Name, '/'))
+			return -EINVAL;
+		if (length > MaxNameLength)
+			return -ENAMETOOLONG;
+		if (FindEntry(Parent, Name, length))
+			return -EEXIST;
+
+		AddEntry(Parent, Name, Target);
+		return 0;
+	}
+
+	TmpFS::TmpFS(size_t Limit)
+	{
+		this->Limit = Limit;
+		Root = NewInode(nullptr, S_IFDIR | 01777);
+		Root->Links = 2;
+	}
+
+	TmpFS::~TmpFS()
+	{
+		foreach (auto node in Inodes)
+		{
+			FreePages(node, 0);
+			foreach (auto entry in node->Entries)
+				delete entry;
+			delete[] node->Buckets;
+			delete node;
+		}
+	}
+}
+
+O2 int __tmpfs_Lookup(struct Inode *Parent, const char *Name, struct Inode **Result)
+{
+	return ((vfs::TmpFS *)Parent->PrivateData)->Lookup(Parent, Name, Result);
+}
+
+O2 int __tmpfs_Create(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result)
+{
+	return ((vfs::TmpFS *)Parent->PrivateData)->Create(Parent, Name, Mode, Result);
+}
+
+O2 int __tmpfs_Remove(struct Inode *Parent, const char *Name)
+{
+	return ((vfs::TmpFS *)Parent->PrivateData)->Remove(Parent, Name);
+}
+
+O2 int __tmpfs_Rename(struct Inode *Parent, const char *OldName, const char *NewName)
+{
+	return ((vfs::TmpFS *)Parent->PrivateData)->Rename(Parent, OldName, NewName);
+}
+
+O2 ssize_t __tmpfs_Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
+{
+	return ((vfs::TmpFS *)Node->PrivateData)->Read(Node, Buffer, Size, Offset);
+}
+
+O2 ssize_t __tmpfs_Write(struct Inode *Node, const void *Buffer, size_t Size, off_t Offset)
+{
+	return ((vfs::TmpFS *)Node->PrivateData)->Write(Node, Buffer, Size, Offset);
+}
+
+O2 int __tmpfs_Truncate(struct Inode *Node, off_t Size)
+{
+	return ((vfs::TmpFS *)Node->PrivateData)->Truncate(Node, Size);
+}
+
+O2 ssize_t __tmpfs_ReadDir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
+{
+	return ((vfs::TmpFS *)Node->PrivateData)->ReadDir(Node, Buffer, Size, Offset, Entries);
+}
+
+O2 int __tmpfs_MkDir(struct Inode *Parent, const char *Name, mode_t Mode, struct Inode **Result)
+{
+	return ((vfs::TmpFS *)Parent->PrivateData)->MkDir(Parent, Name, Mode, Result);
+}
+
+O2 int __tmpfs_RmDir(struct Inode *Parent, const char *Name)
+{
+	return ((vfs::TmpFS *)Parent->PrivateData)->RmDir(Parent, Name);
+}
+
+O2 int __tmpfs_SymLink(struct Inode *Parent, const char *Name, const char *Target, struct Inode **Result)
+{
+	return ((vfs::TmpFS *)Parent->PrivateData)->SymLink(Parent, Name, Target, Result);
+}
+
+O2 ssize_t __tmpfs_ReadLink(struct Inode *Node, char *Buffer, size_t Size)
+{
+	return ((vfs::TmpFS *)Node->PrivateData)->ReadLink(Node, Buffer, Size);
+}
+
+O2 int __tmpfs_Stat(struct Inode *Node, struct kstat *Stat)
+{
+	return ((vfs::TmpFS *)Node->PrivateData)->Stat(Node, Stat);
+}
+
+O2 int __tmpfs_Link(struct Inode *Parent, const char *Name, struct Inode *Target)
+{
+	return ((vfs::TmpFS *)Parent->PrivateData)->Link(Parent, Name, Target);
+}
+
+int __tmpfs_Destroy(FileSystemInfo *fsi)
+{
+	assert(fsi->PrivateData);
+	delete (vfs::TmpFS *)fsi->PrivateData;
+	delete fsi;
+	return 0;
+}
+
+FileNode *MountTmpFS(const char *Path, size_t Limit)
+{
+	if (Limit == 0)
+		Limit = KernelAllocator.GetTotalMemory() / 2;
+
+	vfs::TmpFS *tmpfs = new vfs::TmpFS(Limit);
+
+	FileSystemInfo *fsi = new FileSystemInfo;
+	fsi->Name = "tmpfs";
+	fsi->RootName = "tmpfs";
+	fsi->Flags = I_FLAG_ROOT | I_FLAG_MOUNTPOINT | I_FLAG_CACHE_KEEP;
+	fsi->SuperOps = {};
+	fsi->Ops = {};
+	fsi->SuperOps.Destroy = __tmpfs_Destroy;
+	fsi->Ops.Lookup = __tmpfs_Lookup;
+	fsi->Ops.Create = __tmpfs_Create;
+	fsi->Ops.Remove = __tmpfs_Remove;
+	fsi->Ops.Rename = __tmpfs_Rename;
+	fsi->Ops.Read = __tmpfs_Read;
+	fsi->Ops.Write = __tmpfs_Write;
+	fsi->Ops.Truncate = __tmpfs_Truncate;
+	fsi->Ops.ReadDir = __tmpfs_ReadDir;
+	fsi->Ops.MkDir = __tmpfs_MkDir;
+	fsi->Ops.RmDir = __tmpfs_RmDir;
+	fsi->Ops.SymLink = __tmpfs_SymLink;
+	fsi->Ops.ReadLink = __tmpfs_ReadLink;
+	fsi->Ops.Stat = __tmpfs_Stat;
+	fsi->Ops.Link = __tmpfs_Link;
+	fsi->PrivateData = tmpfs;
+
+	Inode *root = tmpfs->GetRoot();
+	tmpfs->DeviceID = root->Device = fs->RegisterFileSystem(fsi, root);
+	debug("tmpfs %d mounted on %s, %ld bytes", tmpfs->DeviceID, Path, Limit);
+	return fs->Mount(fs->GetRoot(0), root, Path);
+}
@@ -39,10 +39,9 @@ namespace vfs
 		cwk_path_get_basename(Name, &basename, &length);
 		if (basename == NULL)
 		{
-			if (strcmp(Name, "/") == 0)
+			if (strcmp(Name, "/") == 0 && Root)
 			{
-				auto &it = Files.at(0);
-				*Result = &it->Node;
+				*Result = &Root->Node;
 				return 0;
 			}
 
@@ -52,33 +51,92 @@ namespace vfs
 
 		if (_Parent)
 		{
-			for (const auto &child : Parent->Children)
-			{
-				if (child->Deleted || strcmp(child->Name.c_str(), basename) != 0)
-					continue;
+			Materialize(Parent);
+			USTARInode *child = FindChild(Parent, basename, length);
+			if (child == nullptr)
+				return -ENOENT;
 
-				*Result = &child->Node;
-				return 0;
-			}
+			*Result = &child->Node;
+			return 0;
+		}
 
+		/* Without a parent, the name is a path from the root */
+		USTARInode *node = Root;
+		if (node == nullptr)
 			return -ENOENT;
-		}
 
-		auto fileItr = Files.begin();
-		while (fileItr != Files.end())
+		const char *segment = Name;
+		while (*segment)
 		{
-			USTARInode *node = fileItr->second;
+			while (*segment == '/')
+				segment++;
+
+			size_t segLength = 0;
+			while (segment[segLength] && segment[segLength] != '/')
+				segLength++;
+			if (segLength == 0)
+				break;
+
+			Materialize(node);
+			node = FindChild(node, segment, segLength);
+			if (node == nullptr)
+				return -ENOENT;
+			segment += segLength;
+		}
+
+		*Result = &node->Node;
+		return 0;
+	}
+
+	void USTAR::IndexChild(USTARInode *Parent, USTARInode *Child)
+	{
+		Child->Hash = DentryCache::HashName(Child->Name.c_str(), Child->Name.size());
 
-			if (node->Deleted || strcmp(node->Name.c_str(), basename) != 0)
+		/* Keep the chains short, the load factor stays below 1 */
+		if (Parent->Indexed >= Parent->BucketCount)
+		{
+			size_t count = Parent->BucketCount ? Parent->BucketCount * 2 : 8;
+			USTARInode **buckets = new USTARInode *[count]();
+			for (size_t i = 0; i < Parent->BucketCount; i++)
 			{
-				fileItr++;
-				continue;
+				USTARInode *entry = Parent->Buckets[i];
+				while (entry)
+				{
+					USTARInode *next = entry->NextHash;
+					size_t slot = entry->Hash & (count - 1);
+					entry->NextHash = buckets[slot];
+					buckets[slot] = entry;
+					entry = next;
+				}
 			}
 
-			*Result = &fileItr->second->Node;
-			return 0;
+			delete[] Parent->Buckets;
+			Parent->Buckets = buckets;
+			Parent->BucketCount = count;
+		}
+
+		size_t slot = Child->Hash & (Parent->BucketCount - 1);
+		Child->NextHash = Parent->Buckets[slot];
+		Parent->Buckets[slot] = Child;
+		Parent->Indexed++;
+	}
+
+	USTAR::USTARInode *USTAR::FindChild(USTARInode *Parent, const char *Name, size_t Length)
+	{
+		if (Parent->BucketCount == 0)
+			return nullptr;
+
+		uint64_t hash = DentryCache::HashName(Name, Length);
+		USTARInode *entry = Parent->Buckets[hash & (Parent->BucketCount - 1)];
+		for (; entry; entry = entry->NextHash)
+		{
+			if (entry->Hash != hash || entry->Deleted ||
+				entry->Name.size() != Length ||
+				memcmp(entry->Name.c_str(), Name, Length) != 0)
+				continue;
+			return entry;
 		}
-		return -ENOENT;
+		return nullptr;
 	}
 
 	int USTAR::Create(struct Inode *_Parent, const char *Name, mode_t Mode, struct Inode **Result)
@@ -160,23 +218,27 @@ namespace vfs
 		node->Name.assign(basename, length);
 		node->Path.assign(Name, strlen(Name));
 
+		if (Parent)
+			Materialize(Parent);
+
+		SmartLock(IndexLock);
+		node->Node.Index = NextInode;
 		Files.insert(std::make_pair(NextInode, node));
-		*Result = &Files.at(NextInode)->Node;
+		*Result = &node->Node;
 		if (Parent)
-			Parent->Children.push_back(Files.at(NextInode));
+			Attach(Parent, node);
 		NextInode++;
 		return 0;
 	}
 
 	ssize_t USTAR::Read(struct Inode *Node, void *Buffer, size_t Size, off_t Offset)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
 
-		if (fileItr->second->Deleted)
+		if (node->Deleted)
 			return -ENOENT;
 
-		USTARInode *node = fileItr->second;
 		size_t fileSize = GetSize(node->Header->size);
 
 		if (Size <= 0)
@@ -201,7 +263,7 @@ namespace vfs
 		{
 			debug("Offset %d + Size %d is greater than file size %d",
 				  Offset, Size, fileSize);
-			Size = fileSize;
+			Size = fileSize - Offset;
 		}
 
 		memcpy(Buffer, (uint8_t *)((uintptr_t)node->Header + sizeof(FileHeader) + Offset), Size);
@@ -209,11 +271,52 @@ namespace vfs
 		return Size;
 	}
 
+	ssize_t USTAR::MapData(struct Inode *Node, off_t Offset, const void **Data)
+	{
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+
+		if (node->Deleted)
+			return -ENOENT;
+
+		/* The archive stays in memory, hand out the file data directly */
+		size_t fileSize = GetSize(node->Header->size);
+		if (Offset < 0 || (size_t)Offset >= fileSize)
+			return 0;
+
+		*Data = (uint8_t *)((uintptr_t)node->Header + sizeof(FileHeader) + Offset);
+		return fileSize - Offset;
+	}
+
+	ssize_t USTAR::ReadV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset)
+	{
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+
+		if (node->Deleted)
+			return -ENOENT;
+
+		size_t fileSize = GetSize(node->Header->size);
+		if (Offset < 0 || (size_t)Offset >= fileSize)
+			return 0;
+
+		uint8_t *Data = (uint8_t *)((uintptr_t)node->Header + sizeof(FileHeader));
+		size_t Position = Offset;
+		for (int i = 0; i < Count && Position < fileSize; i++)
+		{
+			size_t n = MIN(Vector[i].iov_len, fileSize - Position);
+			memcpy(Vector[i].iov_base, Data + Position, n);
+			Position += n;
+		}
+		return Position - Offset;
+	}
+
 	__no_sanitize("alignment")
 		ssize_t USTAR::ReadDir(struct Inode *_Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
 	{
 		/* FIXME: FIX ALIGNMENT FOR DIRENT! */
 		auto Node = (USTARInode *)_Node;
+		Materialize(Node);
 
 		off_t realOffset = Offset;
 
@@ -377,13 +480,12 @@ namespace vfs
 
 	ssize_t USTAR::ReadLink(struct Inode *Node, char *Buffer, size_t Size)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
 
-		if (fileItr->second->Deleted)
+		if (node->Deleted)
 			return -ENOENT;
 
-		USTARInode *node = fileItr->second;
 
 		if (strlen(node->Header->link) > Size)
 			Size = strlen(node->Header->link);
@@ -395,12 +497,12 @@ namespace vfs
 
 	int USTAR::Stat(struct Inode *Node, struct kstat *Stat)
 	{
-		auto fileItr = Files.find(Node->Index);
-		assert(fileItr != Files.end());
-		if (fileItr->second->Deleted)
+		USTARInode *node = (USTARInode *)Node;
+		assert(node->Checksum == INODE_CHECKSUM);
+
+		if (node->Deleted)
 			return -ENOENT;
 
-		USTARInode *node = fileItr->second;
 		size_t fileSize = GetSize(node->Header->size);
 
 		debug("Header: \"%.*s\"", sizeof(struct FileHeader), node->Header);
@@ -497,70 +599,236 @@ namespace vfs
 		return true;
 	}
 
-	void USTAR::ReadArchive(uintptr_t Address, size_t Size)
+	void USTAR::SetMode(struct Inode &uNode, FileHeader *header)
 	{
-		trace("Initializing USTAR with address %#lx and size %d", Address, Size);
+		mode_t hdrMode = StringToInt(header->mode);
+		if (hdrMode & TSUID)
+			uNode.Mode |= S_ISUID;
+		else if (hdrMode & TSGID)
+			uNode.Mode |= S_ISGID;
+		else if (hdrMode & TSVTX)
+			uNode.Mode |= S_ISVTX;
+		else if (hdrMode & TUREAD)
+			uNode.Mode |= S_IRUSR;
+		else if (hdrMode & TUWRITE)
+			uNode.Mode |= S_IWUSR;
+		else if (hdrMode & TUEXEC)
+			uNode.Mode |= S_IXUSR;
+		else if (hdrMode & TGREAD)
+			uNode.Mode |= S_IRGRP;
+		else if (hdrMode & TGWRITE)
+			uNode.Mode |= S_IWGRP;
+		else if (hdrMode & TGEXEC)
+			uNode.Mode |= S_IXGRP;
+		else if (hdrMode & TOREAD)
+			uNode.Mode |= S_IROTH;
+		else if (hdrMode & TOWRITE)
+			uNode.Mode |= S_IWOTH;
+		else if (hdrMode & TOEXEC)
+			uNode.Mode |= S_IXOTH;
 
-		auto SetMode = [&](Inode &uNode, FileHeader *header)
+		switch (header->typeflag[0])
 		{
-			mode_t hdrMode = StringToInt(header->mode);
-			if (hdrMode & TSUID)
-				uNode.Mode |= S_ISUID;
-			else if (hdrMode & TSGID)
-				uNode.Mode |= S_ISGID;
-			else if (hdrMode & TSVTX)
-				uNode.Mode |= S_ISVTX;
-			else if (hdrMode & TUREAD)
-				uNode.Mode |= S_IRUSR;
-			else if (hdrMode & TUWRITE)
-				uNode.Mode |= S_IWUSR;
-			else if (hdrMode & TUEXEC)
-				uNode.Mode |= S_IXUSR;
-			else if (hdrMode & TGREAD)
-				uNode.Mode |= S_IRGRP;
-			else if (hdrMode & TGWRITE)
-				uNode.Mode |= S_IWGRP;
-			else if (hdrMode & TGEXEC)
-				uNode.Mode |= S_IXGRP;
-			else if (hdrMode & TOREAD)
-				uNode.Mode |= S_IROTH;
-			else if (hdrMode & TOWRITE)
-				uNode.Mode |= S_IWOTH;
-			else if (hdrMode & TOEXEC)
-				uNode.Mode |= S_IXOTH;
-
-			switch (header->typeflag[0])
+		case AREGTYPE:
+		case REGTYPE:
+			uNode.Mode |= S_IFREG;
+			break;
+		case LNKTYPE:
+			uNode.Mode |= S_IFLNK;
+			break;
+		case SYMTYPE:
+			uNode.Mode |= S_IFLNK;
+			break;
+		case CHRTYPE:
+			uNode.Mode |= S_IFCHR;
+			break;
+		case BLKTYPE:
+			uNode.Mode |= S_IFBLK;
+			break;
+		case DIRTYPE:
+			uNode.Mode |= S_IFDIR;
+			break;
+		case FIFOTYPE:
+			uNode.Mode |= S_IFIFO;
+			break;
+		case CONTTYPE:
+			warn("Reserved type for %s", header->name);
+			__fallthrough;
+		default:
+			error("Unknown type: %d for %s", header->typeflag[0], header->name);
+			break;
+		}
+	}
+
+	static void NormalizeName(USTAR::FileHeader *header)
+	{
+		/* This removes the "." at the beginning of the file name
+			"./foo/bar" > "/foo/bar" */
+		if (header->name[0] == '.' && header->name[1] == '/')
+			memmove(header->name, header->name + 1, strlen(header->name));
+	}
+
+	USTAR::USTARInode *USTAR::NewNode(FileHeader *header)
+	{
+		NormalizeName(header);
+		if (isempty((char *)header->name))
+			fixme("Ignoring empty file name \"%.*s\"", sizeof(struct FileHeader), header);
+
+		struct Inode uNode{};
+		uNode.Device = this->DeviceID;
+		uNode.RawDevice = 0;
+		uNode.Index = NextInode;
+		SetMode(uNode, header);
+		uNode.Flags = I_FLAG_CACHE_KEEP;
+		uNode.Offset = 0;
+		uNode.PrivateData = this;
+
+		const char *basename;
+		size_t length;
+		cwk_path_get_basename(header->name, &basename, &length);
+
+		USTARInode *node = new USTARInode{.Node = uNode,
+										  .Header = header,
+										  .Parent = nullptr,
+										  .Name{},
+										  .Path{},
+										  .Children{},
+										  .Deleted = false,
+										  .Checksum = INODE_CHECKSUM};
+
+		if (basename)
+			node->Name.assign(basename, length);
+		else
+			node->Name.assign((const char *)header->name, strlen(header->name));
+		node->Path.assign((const char *)header->name, strlen(header->name));
+
+		Files.insert(std::make_pair(NextInode, node));
+		NextInode++;
+		return node;
+	}
+
+	void USTAR::Attach(USTARInode *Parent, USTARInode *Child)
+	{
+		Child->Parent = Parent;
+		Child->Node.Offset = 2 + Parent->Children.size(); /* 0 . | 1 .. */
+		Parent->Children.push_back(Child);
+		IndexChild(Parent, Child);
+	}
+
+	USTAR::USTARInode *USTAR::FindDirectory(const char *Path, size_t Length)
+	{
+		auto it = Directories.find(DentryCache::HashName(Path, Length));
+		if (it == Directories.end())
+			return nullptr;
+
+		/* Same hash, different path */
+		const std::string &dirPath = it->second->Path;
+		size_t dirLength = dirPath.size();
+		while (dirLength && dirPath[dirLength - 1] == '/')
+			dirLength--;
+		if (dirLength != Length || memcmp(dirPath.c_str(), Path, Length) != 0)
+			return nullptr;
+		return it->second;
+	}
+
+	void USTAR::Materialize(USTARInode *Directory)
+	{
+		if (!Directory->HasPending.load())
+			return;
+
+		SmartLock(IndexLock);
+		if (!Directory->HasPending.load())
+			return;
+
+		foreach (FileHeader *header in Directory->Pending)
+			Attach(Directory, NewNode(header));
+
+		debug("Created %zu entries of \"%s\"",
+			  Directory->Pending.size(), Directory->Path.c_str());
+		Deferred -= Directory->Pending.size();
+		Directory->Pending.clear();
+		Directory->HasPending.store(false);
+	}
+
+	void USTAR::IndexArchive(uintptr_t Address, size_t Size)
+	{
+		Memory::Virtual vmm;
+		uintptr_t End = Address + Size;
+		while (Address + sizeof(FileHeader) <= End)
+		{
+			FileHeader *header = (FileHeader *)Address;
+			if (!vmm.Check((void *)header))
 			{
-			case AREGTYPE:
-			case REGTYPE:
-				uNode.Mode |= S_IFREG;
-				break;
-			case LNKTYPE:
-				uNode.Mode |= S_IFLNK;
-				break;
-			case SYMTYPE:
-				uNode.Mode |= S_IFLNK;
-				break;
-			case CHRTYPE:
-				uNode.Mode |= S_IFCHR;
-				break;
-			case BLKTYPE:
-				uNode.Mode |= S_IFBLK;
-				break;
-			case DIRTYPE:
-				uNode.Mode |= S_IFDIR;
-				break;
-			case FIFOTYPE:
-				uNode.Mode |= S_IFIFO;
+				error("Address %#lx is not mapped!", header);
 				break;
-			case CONTTYPE:
-				warn("Reserved type for %s", header->name);
-				__fallthrough;
-			default:
-				error("Unknown type: %d for %s", header->typeflag[0], header->name);
+			}
+
+			if (strncmp(header->signature, TMAGIC, TMAGLEN) != 0)
 				break;
+
+			size_t size = GetSize(header->size);
+			Address += ((size / 512) + 1) * 512;
+			if (size % 512)
+				Address += 512;
+
+			NormalizeName(header);
+			size_t length = strlen(header->name);
+			bool directory = header->typeflag[0] == DIRTYPE ||
+							 (length && header->name[length - 1] == '/');
+			while (length && header->name[length - 1] == '/')
+				length--;
+
+			if (length == 0)
+			{
+				if (Root == nullptr)
+				{
+					Root = NewNode(header);
+					Directories[DentryCache::HashName("", 0)] = Root;
+				}
+				continue;
 			}
-		};
+
+			/* "/foo/bar" > "/foo" */
+			size_t parentLength = length;
+			while (parentLength && header->name[parentLength - 1] != '/')
+				parentLength--;
+			if (parentLength)
+				parentLength--;
+
+			USTARInode *parent = FindDirectory(header->name, parentLength);
+			if (parent == nullptr)
+			{
+				fixme("No directory entry for \"%s\"", header->name);
+				parent = Root;
+				if (parent == nullptr)
+					continue;
+			}
+
+			if (!directory)
+			{
+				parent->Pending.push_back(header);
+				parent->HasPending.store(true);
+				Deferred++;
+				continue;
+			}
+
+			USTARInode *node = NewNode(header);
+			Attach(parent, node);
+			Directories[DentryCache::HashName(header->name, length)] = node;
+		}
+
+		Directories.clear();
+	}
+
+	void USTAR::ReadArchive(uintptr_t Address, size_t Size, bool Lazy)
+	{
+		trace("Initializing USTAR with address %#lx and size %d", Address, Size);
+
+		if (Lazy)
+		{
+			IndexArchive(Address, Size);
+			return;
+		}
 
 		FileHeader *header = (FileHeader *)Address;
 
@@ -581,43 +849,7 @@ namespace vfs
 				break;
 			// debug("\"%s\"", header->name);
 
-			/* This removes the "." at the beginning of the file name
-				"./foo/bar" > "/foo/bar" */
-			if (header->name[0] == '.' && header->name[1] == '/')
-				memmove(header->name, header->name + 1, strlen(header->name));
-
-			if (isempty((char *)header->name))
-				fixme("Ignoring empty file name \"%.*s\"", sizeof(struct FileHeader), header);
-
-			struct Inode uNode;
-			uNode.Device = this->DeviceID;
-			uNode.RawDevice = 0;
-			uNode.Index = NextInode;
-			SetMode(uNode, header);
-			uNode.Flags = I_FLAG_CACHE_KEEP;
-			uNode.Offset = 0;
-			uNode.PrivateData = this;
-
-			const char *basename;
-			size_t length;
-			cwk_path_get_basename(header->name, &basename, &length);
-
-			USTARInode *node = new USTARInode{.Node = uNode,
-											  .Header = header,
-											  .Parent = nullptr,
-											  .Name{},
-											  .Path{},
-											  .Children{},
-											  .Deleted = false,
-											  .Checksum = INODE_CHECKSUM};
-
-			if (basename)
-				node->Name.assign(basename, length);
-			else
-				node->Name.assign((const char *)header->name, strlen(header->name));
-			node->Path.assign((const char *)header->name, strlen(header->name));
-
-			Files.insert(std::make_pair(NextInode, node));
+			USTARInode *node = NewNode(header);
 			tmpNodes.push_back(node);
 
 			size_t size = GetSize(header->size);
@@ -626,7 +858,6 @@ namespace vfs
 				Address += 512;
 
 			header = (FileHeader *)Address;
-			NextInode++;
 		}
 
 		/* TODO: This code can be significantly optimized but good luck understanding it */
@@ -748,6 +979,13 @@ namespace vfs
 			}
 		}
 
+		for (auto &file : tmpNodes)
+		{
+			if (file->Parent)
+				IndexChild(file->Parent, file);
+		}
+		Root = tmpNodes[0];
+
 		std::function<void(vfs::USTAR::USTARInode *, int, const std::string &)> ustarTree = [&](vfs::USTAR::USTARInode *node, int level, const std::string &prefix)
 		{
 			debug("%*s\"%s\"%ld", level * 4, prefix.c_str(), node->Name.c_str(), node->Node.Offset);
@@ -797,6 +1035,16 @@ O2 ssize_t __ustar_Read(struct Inode *Node, void *Buffer, size_t Size, off_t Off
 	return ((vfs::USTAR *)Node->PrivateData)->Read(Node, Buffer, Size, Offset);
 }
 
+O2 ssize_t __ustar_MapData(struct Inode *Node, off_t Offset, const void **Data)
+{
+	return ((vfs::USTAR *)Node->PrivateData)->MapData(Node, Offset, Data);
+}
+
+O2 ssize_t __ustar_ReadV(struct Inode *Node, const struct kiovec *Vector, int Count, off_t Offset)
+{
+	return ((vfs::USTAR *)Node->PrivateData)->ReadV(Node, Vector, Count, Offset);
+}
+
 O2 ssize_t __ustar_Readdir(struct Inode *Node, struct kdirent *Buffer, size_t Size, off_t Offset, off_t Entries)
 {
 	return ((vfs::USTAR *)Node->PrivateData)->ReadDir(Node, Buffer, Size, Offset, Entries);
@@ -841,7 +1089,12 @@ bool TestAndInitializeUSTAR(uintptr_t Address, size_t Size)
 	}
 
 	ustar->DeviceID = fs->EarlyReserveDevice();
-	ustar->ReadArchive(Address, Size);
+
+	uint64_t start = TimeManager->GetNanosecondsSinceClassCreation();
+	ustar->ReadArchive(Address, Size, Config.LazyInitrd);
+	uint64_t elapsed = TimeManager->GetNanosecondsSinceClassCreation() - start;
+	KPrint("initrd: %ld entries read in %ld us, %ld deferred",
+		   ustar->NextInode, elapsed / 1000, ustar->GetDeferred());
 
 	Inode *initrd = nullptr;
 	ustar->Lookup(nullptr, "/", &initrd);
@@ -860,6 +1113,8 @@ bool TestAndInitializeUSTAR(uintptr_t Address, size_t Size)
 	fsi->Ops.SymLink = __ustar_SymLink;
 	fsi->Ops.ReadLink = __ustar_ReadLink;
 	fsi->Ops.Stat = __ustar_Stat;
+	fsi->Ops.MapData = __ustar_MapData;
+	fsi->Ops.ReadV = __ustar_ReadV;
 	fsi->PrivateData = ustar;
 	fs->LateRegisterFileSystem(ustar->DeviceID, fsi, initrd);
 
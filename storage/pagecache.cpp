@@ -0,0 +1,669 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <filesystem.hpp>
+
+#include <memory.hpp>
+#include <radix.hpp>
+#include <mutex>
+
+#include "../kernel.h"
+
+/** First readahead window once a sequential read is seen, in pages */
+#define READAHEAD_MIN 4
+/** Largest readahead window, also the most pages filled at once */
+#define READAHEAD_MAX 32
+
+/** Pages are reclaimed when less than 1/RECLAIM_RATIO of memory is free */
+#define RECLAIM_RATIO 16
+#define RECLAIM_BATCH 64
+
+/** Milliseconds between two passes of the writeback thread */
+#define WRITEBACK_INTERVAL 5000
+
+namespace vfs
+{
+	struct PageCache::Page
+	{
+		uint64_t Index = 0;
+		void *Data = nullptr;
+		bool Dirty = false;
+		Mapping *Owner = nullptr;
+		Page *Newer = nullptr, *Older = nullptr;
+	};
+
+	struct PageCache::Mapping
+	{
+		/* Taken while the tree, the pages or Size are used */
+		std::mutex Lock;
+		std::atomic_int References = 0;
+		FileNode *File = nullptr;
+		RadixTree<Page> Tree;
+		/** Size of the file including data not written back yet */
+		off_t Size = 0;
+
+		/** Page a sequential read would continue at */
+		uint64_t NextIndex = 0;
+		/** Pages read ahead of the current one */
+		size_t Window = 0;
+	};
+
+	PageCache::Mapping *PageCache::GetMapping(FileNode *File, bool Create)
+	{
+		{
+			SmartLock(CacheLock);
+			auto it = Mappings.find(File->Node);
+			if (it != Mappings.end())
+			{
+				it->second->References++;
+				return it->second;
+			}
+		}
+
+		if (!Create || File->fsi->Ops.Stat == nullptr)
+			return nullptr;
+
+		struct kstat st{};
+		if (File->fsi->Ops.Stat(File->Node, &st) < 0)
+			return nullptr;
+
+		Mapping *m = new Mapping;
+		m->File = File;
+		m->Size = st.Size;
+		/* One for Mappings, one for the caller */
+		m->References = 2;
+
+		SmartLock(CacheLock);
+		auto it = Mappings.find(File->Node);
+		if (it != Mappings.end())
+		{
+			delete m;
+			it->second->References++;
+			return it->second;
+		}
+
+		Mappings[File->Node] = m;
+		return m;
+	}
+
+	void PageCache::PutMapping(Mapping *m)
+	{
+		if (--m->References > 0)
+			return;
+
+		delete m;
+	}
+
+	PageCache::Page *PageCache::NewPage(Mapping *m, uint64_t Index)
+	{
+		if (KernelAllocator.GetFreeMemory() < KernelAllocator.GetTotalMemory() / RECLAIM_RATIO)
+			Evict(RECLAIM_BATCH, m);
+
+		void *Data = KernelAllocator.RequestPage();
+		if (Data == nullptr)
+			return nullptr;
+
+		Page *p = new Page;
+		p->Index = Index;
+		p->Data = Data;
+		p->Owner = m;
+		m->Tree.Insert(Index, p);
+
+		SmartLock(CacheLock);
+		p->Older = Newest;
+		if (Newest)
+			Newest->Newer = p;
+		else
+			Oldest = p;
+		Newest = p;
+		Pages++;
+		return p;
+	}
+
+	void PageCache::Touch(Page *p)
+	{
+		SmartLock(CacheLock);
+		if (p == Newest)
+			return;
+
+		/* Unlink, it can't be the newest */
+		p->Newer->Older = p->Older;
+		if (p->Older)
+			p->Older->Newer = p->Newer;
+		else
+			Oldest = p->Newer;
+
+		p->Newer = nullptr;
+		p->Older = Newest;
+		Newest->Newer = p;
+		Newest = p;
+	}
+
+	void PageCache::Unlink(Page *p)
+	{
+		if (p->Newer)
+			p->Newer->Older = p->Older;
+		else
+			Newest = p->Older;
+
+		if (p->Older)
+			p->Older->Newer = p->Newer;
+		else
+			Oldest = p->Newer;
+
+		p->Newer = p->Older = nullptr;
+		Pages--;
+	}
+
+	void PageCache::Release(Mapping *m, Page *p)
+	{
+		assert(m->Tree.Find(p->Index) == p);
+		m->Tree.Erase(p->Index);
+
+		KernelAllocator.FreePage(p->Data);
+		delete p;
+	}
+
+	int PageCache::Fill(Mapping *m, uint64_t Index, size_t Count)
+	{
+		FileNode *File = m->File;
+		Page *New[READAHEAD_MAX];
+		struct kiovec Vector[READAHEAD_MAX];
+
+		Count = MIN(Count, (size_t)READAHEAD_MAX);
+		size_t Allocated = 0;
+		for (; Allocated < Count; Allocated++)
+		{
+			New[Allocated] = NewPage(m, Index + Allocated);
+			if (New[Allocated] == nullptr)
+				break;
+
+			Vector[Allocated].iov_base = New[Allocated]->Data;
+			Vector[Allocated].iov_len = PAGE_SIZE;
+		}
+
+		if (Allocated == 0)
+			return -ENOMEM;
+
+		/* One request for the whole run if the filesystem can do it */
+		off_t Offset = Index * PAGE_SIZE;
+		ssize_t ret = 0;
+		if (File->fsi->Ops.ReadV)
+			ret = File->fsi->Ops.ReadV(File->Node, Vector, (int)Allocated, Offset);
+		else if (File->fsi->Ops.Read)
+		{
+			for (size_t i = 0; i < Allocated; i++)
+			{
+				ssize_t n = File->fsi->Ops.Read(File->Node, New[i]->Data, PAGE_SIZE,
+												Offset + i * PAGE_SIZE);
+				if (n < 0)
+				{
+					ret = ret ? ret : n;
+					break;
+				}
+
+				ret += n;
+				if (n < PAGE_SIZE)
+					break;
+			}
+		}
+		else
+			ret = -ENOTSUP;
+
+		if (ret < 0)
+		{
+			for (size_t i = 0; i < Allocated; i++)
+			{
+				{
+					SmartLock(CacheLock);
+					Unlink(New[i]);
+				}
+				Release(m, New[i]);
+			}
+			return (int)ret;
+		}
+
+		/* Past the end of the file, or a hole */
+		for (size_t i = 0; i < Allocated; i++)
+		{
+			size_t Valid = (size_t)ret > i * PAGE_SIZE ? (size_t)ret - i * PAGE_SIZE : 0;
+			if (Valid < PAGE_SIZE)
+				memset((uint8_t *)New[i]->Data + Valid, 0, PAGE_SIZE - Valid);
+		}
+		return (int)Allocated;
+	}
+
+	int PageCache::WritePage(Mapping *m, Page *p)
+	{
+		FileNode *File = m->File;
+		off_t Offset = p->Index * PAGE_SIZE;
+
+		/* Truncated away */
+		if (Offset >= m->Size)
+		{
+			p->Dirty = false;
+			return 0;
+		}
+
+		if (File->fsi->Ops.Write == nullptr)
+			return -EROFS;
+
+		size_t Length = MIN((off_t)PAGE_SIZE, m->Size - Offset);
+		ssize_t ret = File->fsi->Ops.Write(File->Node, p->Data, Length, Offset);
+		if (ret < 0)
+			return (int)ret;
+
+		p->Dirty = false;
+		WrittenBack++;
+		return 0;
+	}
+
+	int PageCache::Flush(Mapping *m)
+	{
+		FileNode *File = m->File;
+		std::vector<Page *> List;
+		m->Tree.Collect(0, List);
+
+		int Result = 0;
+		for (size_t i = 0; i < List.size();)
+		{
+			if (!List[i]->Dirty)
+			{
+				i++;
+				continue;
+			}
+
+			if (File->fsi->Ops.WriteV == nullptr)
+			{
+				int ret = WritePage(m, List[i++]);
+				if (ret < 0 && Result == 0)
+					Result = ret;
+				continue;
+			}
+
+			/* Write a run of adjacent dirty pages at once */
+			struct kiovec Vector[READAHEAD_MAX];
+			off_t Offset = List[i]->Index * PAGE_SIZE;
+			size_t Count = 0;
+			off_t Length = 0;
+			while (i + Count < List.size() && Count < READAHEAD_MAX &&
+				   List[i + Count]->Dirty &&
+				   List[i + Count]->Index == List[i]->Index + Count &&
+				   Offset + Length < m->Size)
+			{
+				Vector[Count].iov_base = List[i + Count]->Data;
+				Vector[Count].iov_len = MIN((off_t)PAGE_SIZE, m->Size - Offset - Length);
+				Length += Vector[Count].iov_len;
+				Count++;
+			}
+
+			ssize_t ret = Count ? File->fsi->Ops.WriteV(File->Node, Vector, (int)Count, Offset) : 0;
+			if (ret < 0)
+			{
+				if (Result == 0)
+					Result = (int)ret;
+				i += MAX(Count, (size_t)1);
+				continue;
+			}
+
+			/* Pages past the end are clean by now */
+			if (Count == 0)
+				Count = 1;
+			for (size_t j = 0; j < Count; j++)
+				List[i + j]->Dirty = false;
+			WrittenBack += Count;
+			i += Count;
+		}
+		return Result;
+	}
+
+	size_t PageCache::Evict(size_t Count, Mapping *Skip)
+	{
+		size_t Freed = 0;
+		size_t Scanned = 0;
+		while (Freed < Count)
+		{
+			Page *Victim = nullptr;
+			{
+				SmartLock(CacheLock);
+				for (Page *p = Oldest; p && Scanned < Pages; p = p->Newer, Scanned++)
+				{
+					/* The caller holds Skip and may be using its
+					   pages. Never wait on a mapping from here. */
+					if (p->Owner == Skip || !p->Owner->Lock.try_lock())
+						continue;
+
+					Victim = p;
+					break;
+				}
+
+				if (Victim == nullptr)
+					break;
+
+				Unlink(Victim);
+				Victim->Owner->References++;
+			}
+
+			Mapping *m = Victim->Owner;
+			if (Victim->Dirty && WritePage(m, Victim) < 0)
+			{
+				/* Keep it, the data would be lost */
+				SmartLock(CacheLock);
+				Victim->Older = Newest;
+				if (Newest)
+					Newest->Newer = Victim;
+				else
+					Oldest = Victim;
+				Newest = Victim;
+				Pages++;
+			}
+			else
+			{
+				Release(m, Victim);
+				Reclaimed++;
+				Freed++;
+			}
+
+			m->Lock.unlock();
+			PutMapping(m);
+		}
+
+		debug("Reclaimed %zu pages, %zu left", Freed, Pages);
+		return Freed;
+	}
+
+	ssize_t PageCache::Read(FileNode *File, void *Buffer, size_t Size, off_t Offset)
+	{
+		if (Offset < 0)
+			return -EINVAL;
+
+		Mapping *m = GetMapping(File, true);
+		if (m == nullptr)
+		{
+			if (File->fsi->Ops.Read == nullptr)
+				return -ENOTSUP;
+			return File->fsi->Ops.Read(File->Node, Buffer, Size, Offset);
+		}
+
+		m->Lock.lock();
+		if (Size == 0 || Offset >= m->Size)
+		{
+			m->Lock.unlock();
+			PutMapping(m);
+			return 0;
+		}
+
+		Size = MIN(Size, (size_t)(m->Size - Offset));
+		uint64_t First = Offset / PAGE_SIZE;
+		uint64_t Last = (Offset + Size - 1) / PAGE_SIZE;
+		uint64_t End = (m->Size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+		/* Sequential reads grow the window, anything else resets it */
+		if (First == m->NextIndex)
+			m->Window = m->Window ? MIN(m->Window * 2, (size_t)READAHEAD_MAX) : READAHEAD_MIN;
+		else if (First + 1 != m->NextIndex)
+			m->Window = 0;
+		m->NextIndex = Last + 1;
+		uint64_t Limit = MIN(End, Last + 1 + m->Window);
+
+		size_t Copied = 0;
+		ssize_t ret = 0;
+		for (uint64_t i = First; i <= Last; i++)
+		{
+			Page *p = m->Tree.Find(i);
+			if (p == nullptr)
+			{
+				Misses++;
+				size_t Run = 1;
+				while (i + Run < Limit && Run < READAHEAD_MAX && m->Tree.Find(i + Run) == nullptr)
+					Run++;
+				if (i + Run > Last + 1)
+					ReadAhead += i + Run - (Last + 1);
+
+				ret = Fill(m, i, Run);
+				if (ret < 0)
+					break;
+				p = m->Tree.Find(i);
+			}
+			else
+				Hits++;
+
+			Touch(p);
+			size_t PageOffset = i == First ? Offset % PAGE_SIZE : 0;
+			size_t n = MIN(PAGE_SIZE - PageOffset, Size - Copied);
+			memcpy((uint8_t *)Buffer + Copied, (uint8_t *)p->Data + PageOffset, n);
+			Copied += n;
+		}
+
+		m->Lock.unlock();
+		PutMapping(m);
+		return Copied ? (ssize_t)Copied : ret;
+	}
+
+	ssize_t PageCache::Write(FileNode *File, const void *Buffer, size_t Size, off_t Offset)
+	{
+		if (Offset < 0)
+			return -EINVAL;
+
+		Mapping *m = GetMapping(File, true);
+		if (m == nullptr)
+		{
+			if (File->fsi->Ops.Write == nullptr)
+				return -EROFS;
+			return File->fsi->Ops.Write(File->Node, Buffer, Size, Offset);
+		}
+
+		m->Lock.lock();
+		if (Size == 0)
+		{
+			m->Lock.unlock();
+			PutMapping(m);
+			return 0;
+		}
+
+		uint64_t First = Offset / PAGE_SIZE;
+		uint64_t Last = (Offset + Size - 1) / PAGE_SIZE;
+
+		/* Pages from WholeFirst up to WholeEnd are overwritten completely */
+		uint64_t WholeFirst = ((uint64_t)Offset + PAGE_SIZE - 1) / PAGE_SIZE;
+		uint64_t WholeEnd = ((uint64_t)Offset + Size) / PAGE_SIZE;
+
+		size_t Copied = 0;
+		ssize_t ret = 0;
+		for (uint64_t i = First; i <= Last; i++)
+		{
+			Page *p = m->Tree.Find(i);
+			if (p == nullptr)
+			{
+				off_t Start = i * PAGE_SIZE;
+				bool Whole = i >= WholeFirst && i < WholeEnd;
+
+				/* Nothing to read if the page is overwritten
+				   completely or lies past the end */
+				if (Whole || Start >= m->Size)
+				{
+					p = NewPage(m, i);
+					if (p == nullptr)
+					{
+						ret = -ENOMEM;
+						break;
+					}
+					if (!Whole)
+						memset(p->Data, 0, PAGE_SIZE);
+				}
+				else
+				{
+					ret = Fill(m, i, 1);
+					if (ret < 0)
+						break;
+					p = m->Tree.Find(i);
+				}
+			}
+
+			Touch(p);
+			size_t PageOffset = i == First ? Offset % PAGE_SIZE : 0;
+			size_t n = MIN(PAGE_SIZE - PageOffset, Size - Copied);
+			memcpy((uint8_t *)p->Data + PageOffset, (const uint8_t *)Buffer + Copied, n);
+			p->Dirty = true;
+			Copied += n;
+		}
+
+		if (Offset + (off_t)Copied > m->Size)
+			m->Size = Offset + Copied;
+
+		m->Lock.unlock();
+		PutMapping(m);
+		return Copied ? (ssize_t)Copied : ret;
+	}
+
+	int PageCache::Truncate(FileNode *File, off_t Size)
+	{
+		if (File->fsi->Ops.Truncate == nullptr)
+			return -EROFS;
+
+		Mapping *m = GetMapping(File, false);
+		if (m == nullptr)
+			return File->fsi->Ops.Truncate(File->Node, Size);
+
+		m->Lock.lock();
+		int ret = File->fsi->Ops.Truncate(File->Node, Size);
+		if (ret < 0)
+		{
+			m->Lock.unlock();
+			PutMapping(m);
+			return ret;
+		}
+
+		std::vector<Page *> List;
+		m->Tree.Collect(Size / PAGE_SIZE, List);
+		foreach (Page *p in List)
+		{
+			off_t Start = p->Index * PAGE_SIZE;
+			if (Start < Size)
+			{
+				memset((uint8_t *)p->Data + (Size - Start), 0, PAGE_SIZE - (Size - Start));
+				continue;
+			}
+
+			{
+				SmartLock(CacheLock);
+				Unlink(p);
+			}
+			Release(m, p);
+		}
+
+		m->Size = Size;
+		m->Lock.unlock();
+		PutMapping(m);
+		return 0;
+	}
+
+	int PageCache::Stat(FileNode *File, struct kstat *Stat)
+	{
+		if (File->fsi->Ops.Stat == nullptr)
+			return -ENOTSUP;
+
+		int ret = File->fsi->Ops.Stat(File->Node, Stat);
+		if (ret < 0)
+			return ret;
+
+		Mapping *m = GetMapping(File, false);
+		if (m == nullptr)
+			return ret;
+
+		Stat->Size = m->Size;
+		PutMapping(m);
+		return ret;
+	}
+
+	int PageCache::Sync(FileSystemInfo *fsi, Inode *Node)
+	{
+		std::vector<Mapping *> List;
+		{
+			SmartLock(CacheLock);
+			foreach (auto &it in Mappings)
+			{
+				if (Node && it.first != Node)
+					continue;
+				if (fsi && it.second->File->fsi != fsi)
+					continue;
+
+				it.second->References++;
+				List.push_back(it.second);
+			}
+		}
+
+		int Result = 0;
+		foreach (Mapping *m in List)
+		{
+			m->Lock.lock();
+			int ret = Flush(m);
+			m->Lock.unlock();
+			PutMapping(m);
+
+			if (ret < 0 && Result == 0)
+				Result = ret;
+		}
+		return Result;
+	}
+
+	void PageCache::Invalidate(Inode *Node)
+	{
+		Mapping *m;
+		{
+			SmartLock(CacheLock);
+			auto it = Mappings.find(Node);
+			if (it == Mappings.end())
+				return;
+
+			/* The reference of Mappings moves to us */
+			m = it->second;
+			Mappings.erase(it);
+		}
+
+		m->Lock.lock();
+		std::vector<Page *> List;
+		m->Tree.Collect(0, List);
+		foreach (Page *p in List)
+		{
+			{
+				SmartLock(CacheLock);
+				Unlink(p);
+			}
+			Release(m, p);
+		}
+		m->Size = 0;
+		m->Lock.unlock();
+		PutMapping(m);
+	}
+
+	void PageCache::WritebackThread()
+	{
+		thisThread->SetPriority(Tasking::Low);
+		while (true)
+		{
+			TaskManager->Sleep(WRITEBACK_INTERVAL);
+
+			int ret = fs->Cache.Sync(nullptr, nullptr);
+			if (ret < 0)
+				warn("Writeback failed with %d", ret);
+
+			if (KernelAllocator.GetFreeMemory() < KernelAllocator.GetTotalMemory() / RECLAIM_RATIO)
+				fs->Cache.Reclaim(RECLAIM_BATCH);
+		}
+	}
+}
@@ -0,0 +1,675 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <pipe.hpp>
+
+#include <memory.hpp>
+#include <algorithm>
+#include <signal.hpp>
+#include <poll.hpp>
+#include <task.hpp>
+
+#include "../kernel.h"
+
+namespace vfs
+{
+	/* KernelData of the read end, the write end has 0 */
+	#define PIPE_READ_END 1
+
+	static ssize_t __pipe_Read(struct Inode *Node, void *Buffer, size_t Size, off_t)
+	{
+		if (Node->KernelData != PIPE_READ_END)
+			return -EBADF;
+
+		Pipe *p = (Pipe *)Node->PrivateData;
+		p->Get();
+		ssize_t ret = p->Read(Buffer, Size, false);
+		p->Put();
+		return ret;
+	}
+
+	static ssize_t __pipe_Write(struct Inode *Node, const void *Buffer, size_t Size, off_t)
+	{
+		if (Node->KernelData == PIPE_READ_END)
+			return -EBADF;
+
+		Pipe *p = (Pipe *)Node->PrivateData;
+		p->Get();
+		ssize_t ret = p->Write(Buffer, Size, false);
+		p->Put();
+		return ret;
+	}
+
+	static int __pipe_Stat(struct Inode *Node, struct kstat *Stat)
+	{
+		memset(Stat, 0, sizeof(struct kstat));
+		Stat->Device = Node->Device;
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		Stat->BlockSize = PAGE_SIZE;
+		return 0;
+	}
+
+	static short __pipe_Poll(struct Inode *Node, short Events)
+	{
+		Pipe *p = (Pipe *)Node->PrivateData;
+		return p->Poll(Node->KernelData == PIPE_READ_END, Events);
+	}
+
+	static FileSystemInfo *PipeFS = nullptr;
+	static NewLock(PipeFSLock);
+
+	static FileSystemInfo *GetPipeFS()
+	{
+		SmartLock(PipeFSLock);
+		if (PipeFS)
+			return PipeFS;
+
+		FileSystemInfo *fsi = new FileSystemInfo;
+		fsi->Name = "pipefs";
+		fsi->RootName = "pipe";
+		fsi->Flags = 0;
+		fsi->SuperOps = {};
+		fsi->Ops.Read = __pipe_Read;
+		fsi->Ops.Write = __pipe_Write;
+		fsi->Ops.Stat = __pipe_Stat;
+		fsi->Ops.Poll = __pipe_Poll;
+		PipeFS = fsi;
+		return fsi;
+	}
+
+	Pipe::Page *Pipe::NewPage()
+	{
+		Page *p = new Page;
+		p->Address = KernelAllocator.RequestPage();
+		p->References = 1;
+		return p;
+	}
+
+	void Pipe::PutPage(Page *p)
+	{
+		if (--p->References != 0)
+			return;
+
+		KernelAllocator.FreePage(p->Address);
+		delete p;
+	}
+
+	void Pipe::Push(const Buffer &b)
+	{
+		assert(Used < Slots);
+		Ring[(Head + Used) % Slots] = b;
+		Used++;
+		Bytes += b.Length;
+	}
+
+	void Pipe::Consume(size_t Size)
+	{
+		Buffer &b = At(0);
+		assert(Size <= b.Length);
+		b.Offset += Size;
+		b.Length -= Size;
+		Bytes -= Size;
+
+		if (b.Length != 0)
+			return;
+
+		PutPage(b.Data);
+		b.Data = nullptr;
+		Head = (Head + 1) % Slots;
+		Used--;
+	}
+
+	size_t Pipe::SpaceLeft()
+	{
+		size_t Free = (Slots - Used) * PAGE_SIZE;
+
+		/* Small writes are appended to the last page if
+		   nobody else has a reference to it */
+		Buffer *l = this->Last();
+		if (!PacketMode && l && !l->Packet && l->Data->References == 1)
+			Free += PAGE_SIZE - (l->Offset + l->Length);
+		return Free;
+	}
+
+	void Pipe::Wrote()
+	{
+		ReadWait.WakeAll();
+		PollNotify(&ReadNode, POLLIN | POLLRDNORM);
+	}
+
+	void Pipe::Drained()
+	{
+		WriteWait.WakeAll();
+		PollNotify(&WriteNode, POLLOUT | POLLWRNORM);
+	}
+
+	void Pipe::Broken()
+	{
+		Tasking::TCB *tcb = thisThread;
+		if (tcb)
+			tcb->SendSignal(SIGPIPE);
+	}
+
+	int Pipe::WaitReadable()
+	{
+		Tasking::PCB *pcb = thisProcess;
+		ReadWait.Wait([this, pcb]
+					  { return Used.load() > 0 ||
+							   Writers.load() == 0 ||
+							   (pcb && pcb->Signals.HasPendingSignal()); });
+
+		/* The caller retries under PipeLock, only a
+			signal is a reason to give up */
+		if (pcb && pcb->Signals.HasPendingSignal())
+			return -EINTR;
+		return 0;
+	}
+
+	int Pipe::WaitWritable()
+	{
+		Tasking::PCB *pcb = thisProcess;
+		WriteWait.Wait([this, pcb]
+					   { return Used.load() < Slots.load() ||
+								Readers.load() == 0 ||
+								(pcb && pcb->Signals.HasPendingSignal()); });
+
+		/* The caller retries under PipeLock, only a
+			signal is a reason to give up */
+		if (pcb && pcb->Signals.HasPendingSignal())
+			return -EINTR;
+		return 0;
+	}
+
+	void Pipe::LockBoth(Pipe *a, Pipe *b)
+	{
+		/* Always lock in the same order */
+		if (b < a)
+			std::swap(a, b);
+		a->PipeLock.lock();
+		b->PipeLock.lock();
+	}
+
+	void Pipe::UnlockBoth(Pipe *a, Pipe *b)
+	{
+		a->PipeLock.unlock();
+		b->PipeLock.unlock();
+	}
+
+	ssize_t Pipe::Read(void *Buffer, size_t Size, bool NonBlocking)
+	{
+		if (Size == 0)
+			return 0;
+
+		uint8_t *Out = (uint8_t *)Buffer;
+		while (true)
+		{
+			size_t Done = 0;
+			{
+				std::lock_guard<std::mutex> guard(PipeLock);
+				while (Done < Size && Used > 0)
+				{
+					Pipe::Buffer &b = At(0);
+					size_t n = std::min(Size - Done, size_t(b.Length));
+					memcpy(Out + Done, (uint8_t *)b.Data->Address + b.Offset, n);
+					Done += n;
+
+					/* The rest of a packet that doesn't fit is lost */
+					if (b.Packet)
+					{
+						this->Consume(b.Length);
+						break;
+					}
+					this->Consume(n);
+				}
+
+				if (Done == 0)
+				{
+					if (Writers == 0)
+						return 0;
+					if (NonBlocking)
+						return -EAGAIN;
+				}
+			}
+
+			if (Done)
+			{
+				this->Drained();
+				return Done;
+			}
+
+			int ret = this->WaitReadable();
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	ssize_t Pipe::Write(const void *Buffer, size_t Size, bool NonBlocking)
+	{
+		if (Size == 0)
+			return 0;
+
+		const uint8_t *In = (const uint8_t *)Buffer;
+		size_t Done = 0;
+		while (true)
+		{
+			bool Progress = false;
+			{
+				std::lock_guard<std::mutex> guard(PipeLock);
+				if (Readers == 0)
+				{
+					this->Broken();
+					return Done ? Done : -EPIPE;
+				}
+
+				/* Writes up to PIPE_BUF are all or nothing */
+				size_t Left = Size - Done;
+				bool Atomic = Left <= PIPE_BUF;
+				if (!Atomic || this->SpaceLeft() >= Left)
+				{
+					while (Done < Size)
+					{
+						size_t n;
+						Pipe::Buffer *l = this->Last();
+						if (!PacketMode && l && !l->Packet &&
+							l->Data->References == 1 &&
+							l->Offset + l->Length < PAGE_SIZE)
+						{
+							n = std::min(Size - Done, size_t(PAGE_SIZE - (l->Offset + l->Length)));
+							memcpy((uint8_t *)l->Data->Address + l->Offset + l->Length,
+								   In + Done, n);
+							l->Length += n;
+							Bytes += n;
+						}
+						else
+						{
+							if (Used == Slots)
+								break;
+
+							/* In packet mode every PIPE_BUF sized piece is a packet */
+							n = std::min(Size - Done, size_t(PAGE_SIZE));
+							Page *p = NewPage();
+							memcpy(p->Address, In + Done, n);
+							this->Push({p, 0, uint32_t(n), PacketMode});
+						}
+
+						Done += n;
+						Progress = true;
+					}
+				}
+			}
+
+			if (Progress)
+				this->Wrote();
+
+			if (Done == Size)
+				return Done;
+
+			if (NonBlocking)
+				return Done ? Done : -EAGAIN;
+
+			int ret = this->WaitWritable();
+			if (ret < 0)
+				return Done ? Done : ret;
+		}
+	}
+
+	short Pipe::Poll(bool ReadEnd, short Events)
+	{
+		short Ready = 0;
+		if (ReadEnd)
+		{
+			if (Used.load() > 0)
+				Ready |= POLLIN | POLLRDNORM;
+			if (Writers.load() == 0)
+				Ready |= POLLHUP;
+		}
+		else
+		{
+			if (Used.load() < Slots.load())
+				Ready |= POLLOUT | POLLWRNORM;
+			if (Readers.load() == 0)
+				Ready |= POLLERR;
+		}
+		return Ready & (Events | POLLERR | POLLHUP);
+	}
+
+	ssize_t Pipe::Splice(Pipe *Out, size_t Size, bool NonBlocking)
+	{
+		if (Out == this)
+			return -EINVAL;
+
+		while (true)
+		{
+			size_t Moved = 0;
+			bool Empty = false;
+
+			LockBoth(this, Out);
+			if (Out->Readers == 0)
+			{
+				UnlockBoth(this, Out);
+				this->Broken();
+				return -EPIPE;
+			}
+
+			Empty = Used.load() == 0;
+			while (Moved < Size && Used > 0 && Out->Used.load() < Out->Slots.load())
+			{
+				Pipe::Buffer &b = At(0);
+				size_t n = std::min(Size - Moved, size_t(b.Length));
+				Pipe::Buffer nb = b;
+				nb.Length = uint32_t(n);
+
+				if (n == b.Length)
+				{
+					/* Hand over our reference to the page */
+					b.Data = nullptr;
+					Head = (Head + 1) % Slots;
+					Used--;
+					Bytes -= n;
+				}
+				else
+				{
+					nb.Data->References++;
+					this->Consume(n);
+				}
+
+				Out->Push(nb);
+				Moved += n;
+			}
+			UnlockBoth(this, Out);
+
+			if (Moved)
+			{
+				this->Drained();
+				Out->Wrote();
+				return Moved;
+			}
+
+			if (Empty && Writers.load() == 0)
+				return 0;
+
+			if (NonBlocking)
+				return -EAGAIN;
+
+			int ret = Empty ? this->WaitReadable() : Out->WaitWritable();
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	ssize_t Pipe::Tee(Pipe *Out, size_t Size, bool NonBlocking)
+	{
+		if (Out == this)
+			return -EINVAL;
+
+		while (true)
+		{
+			size_t Copied = 0;
+			bool Empty = false;
+
+			LockBoth(this, Out);
+			if (Out->Readers == 0)
+			{
+				UnlockBoth(this, Out);
+				this->Broken();
+				return -EPIPE;
+			}
+
+			Empty = Used.load() == 0;
+			for (size_t i = 0; i < Used && Copied < Size && Out->Used.load() < Out->Slots.load(); i++)
+			{
+				Pipe::Buffer nb = At(i);
+				nb.Length = uint32_t(std::min(Size - Copied, size_t(nb.Length)));
+				nb.Data->References++;
+				Out->Push(nb);
+				Copied += nb.Length;
+			}
+			UnlockBoth(this, Out);
+
+			if (Copied)
+			{
+				Out->Wrote();
+				return Copied;
+			}
+
+			if (Empty && Writers.load() == 0)
+				return 0;
+
+			if (NonBlocking)
+				return -EAGAIN;
+
+			int ret = Empty ? this->WaitReadable() : Out->WaitWritable();
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	ssize_t Pipe::SpliceTo(FileNode *Out, off_t &Offset, size_t Size, bool NonBlocking)
+	{
+		while (true)
+		{
+			size_t Done = 0;
+			ssize_t Error = 0;
+			{
+				std::lock_guard<std::mutex> guard(PipeLock);
+				while (Done < Size && Used > 0)
+				{
+					Pipe::Buffer &b = At(0);
+					size_t n = std::min(Size - Done, size_t(b.Length));
+					ssize_t w = Out->Write((uint8_t *)b.Data->Address + b.Offset, n, Offset);
+					if (w <= 0)
+					{
+						Error = w ? w : -EIO;
+						break;
+					}
+
+					Offset += w;
+					Done += w;
+					this->Consume(w);
+					if (size_t(w) < n)
+						break;
+				}
+
+				if (Done == 0 && Error == 0)
+				{
+					if (Writers == 0)
+						return 0;
+					if (NonBlocking)
+						return -EAGAIN;
+				}
+			}
+
+			if (Done)
+			{
+				this->Drained();
+				return Done;
+			}
+
+			if (Error)
+				return Error;
+
+			int ret = this->WaitReadable();
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	ssize_t Pipe::SpliceFrom(FileNode *In, off_t &Offset, size_t Size, bool NonBlocking)
+	{
+		while (true)
+		{
+			size_t Done = 0;
+			ssize_t Error = 0;
+			bool Full = false;
+			{
+				std::lock_guard<std::mutex> guard(PipeLock);
+				if (Readers == 0)
+				{
+					this->Broken();
+					return -EPIPE;
+				}
+
+				Full = Used == Slots;
+				while (Done < Size && Used < Slots)
+				{
+					size_t n = std::min(Size - Done, size_t(PAGE_SIZE));
+					Page *p = NewPage();
+					ssize_t r = In->Read(p->Address, n, Offset);
+					if (r <= 0)
+					{
+						PutPage(p);
+						Error = r;
+						break;
+					}
+
+					this->Push({p, 0, uint32_t(r), PacketMode});
+					Offset += r;
+					Done += r;
+
+					/* End of file or nothing more for now */
+					if (size_t(r) < n)
+						break;
+				}
+			}
+
+			if (Done)
+			{
+				this->Wrote();
+				return Done;
+			}
+
+			if (!Full)
+				return Error;
+
+			if (NonBlocking)
+				return -EAGAIN;
+
+			int ret = this->WaitWritable();
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	long Pipe::SetSize(size_t Size)
+	{
+		if (Size > PIPE_MAX_SIZE)
+			return -EPERM;
+
+		/* Round up to a power of two number of pages */
+		size_t NewSlots = 1;
+		while (NewSlots * PAGE_SIZE < Size)
+			NewSlots <<= 1;
+
+		{
+			std::lock_guard<std::mutex> guard(PipeLock);
+			if (Used > NewSlots)
+				return -EBUSY;
+
+			Buffer *NewRing = new Buffer[NewSlots];
+			for (size_t i = 0; i < Used; i++)
+				NewRing[i] = At(i);
+
+			delete[] Ring;
+			Ring = NewRing;
+			Head = 0;
+			Slots = NewSlots;
+		}
+
+		this->Drained();
+		return long(NewSlots * PAGE_SIZE);
+	}
+
+	void Pipe::Open(bool ReadEnd)
+	{
+		References++;
+		if (ReadEnd)
+			Readers++;
+		else
+			Writers++;
+	}
+
+	void Pipe::Close(bool ReadEnd)
+	{
+		if (ReadEnd)
+		{
+			if (--Readers == 0)
+			{
+				/* Writers get EPIPE from now on */
+				WriteWait.WakeAll();
+				PollNotify(&WriteNode, POLLERR);
+			}
+		}
+		else
+		{
+			if (--Writers == 0)
+			{
+				/* Readers get end of file */
+				ReadWait.WakeAll();
+				PollNotify(&ReadNode, POLLHUP);
+			}
+		}
+
+		this->Put();
+	}
+
+	void Pipe::Put()
+	{
+		if (--References == 0)
+			delete this;
+	}
+
+	Pipe *Pipe::FromFile(FileNode *File, bool *ReadEnd)
+	{
+		if (File == nullptr || PipeFS == nullptr ||
+			File->fsi != PipeFS)
+			return nullptr;
+
+		if (ReadEnd)
+			*ReadEnd = File->Node->KernelData == PIPE_READ_END;
+		return (Pipe *)File->Node->PrivateData;
+	}
+
+	Pipe::Pipe(bool Packet)
+	{
+		PacketMode = Packet;
+		Slots = PIPE_DEFAULT_SIZE / PAGE_SIZE;
+		Ring = new Buffer[Slots.load()];
+
+		ReadNode.Mode = S_IFIFO | S_IRUSR | S_IWUSR;
+		ReadNode.PrivateData = this;
+		ReadNode.KernelData = PIPE_READ_END;
+		WriteNode.Mode = S_IFIFO | S_IRUSR | S_IWUSR;
+		WriteNode.PrivateData = this;
+
+		ReadFile = fs->CreateAnonymous("pipe", &ReadNode, GetPipeFS());
+		WriteFile = fs->CreateAnonymous("pipe", &WriteNode, GetPipeFS());
+	}
+
+	Pipe::~Pipe()
+	{
+		/* Nobody can reach us anymore, no need to lock */
+		while (Used > 0)
+		{
+			PutPage(At(0).Data);
+			Head = (Head + 1) % Slots;
+			Used--;
+		}
+		delete[] Ring;
+	}
+}
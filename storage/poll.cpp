@@ -0,0 +1,259 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <poll.hpp>
+
+#include <filesystem.hpp>
+#include <waitqueue.hpp>
+#include <lock.hpp>
+#include <memory>
+
+#include "../kernel.h"
+
+/* 64 buckets */
+#define POLL_HASH_BITS 6
+
+namespace vfs
+{
+	struct PollBucket
+	{
+		LockClass Lock;
+		PollWatcher *Head = nullptr;
+	};
+
+	static PollBucket WatcherTable[1 << POLL_HASH_BITS];
+
+	static PollBucket *GetBucket(Inode *Node)
+	{
+		uint64_t h = uint64_t(uintptr_t(Node) >> 3) * 0x9E3779B97F4A7C15ULL;
+		return &WatcherTable[h >> (64 - POLL_HASH_BITS)];
+	}
+
+	void PollRegister(Inode *Node, PollWatcher *Watcher)
+	{
+		assert(Watcher->Node == nullptr);
+		assert(Watcher->Callback != nullptr);
+
+		PollBucket *b = GetBucket(Node);
+		SmartCriticalSection(b->Lock);
+		Watcher->Node = Node;
+		Watcher->Prev = nullptr;
+		Watcher->Next = b->Head;
+		if (b->Head)
+			b->Head->Prev = Watcher;
+		b->Head = Watcher;
+	}
+
+	void PollUnregister(PollWatcher *Watcher)
+	{
+		if (Watcher->Node == nullptr)
+			return;
+
+		PollBucket *b = GetBucket(Watcher->Node);
+		SmartCriticalSection(b->Lock);
+		if (Watcher->Prev)
+			Watcher->Prev->Next = Watcher->Next;
+		else
+			b->Head = Watcher->Next;
+
+		if (Watcher->Next)
+			Watcher->Next->Prev = Watcher->Prev;
+
+		Watcher->Node = nullptr;
+		Watcher->Next = Watcher->Prev = nullptr;
+	}
+
+	static void Notify(Inode *Node, short Events)
+	{
+		PollBucket *b = GetBucket(Node);
+		SmartCriticalSection(b->Lock);
+		for (PollWatcher *w = b->Head; w; w = w->Next)
+		{
+			if (w->Node != Node)
+				continue;
+
+			if (!(Events & (w->Events | POLLERR | POLLHUP)))
+				continue;
+
+			w->Callback(w, Events);
+		}
+	}
+
+	static NewLock(DeferredLock);
+	static PollDeferred *DeferredHead = nullptr;
+
+	void PollNotify(Inode *Node, short Events)
+	{
+		if (Node == nullptr)
+			return;
+
+		Notify(Node, Events);
+
+		/* Post what the callbacks queued, they may queue more */
+		while (true)
+		{
+			Inode *Next;
+			short NextEvents;
+			{
+				SmartCriticalSection(DeferredLock);
+				PollDeferred *d = DeferredHead;
+				if (d == nullptr)
+					return;
+
+				/* Copied out, the owner may free it once it is off the queue */
+				DeferredHead = d->Next;
+				d->Queued = false;
+				Next = d->Node;
+				NextEvents = d->Events;
+				d->Events = 0;
+			}
+
+			Notify(Next, NextEvents);
+		}
+	}
+
+	void PollNotifyLater(PollDeferred *Deferred, Inode *Node, short Events)
+	{
+		SmartCriticalSection(DeferredLock);
+		Deferred->Node = Node;
+		Deferred->Events |= Events;
+		if (Deferred->Queued)
+			return;
+
+		Deferred->Queued = true;
+		Deferred->Next = DeferredHead;
+		DeferredHead = Deferred;
+	}
+
+	void PollCancelDeferred(PollDeferred *Deferred)
+	{
+		SmartCriticalSection(DeferredLock);
+		if (!Deferred->Queued)
+			return;
+
+		PollDeferred **pp = &DeferredHead;
+		while (*pp != Deferred)
+			pp = &(*pp)->Next;
+		*pp = Deferred->Next;
+		Deferred->Queued = false;
+		Deferred->Events = 0;
+	}
+
+	struct PollTable
+	{
+		Tasking::WaitQueue Queue;
+		std::atomic_bool Triggered = false;
+	};
+
+	static void PollTableCallback(PollWatcher *Watcher, short)
+	{
+		PollTable *Table = (PollTable *)Watcher->Data;
+		Table->Triggered.store(true);
+		Table->Queue.WakeAll();
+	}
+
+	static int PollScan(PollRequest *Requests, size_t Count)
+	{
+		int Ready = 0;
+		for (size_t i = 0; i < Count; i++)
+		{
+			PollRequest &r = Requests[i];
+			if (r.Ignored)
+			{
+				r.ReturnedEvents = 0;
+				continue;
+			}
+
+			if (r.File == nullptr)
+				r.ReturnedEvents = POLLNVAL;
+			else
+			{
+				short Mask = r.Events | POLLERR | POLLHUP;
+				r.ReturnedEvents = r.File->Poll(Mask) & (Mask | POLLNVAL);
+			}
+
+			if (r.ReturnedEvents)
+				Ready++;
+		}
+		return Ready;
+	}
+
+	int PollFiles(PollRequest *Requests, size_t Count, int Timeout)
+	{
+		if (Timeout == 0)
+			return PollScan(Requests, Count);
+
+		Tasking::PCB *pcb = thisProcess;
+		uint64_t Until = 0;
+		if (Timeout > 0)
+			Until = TimeManager->GetNanosecondsSinceClassCreation() +
+					uint64_t(Timeout) * 1000000;
+
+		/* Register before the first scan so no event can slip
+		   between checking a file and going to sleep */
+		PollTable Table;
+		std::unique_ptr<PollWatcher[]> Watchers(new PollWatcher[Count]);
+		for (size_t i = 0; i < Count; i++)
+		{
+			if (Requests[i].File == nullptr)
+				continue;
+
+			Watchers[i].Callback = PollTableCallback;
+			Watchers[i].Data = &Table;
+			Watchers[i].Events = Requests[i].Events;
+			PollRegister(Requests[i].File->Node, &Watchers[i]);
+		}
+
+		int ret;
+		while (true)
+		{
+			Table.Triggered.store(false);
+			ret = PollScan(Requests, Count);
+			if (ret != 0)
+				break;
+
+			uint64_t Left = 0;
+			if (Timeout > 0)
+			{
+				uint64_t Now = TimeManager->GetNanosecondsSinceClassCreation();
+				if (Now >= Until)
+					break;
+				Left = (Until - Now + 999999) / 1000000;
+			}
+
+			if (pcb && pcb->Signals.HasPendingSignal())
+			{
+				ret = -EINTR;
+				break;
+			}
+
+			int err = Table.Queue.Wait([&Table, pcb]
+									   { return Table.Triggered.load() ||
+												(pcb && pcb->Signals.HasPendingSignal()); },
+									   Left);
+			if (err == -ETIMEDOUT)
+			{
+				ret = PollScan(Requests, Count);
+				break;
+			}
+		}
+
+		for (size_t i = 0; i < Count; i++)
+			PollUnregister(&Watchers[i]);
+		return ret;
+	}
+}
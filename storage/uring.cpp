@@ -0,0 +1,797 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <uring.hpp>
+
+#include <memory.hpp>
+#include <vdso.hpp>
+#include <lock.hpp>
+
+#include "../kernel.h"
+
+namespace vfs
+{
+	static short __uring_Poll(struct Inode *Node, short Events)
+	{
+		return ((IoRing *)Node->PrivateData)->Poll(Events);
+	}
+
+	static int __uring_Stat(struct Inode *Node, struct kstat *Stat)
+	{
+		memset(Stat, 0, sizeof(struct kstat));
+		Stat->Device = Node->Device;
+		Stat->Index = Node->Index;
+		Stat->Mode = Node->Mode;
+		Stat->HardLinks = 1;
+		return 0;
+	}
+
+	static FileSystemInfo *IoRingFS = nullptr;
+	static NewLock(IoRingFSLock);
+
+	static FileSystemInfo *GetIoRingFS()
+	{
+		SmartLock(IoRingFSLock);
+		if (IoRingFS)
+			return IoRingFS;
+
+		FileSystemInfo *fsi = new FileSystemInfo;
+		fsi->Name = "io_uring";
+		fsi->RootName = "io_uring";
+		fsi->Flags = 0;
+		fsi->SuperOps = {};
+		fsi->Ops.Stat = __uring_Stat;
+		fsi->Ops.Poll = __uring_Poll;
+		IoRingFS = fsi;
+		return fsi;
+	}
+
+	static uint32_t RoundUpPow2(uint32_t Value)
+	{
+		uint32_t ret = 1;
+		while (ret < Value)
+			ret <<= 1;
+		return ret;
+	}
+
+	void IoRing::Callback(PollWatcher *Watcher, short Events)
+	{
+		/* Only flag it, the request is retried from Enter() */
+		Request *req = (Request *)Watcher->Data;
+		req->Ready.store(true);
+		req->Owner->Triggered.store(true);
+		req->Owner->Waiters.WakeAll();
+	}
+
+	int IoRing::Prepare(Request *req)
+	{
+		io_uring_sqe &sqe = req->Sqe;
+		Memory::VirtualMemoryArea *vma = Process->vma;
+
+		/* Only checked and counted here, Translate() turns
+		   them into kernel segments right before they are used */
+		auto ImportBuffers = [req](struct kiovec *Buffers, uint32_t Count) -> int
+		{
+			size_t total = 0, pages = 0;
+			for (uint32_t i = 0; i < Count; i++)
+			{
+				/* Same limit as a single read() or write() */
+				size_t length = Buffers[i].iov_len;
+				if (length > 0x7FFFF000 - total)
+					return -EINVAL;
+				total += length;
+
+				if (length == 0)
+					continue;
+				uintptr_t base = (uintptr_t)Buffers[i].iov_base;
+				if (base + length < base)
+					return -EFAULT;
+				pages += (ALIGN_UP(base + length, PAGE_SIZE) - ALIGN_DOWN(base, PAGE_SIZE)) / PAGE_SIZE;
+			}
+
+			req->Buffers = Buffers;
+			req->BufferCount = Count;
+			req->Vector = pages > 1 ? new struct kiovec[pages] : &req->Segment;
+			req->MaxSegments = (int)pages;
+			return 0;
+		};
+
+		if (sqe.flags & (IOSQE_FIXED_FILE | IOSQE_IO_DRAIN | IOSQE_BUFFER_SELECT))
+			return -EINVAL;
+
+		switch (sqe.opcode)
+		{
+		case IORING_OP_READ:
+		case IORING_OP_WRITE:
+		{
+			req->Single = {(void *)sqe.addr, sqe.len};
+			return ImportBuffers(&req->Single, 1);
+		}
+		case IORING_OP_READV:
+		case IORING_OP_WRITEV:
+		{
+			if (sqe.len > 1024)
+				return -EINVAL;
+
+			/* Owned by the request from here, Free() releases it */
+			req->Buffers = new struct kiovec[sqe.len];
+			if (sqe.len && vma->CopyFromUser(req->Buffers, (const void *)sqe.addr,
+											 sizeof(struct kiovec) * sqe.len) < 0)
+				return -EFAULT;
+			return ImportBuffers(req->Buffers, sqe.len);
+		}
+		case IORING_OP_TIMEOUT:
+		{
+			struct
+			{
+				int64_t tv_sec;
+				int64_t tv_nsec;
+			} ts;
+
+			if (sqe.len != 1 || (sqe.timeout_flags & ~IORING_TIMEOUT_ABS))
+				return -EINVAL;
+			if (vma->CopyFromUser(&ts, (const decltype(ts) *)sqe.addr) < 0)
+				return -EFAULT;
+			if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000)
+				return -EINVAL;
+
+			uint64_t Now = TimeManager->GetNanosecondsSinceClassCreation();
+			uint64_t ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+			if (sqe.timeout_flags & IORING_TIMEOUT_ABS)
+			{
+				/* Absolute timeouts are on CLOCK_MONOTONIC */
+				uint64_t Mono = VDSO::Monotonic();
+				ns = ns > Mono ? ns - Mono : 0;
+			}
+			req->Deadline = Now + ns;
+			req->Target = sqe.off ? Completions + sqe.off : 0;
+			return 0;
+		}
+		case IORING_OP_OPENAT:
+		{
+			/* PATH_MAX */
+			const size_t Max = 4096;
+			req->Path = new char[Max];
+			ssize_t len = vma->StrncpyFromUser(req->Path, (const char *)sqe.addr, Max);
+			if (len < 0)
+				return -EFAULT;
+			if ((size_t)len == Max)
+				return -ENAMETOOLONG;
+			return 0;
+		}
+		default:
+			return 0;
+		}
+	}
+
+	int IoRing::Translate(Request *req)
+	{
+		/* Reading from the file writes to user memory */
+		bool ToUser = req->Sqe.opcode == IORING_OP_READ ||
+					  req->Sqe.opcode == IORING_OP_READV;
+		Memory::VirtualMemoryArea *vma = Process->vma;
+
+		req->Count = 0;
+		for (uint32_t i = 0; i < req->BufferCount; i++)
+		{
+			if (req->Buffers[i].iov_len == 0)
+				continue;
+
+			int n = vma->UserSegments(req->Buffers[i].iov_base, req->Buffers[i].iov_len, ToUser,
+									  req->Vector + req->Count, req->MaxSegments - req->Count);
+			if (n < 0)
+				return -EFAULT;
+			req->Count += n;
+		}
+		return 0;
+	}
+
+	void IoRing::Watch(Request *req, FileNode *Target, short Events)
+	{
+		if (req->Watching)
+			return;
+
+		req->Watcher.Callback = Callback;
+		req->Watcher.Data = req;
+		req->Watcher.Events = Events;
+		req->Watching = true;
+		PollRegister(Target->Node, &req->Watcher);
+	}
+
+	bool IoRing::Execute(Request *req, intptr_t *Result)
+	{
+		io_uring_sqe &sqe = req->Sqe;
+		FileDescriptorTable *fdt = Process->FileDescriptors;
+
+		if (req->Error)
+		{
+			*Result = req->Error;
+			return true;
+		}
+
+		switch (sqe.opcode)
+		{
+		case IORING_OP_NOP:
+		{
+			*Result = 0;
+			return true;
+		}
+		case IORING_OP_READ:
+		case IORING_OP_WRITE:
+		case IORING_OP_READV:
+		case IORING_OP_WRITEV:
+		{
+			auto it = fdt->GetDescriptor(sqe.fd);
+			if (it == nullptr)
+			{
+				*Result = -EBADF;
+				return true;
+			}
+
+			bool Write = sqe.opcode == IORING_OP_WRITE || sqe.opcode == IORING_OP_WRITEV;
+			short Events = Write ? POLLOUT : POLLIN;
+			FileNode *Target = it->Node;
+
+			/* Pipes say so themselves, anything else is asked first */
+			if (it->Type != FileDescriptorTable::Fildes::FD_PIPE &&
+				!(Target->Poll(Events) & (Events | POLLERR | POLLHUP)))
+			{
+				Watch(req, Target, Events);
+				return false;
+			}
+
+			/* Never keep segments across a wait, the pages behind
+			   them may belong to someone else by the time we wake */
+			int err = Translate(req);
+			if (err < 0)
+			{
+				*Result = err;
+				return true;
+			}
+
+			ssize_t n;
+			if ((int64_t)sqe.off == -1)
+			{
+				n = Write ? fdt->usr_writev(sqe.fd, req->Vector, req->Count, true)
+						  : fdt->usr_readv(sqe.fd, req->Vector, req->Count, true);
+			}
+			else
+			{
+				n = Write ? fdt->usr_pwritev(sqe.fd, req->Vector, req->Count, sqe.off, true)
+						  : fdt->usr_preadv(sqe.fd, req->Vector, req->Count, sqe.off, true);
+			}
+
+			if (n == -EAGAIN)
+			{
+				Watch(req, Target, Events);
+				return false;
+			}
+
+			*Result = n;
+			return true;
+		}
+		case IORING_OP_FSYNC:
+		{
+			/* Nothing is cached yet */
+			*Result = fdt->GetDescriptor(sqe.fd) == nullptr ? -EBADF : 0;
+			return true;
+		}
+		case IORING_OP_POLL_ADD:
+		{
+			auto it = fdt->GetDescriptor(sqe.fd);
+			if (it == nullptr)
+			{
+				*Result = -EBADF;
+				return true;
+			}
+
+			short Events = (short)sqe.poll32_events;
+			short Revents = it->Node->Poll(Events) & (Events | POLLERR | POLLHUP);
+			if (Revents == 0)
+			{
+				Watch(req, it->Node, Events);
+				return false;
+			}
+
+			*Result = Revents;
+			return true;
+		}
+		case IORING_OP_POLL_REMOVE:
+		{
+			*Result = Cancel(sqe.addr, IORING_OP_POLL_ADD);
+			return true;
+		}
+		case IORING_OP_TIMEOUT:
+		{
+			if (req->Target && Completions >= req->Target)
+			{
+				*Result = 0;
+				return true;
+			}
+
+			if (TimeManager->GetNanosecondsSinceClassCreation() >= req->Deadline)
+			{
+				*Result = -ETIME;
+				return true;
+			}
+			return false;
+		}
+		case IORING_OP_TIMEOUT_REMOVE:
+		{
+			*Result = Cancel(sqe.addr, IORING_OP_TIMEOUT);
+			return true;
+		}
+		case IORING_OP_ASYNC_CANCEL:
+		{
+			*Result = Cancel(sqe.addr, -1);
+			return true;
+		}
+		case IORING_OP_OPENAT:
+		{
+			const char *Path = req->Path;
+			if (!fs->PathIsRelative(Path))
+			{
+				*Result = fdt->usr_open(Path, sqe.open_flags, sqe.len);
+				return true;
+			}
+
+			if (sqe.fd != IORING_AT_FDCWD)
+			{
+				fixme("dirfd=%d is stub", sqe.fd);
+				*Result = -ENOSYS;
+				return true;
+			}
+
+			FileNode *Node = fs->GetByPath(Path, Process->CWD);
+			if (Node == nullptr)
+			{
+				*Result = -ENOENT;
+				return true;
+			}
+
+			*Result = fdt->usr_open(Node->Path.c_str(), sqe.open_flags, sqe.len);
+			return true;
+		}
+		case IORING_OP_CLOSE:
+		{
+			auto it = fdt->GetDescriptor(sqe.fd);
+			if (it != nullptr && it->Node == File)
+			{
+				/* The ring can't close itself */
+				*Result = -EBADF;
+				return true;
+			}
+
+			*Result = fdt->usr_close(sqe.fd);
+			return true;
+		}
+		default:
+		{
+			debug("Unsupported opcode %d", sqe.opcode);
+			*Result = -EINVAL;
+			return true;
+		}
+		}
+	}
+
+	void IoRing::Issue(Request *req)
+	{
+		intptr_t Result;
+		if (Execute(req, &Result))
+		{
+			Complete(req, Result);
+			return;
+		}
+
+		/* It may have become ready before the watcher was registered */
+		if (req->Watching && Execute(req, &Result))
+		{
+			Complete(req, Result);
+			return;
+		}
+
+		Pending.push_back(req);
+	}
+
+	void IoRing::Abort(Request *Chain)
+	{
+		while (Chain)
+		{
+			Request *next = Chain->Link;
+			Post(Chain->Sqe.user_data, -ECANCELED);
+			Free(Chain);
+			Chain = next;
+		}
+	}
+
+	void IoRing::Complete(Request *req, intptr_t Result)
+	{
+		if (req->Watching)
+		{
+			PollUnregister(&req->Watcher);
+			req->Watching = false;
+		}
+
+		if (Result < 0 || !(req->Sqe.flags & IOSQE_CQE_SKIP_SUCCESS))
+			Post(req->Sqe.user_data, Result);
+
+		/* A failed request breaks the chain unless it is a hard link */
+		Request *next = req->Link;
+		bool Broken = Result < 0 && !(req->Sqe.flags & IOSQE_IO_HARDLINK);
+		Free(req);
+
+		if (next == nullptr)
+			return;
+
+		if (Broken)
+			Abort(next);
+		else
+			Issue(next);
+	}
+
+	void IoRing::Post(uint64_t UserData, intptr_t Result)
+	{
+		if (ConvertResult)
+			Result = ConvertResult(Result);
+
+		if (Ready() >= CqEntries)
+		{
+			__atomic_fetch_add(&Shared->CqOverflow, 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		io_uring_cqe *cqe = &Cqes[CqTail & CqMask];
+		cqe->user_data = UserData;
+		cqe->res = (int32_t)Result;
+		cqe->flags = 0;
+		__atomic_store_n(&Shared->CqTail, ++CqTail, __ATOMIC_RELEASE);
+		Completions++;
+	}
+
+	void IoRing::Free(Request *req)
+	{
+		assert(!req->Watching);
+		if (req->Vector != &req->Segment)
+			delete[] req->Vector;
+		if (req->Buffers != &req->Single)
+			delete[] req->Buffers;
+		delete[] req->Path;
+		delete req;
+	}
+
+	int IoRing::Cancel(uint64_t UserData, int Opcode)
+	{
+		for (auto it = Pending.begin(); it != Pending.end(); ++it)
+		{
+			Request *req = *it;
+			if (req->Sqe.user_data != UserData)
+				continue;
+			if (Opcode != -1 && req->Sqe.opcode != Opcode)
+				continue;
+
+			Pending.erase(it);
+			Complete(req, -ECANCELED);
+			return 0;
+		}
+		return -ENOENT;
+	}
+
+	void IoRing::RunPending()
+	{
+		uint64_t Before;
+		do
+		{
+			Before = Completions;
+
+			/* Completing a request can issue or cancel others,
+			   so collect them before touching the list again */
+			std::list<std::pair<Request *, intptr_t>> Done;
+			for (auto it = Pending.begin(); it != Pending.end();)
+			{
+				Request *req = *it;
+				bool Due = req->Ready.exchange(false) ||
+						   req->Sqe.opcode == IORING_OP_TIMEOUT;
+
+				intptr_t Result;
+				if (!Due || !Execute(req, &Result))
+				{
+					++it;
+					continue;
+				}
+
+				it = Pending.erase(it);
+				Done.push_back({req, Result});
+			}
+
+			foreach (auto &d in Done)
+				Complete(d.first, d.second);
+
+			/* Timeouts that count completions may be due now */
+		} while (Completions != Before && !Pending.empty());
+	}
+
+	uint64_t IoRing::NextDeadline()
+	{
+		uint64_t ret = 0;
+		foreach (auto req in Pending)
+		{
+			if (req->Sqe.opcode != IORING_OP_TIMEOUT)
+				continue;
+			if (ret == 0 || req->Deadline < ret)
+				ret = req->Deadline;
+		}
+		return ret;
+	}
+
+	int IoRing::Enter(uint32_t ToSubmit, uint32_t MinComplete, uint32_t Flags)
+	{
+		Tasking::PCB *pcb = thisProcess;
+
+		/* The rings and the buffers are only mapped in the creator */
+		if (pcb != Process)
+			return -EBADF;
+
+		if (Flags & ~IORING_ENTER_GETEVENTS)
+			return -EINVAL;
+
+		if (MinComplete > CqEntries)
+			MinComplete = CqEntries;
+
+		SubmitLock.lock();
+		uint64_t Posted = Completions;
+
+		uint32_t Tail = __atomic_load_n(&Shared->SqTail, __ATOMIC_ACQUIRE);
+		uint32_t Count = MIN(ToSubmit, Tail - SqHead);
+		if (Count > SqEntries)
+			Count = SqEntries;
+
+		Request *ChainHead = nullptr, *ChainTail = nullptr;
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			uint32_t Index = __atomic_load_n(&SqArray[SqHead & SqMask], __ATOMIC_RELAXED);
+			SqHead++;
+			if (Index >= SqEntries)
+			{
+				__atomic_fetch_add(&Shared->SqDropped, 1, __ATOMIC_RELAXED);
+				continue;
+			}
+
+			/* A private copy, the SQE can be reused as soon as we return */
+			Request *req = new Request;
+			memcpy(&req->Sqe, &Sqes[Index], sizeof(io_uring_sqe));
+			req->Owner = this;
+			req->Error = Prepare(req);
+
+			if (ChainTail)
+				ChainTail->Link = req;
+			else
+				ChainHead = req;
+			ChainTail = req;
+
+			if (req->Sqe.flags & (IOSQE_IO_LINK | IOSQE_IO_HARDLINK))
+				continue;
+
+			Issue(ChainHead);
+			ChainHead = ChainTail = nullptr;
+		}
+
+		/* The last SQE asked for a link that never came */
+		if (ChainHead)
+			Issue(ChainHead);
+
+		__atomic_store_n(&Shared->SqHead, SqHead, __ATOMIC_RELEASE);
+
+		bool Interrupted = false;
+		while (true)
+		{
+			Triggered.store(false);
+			RunPending();
+
+			if (!(Flags & IORING_ENTER_GETEVENTS) || Ready() >= MinComplete)
+				break;
+
+			uint64_t Timeout = 0;
+			uint64_t Deadline = NextDeadline();
+			if (Deadline)
+			{
+				uint64_t Now = TimeManager->GetNanosecondsSinceClassCreation();
+				/* Round up, 0 would wait forever */
+				Timeout = Deadline > Now ? (Deadline - Now + 999999) / 1000000 : 1;
+			}
+
+			SubmitLock.unlock();
+			Waiters.Wait([this, pcb]
+						 { return Triggered.load() ||
+								  pcb->Signals.HasPendingSignal(); },
+						 Timeout);
+			SubmitLock.lock();
+
+			if (pcb->Signals.HasPendingSignal())
+			{
+				Interrupted = true;
+				break;
+			}
+		}
+
+		bool Notify = Completions != Posted;
+		SubmitLock.unlock();
+
+		if (Notify)
+			PollNotify(&Node, POLLIN | POLLRDNORM);
+
+		if (Interrupted && Count == 0)
+			return -EINTR;
+		return Count;
+	}
+
+	short IoRing::Poll(short Events)
+	{
+		short Revents = 0;
+		if (Ready() > 0)
+			Revents |= POLLIN | POLLRDNORM;
+		if (__atomic_load_n(&Shared->SqTail, __ATOMIC_RELAXED) - SqHead < SqEntries)
+			Revents |= POLLOUT | POLLWRNORM;
+		return Revents & Events;
+	}
+
+	intptr_t IoRing::Map(uint64_t Offset, size_t Length, Memory::VirtualMemoryArea *vma)
+	{
+		void *Base;
+		size_t Size;
+		switch (Offset)
+		{
+		case IORING_OFF_SQ_RING:
+		case IORING_OFF_CQ_RING:
+			Base = Shared;
+			Size = RingsSize;
+			break;
+		case IORING_OFF_SQES:
+			Base = Sqes;
+			Size = SqesSize;
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		if (Length > FROM_PAGES(TO_PAGES(Size)))
+			return -EINVAL;
+
+		/* Identity mapped like every other user allocation */
+		int ret = vma->Map(Base, Base, FROM_PAGES(TO_PAGES(Size)),
+						   Memory::US | Memory::RW);
+		if (ret < 0)
+			return ret;
+
+		Mapped = true;
+		return (intptr_t)Base;
+	}
+
+	void IoRing::Put()
+	{
+		if (--References == 0)
+			delete this;
+	}
+
+	IoRing *IoRing::FromFile(FileNode *File)
+	{
+		if (File == nullptr || IoRingFS == nullptr ||
+			File->fsi != IoRingFS)
+			return nullptr;
+		return (IoRing *)File->Node->PrivateData;
+	}
+
+	IoRing::IoRing(uint32_t Entries, io_uring_params *Params)
+	{
+		Process = thisProcess;
+
+		SqEntries = RoundUpPow2(Entries);
+		SqMask = SqEntries - 1;
+		if (Params->flags & IORING_SETUP_CQSIZE)
+			CqEntries = RoundUpPow2(Params->cq_entries);
+		else
+			CqEntries = 2 * SqEntries;
+		CqMask = CqEntries - 1;
+
+		/* Header, then the CQEs, then the SQ index array */
+		size_t CqesOffset = ALIGN_UP(sizeof(Rings), alignof(io_uring_cqe));
+		size_t ArrayOffset = CqesOffset + CqEntries * sizeof(io_uring_cqe);
+		RingsSize = ArrayOffset + SqEntries * sizeof(uint32_t);
+		SqesSize = SqEntries * sizeof(io_uring_sqe);
+
+		Shared = (Rings *)KernelAllocator.RequestPages(TO_PAGES(RingsSize));
+		memset(Shared, 0, FROM_PAGES(TO_PAGES(RingsSize)));
+		Cqes = (io_uring_cqe *)((uintptr_t)Shared + CqesOffset);
+		SqArray = (uint32_t *)((uintptr_t)Shared + ArrayOffset);
+		Sqes = (io_uring_sqe *)KernelAllocator.RequestPages(TO_PAGES(SqesSize));
+		memset(Sqes, 0, FROM_PAGES(TO_PAGES(SqesSize)));
+
+		Shared->SqMask = SqMask;
+		Shared->SqEntries = SqEntries;
+		Shared->CqMask = CqMask;
+		Shared->CqEntries = CqEntries;
+
+		Params->sq_entries = SqEntries;
+		Params->cq_entries = CqEntries;
+		Params->features = IORING_FEAT_SINGLE_MMAP |
+						   IORING_FEAT_SUBMIT_STABLE |
+						   IORING_FEAT_RW_CUR_POS;
+
+		Params->sq_off = {};
+		Params->sq_off.head = offsetof(Rings, SqHead);
+		Params->sq_off.tail = offsetof(Rings, SqTail);
+		Params->sq_off.ring_mask = offsetof(Rings, SqMask);
+		Params->sq_off.ring_entries = offsetof(Rings, SqEntries);
+		Params->sq_off.flags = offsetof(Rings, SqFlags);
+		Params->sq_off.dropped = offsetof(Rings, SqDropped);
+		Params->sq_off.array = ArrayOffset;
+
+		Params->cq_off = {};
+		Params->cq_off.head = offsetof(Rings, CqHead);
+		Params->cq_off.tail = offsetof(Rings, CqTail);
+		Params->cq_off.ring_mask = offsetof(Rings, CqMask);
+		Params->cq_off.ring_entries = offsetof(Rings, CqEntries);
+		Params->cq_off.overflow = offsetof(Rings, CqOverflow);
+		Params->cq_off.cqes = CqesOffset;
+		Params->cq_off.flags = offsetof(Rings, CqFlags);
+
+		Node.Mode = S_IFREG | S_IRUSR | S_IWUSR;
+		Node.PrivateData = this;
+		File = fs->CreateAnonymous("anon_inode:[io_uring]", &Node, GetIoRingFS());
+	}
+
+	IoRing::~IoRing()
+	{
+		/* The last reference is gone, no need to lock */
+		foreach (auto req in Pending)
+		{
+			if (req->Watching)
+			{
+				PollUnregister(&req->Watcher);
+				req->Watching = false;
+			}
+
+			while (req)
+			{
+				Request *next = req->Link;
+				req->Link = nullptr;
+				Free(req);
+				req = next;
+			}
+		}
+		Pending.clear();
+
+		/* Give the pages back to the kernel, unless the process
+		   is exiting and has already dropped its address space */
+		if (Mapped && Process->State.load() != Tasking::Terminated)
+		{
+			for (size_t i = 0; i < TO_PAGES(RingsSize); i++)
+			{
+				void *Page = (void *)((uintptr_t)Shared + FROM_PAGES(i));
+				Process->vma->Remap(Page, Page, Memory::RW);
+			}
+
+			for (size_t i = 0; i < TO_PAGES(SqesSize); i++)
+			{
+				void *Page = (void *)((uintptr_t)Sqes + FROM_PAGES(i));
+				Process->vma->Remap(Page, Page, Memory::RW);
+			}
+		}
+
+		KernelAllocator.FreePages(Shared, TO_PAGES(RingsSize));
+		KernelAllocator.FreePages(Sqes, TO_PAGES(SqesSize));
+	}
+}
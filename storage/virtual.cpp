@@ -148,8 +148,6 @@ namespace vfs
 
 	void Virtual::Initialize()
 	{
-		SmartLock(VirtualLock);
-
 		trace("Initializing virtual file system...");
 		uint32_t iFlags = I_FLAG_CACHE_KEEP;
 
@@ -160,6 +158,7 @@ namespace vfs
 					  S_IFDIR;
 		FileNode *proc = this->ForceCreate(this->GetRoot(0), "proc", mode);
 		FileNode *var = this->ForceCreate(this->GetRoot(0), "var", mode);
+		this->ForceCreate(this->GetRoot(0), "mnt", mode);
 		FileNode *log = this->ForceCreate(var, "log", mode);
 		proc->Node->Flags = iFlags;
 		log->Node->Flags = iFlags;
@@ -212,6 +211,7 @@ namespace vfs
 		if (it == DeviceMap.end())
 			ReturnLogError(-ENOENT, "Device %d not found", Device);
 
+		Cache.Sync(it->second.fsi, nullptr);
 		if (it->second.fsi->SuperOps.Synchronize)
 			it->second.fsi->SuperOps.Synchronize(it->second.fsi, NULL);
 		if (it->second.fsi->SuperOps.Destroy)
@@ -220,9 +220,34 @@ namespace vfs
 		return 0;
 	}
 
+	int Virtual::Sync(FileSystemInfo *fsi, Inode *Node)
+	{
+		int Result = Cache.Sync(fsi, Node);
+
+		std::vector<FileSystemInfo *> List;
+		if (fsi)
+			List.push_back(fsi);
+		else
+		{
+			foreach (auto &it in DeviceMap)
+				List.push_back(it.second.fsi);
+		}
+
+		foreach (FileSystemInfo *Info in List)
+		{
+			if (Info->SuperOps.Synchronize == nullptr)
+				continue;
+
+			int ret = Info->SuperOps.Synchronize(Info, Node);
+			if (ret < 0 && Result == 0)
+				Result = ret;
+		}
+		return Result;
+	}
+
 	Virtual::Virtual()
 	{
-		SmartLock(VirtualLock);
+		SmartWriteLock(VirtualLock);
 
 		FileSystemRoots = new vfsInode;
 		FileSystemRoots->Node.Index = -1;
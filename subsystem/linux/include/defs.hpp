@@ -90,6 +90,62 @@
 #define linux_CLOCK_SGI_CYCLE 10
 #define linux_CLOCK_TAI 11
 
+#define linux_FUTEX_WAIT 0
+#define linux_FUTEX_WAKE 1
+#define linux_FUTEX_FD 2
+#define linux_FUTEX_REQUEUE 3
+#define linux_FUTEX_CMP_REQUEUE 4
+#define linux_FUTEX_WAKE_OP 5
+#define linux_FUTEX_LOCK_PI 6
+#define linux_FUTEX_UNLOCK_PI 7
+#define linux_FUTEX_TRYLOCK_PI 8
+#define linux_FUTEX_WAIT_BITSET 9
+#define linux_FUTEX_WAKE_BITSET 10
+#define linux_FUTEX_WAIT_REQUEUE_PI 11
+#define linux_FUTEX_CMP_REQUEUE_PI 12
+#define linux_FUTEX_LOCK_PI2 13
+
+#define linux_FUTEX_PRIVATE_FLAG 128
+#define linux_FUTEX_CLOCK_REALTIME 256
+#define linux_FUTEX_CMD_MASK ~(linux_FUTEX_PRIVATE_FLAG | linux_FUTEX_CLOCK_REALTIME)
+
+#define linux_FUTEX_BITSET_MATCH_ANY 0xffffffff
+
+#define linux_POLLIN 0x001
+#define linux_POLLPRI 0x002
+#define linux_POLLOUT 0x004
+#define linux_POLLERR 0x008
+#define linux_POLLHUP 0x010
+#define linux_POLLNVAL 0x020
+#define linux_POLLRDNORM 0x040
+#define linux_POLLRDBAND 0x080
+#define linux_POLLWRNORM 0x100
+#define linux_POLLWRBAND 0x200
+#define linux_POLLRDHUP 0x2000
+
+#define linux_EPOLL_CLOEXEC 02000000
+
+#define linux_EPOLL_CTL_ADD 1
+#define linux_EPOLL_CTL_DEL 2
+#define linux_EPOLL_CTL_MOD 3
+
+#define linux_EPOLLIN 0x001
+#define linux_EPOLLPRI 0x002
+#define linux_EPOLLOUT 0x004
+#define linux_EPOLLERR 0x008
+#define linux_EPOLLHUP 0x010
+#define linux_EPOLLNVAL 0x020
+#define linux_EPOLLRDNORM 0x040
+#define linux_EPOLLRDBAND 0x080
+#define linux_EPOLLWRNORM 0x100
+#define linux_EPOLLWRBAND 0x200
+#define linux_EPOLLMSG 0x400
+#define linux_EPOLLRDHUP 0x2000
+#define linux_EPOLLEXCLUSIVE (1U << 28)
+#define linux_EPOLLWAKEUP (1U << 29)
+#define linux_EPOLLONESHOT (1U << 30)
+#define linux_EPOLLET (1U << 31)
+
 #define linux_GRND_NONBLOCK 0x1
 #define linux_GRND_RANDOM 0x2
 #define linux_GRND_INSECURE 0x4
@@ -142,9 +198,16 @@
 #define linux_F_OFD_SETLKW 38
 
 #define linux_F_DUPFD_CLOEXEC 1030
+#define linux_F_SETPIPE_SZ 1031
+#define linux_F_GETPIPE_SZ 1032
 
 #define linux_FD_CLOEXEC 1
 
+#define linux_SPLICE_F_MOVE 1
+#define linux_SPLICE_F_NONBLOCK 2
+#define linux_SPLICE_F_MORE 4
+#define linux_SPLICE_F_GIFT 8
+
 #define linux_DT_UNKNOWN 0
 #define linux_DT_FIFO 1
 #define linux_DT_CHR 2
@@ -207,6 +270,19 @@ struct f_owner_ex
 	pid_t pid;
 };
 
+#define linux_PATH_MAX 4096
+#define linux_MAX_RW_COUNT (INT_MAX & ~(PAGE_SIZE - 1))
+#define linux_IOV_MAX 1024
+#define linux_UIO_FASTIOV 8
+
+#define linux_RWF_HIPRI 0x01
+#define linux_RWF_DSYNC 0x02
+#define linux_RWF_SYNC 0x04
+#define linux_RWF_NOWAIT 0x08
+#define linux_RWF_APPEND 0x10
+#define linux_RWF_SUPPORTED (linux_RWF_HIPRI | linux_RWF_DSYNC | linux_RWF_SYNC | \
+							 linux_RWF_NOWAIT | linux_RWF_APPEND)
+
 struct iovec
 {
 	void *iov_base;
@@ -219,6 +295,34 @@ struct timeval
 	__kernel_suseconds_t tv_usec;
 };
 
+struct timezone
+{
+	int tz_minuteswest;
+	int tz_dsttime;
+};
+
+typedef unsigned int nfds_t;
+
+struct pollfd
+{
+	int fd;
+	short events;
+	short revents;
+};
+
+#define linux_FD_SETSIZE 1024
+
+struct linux_fd_set
+{
+	unsigned long fds_bits[linux_FD_SETSIZE / (8 * sizeof(long))];
+};
+
+struct epoll_event
+{
+	uint32_t events;
+	uint64_t data;
+} __attribute__((packed));
+
 struct timespec64
 {
 	time64_t tv_sec;
@@ -21,6 +21,12 @@
 #include <signal.hpp>
 #include <dumper.hpp>
 #include <utsname.h>
+#include <futex.hpp>
+#include <epoll.hpp>
+#include <pipe.hpp>
+#include <uring.hpp>
+#include <poll.hpp>
+#include <vdso.hpp>
 #include <rand.hpp>
 #include <limits.h>
 #include <exec.hpp>
@@ -747,58 +753,310 @@ __no_stack_protector void __LinuxForkReturn(void *tableAddr)
 	__builtin_unreachable();
 }
 
-static ssize_t linux_read(SysFrm *, int fd, void *buf, size_t count)
+/* Timeouts of the poll family are in milliseconds, -1 waits forever */
+static int linux_PollTimeout(const struct timespec *pTimeout, int *Timeout)
+{
+	if (pTimeout == nullptr)
+	{
+		*Timeout = -1;
+		return 0;
+	}
+
+	if (pTimeout->tv_sec < 0 ||
+		pTimeout->tv_nsec < 0 ||
+		pTimeout->tv_nsec >= 1000000000)
+		return -linux_EINVAL;
+
+	/* Round up, we must not wake up early */
+	uint64_t ms = uint64_t(pTimeout->tv_sec) * 1000 +
+				  (uint64_t(pTimeout->tv_nsec) + 999999) / 1000000;
+	*Timeout = ms > INT_MAX ? INT_MAX : int(ms);
+	return 0;
+}
+
+/* Install the temporary signal mask of ppoll, pselect6 and epoll_pwait */
+static int linux_SetWaitMask(const sigset_t *sigmask, size_t sigsetsize,
+							 sigset_t *OldMask)
+{
+	TCB *tcb = thisThread;
+	*OldMask = tcb->Signals.GetMask();
+	if (sigmask == nullptr)
+		return 0;
+
+	if (sigsetsize != sizeof(sigset_t))
+		return -linux_EINVAL;
+
+	auto pSigmask = tcb->Parent->vma->UserCheckAndGetAddress(sigmask);
+	if (pSigmask == nullptr)
+		return -linux_EFAULT;
+
+	tcb->Signals.SetMask(ConvertMaskToNative(*pSigmask));
+	return 0;
+}
+
+static int linux_DoPoll(struct pollfd *fds, nfds_t nfds, int timeout)
 {
 	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	void *pBuf = vma->UserCheckAndGetAddress(buf, count);
-	if (pBuf == nullptr)
+	if (nfds > pcb->SoftLimits.OpenFiles)
+		return -linux_EINVAL;
+
+	/* The array may span pages that aren't next to each other */
+	std::unique_ptr<struct pollfd[]> pFds(new struct pollfd[nfds]);
+	if (nfds > 0 && vma->CopyFromUser(pFds.get(), fds, sizeof(struct pollfd) * nfds) < 0)
 		return -linux_EFAULT;
 
-	func("%d, %p, %d", fd, buf, count);
+	/* Keep the descriptions open while we sleep on them */
+	std::unique_ptr<vfs::PollRequest[]> req(new vfs::PollRequest[nfds]);
+	std::unique_ptr<vfs::FileDescriptorTable::FildesRef[]> held(
+		new vfs::FileDescriptorTable::FildesRef[nfds]);
+	for (nfds_t i = 0; i < nfds; i++)
+	{
+		req[i].File = nullptr;
+		req[i].Events = pFds[i].events;
+		req[i].ReturnedEvents = 0;
 
-	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
-	ssize_t ret = ConvertErrnoToLinux(fdt->usr_read(fd, pBuf, count));
-	if (ret >= 0)
-		fdt->usr_lseek(fd, ret, SEEK_CUR);
+		/* Negative descriptors are ignored */
+		if (pFds[i].fd < 0)
+		{
+			req[i].Events = 0;
+			req[i].Ignored = true;
+			continue;
+		}
 
-#ifdef DEBUG
-	DumpData("READ", pBuf, ret < 0 ? 0 : ret);
-#endif
+		held[i] = fdt->GetDescriptor(pFds[i].fd);
+		if (held[i] != nullptr)
+			req[i].File = held[i]->Node;
+	}
+
+	/* The event bits are the same as ours */
+	int ret = vfs::PollFiles(req.get(), nfds, timeout);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+
+	ret = 0;
+	for (nfds_t i = 0; i < nfds; i++)
+	{
+		pFds[i].revents = req[i].ReturnedEvents;
+		if (pFds[i].revents)
+			ret++;
+	}
+
+	if (nfds > 0 && vma->CopyToUser(fds, pFds.get(), sizeof(struct pollfd) * nfds) < 0)
+		return -linux_EFAULT;
 	return ret;
 }
 
-static ssize_t linux_write(SysFrm *, int fd, const void *buf, size_t count)
+#define linux_SELECT_READ (linux_POLLIN | linux_POLLRDNORM | linux_POLLRDBAND | \
+						   linux_POLLHUP | linux_POLLERR)
+#define linux_SELECT_WRITE (linux_POLLOUT | linux_POLLWRNORM | linux_POLLWRBAND | \
+							linux_POLLERR)
+#define linux_SELECT_EXCEPT (linux_POLLPRI)
+
+static int linux_DoSelect(int nfds, struct linux_fd_set *readfds,
+						  struct linux_fd_set *writefds,
+						  struct linux_fd_set *exceptfds, int timeout)
 {
 	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	const void *pBuf = vma->UserCheckAndGetAddress(buf, count);
-	if (pBuf == nullptr)
-		return -linux_EFAULT;
+	if (nfds < 0 || nfds > linux_FD_SETSIZE)
+		return -linux_EINVAL;
 
-	func("%d, %p, %d", fd, buf, count);
+	struct linux_fd_set *sets[3] = {readfds, writefds, exceptfds};
+	for (int i = 0; i < 3; i++)
+	{
+		if (sets[i] == nullptr)
+			continue;
 
-	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
-	ssize_t ret = ConvertErrnoToLinux(fdt->usr_write(fd, pBuf, count));
-	if (ret)
-		fdt->usr_lseek(fd, ret, SEEK_CUR);
+		sets[i] = vma->UserCheckAndGetAddress(sets[i]);
+		if (sets[i] == nullptr)
+			return -linux_EFAULT;
+	}
 
-#ifdef DEBUG
-	DumpData("WRITE", (void *)pBuf, ret < 0 ? 0 : ret);
-#endif
+	const size_t bits = 8 * sizeof(long);
+	auto isSet = [bits](struct linux_fd_set *set, int fd)
+	{ return set && (set->fds_bits[fd / bits] & (1UL << (fd % bits))); };
+
+	/* Keep the descriptions open while we sleep on them */
+	std::unique_ptr<vfs::PollRequest[]> req(new vfs::PollRequest[nfds]);
+	std::unique_ptr<vfs::FileDescriptorTable::FildesRef[]> held(
+		new vfs::FileDescriptorTable::FildesRef[nfds]);
+	std::unique_ptr<int[]> fdOf(new int[nfds]);
+	nfds_t count = 0;
+	for (int fd = 0; fd < nfds; fd++)
+	{
+		short events = 0;
+		if (isSet(sets[0], fd))
+			events |= linux_SELECT_READ;
+		if (isSet(sets[1], fd))
+			events |= linux_SELECT_WRITE;
+		if (isSet(sets[2], fd))
+			events |= linux_SELECT_EXCEPT;
+		if (events == 0)
+			continue;
+
+		held[count] = fdt->GetDescriptor(fd);
+		if (held[count] == nullptr)
+			return -linux_EBADF;
+
+		req[count].File = held[count]->Node;
+		req[count].Events = events;
+		req[count].ReturnedEvents = 0;
+		fdOf[count] = fd;
+		count++;
+	}
+
+	int ret = vfs::PollFiles(req.get(), count, timeout);
+	if (ret < 0)
+		return ConvertErrnoToLinux(ret);
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (sets[i])
+			memset(sets[i]->fds_bits, 0, (nfds + bits - 1) / bits * sizeof(long));
+	}
+
+	/* Every bit that is set counts, not every descriptor */
+	const short masks[3] = {linux_SELECT_READ, linux_SELECT_WRITE, linux_SELECT_EXCEPT};
+	ret = 0;
+	for (nfds_t n = 0; n < count; n++)
+	{
+		int fd = fdOf[n];
+		for (int i = 0; i < 3; i++)
+		{
+			if (sets[i] == nullptr || !(req[n].Events & masks[i]) ||
+				!(req[n].ReturnedEvents & masks[i]))
+				continue;
+
+			sets[i]->fds_bits[fd / bits] |= 1UL << (fd % bits);
+			ret++;
+		}
+	}
 	return ret;
 }
 
+/* Copy a user path into a kernel buffer, like getname() */
+static int linux_ImportPath(const char *pathname, std::unique_ptr<char[]> &Path)
+{
+	Path.reset(new char[linux_PATH_MAX]);
+	ssize_t len = thisProcess->vma->StrncpyFromUser(Path.get(), pathname, linux_PATH_MAX);
+	if (len < 0)
+		return -linux_EFAULT;
+	if (len == linux_PATH_MAX)
+		return -linux_ENAMETOOLONG;
+	return 0;
+}
+
+/* Split a user buffer into physically contiguous kernel segments,
+   short lists use the caller's Fast array like linux_ImportIovec */
+static int linux_ImportBuffer(const void *buf, size_t count, bool Write,
+							  struct kiovec *Fast,
+							  std::unique_ptr<struct kiovec[]> &Slow,
+							  struct kiovec **Result)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+	uintptr_t Start = ALIGN_DOWN((uintptr_t)buf, PAGE_SIZE);
+	uintptr_t End = ALIGN_UP((uintptr_t)buf + count, PAGE_SIZE);
+	int Max = (int)((End - Start) / PAGE_SIZE);
+
+	struct kiovec *Vector = Fast;
+	if (Max > linux_UIO_FASTIOV)
+	{
+		/* Most buffers are contiguous, try before allocating */
+		int n = vma->UserSegments(buf, count, Write, Fast, linux_UIO_FASTIOV);
+		if (n != -E2BIG)
+		{
+			*Result = Fast;
+			return n < 0 ? -linux_EFAULT : n;
+		}
+
+		Slow.reset(new struct kiovec[Max]);
+		Vector = Slow.get();
+	}
+
+	int n = vma->UserSegments(buf, count, Write, Vector, Max);
+	if (n < 0)
+		return -linux_EFAULT;
+
+	*Result = Vector;
+	return n;
+}
+
+/* Offset -1 means the current file position */
+static ssize_t linux_DoBuffer(int fd, const void *buf, size_t count,
+							  off_t offset, bool Write)
+{
+	count = MIN(count, (size_t)linux_MAX_RW_COUNT);
+
+	/* Reading from user memory means writing to the file */
+	struct kiovec Fast[linux_UIO_FASTIOV];
+	std::unique_ptr<struct kiovec[]> Slow;
+	struct kiovec *Vector;
+	int cnt = linux_ImportBuffer(buf, count, !Write, Fast, Slow, &Vector);
+	if (cnt < 0)
+		return cnt;
+
+	/* A small buffer split across frames is bounced, pipes
+	   and terminals have to see it as a single buffer */
+	std::unique_ptr<uint8_t[]> Bounce;
+	if (cnt > 1 && count <= PAGE_SIZE)
+	{
+		Bounce.reset(new uint8_t[count]);
+		if (Write)
+		{
+			for (int i = 0, Done = 0; i < cnt; Done += Vector[i].iov_len, i++)
+				memcpy(Bounce.get() + Done, Vector[i].iov_base, Vector[i].iov_len);
+		}
+
+		Fast[0] = {Bounce.get(), count};
+		Vector = Fast;
+		cnt = 1;
+	}
+
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	ssize_t ret;
+	if (offset == -1)
+	{
+		ret = Write ? fdt->usr_writev(fd, Vector, cnt)
+					: fdt->usr_readv(fd, Vector, cnt);
+	}
+	else
+	{
+		ret = Write ? fdt->usr_pwritev(fd, Vector, cnt, offset)
+					: fdt->usr_preadv(fd, Vector, cnt, offset);
+	}
+
+	if (Bounce && !Write && ret > 0 &&
+		thisProcess->vma->CopyToUser((void *)buf, Bounce.get(), ret) < 0)
+		return -linux_EFAULT;
+	return ConvertErrnoToLinux(ret);
+}
+
+static ssize_t linux_read(SysFrm *, int fd, void *buf, size_t count)
+{
+	func("%d, %p, %d", fd, buf, count);
+	return linux_DoBuffer(fd, buf, count, -1, false);
+}
+
+static ssize_t linux_write(SysFrm *, int fd, const void *buf, size_t count)
+{
+	func("%d, %p, %d", fd, buf, count);
+	return linux_DoBuffer(fd, buf, count, -1, true);
+}
+
 static int linux_open(SysFrm *sf, const char *pathname, int flags, mode_t mode)
 {
 	PCB *pcb = thisProcess;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	const char *pPathname = vma->UserCheckAndGetAddress(pathname, PAGE_SIZE);
-	if (pPathname == nullptr)
-		return -linux_EFAULT;
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(pathname, Path);
+	if (err < 0)
+		return err;
+	const char *pPathname = Path.get();
 
 	func("%s, %d, %d", pPathname, flags, mode);
 
@@ -840,9 +1098,11 @@ static int linux_stat(SysFrm *, const char *pathname, struct linux_kstat *statbu
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	auto pPathname = vma->UserCheckAndGetAddress(pathname, PAGE_SIZE);
-	if (pPathname == nullptr)
-		return -linux_EFAULT;
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(pathname, Path);
+	if (err < 0)
+		return err;
+	const char *pPathname = Path.get();
 
 	auto pStatbuf = vma->UserCheckAndGetAddress(statbuf);
 	if (pStatbuf == nullptr)
@@ -876,9 +1136,14 @@ static int linux_lstat(SysFrm *, const char *pathname, struct linux_kstat *statb
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	auto pPathname = vma->UserCheckAndGetAddress(pathname, PAGE_SIZE);
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(pathname, Path);
+	if (err < 0)
+		return err;
+	const char *pPathname = Path.get();
+
 	auto pStatbuf = vma->UserCheckAndGetAddress(statbuf);
-	if (pPathname == nullptr || pStatbuf == nullptr)
+	if (pStatbuf == nullptr)
 		return -linux_EFAULT;
 
 	struct kstat nstat = KStatToStat(*pStatbuf);
@@ -889,6 +1154,11 @@ static int linux_lstat(SysFrm *, const char *pathname, struct linux_kstat *statb
 
 // #include "../syscalls.h"
 
+static int linux_poll(SysFrm *, struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	return linux_DoPoll(fds, nfds, timeout < 0 ? -1 : timeout);
+}
+
 static off_t linux_lseek(SysFrm *, int fd, off_t offset, int whence)
 {
 	static_assert(linux_SEEK_SET == SEEK_SET);
@@ -948,16 +1218,66 @@ static void *linux_mmap(SysFrm *, void *addr, size_t length, int prot,
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 	if (fildes != -1 && !m_Anon)
 	{
-		fixme("File mapping not fully implemented");
 		vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 
-		auto _fd = fdt->FileMap.find(fildes);
-		if (_fd == fdt->FileMap.end())
+		auto _fd = fdt->GetDescriptor(fildes);
+		if (_fd == nullptr)
 		{
 			debug("Invalid file descriptor %d", fildes);
 			return (void *)-linux_EBADF;
 		}
 
+		/* The rings are shared with the kernel, never copied */
+		if (_fd->Type == vfs::FileDescriptorTable::Fildes::FD_URING)
+		{
+			if (!m_Shared || m_Fixed)
+				return (void *)-linux_EINVAL;
+
+			vfs::IoRing *ring = vfs::IoRing::FromFile(_fd->Node);
+			return (void *)ConvertErrnoToLinux(ring->Map(offset, length, vma));
+		}
+
+		/* Read-only mappings of data the filesystem keeps in
+			memory share its pages instead of copying them */
+		FileNode *node = _fd->Node;
+		const void *Data = nullptr;
+		ssize_t Available = -1;
+		if (p_Read && !p_Write && node->IsRegularFile())
+			Available = node->MapPages(offset, &Data);
+
+		if (Available > 0)
+		{
+			uintptr_t Target = m_Fixed ? (uintptr_t)addr : (uintptr_t)Data;
+			size_t Length = ALIGN_UP(length, PAGE_SIZE);
+			size_t Whole = MIN((size_t)ALIGN_DOWN(Available, PAGE_SIZE), Length);
+
+			if (Whole)
+			{
+				int mRet = vma->Map((void *)Target, (void *)Data, Whole, Memory::US);
+				if (mRet < 0)
+					return (void *)(uintptr_t)ConvertErrnoToLinux(mRet);
+			}
+
+			/* The last page of the file is copied, so
+				it reads as zeros past the end */
+			if (Whole < Length)
+			{
+				void *Tail = vma->RequestPages(TO_PAGES(Length - Whole));
+				memcpy(Tail, (const uint8_t *)Data + Whole,
+					   MIN(Length - Whole, (size_t)Available - Whole));
+
+				int mRet = vma->Map((void *)(Target + Whole), Tail,
+									Length - Whole, Memory::US);
+				if (mRet < 0)
+					return (void *)(uintptr_t)ConvertErrnoToLinux(mRet);
+			}
+
+			debug("Mapped %#lx-%#lx in place", Target, Target + Length);
+			return (void *)Target;
+		}
+
+		fixme("File mapping not fully implemented");
+
 		if (p_Read)
 		{
 			void *pBuf = vma->RequestPages(TO_PAGES(length));
@@ -1142,130 +1462,144 @@ static int linux_ioctl(SysFrm *, int fd, unsigned long request, void *argp)
 
 static ssize_t linux_pread64(SysFrm *, int fd, void *buf, size_t count, off_t offset)
 {
-	PCB *pcb = thisProcess;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
-
-	void *pBuf = vma->UserCheckAndGetAddress(buf, count);
-	if (pBuf == nullptr)
-		return -linux_EFAULT;
-
-	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
-	off_t oldOff = fdt->usr_lseek(fd, 0, SEEK_CUR);
-	fdt->usr_lseek(fd, offset, SEEK_SET);
-	ssize_t ret = fdt->usr_read(fd, pBuf, count);
-	fdt->usr_lseek(fd, oldOff, SEEK_SET);
-	return ConvertErrnoToLinux(ret);
+	if (offset < 0)
+		return -linux_EINVAL;
+	return linux_DoBuffer(fd, buf, count, offset, false);
 }
 
 static ssize_t linux_pwrite64(SysFrm *, int fd, const void *buf, size_t count, off_t offset)
 {
-	PCB *pcb = thisProcess;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
-
-	const void *pBuf = vma->UserCheckAndGetAddress(buf, count);
-	if (pBuf == nullptr)
-		return -linux_EFAULT;
-
-	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
-	off_t oldOff = fdt->usr_lseek(fd, 0, SEEK_CUR);
-	fdt->usr_lseek(fd, offset, SEEK_SET);
-	ssize_t ret = fdt->usr_write(fd, pBuf, count);
-	fdt->usr_lseek(fd, oldOff, SEEK_SET);
-	return ConvertErrnoToLinux(ret);
+	if (offset < 0)
+		return -linux_EINVAL;
+	return linux_DoBuffer(fd, buf, count, offset, true);
 }
 
-static ssize_t linux_readv(SysFrm *sf, int fildes, const struct iovec *iov, int iovcnt)
+/* Check a user iovec list and turn it into kernel segments, a buffer
+   that spans discontiguous frames takes more than one. Short lists
+   use the caller's Fast array, longer ones are allocated.
+   Returns the number of segments. */
+static int linux_ImportIovec(const struct iovec *iov, int iovcnt, bool Write,
+							 struct kiovec *Fast,
+							 std::unique_ptr<struct kiovec[]> &Slow,
+							 struct kiovec **Result)
 {
-	PCB *pcb = thisProcess;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+
+	if (iovcnt < 0 || iovcnt > linux_IOV_MAX)
+		return -linux_EINVAL;
+
+	struct iovec FastIov[linux_UIO_FASTIOV];
+	std::unique_ptr<struct iovec[]> SlowIov;
+	struct iovec *pIov = FastIov;
+	if (iovcnt > linux_UIO_FASTIOV)
+	{
+		SlowIov.reset(new struct iovec[iovcnt]);
+		pIov = SlowIov.get();
+	}
 
-	const struct iovec *pIov = vma->UserCheckAndGetAddress(iov, sizeof(struct iovec) * iovcnt);
-	if (pIov == nullptr)
+	if (vma->CopyFromUser(pIov, iov, sizeof(struct iovec) * iovcnt) < 0)
 		return -linux_EFAULT;
 
-	ssize_t Total = 0;
+	size_t Total = 0;
+	size_t Pages = 0;
 	for (int i = 0; i < iovcnt; i++)
 	{
-		debug("%d: iov[%d]: %p %d", fildes, i, pIov[i].iov_base, pIov[i].iov_len);
+		size_t Length = pIov[i].iov_len;
+		if ((ssize_t)Length < 0 || Total + Length > (size_t)LONG_MAX)
+			return -linux_EINVAL;
+		Total += Length;
 
-		if (!pIov[i].iov_base)
-		{
-			debug("invalid iov_base");
-			return -linux_EFAULT;
-		}
+		if (Length == 0)
+			continue;
+		uintptr_t Base = (uintptr_t)pIov[i].iov_base;
+		Pages += (ALIGN_UP(Base + Length, PAGE_SIZE) - ALIGN_DOWN(Base, PAGE_SIZE)) / PAGE_SIZE;
+	}
+
+	struct kiovec *Vector = Fast;
+	int Max = linux_UIO_FASTIOV;
+	if (Pages > (size_t)linux_UIO_FASTIOV)
+	{
+		Slow.reset(new struct kiovec[Pages]);
+		Vector = Slow.get();
+		Max = (int)Pages;
+	}
 
+	int Count = 0;
+	for (int i = 0; i < iovcnt; i++)
+	{
 		if (pIov[i].iov_len == 0)
-		{
-			debug("invalid iov_len");
 			continue;
-		}
 
-		ssize_t n = linux_read(sf, fildes, pIov[i].iov_base, pIov[i].iov_len);
+		int n = vma->UserSegments(pIov[i].iov_base, pIov[i].iov_len, Write,
+								  Vector + Count, Max - Count);
 		if (n < 0)
-			return ConvertErrnoToLinux(n);
-		debug("n: %d", n);
-
-		Total += n;
-		if (n < (ssize_t)pIov[i].iov_len)
-		{
-			debug("break");
-			break;
-		}
+			return -linux_EFAULT;
+		Count += n;
 	}
-	debug("readv: %d", Total);
-	return Total;
+
+	*Result = Vector;
+	return Count;
 }
 
-static ssize_t linux_writev(SysFrm *sf, int fildes, const struct iovec *iov, int iovcnt)
+/* Offset -1 means the current file position */
+static ssize_t linux_DoVector(int fd, const struct iovec *iov, int iovcnt,
+							  off_t offset, int flags, bool Write)
 {
-	PCB *pcb = thisProcess;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
-
-	const struct iovec *pIov = vma->UserCheckAndGetAddress(iov, sizeof(struct iovec) * iovcnt);
-	if (pIov == nullptr)
-		return -linux_EFAULT;
-
-	ssize_t Total = 0;
-	for (int i = 0; i < iovcnt; i++)
+	if (flags & ~linux_RWF_SUPPORTED)
+		return -linux_EOPNOTSUPP;
+
+	struct kiovec Fast[linux_UIO_FASTIOV];
+	std::unique_ptr<struct kiovec[]> Slow;
+	struct kiovec *Vector;
+	int cnt = linux_ImportIovec(iov, iovcnt, !Write, Fast, Slow, &Vector);
+	if (cnt < 0)
+		return cnt;
+
+	vfs::FileDescriptorTable *fdt = thisProcess->FileDescriptors;
+	bool NonBlocking = flags & linux_RWF_NOWAIT;
+	ssize_t n;
+	if (offset == -1)
 	{
-		debug("%d: iov[%d]: %p %d", fildes, i, pIov[i].iov_base, pIov[i].iov_len);
+		n = Write ? fdt->usr_writev(fd, Vector, cnt, NonBlocking)
+				  : fdt->usr_readv(fd, Vector, cnt, NonBlocking);
+	}
+	else
+	{
+		n = Write ? fdt->usr_pwritev(fd, Vector, cnt, offset, NonBlocking)
+				  : fdt->usr_preadv(fd, Vector, cnt, offset, NonBlocking);
+	}
 
-		if (!pIov[i].iov_base)
-		{
-			debug("invalid iov_base");
-			return -linux_EFAULT;
-		}
+	debug("%s %d: %d bytes", Write ? "writev" : "readv", fd, n);
+	return ConvertErrnoToLinux(n);
+}
 
-		if (pIov[i].iov_len == 0)
-		{
-			debug("invalid iov_len");
-			continue;
-		}
+/* Same as pos_from_hilo(), the high half only matters on 32-bit */
+static off_t linux_PosFromHiLo(unsigned long pos_l, unsigned long pos_h)
+{
+	if (sizeof(long) == sizeof(off_t))
+		return (off_t)pos_l;
+	return (off_t)(pos_l | ((uint64_t)pos_h << 32));
+}
 
-		ssize_t n = linux_write(sf, fildes, pIov[i].iov_base, pIov[i].iov_len);
-		if (n < 0)
-			return ConvertErrnoToLinux(n);
-		debug("n: %d", n);
+static ssize_t linux_readv(SysFrm *, int fildes, const struct iovec *iov, int iovcnt)
+{
+	return linux_DoVector(fildes, iov, iovcnt, -1, 0, false);
+}
 
-		Total += n;
-		if (n < (ssize_t)pIov[i].iov_len)
-		{
-			debug("break");
-			break;
-		}
-	}
-	debug("writev: %d", Total);
-	return Total;
+static ssize_t linux_writev(SysFrm *, int fildes, const struct iovec *iov, int iovcnt)
+{
+	return linux_DoVector(fildes, iov, iovcnt, -1, 0, true);
 }
 
 static int linux_access(SysFrm *, const char *pathname, int mode)
 {
 	PCB *pcb = thisProcess;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	auto pPathname = vma->UserCheckAndGetAddress(pathname);
-	if (pPathname == nullptr)
-		return -linux_EFAULT;
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(pathname, Path);
+	if (err < 0)
+		return err;
+	const char *pPathname = Path.get();
 
 	debug("access(%s, %d)", (char *)pPathname, mode);
 
@@ -1281,10 +1615,52 @@ static int linux_pipe(SysFrm *, int pipefd[2])
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	int *pPipefd = vma->UserCheckAndGetAddress(pipefd);
-	debug("pipefd=%#lx", pPipefd);
-	fixme("pipefd=[%d, %d]", pPipefd[0], pPipefd[1]);
-	return -linux_ENOSYS;
+	int *pPipefd = vma->UserCheckAndGetAddress(pipefd, sizeof(int) * 2);
+	if (pPipefd == nullptr)
+		return -linux_EFAULT;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	return ConvertErrnoToLinux(fdt->usr_pipe(pPipefd, 0));
+}
+
+static int linux_select(SysFrm *, int nfds, struct linux_fd_set *readfds,
+						struct linux_fd_set *writefds,
+						struct linux_fd_set *exceptfds,
+						struct timeval *timeout)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+
+	int msTimeout = -1;
+	struct timeval *pTimeout = nullptr;
+	if (timeout)
+	{
+		pTimeout = vma->UserCheckAndGetAddress(timeout);
+		if (pTimeout == nullptr)
+			return -linux_EFAULT;
+
+		if (pTimeout->tv_sec < 0 ||
+			pTimeout->tv_usec < 0 ||
+			pTimeout->tv_usec >= 1000000)
+			return -linux_EINVAL;
+
+		uint64_t ms = uint64_t(pTimeout->tv_sec) * 1000 +
+					  (uint64_t(pTimeout->tv_usec) + 999) / 1000;
+		msTimeout = ms > INT_MAX ? INT_MAX : int(ms);
+	}
+
+	uint64_t start = TimeManager->GetNanosecondsSinceClassCreation();
+	int ret = linux_DoSelect(nfds, readfds, writefds, exceptfds, msTimeout);
+
+	/* Like Linux, leave the time that was not slept in *timeout */
+	if (pTimeout)
+	{
+		uint64_t slept = (TimeManager->GetNanosecondsSinceClassCreation() - start) / 1000;
+		uint64_t total = uint64_t(pTimeout->tv_sec) * 1000000 + pTimeout->tv_usec;
+		uint64_t left = slept >= total ? 0 : total - slept;
+		pTimeout->tv_sec = left / 1000000;
+		pTimeout->tv_usec = left % 1000000;
+	}
+	return ret;
 }
 
 static int linux_madvise(SysFrm *, void *addr, size_t length, int advice)
@@ -1420,9 +1796,27 @@ static int linux_setitimer(SysFrm *, int which,
 	return 0;
 }
 
-static int linux_shutdown(SysFrm *, int sockfd, int how)
+static ssize_t linux_sendfile(SysFrm *, int out_fd, int in_fd,
+							  off_t *offset, size_t count)
 {
-	stub;
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	off_t *pOffset = nullptr;
+	if (offset)
+	{
+		pOffset = vma->UserCheckAndGetAddress(offset);
+		if (pOffset == nullptr)
+			return -linux_EFAULT;
+	}
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	return ConvertErrnoToLinux(fdt->usr_sendfile(out_fd, in_fd, pOffset, count));
+}
+
+static int linux_shutdown(SysFrm *, int sockfd, int how)
+{
+	stub;
 	return -linux_ENOSYS;
 }
 
@@ -1789,6 +2183,18 @@ __no_sanitize("undefined") static int linux_execve(SysFrm *sf, const char *pathn
 static __noreturn void linux_exit(SysFrm *, int status)
 {
 	TCB *t = thisThread;
+
+	if (t->Linux.clear_child_tid)
+	{
+		/* Wake up pthread_join() */
+		int *pTid = t->Parent->vma->UserCheckAndGetAddress(t->Linux.clear_child_tid);
+		if (pTid)
+		{
+			__atomic_store_n(pTid, 0, __ATOMIC_SEQ_CST);
+			Futex::Wake((uint32_t *)pTid, 1);
+		}
+	}
+
 	{
 		CriticalSection cs;
 		trace("Userspace thread %s(%d) exited with code %d (%#x)",
@@ -1806,6 +2212,14 @@ static __noreturn void linux_exit(SysFrm *, int status)
 	__builtin_unreachable();
 }
 
+/* Task times are accounted in TSC cycles */
+static void linux_CyclesToTimeval(uint64_t Cycles, struct timeval *tv)
+{
+	uint64_t ns = VDSO::CyclesToNanoseconds(Cycles);
+	tv->tv_sec = ns / 1000000000;
+	tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
 static pid_t linux_wait4(SysFrm *, pid_t pid, int *wstatus,
 						 int options, struct rusage *rusage)
 {
@@ -1854,11 +2268,8 @@ static pid_t linux_wait4(SysFrm *, pid_t pid, int *wstatus,
 					if (pRusage == nullptr)
 						return -linux_EFAULT;
 
-					pRusage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
-					pRusage->ru_utime.tv_usec = uTime / 1000000000;		 /* Microseconds */
-
-					pRusage->ru_stime.tv_sec = kTime / 1000000000000000; /* Seconds */
-					pRusage->ru_stime.tv_usec = kTime / 1000000000;		 /* Microseconds */
+					linux_CyclesToTimeval(uTime, &pRusage->ru_utime);
+					linux_CyclesToTimeval(kTime, &pRusage->ru_stime);
 
 					pRusage->ru_maxrss = _maxrss;
 				}
@@ -1906,11 +2317,8 @@ static pid_t linux_wait4(SysFrm *, pid_t pid, int *wstatus,
 					if (pRusage == nullptr)
 						return -linux_EFAULT;
 
-					pRusage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
-					pRusage->ru_utime.tv_usec = uTime / 1000000000;		 /* Microseconds */
-
-					pRusage->ru_stime.tv_sec = kTime / 1000000000000000; /* Seconds */
-					pRusage->ru_stime.tv_usec = kTime / 1000000000;		 /* Microseconds */
+					linux_CyclesToTimeval(uTime, &pRusage->ru_utime);
+					linux_CyclesToTimeval(kTime, &pRusage->ru_stime);
 
 					pRusage->ru_maxrss = _maxrss;
 				}
@@ -2023,11 +2431,8 @@ static pid_t linux_wait4(SysFrm *, pid_t pid, int *wstatus,
 		if (pRusage == nullptr)
 			return -linux_EFAULT;
 
-		pRusage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
-		pRusage->ru_utime.tv_usec = uTime / 1000000000;		 /* Microseconds */
-
-		pRusage->ru_stime.tv_sec = kTime / 1000000000000000; /* Seconds */
-		pRusage->ru_stime.tv_usec = kTime / 1000000000;		 /* Microseconds */
+		linux_CyclesToTimeval(uTime, &pRusage->ru_utime);
+		linux_CyclesToTimeval(kTime, &pRusage->ru_stime);
 
 		pRusage->ru_maxrss = _maxrss;
 		/* TODO: The rest of the fields */
@@ -2172,9 +2577,17 @@ static int linux_fcntl(SysFrm *, int fd, int cmd, void *arg)
 	case linux_F_DUPFD:
 		return ConvertErrnoToLinux(fdt->usr_dup2(fd, s_cst(int, (uintptr_t)arg)));
 	case linux_F_GETFD:
-		return ConvertErrnoToLinux(fdt->GetFlags(fd));
+	{
+		int ret = fdt->GetDescriptorFlags(fd);
+		if (ret < 0)
+			return ConvertErrnoToLinux(ret);
+		return (ret & O_CLOEXEC) ? linux_FD_CLOEXEC : 0;
+	}
 	case linux_F_SETFD:
-		return ConvertErrnoToLinux(fdt->SetFlags(fd, s_cst(int, (uintptr_t)arg)));
+	{
+		int flags = s_cst(int, (uintptr_t)arg) & linux_FD_CLOEXEC ? O_CLOEXEC : 0;
+		return ConvertErrnoToLinux(fdt->SetDescriptorFlags(fd, flags));
+	}
 	case linux_F_GETFL:
 	{
 		fixme("F_GETFL is stub?");
@@ -2182,12 +2595,21 @@ static int linux_fcntl(SysFrm *, int fd, int cmd, void *arg)
 	}
 	case linux_F_SETFL:
 	{
-		fixme("F_SETFL is stub?");
+		auto it = fdt->GetDescriptor(fd);
+		if (it == nullptr)
+			ReturnLogError(-linux_EBADF, "Invalid fd %d", fd);
+
+		/* Only these can be changed after open */
+		const int Changeable = O_APPEND | O_NONBLOCK | O_DIRECT;
 		int flags = s_cst(int, (uintptr_t)arg);
-		if (flags & O_APPEND)
-			fdt->SetFlags(fd, fdt->GetFlags(fd) | O_APPEND);
+
+		vfs::Pipe *p = vfs::Pipe::FromFile(it->Node);
+		if (p)
+			p->SetPacketMode(flags & O_DIRECT);
 		else
-			fdt->SetFlags(fd, fdt->GetFlags(fd) & ~O_APPEND);
+			flags &= ~O_DIRECT;
+
+		it->Flags = (it->Flags & ~Changeable) | (flags & Changeable);
 		return 0;
 	}
 	case linux_F_DUPFD_CLOEXEC:
@@ -2196,12 +2618,24 @@ static int linux_fcntl(SysFrm *, int fd, int cmd, void *arg)
 		if (ret < 0)
 			return ConvertErrnoToLinux(ret);
 
-		auto it = fdt->FileMap.find(fd);
-		if (it == fdt->FileMap.end())
+		/* Only the new descriptor, the description is shared */
+		fdt->SetDescriptorFlags(ret, O_CLOEXEC);
+		return ret;
+	}
+	case linux_F_SETPIPE_SZ:
+	case linux_F_GETPIPE_SZ:
+	{
+		auto it = fdt->GetDescriptor(fd);
+		if (it == nullptr)
 			ReturnLogError(-linux_EBADF, "Invalid fd %d", fd);
 
-		it->second.Flags |= linux_FD_CLOEXEC;
-		return ret;
+		vfs::Pipe *p = vfs::Pipe::FromFile(it->Node);
+		if (p == nullptr)
+			return -linux_EBADF;
+
+		if (cmd == linux_F_GETPIPE_SZ)
+			return p->GetSize();
+		return ConvertErrnoToLinux(p->SetSize((size_t)arg));
 	}
 	case linux_F_SETOWN:
 	case linux_F_GETOWN:
@@ -2235,15 +2669,33 @@ static int linux_creat(SysFrm *, const char *pathname, mode_t mode)
 	return ConvertErrnoToLinux(fdt->usr_creat(pathname, mode));
 }
 
+static int linux_fsync(SysFrm *, int fd)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	auto it = fdt->GetDescriptor(fd);
+	if (it == nullptr)
+		return -linux_EBADF;
+
+	FileNode *node = it->Node;
+	if (node == nullptr || it->Type != vfs::FileDescriptorTable::Fildes::FD_INODE)
+		return -linux_EINVAL;
+
+	return (int)ConvertErrnoToLinux(fs->Sync(node->fsi, node->Node));
+}
+
+static int linux_fdatasync(SysFrm *Frame, int fd)
+{
+	/* Metadata is written along with the data */
+	return linux_fsync(Frame, fd);
+}
+
 static long linux_getcwd(SysFrm *, char *buf, size_t size)
 {
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	char *pBuf = vma->UserCheckAndGetAddress(buf, size);
-	if (pBuf == nullptr)
-		return -linux_EFAULT;
-
 	std::string cwd = pcb->CWD->GetPath();
 	if (cwd.length() >= size)
 	{
@@ -2251,8 +2703,8 @@ static long linux_getcwd(SysFrm *, char *buf, size_t size)
 		return -linux_ERANGE;
 	}
 
-	strncpy(pBuf, cwd.c_str(), cwd.length());
-	pBuf[cwd.length()] = '\0';
+	if (vma->CopyToUser(buf, cwd.c_str(), cwd.length() + 1) < 0)
+		return -linux_EFAULT;
 	debug("cwd: \"%s\" with %ld bytes", cwd.c_str(), cwd.length());
 	return cwd.length();
 }
@@ -2260,13 +2712,13 @@ static long linux_getcwd(SysFrm *, char *buf, size_t size)
 static int linux_chdir(SysFrm *, const char *path)
 {
 	PCB *pcb = thisProcess;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	const char *pPath = vma->UserCheckAndGetAddress(path);
-	if (!pPath)
-		return -linux_EFAULT;
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(path, Path);
+	if (err < 0)
+		return err;
 
-	FileNode *n = fs->GetByPath(pPath, pcb->CWD);
+	FileNode *n = fs->GetByPath(Path.get(), pcb->CWD);
 	if (!n)
 		return -linux_ENOENT;
 
@@ -2280,33 +2732,53 @@ static int linux_fchdir(SysFrm *, int fd)
 	PCB *pcb = thisProcess;
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
 
-	auto it = fdt->FileMap.find(fd);
-	if (it == fdt->FileMap.end())
+	auto it = fdt->GetDescriptor(fd);
+	if (it == nullptr)
 		return -linux_EBADF;
 
-	pcb->SetWorkingDirectory(it->second.Node);
-	debug("Changed cwd to \"%s\"", it->second.Node->GetPath().c_str());
+	pcb->SetWorkingDirectory(it->Node);
+	debug("Changed cwd to \"%s\"", it->Node->GetPath().c_str());
 	return 0;
 }
 
 static int linux_mkdir(SysFrm *, const char *pathname, mode_t mode)
 {
 	PCB *pcb = thisProcess;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
 	fixme("semi-stub");
 
-	const char *pPathname = vma->UserCheckAndGetAddress(pathname);
-	if (!pPathname)
-		return -linux_EFAULT;
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(pathname, Path);
+	if (err < 0)
+		return err;
+	const char *pPathname = Path.get();
 
 	mode &= ~pcb->FileCreationMask & 0777;
 
-	FileNode *n = fs->Create(pcb->CWD, pPathname, mode);
+	FileNode *n = fs->Create(pcb->CWD, pPathname, mode | S_IFDIR);
 	if (!n)
 		return -linux_EEXIST;
 	return 0;
 }
 
+static int linux_link(SysFrm *, const char *oldpath, const char *newpath)
+{
+	PCB *pcb = thisProcess;
+
+	std::unique_ptr<char[]> OldPath, NewPath;
+	int err = linux_ImportPath(oldpath, OldPath);
+	if (err < 0)
+		return err;
+	err = linux_ImportPath(newpath, NewPath);
+	if (err < 0)
+		return err;
+
+	FileNode *target = fs->GetByPath(OldPath.get(), pcb->CWD);
+	if (target == nullptr)
+		return -linux_ENOENT;
+
+	return ConvertErrnoToLinux(fs->Link(target, pcb->CWD, NewPath.get()));
+}
+
 static ssize_t linux_readlink(SysFrm *, const char *pathname,
 							  char *buf, size_t bufsiz)
 {
@@ -2322,10 +2794,11 @@ static ssize_t linux_readlink(SysFrm *, const char *pathname,
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	const char *pPath = vma->UserCheckAndGetAddress(pathname);
-	char *pBuf = vma->UserCheckAndGetAddress(buf);
-	if (pPath == nullptr || pBuf == nullptr)
-		return -linux_EFAULT;
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(pathname, Path);
+	if (err < 0)
+		return err;
+	const char *pPath = Path.get();
 
 	func("%s %#lx %ld", pPath, buf, bufsiz);
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
@@ -2333,18 +2806,22 @@ static ssize_t linux_readlink(SysFrm *, const char *pathname,
 	if (fd < 0)
 		return -linux_ENOENT;
 
-	auto it = fdt->FileMap.find(fd);
-	if (it == fdt->FileMap.end())
+	auto it = fdt->GetDescriptor(fd);
+	if (it == nullptr)
 		ReturnLogError(-linux_EBADF, "Invalid fd %d", fd);
 
-	vfs::FileDescriptorTable::Fildes &fildes = it->second;
+	vfs::FileDescriptorTable::Fildes &fildes = *it;
 	FileNode *node = fildes.Node;
 	fdt->usr_close(fd);
 
 	if (!node->IsSymbolicLink())
 		return -linux_EINVAL;
 
-	return ConvertErrnoToLinux(node->ReadLink(pBuf, bufsiz));
+	std::unique_ptr<char[]> Link(new char[bufsiz]);
+	ssize_t ret = node->ReadLink(Link.get(), bufsiz);
+	if (ret > 0 && vma->CopyToUser(buf, Link.get(), ret) < 0)
+		return -linux_EFAULT;
+	return ConvertErrnoToLinux(ret);
 }
 
 static mode_t linux_umask(SysFrm *, mode_t mask)
@@ -2373,11 +2850,8 @@ static int linux_getrusage(SysFrm *, int who, struct rusage *usage)
 		size_t uTime = pcb->Info.UserTime;
 		size_t _maxrss = pcb->GetSize();
 
-		pUsage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
-		pUsage->ru_utime.tv_usec = uTime / 1000000000;		/* Microseconds */
-
-		pUsage->ru_stime.tv_sec = kTime / 1000000000000000; /* Seconds */
-		pUsage->ru_stime.tv_usec = kTime / 1000000000;		/* Microseconds */
+		linux_CyclesToTimeval(uTime, &pUsage->ru_utime);
+		linux_CyclesToTimeval(kTime, &pUsage->ru_stime);
 
 		pUsage->ru_maxrss = _maxrss;
 		break;
@@ -2395,11 +2869,8 @@ static int linux_getrusage(SysFrm *, int who, struct rusage *usage)
 			_maxrss += child->GetSize();
 		}
 
-		pUsage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
-		pUsage->ru_utime.tv_usec = uTime / 1000000000;		/* Microseconds */
-
-		pUsage->ru_stime.tv_sec = kTime / 1000000000000000; /* Seconds */
-		pUsage->ru_stime.tv_usec = kTime / 1000000000;		/* Microseconds */
+		linux_CyclesToTimeval(uTime, &pUsage->ru_utime);
+		linux_CyclesToTimeval(kTime, &pUsage->ru_stime);
 
 		pUsage->ru_maxrss = _maxrss;
 		break;
@@ -2412,11 +2883,8 @@ static int linux_getrusage(SysFrm *, int who, struct rusage *usage)
 		size_t uTime = tcb->Info.UserTime;
 		size_t _maxrss = tcb->GetSize();
 
-		pUsage->ru_utime.tv_sec = uTime / 1000000000000000; /* Seconds */
-		pUsage->ru_utime.tv_usec = uTime / 1000000000;		/* Microseconds */
-
-		pUsage->ru_stime.tv_sec = kTime / 1000000000000000; /* Seconds */
-		pUsage->ru_stime.tv_usec = kTime / 1000000000;		/* Microseconds */
+		linux_CyclesToTimeval(uTime, &pUsage->ru_utime);
+		linux_CyclesToTimeval(kTime, &pUsage->ru_stime);
 
 		pUsage->ru_maxrss = _maxrss;
 		break;
@@ -2567,6 +3035,28 @@ static int linux_arch_prctl(SysFrm *, int code, unsigned long addr)
 	}
 }
 
+static long linux_sync(SysFrm *)
+{
+	fs->Sync(nullptr, nullptr);
+	return 0;
+}
+
+static int linux_syncfs(SysFrm *, int fd)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	auto it = fdt->GetDescriptor(fd);
+	if (it == nullptr)
+		return -linux_EBADF;
+
+	FileNode *node = it->Node;
+	if (node == nullptr)
+		return -linux_EBADF;
+
+	return (int)ConvertErrnoToLinux(fs->Sync(node->fsi, nullptr));
+}
+
 static int linux_reboot(SysFrm *, int magic, int magic2, int cmd, void *arg)
 {
 	if (magic != linux_LINUX_REBOOT_MAGIC1 ||
@@ -2783,6 +3273,118 @@ static int linux_tkill(SysFrm *, int tid, int sig)
 	return ConvertErrnoToLinux(tcb->SendSignal(nSig));
 }
 
+static uint64_t linux_FutexTimeout(const struct timespec *pTimeout,
+								   bool Absolute, bool Realtime)
+{
+	if (pTimeout == nullptr)
+		return 0;
+
+	uint64_t ns = pTimeout->tv_sec * 1000000000ULL + pTimeout->tv_nsec;
+	if (Absolute)
+	{
+		uint64_t now = Realtime ? VDSO::Realtime() : VDSO::Monotonic();
+		/* Already expired, wait for the shortest time possible */
+		ns = ns > now ? ns - now : 1;
+	}
+	return ns ? ns : 1;
+}
+
+static long linux_futex(SysFrm *, uint32_t *uaddr, int op, uint32_t val,
+						const struct timespec *timeout, uint32_t *uaddr2,
+						uint32_t val3)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	if ((uintptr_t)uaddr % sizeof(uint32_t))
+		return -linux_EINVAL;
+
+	uint32_t *pUaddr = vma->UserCheckAndGetAddress(uaddr);
+	if (pUaddr == nullptr)
+		return -linux_EFAULT;
+
+	int cmd = op & linux_FUTEX_CMD_MASK;
+	/* For the requeue and wake op commands
+	   this argument is a count, not a pointer */
+	uint32_t val2 = (uint32_t)(uintptr_t)timeout;
+
+	const timespec *pTimeout = nullptr;
+	if (timeout && (cmd == linux_FUTEX_WAIT ||
+					cmd == linux_FUTEX_WAIT_BITSET ||
+					cmd == linux_FUTEX_LOCK_PI ||
+					cmd == linux_FUTEX_LOCK_PI2))
+	{
+		pTimeout = vma->UserCheckAndGetAddress(timeout);
+		if (pTimeout == nullptr)
+			return -linux_EFAULT;
+
+		if (pTimeout->tv_sec < 0 ||
+			pTimeout->tv_nsec < 0 || pTimeout->tv_nsec > 999999999)
+			return -linux_EINVAL;
+	}
+
+	uint32_t *pUaddr2 = nullptr;
+	if (cmd == linux_FUTEX_REQUEUE ||
+		cmd == linux_FUTEX_CMP_REQUEUE ||
+		cmd == linux_FUTEX_WAKE_OP)
+	{
+		if ((uintptr_t)uaddr2 % sizeof(uint32_t))
+			return -linux_EINVAL;
+
+		pUaddr2 = vma->UserCheckAndGetAddress(uaddr2);
+		if (pUaddr2 == nullptr)
+			return -linux_EFAULT;
+	}
+
+	debug("uaddr=%#lx op=%d val=%u val3=%#x", uaddr, cmd, val, val3);
+
+	switch (cmd)
+	{
+	case linux_FUTEX_WAIT:
+		return ConvertErrnoToLinux(Futex::Wait(pUaddr, val,
+											   linux_FutexTimeout(pTimeout, false, false)));
+	case linux_FUTEX_WAIT_BITSET:
+		return ConvertErrnoToLinux(Futex::Wait(pUaddr, val,
+											   linux_FutexTimeout(pTimeout, true,
+																  op & linux_FUTEX_CLOCK_REALTIME),
+											   val3));
+	case linux_FUTEX_WAKE:
+		return ConvertErrnoToLinux(Futex::Wake(pUaddr, val));
+	case linux_FUTEX_WAKE_BITSET:
+		return ConvertErrnoToLinux(Futex::Wake(pUaddr, val, val3));
+	case linux_FUTEX_REQUEUE:
+		return ConvertErrnoToLinux(Futex::Requeue(pUaddr, pUaddr2, val, val2));
+	case linux_FUTEX_CMP_REQUEUE:
+		return ConvertErrnoToLinux(Futex::Requeue(pUaddr, pUaddr2, val, val2, &val3));
+	case linux_FUTEX_WAKE_OP:
+		return ConvertErrnoToLinux(Futex::WakeOp(pUaddr, pUaddr2, val, val2, val3));
+	case linux_FUTEX_LOCK_PI:
+		/* FUTEX_LOCK_PI always measures against CLOCK_REALTIME */
+		return ConvertErrnoToLinux(Futex::LockPI(pUaddr,
+												 linux_FutexTimeout(pTimeout, true, true)));
+	case linux_FUTEX_LOCK_PI2:
+		return ConvertErrnoToLinux(Futex::LockPI(pUaddr,
+												 linux_FutexTimeout(pTimeout, true,
+																	op & linux_FUTEX_CLOCK_REALTIME)));
+	case linux_FUTEX_TRYLOCK_PI:
+		return ConvertErrnoToLinux(Futex::TryLockPI(pUaddr));
+	case linux_FUTEX_UNLOCK_PI:
+		return ConvertErrnoToLinux(Futex::UnlockPI(pUaddr));
+	case linux_FUTEX_FD:
+	case linux_FUTEX_WAIT_REQUEUE_PI:
+	case linux_FUTEX_CMP_REQUEUE_PI:
+	{
+		fixme("futex op %d is stub", cmd);
+		return -linux_ENOSYS;
+	}
+	default:
+	{
+		debug("Invalid futex op %d", cmd);
+		return -linux_ENOSYS;
+	}
+	}
+}
+
 static int linux_sched_setaffinity(SysFrm *, pid_t pid, size_t cpusetsize, const cpu_set_t *mask)
 {
 	PCB *pcb = thisProcess;
@@ -2858,6 +3460,36 @@ static int linux_sched_getaffinity(SysFrm *, pid_t pid, size_t cpusetsize, cpu_s
 	return 0;
 }
 
+static int linux_epoll_create1(SysFrm *, int flags)
+{
+	if (flags & ~linux_EPOLL_CLOEXEC)
+		return -linux_EINVAL;
+
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	int nFlags = O_RDWR;
+	if (flags & linux_EPOLL_CLOEXEC)
+		nFlags |= O_CLOEXEC;
+
+	vfs::EventPoll *ep = new vfs::EventPoll;
+	int fd = fdt->AddAnonymousDescriptor(ep->GetFile(),
+										 vfs::FileDescriptorTable::Fildes::FD_EPOLL,
+										 nFlags, "anon_inode:[eventpoll]");
+	if (fd < 0)
+		ep->Put();
+	return ConvertErrnoToLinux(fd);
+}
+
+static int linux_epoll_create(SysFrm *sf, int size)
+{
+	/* The size is only a hint since 2.6.8 */
+	if (size <= 0)
+		return -linux_EINVAL;
+
+	return linux_epoll_create1(sf, 0);
+}
+
 static pid_t linux_set_tid_address(SysFrm *, int *tidptr)
 {
 	if (tidptr == nullptr)
@@ -2880,24 +3512,25 @@ __no_sanitize("undefined") static ssize_t linux_getdents64(SysFrm *,
 
 	PCB *pcb = thisProcess;
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
-	auto it = fdt->FileMap.find(fd);
-	if (it == fdt->FileMap.end())
+	auto it = fdt->GetDescriptor(fd);
+	if (it == nullptr)
 	{
 		debug("Invalid fd %d", fd);
 		return -linux_EBADF;
 	}
 
-	vfs::FileDescriptorTable::Fildes &fildes = it->second;
+	vfs::FileDescriptorTable::Fildes &fildes = *it;
 	if (!fildes.Node->IsDirectory())
 	{
 		debug("Not a directory");
 		return -ENOTDIR;
 	}
 
-	Memory::VirtualMemoryArea *vma = pcb->vma;
-	auto pDirp = vma->UserCheckAndGetAddress(dirp);
-	if (pDirp == nullptr)
-		return -linux_EFAULT;
+	/* Entries are built in a kernel buffer and copied out, the
+	   user buffer may span pages that aren't next to each other.
+	   A smaller buffer only means fewer entries per call. */
+	count = MIN(count, (size_t)(16 * PAGE_SIZE));
+	std::unique_ptr<uint8_t[]> pDirp(new uint8_t[count]);
 
 	/* Sanity checks */
 	static_assert(sizeof(kdirent) == sizeof(linux_dirent64));
@@ -2907,9 +3540,12 @@ __no_sanitize("undefined") static ssize_t linux_getdents64(SysFrm *,
 	static_assert(offsetof(kdirent, d_type) == offsetof(linux_dirent64, d_type));
 	static_assert(offsetof(kdirent, d_name) == offsetof(linux_dirent64, d_name));
 
+	vfs::FileDescriptorTable::OffsetGuard guard(fildes);
 	/* The structs are the same, no need for conversion. */
-	ssize_t ret = fildes.Node->ReadDir((struct kdirent *)pDirp, count, fildes.Offset,
+	ssize_t ret = fildes.Node->ReadDir((struct kdirent *)pDirp.get(), count, fildes.Offset,
 									   count / sizeof(kdirent));
+	if (ret > 0 && pcb->vma->CopyToUser(dirp, pDirp.get(), ret) < 0)
+		return -linux_EFAULT;
 
 	if (ret > 0)
 		fildes.Offset += ret;
@@ -2919,7 +3555,7 @@ __no_sanitize("undefined") static ssize_t linux_getdents64(SysFrm *,
 	{
 		for (size_t bpos = 0; bpos < ret;)
 		{
-			linux_dirent64 *d = (struct linux_dirent64 *)((char *)pDirp + bpos);
+			linux_dirent64 *d = (struct linux_dirent64 *)(pDirp.get() + bpos);
 			debug("%ld: d_ino:%d d_off:%d d_reclen:%d d_type:%d(%s) d_name:\"%s\"",
 				  bpos, d->d_ino, d->d_off, d->d_reclen, d->d_type,
 				  (d->d_type == DT_REG)	   ? "REG"
@@ -2950,33 +3586,26 @@ static int linux_clock_gettime(SysFrm *, clockid_t clockid, struct timespec *tp)
 	if (pTp == nullptr)
 		return -linux_EFAULT;
 
-	/* FIXME: This is not correct? */
+	/* Only reached when the vDSO falls back to the system call */
+	uint64_t time;
 	switch (clockid)
 	{
 	case linux_CLOCK_REALTIME:
+	case linux_CLOCK_REALTIME_COARSE:
 	{
-		uint64_t time = TimeManager->GetCounter();
-		pTp->tv_sec = time / Time::ConvertUnit(Time::Seconds);
-		pTp->tv_nsec = time / Time::ConvertUnit(Time::Nanoseconds);
-		debug("time=%ld sec=%ld nsec=%ld",
-			  time, pTp->tv_sec, pTp->tv_nsec);
+		time = VDSO::Realtime();
 		break;
 	}
 	case linux_CLOCK_MONOTONIC:
+	case linux_CLOCK_MONOTONIC_RAW:
+	case linux_CLOCK_MONOTONIC_COARSE:
+	case linux_CLOCK_BOOTTIME:
 	{
-		uint64_t time = TimeManager->GetCounter();
-		pTp->tv_sec = time / Time::ConvertUnit(Time::Seconds);
-		pTp->tv_nsec = time / Time::ConvertUnit(Time::Nanoseconds);
-		debug("time=%ld sec=%ld nsec=%ld",
-			  time, pTp->tv_sec, pTp->tv_nsec);
+		time = VDSO::Monotonic();
 		break;
 	}
 	case linux_CLOCK_PROCESS_CPUTIME_ID:
 	case linux_CLOCK_THREAD_CPUTIME_ID:
-	case linux_CLOCK_MONOTONIC_RAW:
-	case linux_CLOCK_REALTIME_COARSE:
-	case linux_CLOCK_MONOTONIC_COARSE:
-	case linux_CLOCK_BOOTTIME:
 	case linux_CLOCK_REALTIME_ALARM:
 	case linux_CLOCK_BOOTTIME_ALARM:
 	case linux_CLOCK_SGI_CYCLE:
@@ -2991,6 +3620,78 @@ static int linux_clock_gettime(SysFrm *, clockid_t clockid, struct timespec *tp)
 		return -linux_EINVAL;
 	}
 	}
+
+	pTp->tv_sec = time / 1000000000;
+	pTp->tv_nsec = time % 1000000000;
+	debug("time=%ld sec=%ld nsec=%ld",
+		  time, pTp->tv_sec, pTp->tv_nsec);
+	return 0;
+}
+
+static int linux_gettimeofday(SysFrm *, struct timeval *tv, struct timezone *tz)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	if (tv)
+	{
+		timeval *pTv = vma->UserCheckAndGetAddress(tv);
+		if (pTv == nullptr)
+			return -linux_EFAULT;
+
+		uint64_t time = VDSO::Realtime();
+		pTv->tv_sec = time / 1000000000;
+		pTv->tv_usec = (time % 1000000000) / 1000;
+	}
+
+	if (tz)
+	{
+		struct timezone *pTz = vma->UserCheckAndGetAddress(tz);
+		if (pTz == nullptr)
+			return -linux_EFAULT;
+
+		pTz->tz_minuteswest = 0;
+		pTz->tz_dsttime = 0;
+	}
+	return 0;
+}
+
+static __kernel_old_time_t linux_time(SysFrm *, __kernel_old_time_t *tloc)
+{
+	__kernel_old_time_t time = VDSO::Realtime() / 1000000000;
+	if (tloc)
+	{
+		PCB *pcb = thisProcess;
+		__kernel_old_time_t *pTloc = pcb->vma->UserCheckAndGetAddress(tloc);
+		if (pTloc == nullptr)
+			return -linux_EFAULT;
+		*pTloc = time;
+	}
+	return time;
+}
+
+static int linux_getcpu(SysFrm *, unsigned int *cpu, unsigned int *node,
+						void *tcache)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	UNUSED(tcache);
+
+	if (cpu)
+	{
+		unsigned int *pCpu = vma->UserCheckAndGetAddress(cpu);
+		if (pCpu == nullptr)
+			return -linux_EFAULT;
+		*pCpu = GetCurrentCPU()->ID;
+	}
+
+	if (node)
+	{
+		unsigned int *pNode = vma->UserCheckAndGetAddress(node);
+		if (pNode == nullptr)
+			return -linux_EFAULT;
+		*pNode = 0;
+	}
 	return 0;
 }
 
@@ -3052,6 +3753,113 @@ static __noreturn void linux_exit_group(SysFrm *sf, int status)
 	linux_exit(sf, status);
 }
 
+static int linux_EventPollWait(int epfd, struct epoll_event *events,
+							   int maxevents, int timeout)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	if (maxevents <= 0 ||
+		size_t(maxevents) > INT_MAX / sizeof(struct epoll_event))
+		return -linux_EINVAL;
+
+	auto it = fdt->GetDescriptor(epfd);
+	if (it == nullptr)
+		return -linux_EBADF;
+
+	vfs::EventPoll *ep = vfs::EventPoll::FromFile(it->Node);
+	if (ep == nullptr)
+		return -linux_EINVAL;
+
+	std::unique_ptr<vfs::EventPoll::Event[]> ready(new vfs::EventPoll::Event[maxevents]);
+
+	/* Another thread may close epfd while we sleep */
+	ep->Get();
+	int ret = ep->Wait(ready.get(), maxevents, timeout);
+	ep->Put();
+
+	if (ret <= 0)
+		return ConvertErrnoToLinux(ret);
+
+	/* The array may span pages that aren't next to each other */
+	std::unique_ptr<struct epoll_event[]> pEvents(new struct epoll_event[ret]);
+	for (int i = 0; i < ret; i++)
+	{
+		pEvents[i].events = ready[i].Events;
+		pEvents[i].data = ready[i].Data;
+	}
+
+	if (vma->CopyToUser(events, pEvents.get(), sizeof(struct epoll_event) * ret) < 0)
+		return -linux_EFAULT;
+	return ret;
+}
+
+static int linux_epoll_wait(SysFrm *, int epfd, struct epoll_event *events,
+							int maxevents, int timeout)
+{
+	return linux_EventPollWait(epfd, events, maxevents, timeout);
+}
+
+static int linux_epoll_ctl(SysFrm *, int epfd, int op, int fd,
+						   struct epoll_event *event)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	auto epIt = fdt->GetDescriptor(epfd);
+	auto fdIt = fdt->GetDescriptor(fd);
+	if (epIt == nullptr || fdIt == nullptr)
+		return -linux_EBADF;
+
+	vfs::EventPoll *ep = vfs::EventPoll::FromFile(epIt->Node);
+	if (ep == nullptr || epfd == fd)
+		return -linux_EINVAL;
+
+	/* Regular files and directories are always ready */
+	FileNode *target = fdIt->Node;
+	if (target->IsRegularFile() || target->IsDirectory())
+		return -linux_EPERM;
+
+	int nOp;
+	switch (op)
+	{
+	case linux_EPOLL_CTL_ADD:
+		nOp = EPOLL_CTL_ADD;
+		break;
+	case linux_EPOLL_CTL_DEL:
+		nOp = EPOLL_CTL_DEL;
+		break;
+	case linux_EPOLL_CTL_MOD:
+		nOp = EPOLL_CTL_MOD;
+		break;
+	default:
+		return -linux_EINVAL;
+	}
+
+	uint32_t nEvents = 0;
+	uint64_t data = 0;
+	if (nOp != EPOLL_CTL_DEL)
+	{
+		auto pEvent = vma->UserCheckAndGetAddress(event);
+		if (pEvent == nullptr)
+			return -linux_EFAULT;
+
+		/* The event bits are the same as ours */
+		nEvents = pEvent->events;
+		data = pEvent->data;
+	}
+
+	debug("epfd=%d op=%d fd=%d events=%#x data=%#lx",
+		  epfd, op, fd, nEvents, data);
+
+	ep->Get();
+	int ret = ep->Control(nOp, fd, fdIt.get(), nEvents, data);
+	ep->Put();
+	return ConvertErrnoToLinux(ret);
+}
+
 static int linux_tgkill(SysFrm *sf, pid_t tgid, pid_t tid, int sig)
 {
 	Tasking::TCB *tcb = thisProcess->GetThread(tid);
@@ -3083,11 +3891,12 @@ static int linux_openat(SysFrm *, int dirfd, const char *pathname, int flags, mo
 {
 	PCB *pcb = thisProcess;
 	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
-	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	const char *pPathname = vma->UserCheckAndGetAddress(pathname);
-	if (pPathname == nullptr)
-		return -linux_EFAULT;
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(pathname, Path);
+	if (err < 0)
+		return err;
+	const char *pPathname = Path.get();
 
 	debug("dirfd=%d pathname=%s flags=%#x mode=%#x",
 		  dirfd, pPathname, flags, mode);
@@ -3122,9 +3931,14 @@ static long linux_newfstatat(SysFrm *, int dirfd, const char *pathname,
 	if (flag)
 		fixme("flag %#x is stub", flag);
 
-	const char *pPathname = vma->UserCheckAndGetAddress(pathname);
+	std::unique_ptr<char[]> Path;
+	int err = linux_ImportPath(pathname, Path);
+	if (err < 0)
+		return err;
+	const char *pPathname = Path.get();
+
 	struct linux_kstat *pStatbuf = vma->UserCheckAndGetAddress(statbuf);
-	if (pPathname == nullptr || pStatbuf == nullptr)
+	if (pStatbuf == nullptr)
 		return -linux_EFAULT;
 
 	debug("\"%s\" %#lx %#lx", pPathname, pathname, statbuf);
@@ -3155,11 +3969,11 @@ static long linux_newfstatat(SysFrm *, int dirfd, const char *pathname,
 	default:
 	{
 		debug("dirfd is %d for \"%s\"", dirfd, pPathname);
-		auto it = fdt->FileMap.find(dirfd);
-		if (it == fdt->FileMap.end())
+		auto it = fdt->GetDescriptor(dirfd);
+		if (it == nullptr)
 			ReturnLogError(-linux_EBADF, "Invalid fd %d", dirfd);
 
-		vfs::FileDescriptorTable::Fildes &fildes = it->second;
+		vfs::FileDescriptorTable::Fildes &fildes = *it;
 		FileNode *node = fs->GetByPath(pPathname, fildes.Node);
 		debug("node: %s", node->GetPath().c_str());
 		if (!node)
@@ -3173,21 +3987,333 @@ static long linux_newfstatat(SysFrm *, int dirfd, const char *pathname,
 	}
 }
 
-static int linux_pipe2(SysFrm *sf, int pipefd[2], int flags)
+static int linux_pselect6(SysFrm *, int nfds, struct linux_fd_set *readfds,
+						  struct linux_fd_set *writefds,
+						  struct linux_fd_set *exceptfds,
+						  struct timespec *timeout, void *sig)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+
+	struct timespec *pTimeout = nullptr;
+	if (timeout)
+	{
+		pTimeout = vma->UserCheckAndGetAddress(timeout);
+		if (pTimeout == nullptr)
+			return -linux_EFAULT;
+	}
+
+	int msTimeout;
+	int ret = linux_PollTimeout(pTimeout, &msTimeout);
+	if (ret < 0)
+		return ret;
+
+	/* The last argument points to { const sigset_t *ss; size_t ss_len; } */
+	const sigset_t *sigmask = nullptr;
+	size_t sigsetsize = 0;
+	if (sig)
+	{
+		struct
+		{
+			const sigset_t *ss;
+			size_t ss_len;
+		} *pSig = (decltype(pSig))vma->UserCheckAndGetAddress(sig, 2 * sizeof(void *));
+		if (pSig == nullptr)
+			return -linux_EFAULT;
+
+		sigmask = pSig->ss;
+		sigsetsize = pSig->ss_len;
+	}
+
+	sigset_t oldMask;
+	ret = linux_SetWaitMask(sigmask, sigsetsize, &oldMask);
+	if (ret < 0)
+		return ret;
+
+	uint64_t start = TimeManager->GetNanosecondsSinceClassCreation();
+	ret = linux_DoSelect(nfds, readfds, writefds, exceptfds, msTimeout);
+	thisThread->Signals.SetMask(oldMask);
+
+	if (pTimeout)
+	{
+		uint64_t slept = TimeManager->GetNanosecondsSinceClassCreation() - start;
+		uint64_t total = uint64_t(pTimeout->tv_sec) * 1000000000 + pTimeout->tv_nsec;
+		uint64_t left = slept >= total ? 0 : total - slept;
+		pTimeout->tv_sec = left / 1000000000;
+		pTimeout->tv_nsec = left % 1000000000;
+	}
+	return ret;
+}
+
+static int linux_ppoll(SysFrm *, struct pollfd *fds, nfds_t nfds,
+					   const struct timespec *tmo_p,
+					   const sigset_t *sigmask, size_t sigsetsize)
+{
+	Memory::VirtualMemoryArea *vma = thisProcess->vma;
+
+	const struct timespec *pTimeout = nullptr;
+	if (tmo_p)
+	{
+		pTimeout = vma->UserCheckAndGetAddress(tmo_p);
+		if (pTimeout == nullptr)
+			return -linux_EFAULT;
+	}
+
+	int msTimeout;
+	int ret = linux_PollTimeout(pTimeout, &msTimeout);
+	if (ret < 0)
+		return ret;
+
+	sigset_t oldMask;
+	ret = linux_SetWaitMask(sigmask, sigsetsize, &oldMask);
+	if (ret < 0)
+		return ret;
+
+	ret = linux_DoPoll(fds, nfds, msTimeout);
+	thisThread->Signals.SetMask(oldMask);
+	return ret;
+}
+
+static vfs::Pipe *linux_GetPipe(vfs::FileDescriptorTable::Fildes &fd,
+								bool *ReadEnd = nullptr)
+{
+	if (fd.Type != vfs::FileDescriptorTable::Fildes::FD_PIPE)
+		return nullptr;
+	return vfs::Pipe::FromFile(fd.Node, ReadEnd);
+}
+
+static ssize_t linux_splice(SysFrm *, int fd_in, off_t *off_in, int fd_out,
+							off_t *off_out, size_t len, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	auto itIn = fdt->GetDescriptor(fd_in);
+	auto itOut = fdt->GetDescriptor(fd_out);
+	if (itIn == nullptr || itOut == nullptr)
+		return -linux_EBADF;
+
+	if (len == 0)
+		return 0;
+
+	vfs::FileDescriptorTable::Fildes &In = *itIn;
+	vfs::FileDescriptorTable::Fildes &Out = *itOut;
+
+	bool InRead, OutRead;
+	vfs::Pipe *pIn = linux_GetPipe(In, &InRead);
+	vfs::Pipe *pOut = linux_GetPipe(Out, &OutRead);
+
+	if ((pIn && !InRead) || (pOut && OutRead))
+		return -linux_EBADF;
+
+	if ((pIn && off_in) || (pOut && off_out))
+		return -linux_ESPIPE;
+
+	bool NonBlocking = flags & linux_SPLICE_F_NONBLOCK;
+
+	if (pIn && pOut)
+	{
+		pIn->Get();
+		pOut->Get();
+		ssize_t ret = pIn->Splice(pOut, len, NonBlocking);
+		pOut->Put();
+		pIn->Put();
+		return ConvertErrnoToLinux(ret);
+	}
+
+	if (pIn == nullptr && pOut == nullptr)
+		return -linux_EINVAL;
+
+	/* One side is a file, it uses the given offset or the descriptor's own */
+	off_t *Off = pIn ? off_out : off_in;
+	vfs::FileDescriptorTable::Fildes &File = pIn ? Out : In;
+	if (File.Type != vfs::FileDescriptorTable::Fildes::FD_INODE)
+		return -linux_EINVAL;
+
+	off_t *pOff = nullptr;
+	if (Off)
+	{
+		pOff = vma->UserCheckAndGetAddress(Off);
+		if (pOff == nullptr)
+			return -linux_EFAULT;
+	}
+
+	vfs::FileDescriptorTable::OffsetGuard guard(File);
+	off_t Offset = pOff ? *pOff : File.Offset;
+	if (Offset < 0)
+		return -linux_EINVAL;
+
+	vfs::Pipe *p = pIn ? pIn : pOut;
+	p->Get();
+	ssize_t ret;
+	if (pIn)
+		ret = pIn->SpliceTo(File.Node, Offset, len, NonBlocking);
+	else
+		ret = pOut->SpliceFrom(File.Node, Offset, len, NonBlocking);
+	p->Put();
+
+	if (pOff)
+		*pOff = Offset;
+	else
+		File.Offset = Offset;
+	return ConvertErrnoToLinux(ret);
+}
+
+static ssize_t linux_tee(SysFrm *, int fd_in, int fd_out,
+						 size_t len, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	auto itIn = fdt->GetDescriptor(fd_in);
+	auto itOut = fdt->GetDescriptor(fd_out);
+	if (itIn == nullptr || itOut == nullptr)
+		return -linux_EBADF;
+
+	bool InRead, OutRead;
+	vfs::Pipe *pIn = linux_GetPipe(*itIn, &InRead);
+	vfs::Pipe *pOut = linux_GetPipe(*itOut, &OutRead);
+	if (pIn == nullptr || pOut == nullptr)
+		return -linux_EINVAL;
+
+	if (!InRead || OutRead)
+		return -linux_EBADF;
+
+	if (len == 0)
+		return 0;
+
+	pIn->Get();
+	pOut->Get();
+	ssize_t ret = pIn->Tee(pOut, len, flags & linux_SPLICE_F_NONBLOCK);
+	pOut->Put();
+	pIn->Put();
+	return ConvertErrnoToLinux(ret);
+}
+
+static ssize_t linux_vmsplice(SysFrm *, int fd, const struct iovec *iov,
+							  unsigned long nr_segs, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	auto it = fdt->GetDescriptor(fd);
+	if (it == nullptr)
+		return -linux_EBADF;
+
+	bool ReadEnd;
+	vfs::Pipe *p = linux_GetPipe(*it, &ReadEnd);
+	if (p == nullptr)
+		return -linux_EBADF;
+
+	if (nr_segs > linux_IOV_MAX)
+		return -linux_EINVAL;
+
+	/* Reading from the pipe writes to user memory */
+	struct kiovec Fast[linux_UIO_FASTIOV];
+	std::unique_ptr<struct kiovec[]> Slow;
+	struct kiovec *Vector;
+	int cnt = linux_ImportIovec(iov, (int)nr_segs, ReadEnd, Fast, Slow, &Vector);
+	if (cnt < 0)
+		return cnt;
+
+	/* User pages can't be pinned yet, so the data is
+	   copied into (or out of) the pipe pages once */
+	if (flags & linux_SPLICE_F_GIFT)
+	{
+		debug("SPLICE_F_GIFT ignored");
+	}
+
+	bool NonBlocking = flags & linux_SPLICE_F_NONBLOCK;
+	ssize_t Total = 0;
+	p->Get();
+	for (int i = 0; i < cnt; i++)
+	{
+		ssize_t n = ReadEnd ? p->Read(Vector[i].iov_base, Vector[i].iov_len, NonBlocking)
+							: p->Write(Vector[i].iov_base, Vector[i].iov_len, NonBlocking);
+		if (n < 0)
+		{
+			if (Total == 0)
+				Total = n;
+			break;
+		}
+
+		Total += n;
+		if ((size_t)n < Vector[i].iov_len)
+			break;
+
+		/* Don't block after the first segment */
+		NonBlocking = true;
+	}
+	p->Put();
+
+	return ConvertErrnoToLinux(Total);
+}
+
+static int linux_epoll_pwait(SysFrm *, int epfd, struct epoll_event *events,
+							 int maxevents, int timeout,
+							 const sigset_t *sigmask, size_t sigsetsize)
 {
-	if (flags == 0)
-		return linux_pipe(sf, pipefd);
+	sigset_t oldMask;
+	int ret = linux_SetWaitMask(sigmask, sigsetsize, &oldMask);
+	if (ret < 0)
+		return ret;
+
+	ret = linux_EventPollWait(epfd, events, maxevents, timeout);
+	thisThread->Signals.SetMask(oldMask);
+	return ret;
+}
+
+static int linux_epoll_pwait2(SysFrm *sf, int epfd, struct epoll_event *events,
+							  int maxevents, const struct timespec *timeout,
+							  const sigset_t *sigmask, size_t sigsetsize)
+{
+	const struct timespec *pTimeout = nullptr;
+	if (timeout)
+	{
+		pTimeout = thisProcess->vma->UserCheckAndGetAddress(timeout);
+		if (pTimeout == nullptr)
+			return -linux_EFAULT;
+	}
+
+	int msTimeout;
+	int ret = linux_PollTimeout(pTimeout, &msTimeout);
+	if (ret < 0)
+		return ret;
+
+	return linux_epoll_pwait(sf, epfd, events, maxevents, msTimeout,
+							 sigmask, sigsetsize);
+}
 
+static int linux_pipe2(SysFrm *, int pipefd[2], int flags)
+{
 	PCB *pcb = thisProcess;
 	Memory::VirtualMemoryArea *vma = pcb->vma;
 
-	int *pPipefd = vma->UserCheckAndGetAddress(pipefd);
+	int *pPipefd = vma->UserCheckAndGetAddress(pipefd, sizeof(int) * 2);
 	if (pPipefd == nullptr)
 		return -linux_EFAULT;
 
-	debug("pipefd=%#lx", pPipefd);
-	fixme("pipefd=[%d, %d] flags=%#x", pPipefd[0], pPipefd[1], flags);
-	return -linux_ENOSYS;
+	debug("pipefd=%#lx flags=%#x", pPipefd, flags);
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	return ConvertErrnoToLinux(fdt->usr_pipe(pPipefd, flags));
+}
+
+static ssize_t linux_preadv(SysFrm *, int fd, const struct iovec *iov, int iovcnt,
+							unsigned long pos_l, unsigned long pos_h)
+{
+	off_t offset = linux_PosFromHiLo(pos_l, pos_h);
+	if (offset < 0)
+		return -linux_EINVAL;
+	return linux_DoVector(fd, iov, iovcnt, offset, 0, false);
+}
+
+static ssize_t linux_pwritev(SysFrm *, int fd, const struct iovec *iov, int iovcnt,
+							 unsigned long pos_l, unsigned long pos_h)
+{
+	off_t offset = linux_PosFromHiLo(pos_l, pos_h);
+	if (offset < 0)
+		return -linux_EINVAL;
+	return linux_DoVector(fd, iov, iovcnt, offset, 0, true);
 }
 
 static int linux_prlimit64(SysFrm *, pid_t pid, int resource,
@@ -3338,17 +4464,20 @@ static ssize_t linux_getrandom(SysFrm *, void *buf,
 		return -linux_EINVAL;
 	}
 
-	auto pBuf = vma->UserCheckAndGetAddress(buf, buflen);
-	if (pBuf == nullptr)
-		return -linux_EFAULT;
-
 	if (flags & linux_GRND_RANDOM)
 	{
-		uint16_t random;
-		for (size_t i = 0; i < buflen; i++)
+		/* Filled in chunks, the buffer may span pages
+		   that aren't next to each other */
+		uint8_t chunk[256];
+		for (size_t done = 0; done < buflen;)
 		{
-			random = Random::rand16();
-			((uint8_t *)pBuf)[i] = uint8_t(random & 0xFF);
+			size_t n = MIN(buflen - done, sizeof(chunk));
+			for (size_t i = 0; i < n; i++)
+				chunk[i] = uint8_t(Random::rand16() & 0xFF);
+
+			if (vma->CopyToUser((uint8_t *)buf + done, chunk, n) < 0)
+				return done ? (ssize_t)done : -linux_EFAULT;
+			done += n;
 		}
 		return buflen;
 	}
@@ -3356,6 +4485,141 @@ static ssize_t linux_getrandom(SysFrm *, void *buf,
 	return 0;
 }
 
+static ssize_t linux_copy_file_range(SysFrm *, int fd_in, off_t *off_in,
+									 int fd_out, off_t *off_out,
+									 size_t len, unsigned int flags)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	off_t *pOffIn = nullptr;
+	if (off_in)
+	{
+		pOffIn = vma->UserCheckAndGetAddress(off_in);
+		if (pOffIn == nullptr)
+			return -linux_EFAULT;
+	}
+
+	off_t *pOffOut = nullptr;
+	if (off_out)
+	{
+		pOffOut = vma->UserCheckAndGetAddress(off_out);
+		if (pOffOut == nullptr)
+			return -linux_EFAULT;
+	}
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	return ConvertErrnoToLinux(fdt->usr_copy_file_range(fd_in, pOffIn, fd_out,
+														pOffOut, len, flags));
+}
+
+static ssize_t linux_preadv2(SysFrm *, int fd, const struct iovec *iov, int iovcnt,
+							 unsigned long pos_l, unsigned long pos_h, int flags)
+{
+	off_t offset = linux_PosFromHiLo(pos_l, pos_h);
+	if (offset < -1)
+		return -linux_EINVAL;
+	return linux_DoVector(fd, iov, iovcnt, offset, flags, false);
+}
+
+static ssize_t linux_pwritev2(SysFrm *, int fd, const struct iovec *iov, int iovcnt,
+							  unsigned long pos_l, unsigned long pos_h, int flags)
+{
+	off_t offset = linux_PosFromHiLo(pos_l, pos_h);
+	if (offset < -1)
+		return -linux_EINVAL;
+	return linux_DoVector(fd, iov, iovcnt, offset, flags, true);
+}
+
+static intptr_t linux_ConvertRingResult(intptr_t Result)
+{
+	return ConvertErrnoToLinux(Result);
+}
+
+static int linux_io_uring_setup(SysFrm *, uint32_t entries, struct io_uring_params *p)
+{
+	PCB *pcb = thisProcess;
+	Memory::VirtualMemoryArea *vma = pcb->vma;
+
+	struct io_uring_params *pParams = vma->UserCheckAndGetAddress(p);
+	if (pParams == nullptr)
+		return -linux_EFAULT;
+
+	foreach (auto r in pParams->resv)
+	{
+		if (r != 0)
+			return -linux_EINVAL;
+	}
+
+	/* No SQ polling thread, no attached work queues */
+	if (pParams->flags & ~(IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP))
+		return -linux_EINVAL;
+
+	bool Clamp = pParams->flags & IORING_SETUP_CLAMP;
+	if (entries == 0)
+		return -linux_EINVAL;
+	if (entries > IORING_MAX_ENTRIES)
+	{
+		if (!Clamp)
+			return -linux_EINVAL;
+		entries = IORING_MAX_ENTRIES;
+	}
+
+	if (pParams->flags & IORING_SETUP_CQSIZE)
+	{
+		if (pParams->cq_entries == 0)
+			return -linux_EINVAL;
+		if (pParams->cq_entries > IORING_MAX_CQ_ENTRIES)
+		{
+			if (!Clamp)
+				return -linux_EINVAL;
+			pParams->cq_entries = IORING_MAX_CQ_ENTRIES;
+		}
+		if (pParams->cq_entries < entries)
+			return -linux_EINVAL;
+	}
+
+	vfs::IoRing *ring = new vfs::IoRing(entries, pParams);
+	ring->ConvertResult = linux_ConvertRingResult;
+
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+	int fd = fdt->AddAnonymousDescriptor(ring->GetFile(),
+										 vfs::FileDescriptorTable::Fildes::FD_URING,
+										 O_RDWR | O_CLOEXEC, "anon_inode:[io_uring]");
+	if (fd < 0)
+		ring->Put();
+	return ConvertErrnoToLinux(fd);
+}
+
+static int linux_io_uring_enter(SysFrm *, unsigned int fd, uint32_t to_submit,
+								uint32_t min_complete, uint32_t flags,
+								const sigset_t *sig, size_t sigsz)
+{
+	PCB *pcb = thisProcess;
+	vfs::FileDescriptorTable *fdt = pcb->FileDescriptors;
+
+	auto it = fdt->GetDescriptor(fd);
+	if (it == nullptr)
+		return -linux_EBADF;
+
+	if (it->Type != vfs::FileDescriptorTable::Fildes::FD_URING)
+		return -linux_EOPNOTSUPP;
+
+	vfs::IoRing *ring = vfs::IoRing::FromFile(it->Node);
+
+	sigset_t oldMask;
+	int ret = linux_SetWaitMask(sig, sigsz, &oldMask);
+	if (ret < 0)
+		return ret;
+
+	ring->Get();
+	ret = ring->Enter(to_submit, min_complete, flags);
+	ring->Put();
+
+	thisThread->Signals.SetMask(oldMask);
+	return ConvertErrnoToLinux(ret);
+}
+
 static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_read] = {"read", (void *)linux_read},
 	[__NR_amd64_write] = {"write", (void *)linux_write},
@@ -3364,7 +4628,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_stat] = {"stat", (void *)linux_stat},
 	[__NR_amd64_fstat] = {"fstat", (void *)linux_fstat},
 	[__NR_amd64_lstat] = {"lstat", (void *)linux_lstat},
-	[__NR_amd64_poll] = {"poll", (void *)nullptr},
+	[__NR_amd64_poll] = {"poll", (void *)linux_poll},
 	[__NR_amd64_lseek] = {"lseek", (void *)linux_lseek},
 	[__NR_amd64_mmap] = {"mmap", (void *)linux_mmap},
 	[__NR_amd64_mprotect] = {"mprotect", (void *)linux_mprotect},
@@ -3380,7 +4644,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_writev] = {"writev", (void *)linux_writev},
 	[__NR_amd64_access] = {"access", (void *)linux_access},
 	[__NR_amd64_pipe] = {"pipe", (void *)linux_pipe},
-	[__NR_amd64_select] = {"select", (void *)nullptr},
+	[__NR_amd64_select] = {"select", (void *)linux_select},
 	[__NR_amd64_sched_yield] = {"sched_yield", (void *)nullptr},
 	[__NR_amd64_mremap] = {"mremap", (void *)nullptr},
 	[__NR_amd64_msync] = {"msync", (void *)nullptr},
@@ -3397,7 +4661,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_alarm] = {"alarm", (void *)nullptr},
 	[__NR_amd64_setitimer] = {"setitimer", (void *)linux_setitimer},
 	[__NR_amd64_getpid] = {"getpid", (void *)linux_getpid},
-	[__NR_amd64_sendfile] = {"sendfile", (void *)nullptr},
+	[__NR_amd64_sendfile] = {"sendfile", (void *)linux_sendfile},
 	[__NR_amd64_socket] = {"socket", (void *)nullptr},
 	[__NR_amd64_connect] = {"connect", (void *)nullptr},
 	[__NR_amd64_accept] = {"accept", (void *)nullptr},
@@ -3431,8 +4695,8 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_msgctl] = {"msgctl", (void *)nullptr},
 	[__NR_amd64_fcntl] = {"fcntl", (void *)linux_fcntl},
 	[__NR_amd64_flock] = {"flock", (void *)nullptr},
-	[__NR_amd64_fsync] = {"fsync", (void *)nullptr},
-	[__NR_amd64_fdatasync] = {"fdatasync", (void *)nullptr},
+	[__NR_amd64_fsync] = {"fsync", (void *)linux_fsync},
+	[__NR_amd64_fdatasync] = {"fdatasync", (void *)linux_fdatasync},
 	[__NR_amd64_truncate] = {"truncate", (void *)nullptr},
 	[__NR_amd64_ftruncate] = {"ftruncate", (void *)nullptr},
 	[__NR_amd64_getdents] = {"getdents", (void *)nullptr},
@@ -3443,7 +4707,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_mkdir] = {"mkdir", (void *)linux_mkdir},
 	[__NR_amd64_rmdir] = {"rmdir", (void *)nullptr},
 	[__NR_amd64_creat] = {"creat", (void *)linux_creat},
-	[__NR_amd64_link] = {"link", (void *)nullptr},
+	[__NR_amd64_link] = {"link", (void *)linux_link},
 	[__NR_amd64_unlink] = {"unlink", (void *)nullptr},
 	[__NR_amd64_symlink] = {"symlink", (void *)nullptr},
 	[__NR_amd64_readlink] = {"readlink", (void *)linux_readlink},
@@ -3453,7 +4717,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_fchown] = {"fchown", (void *)nullptr},
 	[__NR_amd64_lchown] = {"lchown", (void *)nullptr},
 	[__NR_amd64_umask] = {"umask", (void *)linux_umask},
-	[__NR_amd64_gettimeofday] = {"gettimeofday", (void *)nullptr},
+	[__NR_amd64_gettimeofday] = {"gettimeofday", (void *)linux_gettimeofday},
 	[__NR_amd64_getrlimit] = {"getrlimit", (void *)nullptr},
 	[__NR_amd64_getrusage] = {"getrusage", (void *)linux_getrusage},
 	[__NR_amd64_sysinfo] = {"sysinfo", (void *)nullptr},
@@ -3519,7 +4783,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_adjtimex] = {"adjtimex", (void *)nullptr},
 	[__NR_amd64_setrlimit] = {"setrlimit", (void *)nullptr},
 	[__NR_amd64_chroot] = {"chroot", (void *)nullptr},
-	[__NR_amd64_sync] = {"sync", (void *)nullptr},
+	[__NR_amd64_sync] = {"sync", (void *)linux_sync},
 	[__NR_amd64_acct] = {"acct", (void *)nullptr},
 	[__NR_amd64_settimeofday] = {"settimeofday", (void *)nullptr},
 	[__NR_amd64_mount] = {"mount", (void *)nullptr},
@@ -3558,8 +4822,8 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_lremovexattr] = {"lremovexattr", (void *)nullptr},
 	[__NR_amd64_fremovexattr] = {"fremovexattr", (void *)nullptr},
 	[__NR_amd64_tkill] = {"tkill", (void *)linux_tkill},
-	[__NR_amd64_time] = {"time", (void *)nullptr},
-	[__NR_amd64_futex] = {"futex", (void *)nullptr},
+	[__NR_amd64_time] = {"time", (void *)linux_time},
+	[__NR_amd64_futex] = {"futex", (void *)linux_futex},
 	[__NR_amd64_sched_setaffinity] = {"sched_setaffinity", (void *)linux_sched_setaffinity},
 	[__NR_amd64_sched_getaffinity] = {"sched_getaffinity", (void *)linux_sched_getaffinity},
 	[__NR_amd64_set_thread_area] = {"set_thread_area", (void *)nullptr},
@@ -3570,7 +4834,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_io_cancel] = {"io_cancel", (void *)nullptr},
 	[__NR_amd64_get_thread_area] = {"get_thread_area", (void *)nullptr},
 	[__NR_amd64_lookup_dcookie] = {"lookup_dcookie", (void *)nullptr},
-	[__NR_amd64_epoll_create] = {"epoll_create", (void *)nullptr},
+	[__NR_amd64_epoll_create] = {"epoll_create", (void *)linux_epoll_create},
 	[__NR_amd64_epoll_ctl_old] = {"epoll_ctl_old", (void *)nullptr},
 	[__NR_amd64_epoll_wait_old] = {"epoll_wait_old", (void *)nullptr},
 	[__NR_amd64_remap_file_pages] = {"remap_file_pages", (void *)nullptr},
@@ -3589,8 +4853,8 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_clock_getres] = {"clock_getres", (void *)nullptr},
 	[__NR_amd64_clock_nanosleep] = {"clock_nanosleep", (void *)linux_clock_nanosleep},
 	[__NR_amd64_exit_group] = {"exit_group", (void *)linux_exit_group},
-	[__NR_amd64_epoll_wait] = {"epoll_wait", (void *)nullptr},
-	[__NR_amd64_epoll_ctl] = {"epoll_ctl", (void *)nullptr},
+	[__NR_amd64_epoll_wait] = {"epoll_wait", (void *)linux_epoll_wait},
+	[__NR_amd64_epoll_ctl] = {"epoll_ctl", (void *)linux_epoll_ctl},
 	[__NR_amd64_tgkill] = {"tgkill", (void *)linux_tgkill},
 	[__NR_amd64_utimes] = {"utimes", (void *)nullptr},
 	[__NR_amd64_vserver] = {"vserver", (void *)nullptr},
@@ -3627,18 +4891,18 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_readlinkat] = {"readlinkat", (void *)nullptr},
 	[__NR_amd64_fchmodat] = {"fchmodat", (void *)nullptr},
 	[__NR_amd64_faccessat] = {"faccessat", (void *)nullptr},
-	[__NR_amd64_pselect6] = {"pselect6", (void *)nullptr},
-	[__NR_amd64_ppoll] = {"ppoll", (void *)nullptr},
+	[__NR_amd64_pselect6] = {"pselect6", (void *)linux_pselect6},
+	[__NR_amd64_ppoll] = {"ppoll", (void *)linux_ppoll},
 	[__NR_amd64_unshare] = {"unshare", (void *)nullptr},
 	[__NR_amd64_set_robust_list] = {"set_robust_list", (void *)nullptr},
 	[__NR_amd64_get_robust_list] = {"get_robust_list", (void *)nullptr},
-	[__NR_amd64_splice] = {"splice", (void *)nullptr},
-	[__NR_amd64_tee] = {"tee", (void *)nullptr},
+	[__NR_amd64_splice] = {"splice", (void *)linux_splice},
+	[__NR_amd64_tee] = {"tee", (void *)linux_tee},
 	[__NR_amd64_sync_file_range] = {"sync_file_range", (void *)nullptr},
-	[__NR_amd64_vmsplice] = {"vmsplice", (void *)nullptr},
+	[__NR_amd64_vmsplice] = {"vmsplice", (void *)linux_vmsplice},
 	[__NR_amd64_move_pages] = {"move_pages", (void *)nullptr},
 	[__NR_amd64_utimensat] = {"utimensat", (void *)nullptr},
-	[__NR_amd64_epoll_pwait] = {"epoll_pwait", (void *)nullptr},
+	[__NR_amd64_epoll_pwait] = {"epoll_pwait", (void *)linux_epoll_pwait},
 	[__NR_amd64_signalfd] = {"signalfd", (void *)nullptr},
 	[__NR_amd64_timerfd_create] = {"timerfd_create", (void *)nullptr},
 	[__NR_amd64_eventfd] = {"eventfd", (void *)nullptr},
@@ -3648,12 +4912,12 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_accept4] = {"accept4", (void *)nullptr},
 	[__NR_amd64_signalfd4] = {"signalfd4", (void *)nullptr},
 	[__NR_amd64_eventfd2] = {"eventfd2", (void *)nullptr},
-	[__NR_amd64_epoll_create1] = {"epoll_create1", (void *)nullptr},
+	[__NR_amd64_epoll_create1] = {"epoll_create1", (void *)linux_epoll_create1},
 	[__NR_amd64_dup3] = {"dup3", (void *)nullptr},
 	[__NR_amd64_pipe2] = {"pipe2", (void *)linux_pipe2},
 	[__NR_amd64_inotify_init1] = {"inotify_init1", (void *)nullptr},
-	[__NR_amd64_preadv] = {"preadv", (void *)nullptr},
-	[__NR_amd64_pwritev] = {"pwritev", (void *)nullptr},
+	[__NR_amd64_preadv] = {"preadv", (void *)linux_preadv},
+	[__NR_amd64_pwritev] = {"pwritev", (void *)linux_pwritev},
 	[__NR_amd64_rt_tgsigqueueinfo] = {"rt_tgsigqueueinfo", (void *)nullptr},
 	[__NR_amd64_perf_event_open] = {"perf_event_open", (void *)nullptr},
 	[__NR_amd64_recvmmsg] = {"recvmmsg", (void *)nullptr},
@@ -3663,10 +4927,10 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_name_to_handle_at] = {"name_to_handle_at", (void *)nullptr},
 	[__NR_amd64_open_by_handle_at] = {"open_by_handle_at", (void *)nullptr},
 	[__NR_amd64_clock_adjtime] = {"clock_adjtime", (void *)nullptr},
-	[__NR_amd64_syncfs] = {"syncfs", (void *)nullptr},
+	[__NR_amd64_syncfs] = {"syncfs", (void *)linux_syncfs},
 	[__NR_amd64_sendmmsg] = {"sendmmsg", (void *)nullptr},
 	[__NR_amd64_setns] = {"setns", (void *)nullptr},
-	[__NR_amd64_getcpu] = {"getcpu", (void *)nullptr},
+	[__NR_amd64_getcpu] = {"getcpu", (void *)linux_getcpu},
 	[__NR_amd64_process_vm_readv] = {"process_vm_readv", (void *)nullptr},
 	[__NR_amd64_process_vm_writev] = {"process_vm_writev", (void *)nullptr},
 	[__NR_amd64_kcmp] = {"kcmp", (void *)nullptr},
@@ -3683,9 +4947,9 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_userfaultfd] = {"userfaultfd", (void *)nullptr},
 	[__NR_amd64_membarrier] = {"membarrier", (void *)nullptr},
 	[__NR_amd64_mlock2] = {"mlock2", (void *)nullptr},
-	[__NR_amd64_copy_file_range] = {"copy_file_range", (void *)nullptr},
-	[__NR_amd64_preadv2] = {"preadv2", (void *)nullptr},
-	[__NR_amd64_pwritev2] = {"pwritev2", (void *)nullptr},
+	[__NR_amd64_copy_file_range] = {"copy_file_range", (void *)linux_copy_file_range},
+	[__NR_amd64_preadv2] = {"preadv2", (void *)linux_preadv2},
+	[__NR_amd64_pwritev2] = {"pwritev2", (void *)linux_pwritev2},
 	[__NR_amd64_pkey_mprotect] = {"pkey_mprotect", (void *)nullptr},
 	[__NR_amd64_pkey_alloc] = {"pkey_alloc", (void *)nullptr},
 	[__NR_amd64_pkey_free] = {"pkey_free", (void *)nullptr},
@@ -3782,8 +5046,8 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[422] = {"reserved", (void *)nullptr},
 	[423] = {"reserved", (void *)nullptr},
 	[__NR_amd64_pidfd_send_signal] = {"pidfd_send_signal", (void *)nullptr},
-	[__NR_amd64_io_uring_setup] = {"io_uring_setup", (void *)nullptr},
-	[__NR_amd64_io_uring_enter] = {"io_uring_enter", (void *)nullptr},
+	[__NR_amd64_io_uring_setup] = {"io_uring_setup", (void *)linux_io_uring_setup},
+	[__NR_amd64_io_uring_enter] = {"io_uring_enter", (void *)linux_io_uring_enter},
 	[__NR_amd64_io_uring_register] = {"io_uring_register", (void *)nullptr},
 	[__NR_amd64_open_tree] = {"open_tree", (void *)nullptr},
 	[__NR_amd64_move_mount] = {"move_mount", (void *)nullptr},
@@ -3798,7 +5062,7 @@ static SyscallData LinuxSyscallsTableAMD64[] = {
 	[__NR_amd64_pidfd_getfd] = {"pidfd_getfd", (void *)nullptr},
 	[__NR_amd64_faccessat2] = {"faccessat2", (void *)nullptr},
 	[__NR_amd64_process_madvise] = {"process_madvise", (void *)nullptr},
-	[__NR_amd64_epoll_pwait2] = {"epoll_pwait2", (void *)nullptr},
+	[__NR_amd64_epoll_pwait2] = {"epoll_pwait2", (void *)linux_epoll_pwait2},
 	[__NR_amd64_mount_setattr] = {"mount_setattr", (void *)nullptr},
 	[443] = {"reserved", (void *)nullptr},
 	[__NR_amd64_landlock_create_ruleset] = {"landlock_create_ruleset", (void *)nullptr},
@@ -3816,7 +5080,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_close] = {"close", (void *)linux_close},
 	[__NR_i386_waitpid] = {"waitpid", (void *)nullptr},
 	[__NR_i386_creat] = {"creat", (void *)linux_creat},
-	[__NR_i386_link] = {"link", (void *)nullptr},
+	[__NR_i386_link] = {"link", (void *)linux_link},
 	[__NR_i386_unlink] = {"unlink", (void *)nullptr},
 	[__NR_i386_execve] = {"execve", (void *)linux_execve},
 	[__NR_i386_chdir] = {"chdir", (void *)linux_chdir},
@@ -3843,13 +5107,13 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_access] = {"access", (void *)linux_access},
 	[__NR_i386_nice] = {"nice", (void *)nullptr},
 	[__NR_i386_ftime] = {"ftime", (void *)nullptr},
-	[__NR_i386_sync] = {"sync", (void *)nullptr},
+	[__NR_i386_sync] = {"sync", (void *)linux_sync},
 	[__NR_i386_kill] = {"kill", (void *)linux_kill},
 	[__NR_i386_rename] = {"rename", (void *)nullptr},
 	[__NR_i386_mkdir] = {"mkdir", (void *)linux_mkdir},
 	[__NR_i386_rmdir] = {"rmdir", (void *)nullptr},
 	[__NR_i386_dup] = {"dup", (void *)linux_dup},
-	[__NR_i386_pipe] = {"pipe", (void *)nullptr},
+	[__NR_i386_pipe] = {"pipe", (void *)linux_pipe},
 	[__NR_i386_times] = {"times", (void *)nullptr},
 	[__NR_i386_prof] = {"prof", (void *)nullptr},
 	[__NR_i386_brk] = {"brk", (void *)linux_brk},
@@ -3925,7 +5189,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_swapoff] = {"swapoff", (void *)nullptr},
 	[__NR_i386_sysinfo] = {"sysinfo", (void *)nullptr},
 	[__NR_i386_ipc] = {"ipc", (void *)nullptr},
-	[__NR_i386_fsync] = {"fsync", (void *)nullptr},
+	[__NR_i386_fsync] = {"fsync", (void *)linux_fsync},
 	[__NR_i386_sigreturn] = {"sigreturn", (void *)nullptr},
 	[__NR_i386_clone] = {"clone", (void *)nullptr},
 	[__NR_i386_setdomainname] = {"setdomainname", (void *)nullptr},
@@ -3949,13 +5213,13 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_setfsgid] = {"setfsgid", (void *)nullptr},
 	[__NR_i386__llseek] = {"_llseek", (void *)nullptr},
 	[__NR_i386_getdents] = {"getdents", (void *)nullptr},
-	[__NR_i386__newselect] = {"_newselect", (void *)nullptr},
+	[__NR_i386__newselect] = {"_newselect", (void *)linux_select},
 	[__NR_i386_flock] = {"flock", (void *)nullptr},
 	[__NR_i386_msync] = {"msync", (void *)nullptr},
 	[__NR_i386_readv] = {"readv", (void *)linux_readv},
 	[__NR_i386_writev] = {"writev", (void *)linux_writev},
 	[__NR_i386_getsid] = {"getsid", (void *)nullptr},
-	[__NR_i386_fdatasync] = {"fdatasync", (void *)nullptr},
+	[__NR_i386_fdatasync] = {"fdatasync", (void *)linux_fdatasync},
 	[__NR_i386__sysctl] = {"_sysctl", (void *)nullptr},
 	[__NR_i386_mlock] = {"mlock", (void *)nullptr},
 	[__NR_i386_munlock] = {"munlock", (void *)nullptr},
@@ -3975,7 +5239,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_getresuid] = {"getresuid", (void *)nullptr},
 	[__NR_i386_vm86] = {"vm86", (void *)nullptr},
 	[__NR_i386_query_module] = {"query_module", (void *)nullptr},
-	[__NR_i386_poll] = {"poll", (void *)nullptr},
+	[__NR_i386_poll] = {"poll", (void *)linux_poll},
 	[__NR_i386_nfsservctl] = {"nfsservctl", (void *)nullptr},
 	[__NR_i386_setresgid] = {"setresgid", (void *)nullptr},
 	[__NR_i386_getresgid] = {"getresgid", (void *)nullptr},
@@ -4046,8 +5310,8 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_lremovexattr] = {"lremovexattr", (void *)nullptr},
 	[__NR_i386_fremovexattr] = {"fremovexattr", (void *)nullptr},
 	[__NR_i386_tkill] = {"tkill", (void *)linux_tkill},
-	[__NR_i386_sendfile64] = {"sendfile64", (void *)nullptr},
-	[__NR_i386_futex] = {"futex", (void *)nullptr},
+	[__NR_i386_sendfile64] = {"sendfile64", (void *)linux_sendfile},
+	[__NR_i386_futex] = {"futex", (void *)linux_futex},
 	[__NR_i386_sched_setaffinity] = {"sched_setaffinity", (void *)linux_sched_setaffinity},
 	[__NR_i386_sched_getaffinity] = {"sched_getaffinity", (void *)linux_sched_getaffinity},
 	[__NR_i386_set_thread_area] = {"set_thread_area", (void *)nullptr},
@@ -4061,9 +5325,9 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_set_zone_reclaim] = {"set_zone_reclaim", (void *)nullptr},
 	[__NR_i386_exit_group] = {"exit_group", (void *)linux_exit_group},
 	[__NR_i386_lookup_dcookie] = {"lookup_dcookie", (void *)nullptr},
-	[__NR_i386_epoll_create] = {"epoll_create", (void *)nullptr},
-	[__NR_i386_epoll_ctl] = {"epoll_ctl", (void *)nullptr},
-	[__NR_i386_epoll_wait] = {"epoll_wait", (void *)nullptr},
+	[__NR_i386_epoll_create] = {"epoll_create", (void *)linux_epoll_create},
+	[__NR_i386_epoll_ctl] = {"epoll_ctl", (void *)linux_epoll_ctl},
+	[__NR_i386_epoll_wait] = {"epoll_wait", (void *)linux_epoll_wait},
 	[__NR_i386_remap_file_pages] = {"remap_file_pages", (void *)nullptr},
 	[__NR_i386_set_tid_address] = {"set_tid_address", (void *)linux_set_tid_address},
 	[__NR_i386_timer_create] = {"timer_create", (void *)nullptr},
@@ -4115,18 +5379,18 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_readlinkat] = {"readlinkat", (void *)nullptr},
 	[__NR_i386_fchmodat] = {"fchmodat", (void *)nullptr},
 	[__NR_i386_faccessat] = {"faccessat", (void *)nullptr},
-	[__NR_i386_pselect6] = {"pselect6", (void *)nullptr},
-	[__NR_i386_ppoll] = {"ppoll", (void *)nullptr},
+	[__NR_i386_pselect6] = {"pselect6", (void *)linux_pselect6},
+	[__NR_i386_ppoll] = {"ppoll", (void *)linux_ppoll},
 	[__NR_i386_unshare] = {"unshare", (void *)nullptr},
 	[__NR_i386_set_robust_list] = {"set_robust_list", (void *)nullptr},
 	[__NR_i386_get_robust_list] = {"get_robust_list", (void *)nullptr},
-	[__NR_i386_splice] = {"splice", (void *)nullptr},
+	[__NR_i386_splice] = {"splice", (void *)linux_splice},
 	[__NR_i386_sync_file_range] = {"sync_file_range", (void *)nullptr},
-	[__NR_i386_tee] = {"tee", (void *)nullptr},
-	[__NR_i386_vmsplice] = {"vmsplice", (void *)nullptr},
+	[__NR_i386_tee] = {"tee", (void *)linux_tee},
+	[__NR_i386_vmsplice] = {"vmsplice", (void *)linux_vmsplice},
 	[__NR_i386_move_pages] = {"move_pages", (void *)nullptr},
-	[__NR_i386_getcpu] = {"getcpu", (void *)nullptr},
-	[__NR_i386_epoll_pwait] = {"epoll_pwait", (void *)nullptr},
+	[__NR_i386_getcpu] = {"getcpu", (void *)linux_getcpu},
+	[__NR_i386_epoll_pwait] = {"epoll_pwait", (void *)linux_epoll_pwait},
 	[__NR_i386_utimensat] = {"utimensat", (void *)nullptr},
 	[__NR_i386_signalfd] = {"signalfd", (void *)nullptr},
 	[__NR_i386_timerfd_create] = {"timerfd_create", (void *)nullptr},
@@ -4136,12 +5400,12 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_timerfd_gettime32] = {"timerfd_gettime32", (void *)nullptr},
 	[__NR_i386_signalfd4] = {"signalfd4", (void *)nullptr},
 	[__NR_i386_eventfd2] = {"eventfd2", (void *)nullptr},
-	[__NR_i386_epoll_create1] = {"epoll_create1", (void *)nullptr},
+	[__NR_i386_epoll_create1] = {"epoll_create1", (void *)linux_epoll_create1},
 	[__NR_i386_dup3] = {"dup3", (void *)nullptr},
-	[__NR_i386_pipe2] = {"pipe2", (void *)nullptr},
+	[__NR_i386_pipe2] = {"pipe2", (void *)linux_pipe2},
 	[__NR_i386_inotify_init1] = {"inotify_init1", (void *)nullptr},
-	[__NR_i386_preadv] = {"preadv", (void *)nullptr},
-	[__NR_i386_pwritev] = {"pwritev", (void *)nullptr},
+	[__NR_i386_preadv] = {"preadv", (void *)linux_preadv},
+	[__NR_i386_pwritev] = {"pwritev", (void *)linux_pwritev},
 	[__NR_i386_rt_tgsigqueueinfo] = {"rt_tgsigqueueinfo", (void *)nullptr},
 	[__NR_i386_perf_event_open] = {"perf_event_open", (void *)nullptr},
 	[__NR_i386_recvmmsg] = {"recvmmsg", (void *)nullptr},
@@ -4151,7 +5415,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_name_to_handle_at] = {"name_to_handle_at", (void *)nullptr},
 	[__NR_i386_open_by_handle_at] = {"open_by_handle_at", (void *)nullptr},
 	[__NR_i386_clock_adjtime] = {"clock_adjtime", (void *)nullptr},
-	[__NR_i386_syncfs] = {"syncfs", (void *)nullptr},
+	[__NR_i386_syncfs] = {"syncfs", (void *)linux_syncfs},
 	[__NR_i386_sendmmsg] = {"sendmmsg", (void *)nullptr},
 	[__NR_i386_setns] = {"setns", (void *)nullptr},
 	[__NR_i386_process_vm_readv] = {"process_vm_readv", (void *)nullptr},
@@ -4184,9 +5448,9 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_userfaultfd] = {"userfaultfd", (void *)nullptr},
 	[__NR_i386_membarrier] = {"membarrier", (void *)nullptr},
 	[__NR_i386_mlock2] = {"mlock2", (void *)nullptr},
-	[__NR_i386_copy_file_range] = {"copy_file_range", (void *)nullptr},
-	[__NR_i386_preadv2] = {"preadv2", (void *)nullptr},
-	[__NR_i386_pwritev2] = {"pwritev2", (void *)nullptr},
+	[__NR_i386_copy_file_range] = {"copy_file_range", (void *)linux_copy_file_range},
+	[__NR_i386_preadv2] = {"preadv2", (void *)linux_preadv2},
+	[__NR_i386_pwritev2] = {"pwritev2", (void *)linux_pwritev2},
 	[__NR_i386_pkey_mprotect] = {"pkey_mprotect", (void *)nullptr},
 	[__NR_i386_pkey_alloc] = {"pkey_alloc", (void *)nullptr},
 	[__NR_i386_pkey_free] = {"pkey_free", (void *)nullptr},
@@ -4232,8 +5496,8 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_futex_time64] = {"futex_time64", (void *)nullptr},
 	[__NR_i386_sched_rr_get_interval_time64] = {"sched_rr_get_interval_time64", (void *)nullptr},
 	[__NR_i386_pidfd_send_signal] = {"pidfd_send_signal", (void *)nullptr},
-	[__NR_i386_io_uring_setup] = {"io_uring_setup", (void *)nullptr},
-	[__NR_i386_io_uring_enter] = {"io_uring_enter", (void *)nullptr},
+	[__NR_i386_io_uring_setup] = {"io_uring_setup", (void *)linux_io_uring_setup},
+	[__NR_i386_io_uring_enter] = {"io_uring_enter", (void *)linux_io_uring_enter},
 	[__NR_i386_io_uring_register] = {"io_uring_register", (void *)nullptr},
 	[__NR_i386_open_tree] = {"open_tree", (void *)nullptr},
 	[__NR_i386_move_mount] = {"move_mount", (void *)nullptr},
@@ -4248,7 +5512,7 @@ static SyscallData LinuxSyscallsTableI386[] = {
 	[__NR_i386_pidfd_getfd] = {"pidfd_getfd", (void *)nullptr},
 	[__NR_i386_faccessat2] = {"faccessat2", (void *)nullptr},
 	[__NR_i386_process_madvise] = {"process_madvise", (void *)nullptr},
-	[__NR_i386_epoll_pwait2] = {"epoll_pwait2", (void *)nullptr},
+	[__NR_i386_epoll_pwait2] = {"epoll_pwait2", (void *)linux_epoll_pwait2},
 	[__NR_i386_mount_setattr] = {"mount_setattr", (void *)nullptr},
 	[443] = {"reserved", (void *)nullptr},
 	[__NR_i386_landlock_create_ruleset] = {"landlock_create_ruleset", (void *)nullptr},
@@ -4283,9 +5547,12 @@ uintptr_t HandleLinuxSyscalls(SyscallsFrame *Frame)
 		  Frame->rdi, Frame->rsi, Frame->rdx,
 		  Frame->r10, Frame->r8, Frame->r9);
 
+	uint64_t StatStart = SyscallStat::Start();
 	long sc_ret = call(Frame,
 					   Frame->rdi, Frame->rsi, Frame->rdx,
 					   Frame->r10, Frame->r8, Frame->r9);
+	SyscallStat::Record(SyscallStat::Linux, Frame->rax, Syscall.Name,
+						StatStart, sc_ret);
 
 	debug("< [%ld:\"%s\"] = %ld", Frame->rax, Syscall.Name, sc_ret);
 	return sc_ret;
@@ -4314,9 +5581,12 @@ uintptr_t HandleLinuxSyscalls(SyscallsFrame *Frame)
 		  Frame->ebx, Frame->ecx, Frame->edx,
 		  Frame->esi, Frame->edi, Frame->ebp);
 
+	uint64_t StatStart = SyscallStat::Start();
 	int sc_ret = call(Frame,
 					  Frame->ebx, Frame->ecx, Frame->edx,
 					  Frame->esi, Frame->edi, Frame->ebp);
+	SyscallStat::Record(SyscallStat::Linux, Frame->eax, Syscall.Name,
+						StatStart, sc_ret);
 
 	debug("< [%d:\"%s\"] = %d", Frame->eax, Syscall.Name, sc_ret);
 	return sc_ret;
@@ -96,9 +96,12 @@ uintptr_t HandleNativeSyscalls(SysFrm *Frame)
 		  Frame->rdi, Frame->rsi, Frame->rdx,
 		  Frame->r10, Frame->r8, Frame->r9);
 
+	uint64_t StatStart = SyscallStat::Start();
 	long sc_ret = call(Frame,
 					   Frame->rdi, Frame->rsi, Frame->rdx,
 					   Frame->r10, Frame->r8, Frame->r9);
+	SyscallStat::Record(SyscallStat::Native, Frame->rax, Syscall.Name,
+						StatStart, sc_ret);
 
 	debug("< [%d:\"%s\"] = %d",
 		  Frame->rax, Syscall.Name, sc_ret);
@@ -139,9 +142,12 @@ uintptr_t HandleNativeSyscalls(SysFrm *Frame)
 		  Frame->ebx, Frame->ecx, Frame->edx,
 		  Frame->esi, Frame->edi, Frame->ebp);
 
+	uint64_t StatStart = SyscallStat::Start();
 	int sc_ret = call(Frame,
 					  Frame->ebx, Frame->ecx, Frame->edx,
 					  Frame->esi, Frame->edi, Frame->ebp);
+	SyscallStat::Record(SyscallStat::Native, Frame->eax, Syscall.Name,
+						StatStart, sc_ret);
 
 	debug("< [%d:\"%s\"] = %d",
 		  Frame->eax, Syscall.Name, sc_ret);
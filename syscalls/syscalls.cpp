@@ -18,6 +18,7 @@
 #include <syscalls.hpp>
 
 #include <debug.h>
+#include <cpu.hpp>
 
 #include "../kernel.h"
 
@@ -59,9 +60,14 @@ extern "C" uintptr_t SystemCallsHandler(SyscallsFrame *Frame)
 		and switch back when this function returns. */
 	AutoSwitchPageTable PageSwitcher;
 
-	uint64_t _ctime = TimeManager->GetCounter();
-	Tasking::TaskInfo *Ptinfo = &thisProcess->Info;
-	Tasking::TaskInfo *Ttinfo = &thisThread->Info;
+	/* TSC, the timer counter can be an MMIO read */
+	uint64_t _ctime = CPU::Counter();
+
+	/* thisThread has to look up the current CPU,
+		only do it once. */
+	Tasking::TCB *tcb = thisThread;
+	Tasking::TaskInfo *Ptinfo = &tcb->Parent->Info;
+	Tasking::TaskInfo *Ttinfo = &tcb->Info;
 	uintptr_t ret;
 
 	if (Config.UseLinuxSyscalls)
@@ -97,7 +103,8 @@ extern "C" uintptr_t SystemCallsHandler(SyscallsFrame *Frame)
 	}
 
 Ret:
-	Ptinfo->KernelTime += TimeManager->GetCounter() - _ctime;
-	Ttinfo->KernelTime += TimeManager->GetCounter() - _ctime;
+	uint64_t _spent = CPU::Counter() - _ctime;
+	Ptinfo->KernelTime += _spent;
+	Ttinfo->KernelTime += _spent;
 	return ret;
 }
@@ -0,0 +1,580 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <futex.hpp>
+
+#include <lock.hpp>
+#include <task.hpp>
+#include <smp.hpp>
+#include <errno.h>
+
+#include "../kernel.h"
+
+using namespace Tasking;
+
+/* 256 buckets */
+#define FUTEX_HASH_BITS 8
+
+namespace Futex
+{
+	struct Bucket;
+
+	struct Waiter
+	{
+		TCB *Thread = nullptr;
+		uintptr_t Key = 0;
+		uint32_t Bitset = BitsetMatchAny;
+		bool PI = false;
+		bool Woken = false;
+
+		/* Changes when the waiter is requeued */
+		Bucket *Queue = nullptr;
+		Waiter *Next = nullptr;
+		Waiter *Prev = nullptr;
+	};
+
+	struct Bucket
+	{
+		LockClass Lock;
+		Waiter *Head = nullptr;
+		Waiter *Tail = nullptr;
+	};
+
+	static Bucket Table[1 << FUTEX_HASH_BITS];
+
+	static Bucket *GetBucket(uintptr_t Key)
+	{
+		/* Futex words are aligned to 4 bytes */
+		uint64_t h = uint64_t(Key >> 2) * 0x9E3779B97F4A7C15ULL;
+		return &Table[h >> (64 - FUTEX_HASH_BITS)];
+	}
+
+	/**
+	 * Interrupts must stay disabled while a bucket is locked,
+	 * or the scheduler could preempt a thread that is already
+	 * marked as blocked while it still holds the lock.
+	 */
+	class BucketLock
+	{
+	private:
+		Bucket *First = nullptr;
+		Bucket *Second = nullptr;
+		bool InterruptsEnabled = false;
+
+	public:
+		BucketLock(Bucket *a, Bucket *b = nullptr)
+		{
+			/* Always lock in the same order */
+			if (b == a)
+				b = nullptr;
+			if (b && b < a)
+				std::swap(a, b);
+
+			First = a;
+			Second = b;
+			InterruptsEnabled = CPU::Interrupts(CPU::Check);
+			CPU::Interrupts(CPU::Disable);
+			First->Lock.Lock(__FUNCTION__);
+			if (Second)
+				Second->Lock.Lock(__FUNCTION__);
+		}
+
+		~BucketLock()
+		{
+			if (Second)
+				Second->Lock.Unlock();
+			First->Lock.Unlock();
+			if (InterruptsEnabled)
+				CPU::Interrupts(CPU::Enable);
+		}
+	};
+
+	static void Enqueue(Bucket *b, Waiter *w)
+	{
+		w->Queue = b;
+		w->Next = nullptr;
+		w->Prev = b->Tail;
+		if (b->Tail)
+			b->Tail->Next = w;
+		else
+			b->Head = w;
+		b->Tail = w;
+	}
+
+	static void Dequeue(Bucket *b, Waiter *w)
+	{
+		if (w->Prev)
+			w->Prev->Next = w->Next;
+		else
+			b->Head = w->Next;
+
+		if (w->Next)
+			w->Next->Prev = w->Prev;
+		else
+			b->Tail = w->Prev;
+
+		w->Next = w->Prev = nullptr;
+	}
+
+	static void Block(Waiter *w, uint64_t Until)
+	{
+		if (Until)
+		{
+			/* The scheduler wakes us up when the time is up */
+			w->Thread->Info.SleepUntil = Until;
+			w->Thread->SetState(TaskState::Sleeping);
+		}
+		else
+			w->Thread->Block();
+	}
+
+	/**
+	 * @note The waiter can return as soon as the bucket
+	 * is unlocked, don't touch it after this.
+	 */
+	static void WakeWaiter(Bucket *b, Waiter *w)
+	{
+		Dequeue(b, w);
+		w->Woken = true;
+		w->Thread->Info.SleepUntil = 0;
+		w->Thread->Unblock();
+	}
+
+	static Waiter *FirstPIWaiter(Bucket *b, uintptr_t Key)
+	{
+		for (Waiter *w = b->Head; w; w = w->Next)
+		{
+			if (w->Key == Key && w->PI)
+				return w;
+		}
+		return nullptr;
+	}
+
+	static void Boost(TCB *Owner, TaskPriority Priority)
+	{
+		if (Owner == nullptr || Owner->Info.Priority >= Priority)
+			return;
+
+		if (Owner->Info.BasePriority == UnknownPriority)
+			Owner->Info.BasePriority = Owner->Info.Priority;
+		Owner->Info.Priority = Priority;
+	}
+
+	static void Unboost(TCB *Owner)
+	{
+		if (Owner->Info.BasePriority == UnknownPriority)
+			return;
+
+		Owner->Info.Priority = Owner->Info.BasePriority;
+		Owner->Info.BasePriority = UnknownPriority;
+	}
+
+	/* Drop what a waiter that left lent to the owner, keep
+	   the boost from the ones still queued on the futex */
+	static void Reboost(Bucket *b, uintptr_t Key, TCB *Owner)
+	{
+		if (Owner == nullptr)
+			return;
+
+		Unboost(Owner);
+		for (Waiter *w = b->Head; w; w = w->Next)
+		{
+			if (w->Key == Key && w->PI)
+				Boost(Owner, w->Thread->Info.Priority);
+		}
+	}
+
+	static uint64_t Deadline(uint64_t Timeout)
+	{
+		if (Timeout == 0)
+			return 0;
+		return TimeManager->CalculateTarget(Timeout, Time::Nanoseconds);
+	}
+
+	/**
+	 * Sleep until the waiter is woken up, times
+	 * out or a signal arrives.
+	 *
+	 * @note Must be called right after releasing
+	 * the bucket lock that queued and blocked @p w.
+	 */
+	static int Sleep(Waiter *w, uint64_t Until)
+	{
+		PCB *pcb = thisProcess;
+		while (true)
+		{
+			TaskManager->Yield();
+
+			/* Find the bucket we are on right now, a
+			   requeue might have moved us while asleep */
+			Bucket *b;
+			while (true)
+			{
+				b = __atomic_load_n(&w->Queue, __ATOMIC_ACQUIRE);
+				BucketLock lock(b);
+				if (__atomic_load_n(&w->Queue, __ATOMIC_ACQUIRE) != b)
+					continue;
+
+				if (w->Woken)
+					return 0;
+
+				int ret = 0;
+				if (pcb->Signals.HasPendingSignal())
+					ret = -EINTR;
+				else if (Until && TimeManager->GetCounter() >= Until)
+					ret = -ETIMEDOUT;
+
+				if (ret)
+				{
+					Dequeue(b, w);
+					return ret;
+				}
+
+				/* Spurious wake up */
+				Block(w, Until);
+				break;
+			}
+		}
+	}
+
+	int Wait(uint32_t *Address, uint32_t Expected,
+			 uint64_t Timeout, uint32_t Bitset)
+	{
+		if (Bitset == 0)
+			return -EINVAL;
+
+		Waiter w;
+		w.Thread = thisThread;
+		w.Key = (uintptr_t)Address;
+		w.Bitset = Bitset;
+		uint64_t Until = Deadline(Timeout);
+
+		Bucket *b = GetBucket(w.Key);
+		{
+			BucketLock lock(b);
+			if (__atomic_load_n(Address, __ATOMIC_SEQ_CST) != Expected)
+				return -EAGAIN;
+
+			Enqueue(b, &w);
+			Block(&w, Until);
+		}
+		return Sleep(&w, Until);
+	}
+
+	int Wake(uint32_t *Address, int Count, uint32_t Bitset)
+	{
+		if (Bitset == 0)
+			return -EINVAL;
+
+		uintptr_t Key = (uintptr_t)Address;
+		Bucket *b = GetBucket(Key);
+		BucketLock lock(b);
+
+		int Woken = 0;
+		Waiter *w = b->Head;
+		while (w && Woken < Count)
+		{
+			Waiter *next = w->Next;
+			if (w->Key == Key && !w->PI && (w->Bitset & Bitset))
+			{
+				WakeWaiter(b, w);
+				Woken++;
+			}
+			w = next;
+		}
+		return Woken;
+	}
+
+	int Requeue(uint32_t *Address, uint32_t *Target,
+				int WakeCount, int RequeueCount,
+				const uint32_t *Expected)
+	{
+		if (WakeCount < 0 || RequeueCount < 0)
+			return -EINVAL;
+
+		uintptr_t Key = (uintptr_t)Address;
+		uintptr_t TargetKey = (uintptr_t)Target;
+		Bucket *b = GetBucket(Key);
+		Bucket *tb = GetBucket(TargetKey);
+		BucketLock lock(b, tb);
+
+		if (Expected && __atomic_load_n(Address, __ATOMIC_SEQ_CST) != *Expected)
+			return -EAGAIN;
+
+		int Woken = 0, Requeued = 0;
+		Waiter *w = b->Head;
+		while (w)
+		{
+			Waiter *next = w->Next;
+			if (w->Key != Key || w->PI)
+			{
+				w = next;
+				continue;
+			}
+
+			if (Woken < WakeCount)
+			{
+				WakeWaiter(b, w);
+				Woken++;
+			}
+			else if (Requeued < RequeueCount)
+			{
+				Dequeue(b, w);
+				w->Key = TargetKey;
+				__atomic_store_n(&w->Queue, tb, __ATOMIC_RELEASE);
+				Enqueue(tb, w);
+				Requeued++;
+			}
+			else
+				break;
+			w = next;
+		}
+		return Woken + Requeued;
+	}
+
+	int WakeOp(uint32_t *Address, uint32_t *Target,
+			   int Count, int Count2, uint32_t Op)
+	{
+		enum
+		{
+			OpSet = 0,
+			OpAdd = 1,
+			OpOr = 2,
+			OpAndN = 3,
+			OpXor = 4,
+			OpArgShift = 8
+		};
+
+		int op = (Op >> 28) & 0xf;
+		int cmp = (Op >> 24) & 0xf;
+		/* Both arguments are sign extended 12 bit values */
+		int32_t oparg = int32_t(Op << 8) >> 20;
+		int32_t cmparg = int32_t(Op << 20) >> 20;
+
+		if (op & OpArgShift)
+		{
+			if (oparg < 0 || oparg > 31)
+				return -EINVAL;
+			oparg = 1 << oparg;
+			op &= ~OpArgShift;
+		}
+
+		uintptr_t Key = (uintptr_t)Address;
+		uintptr_t TargetKey = (uintptr_t)Target;
+		Bucket *b = GetBucket(Key);
+		Bucket *tb = GetBucket(TargetKey);
+		BucketLock lock(b, tb);
+
+		uint32_t old = __atomic_load_n(Target, __ATOMIC_RELAXED), nv;
+		do
+		{
+			switch (op)
+			{
+			case OpSet:
+				nv = oparg;
+				break;
+			case OpAdd:
+				nv = old + oparg;
+				break;
+			case OpOr:
+				nv = old | oparg;
+				break;
+			case OpAndN:
+				nv = old & ~oparg;
+				break;
+			case OpXor:
+				nv = old ^ oparg;
+				break;
+			default:
+				return -ENOSYS;
+			}
+		} while (!__atomic_compare_exchange_n(Target, &old, nv, false,
+											  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+		bool match;
+		switch (cmp)
+		{
+		case 0:
+			match = int32_t(old) == cmparg;
+			break;
+		case 1:
+			match = int32_t(old) != cmparg;
+			break;
+		case 2:
+			match = int32_t(old) < cmparg;
+			break;
+		case 3:
+			match = int32_t(old) <= cmparg;
+			break;
+		case 4:
+			match = int32_t(old) > cmparg;
+			break;
+		case 5:
+			match = int32_t(old) >= cmparg;
+			break;
+		default:
+			return -ENOSYS;
+		}
+
+		int Woken = 0;
+		for (Waiter *w = b->Head, *next; w && Woken < Count; w = next)
+		{
+			next = w->Next;
+			if (w->Key == Key && !w->PI)
+			{
+				WakeWaiter(b, w);
+				Woken++;
+			}
+		}
+
+		if (!match)
+			return Woken;
+
+		int Woken2 = 0;
+		for (Waiter *w = tb->Head, *next; w && Woken2 < Count2; w = next)
+		{
+			next = w->Next;
+			if (w->Key == TargetKey && !w->PI)
+			{
+				WakeWaiter(tb, w);
+				Woken2++;
+			}
+		}
+		return Woken + Woken2;
+	}
+
+	int LockPI(uint32_t *Address, uint64_t Timeout)
+	{
+		TCB *tcb = thisThread;
+		uint32_t tid = uint32_t(tcb->ID) & TIDMask;
+
+		Waiter w;
+		w.Thread = tcb;
+		w.Key = (uintptr_t)Address;
+		w.PI = true;
+		uint64_t Until = Deadline(Timeout);
+
+		Bucket *b = GetBucket(w.Key);
+		{
+			BucketLock lock(b);
+			uint32_t v = __atomic_load_n(Address, __ATOMIC_SEQ_CST);
+			while (true)
+			{
+				if ((v & TIDMask) == 0)
+				{
+					uint32_t nv = tid | (v & OwnerDied);
+					if (FirstPIWaiter(b, w.Key))
+						nv |= Waiters;
+					if (__atomic_compare_exchange_n(Address, &v, nv, false,
+													__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+						return 0;
+					continue;
+				}
+
+				if ((v & TIDMask) == tid)
+					return -EDEADLK;
+
+				/* Make the owner come to the kernel to unlock */
+				if ((v & Waiters) ||
+					__atomic_compare_exchange_n(Address, &v, v | Waiters, false,
+												__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+					break;
+			}
+
+			TCB *Owner = TaskManager->GetThreadByID(v & TIDMask, tcb->Parent);
+			Boost(Owner, tcb->Info.Priority);
+
+			Enqueue(b, &w);
+			Block(&w, Until);
+		}
+
+		/* UnlockPI() writes our TID to the futex
+		   word before waking us up. */
+		int ret = Sleep(&w, Until);
+		if (ret == 0)
+			return 0;
+
+		/* Timed out or interrupted, take our boost back */
+		BucketLock lock(b);
+		uint32_t v = __atomic_load_n(Address, __ATOMIC_SEQ_CST);
+		if (v & TIDMask)
+			Reboost(b, w.Key, TaskManager->GetThreadByID(v & TIDMask, tcb->Parent));
+		return ret;
+	}
+
+	int TryLockPI(uint32_t *Address)
+	{
+		uint32_t tid = uint32_t(thisThread->ID) & TIDMask;
+		uint32_t v = __atomic_load_n(Address, __ATOMIC_SEQ_CST);
+		while ((v & TIDMask) == 0)
+		{
+			if (__atomic_compare_exchange_n(Address, &v, tid | (v & (OwnerDied | Waiters)),
+											false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+				return 0;
+		}
+
+		if ((v & TIDMask) == tid)
+			return -EDEADLK;
+		return -EAGAIN;
+	}
+
+	int UnlockPI(uint32_t *Address)
+	{
+		TCB *tcb = thisThread;
+		uint32_t tid = uint32_t(tcb->ID) & TIDMask;
+		uintptr_t Key = (uintptr_t)Address;
+
+		Bucket *b = GetBucket(Key);
+		BucketLock lock(b);
+
+		uint32_t v = __atomic_load_n(Address, __ATOMIC_SEQ_CST);
+		if ((v & TIDMask) != tid)
+			return -EPERM;
+
+		Unboost(tcb);
+
+		Waiter *Next = FirstPIWaiter(b, Key);
+		if (Next == nullptr)
+		{
+			__atomic_store_n(Address, 0, __ATOMIC_SEQ_CST);
+			return 0;
+		}
+
+		/* Hand the lock over to the first waiter */
+		Dequeue(b, Next);
+		uint32_t nv = uint32_t(Next->Thread->ID) & TIDMask;
+
+		bool HasMore = false;
+		for (Waiter *w = b->Head; w; w = w->Next)
+		{
+			if (w->Key != Key || !w->PI)
+				continue;
+
+			HasMore = true;
+			Boost(Next->Thread, w->Thread->Info.Priority);
+		}
+
+		if (HasMore)
+			nv |= Waiters;
+		__atomic_store_n(Address, nv, __ATOMIC_SEQ_CST);
+
+		Next->Woken = true;
+		Next->Thread->Info.SleepUntil = 0;
+		Next->Thread->Unblock();
+		return 0;
+	}
+}
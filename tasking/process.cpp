@@ -269,6 +269,8 @@ namespace Tasking
 		debug("Closing file descriptors");
 		delete this->FileDescriptors;
 
+		delete this->SyscallCounters.load();
+
 		debug("Deleting tty");
 		// if (this->tty)
 		// 	delete ((TTY::TeletypeDriver *)this->tty);
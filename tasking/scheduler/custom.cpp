@@ -21,6 +21,7 @@
 #include <convert.h>
 #include <lock.hpp>
 #include <printf.h>
+#include <rcu.hpp>
 #include <smp.hpp>
 #include <io.h>
 
@@ -287,8 +288,9 @@ namespace Tasking::Scheduler
 	nsa void Custom::UpdateUsage(TaskInfo *Info, TaskExecutionMode Mode, int Core)
 	{
 		UNUSED(Core);
-		uint64_t CurrentTime = TimeManager->GetCounter();
-		uint64_t TimePassed = Info->LastUpdateTime - CurrentTime;
+		/* Usage is accounted in TSC cycles */
+		uint64_t CurrentTime = CPU::Counter();
+		uint64_t TimePassed = CurrentTime - Info->LastUpdateTime;
 		Info->LastUpdateTime = CurrentTime;
 
 		if (Mode == TaskExecutionMode::User)
@@ -567,18 +569,27 @@ namespace Tasking::Scheduler
 			warn("Scheduler stopped.");
 			return;
 		}
-		bool ProcessNotChanged = false;
 		uint64_t SchedTmpTicks = TimeManager->GetCounter();
 		this->LastTaskTicks.store(size_t(SchedTmpTicks - this->SchedulerTicks.load()));
 		CPUData *CurrentCPU = GetCurrentCPU();
 		this->LastCore.store(CurrentCPU->ID);
 		schedbg("Scheduler called on CPU %d.", CurrentCPU->ID);
 
+		if (unlikely(CurrentCPU->RCUNesting > 0))
+		{
+			/* Don't switch away from an RCU reader.
+			   Try again on the next tick. */
+			schedbg("Thread is in an RCU read-side section.");
+			this->OneShot(CurrentCPU->CurrentThread->Info.Priority);
+			this->SchedulerTicks.store(size_t(TimeManager->GetCounter() - SchedTmpTicks));
+			return;
+		}
+		RCU::QuiescentState(CurrentCPU);
+
 		if (unlikely(!CurrentCPU->CurrentProcess.load() ||
 					 !CurrentCPU->CurrentThread.load()))
 		{
 			schedbg("Invalid process or thread. Finding a new one.");
-			ProcessNotChanged = true;
 			if (this->FindNewProcess(CurrentCPU))
 				goto Success;
 			else
@@ -598,6 +609,14 @@ namespace Tasking::Scheduler
 			CurrentCPU->CurrentThread->FSBase = uintptr_t(CPU::x32::rdmsr(CPU::x32::MSR_FS_BASE));
 #endif
 
+			/* Charge the time slice to the task that used it */
+			UpdateUsage(&CurrentCPU->CurrentProcess->Info,
+						CurrentCPU->CurrentProcess->Security.ExecutionMode,
+						CurrentCPU->ID);
+			UpdateUsage(&CurrentCPU->CurrentThread->Info,
+						CurrentCPU->CurrentThread->Security.ExecutionMode,
+						CurrentCPU->ID);
+
 			if (CurrentCPU->CurrentProcess->State.load() == TaskState::Running)
 				CurrentCPU->CurrentProcess->State.store(TaskState::Ready);
 			if (CurrentCPU->CurrentThread->State.load() == TaskState::Running)
@@ -625,7 +644,6 @@ namespace Tasking::Scheduler
 
 			if (this->GetNextAvailableThread(CurrentCPU))
 			{
-				ProcessNotChanged = true;
 				goto Success;
 			}
 			schedbg("Passed GetNextAvailableThread");
@@ -651,7 +669,6 @@ namespace Tasking::Scheduler
 		assert(!"Unwanted code execution");
 
 	Idle:
-		ProcessNotChanged = true;
 		CurrentCPU->CurrentProcess = IdleProcess;
 		CurrentCPU->CurrentThread = IdleThread;
 
@@ -660,15 +677,6 @@ namespace Tasking::Scheduler
 				CurrentCPU->CurrentProcess->Name, CurrentCPU->CurrentProcess->ID,
 				CurrentCPU->CurrentThread->Name, CurrentCPU->CurrentThread->ID, CurrentCPU->ID);
 
-		if (!ProcessNotChanged)
-			UpdateUsage(&CurrentCPU->CurrentProcess->Info,
-						CurrentCPU->CurrentProcess->Security.ExecutionMode,
-						CurrentCPU->ID);
-
-		UpdateUsage(&CurrentCPU->CurrentThread->Info,
-					CurrentCPU->CurrentThread->Security.ExecutionMode,
-					CurrentCPU->ID);
-
 		CurrentCPU->CurrentProcess->State.store(TaskState::Running);
 		CurrentCPU->CurrentThread->State.store(TaskState::Running);
 
@@ -697,9 +705,9 @@ namespace Tasking::Scheduler
 
 		CurrentCPU->CurrentProcess->Signals.HandleSignal(Frame, CurrentCPU->CurrentThread.load());
 
-		if (!ProcessNotChanged)
-			(&CurrentCPU->CurrentProcess->Info)->LastUpdateTime = TimeManager->GetCounter();
-		(&CurrentCPU->CurrentThread->Info)->LastUpdateTime = TimeManager->GetCounter();
+		uint64_t UpdateTime = CPU::Counter();
+		(&CurrentCPU->CurrentProcess->Info)->LastUpdateTime = UpdateTime;
+		(&CurrentCPU->CurrentThread->Info)->LastUpdateTime = UpdateTime;
 		this->OneShot(CurrentCPU->CurrentThread->Info.Priority);
 
 		if (CurrentCPU->CurrentThread->Security.IsDebugEnabled &&
@@ -0,0 +1,129 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <waitqueue.hpp>
+
+#include <smp.hpp>
+#include <cpu.hpp>
+
+#include "../kernel.h"
+
+namespace Tasking
+{
+	void WaitQueue::Append(WaitEntry *Entry)
+	{
+		Entry->Next = nullptr;
+		Entry->Prev = Tail;
+		if (Tail)
+			Tail->Next = Entry;
+		else
+			Head = Entry;
+		Tail = Entry;
+		Entry->Queued = true;
+		Count++;
+	}
+
+	void WaitQueue::Remove(WaitEntry *Entry)
+	{
+		assert(Entry->Queued);
+		if (Entry->Prev)
+			Entry->Prev->Next = Entry->Next;
+		else
+			Head = Entry->Next;
+
+		if (Entry->Next)
+			Entry->Next->Prev = Entry->Prev;
+		else
+			Tail = Entry->Prev;
+
+		Entry->Next = Entry->Prev = nullptr;
+		Entry->Queued = false;
+		Count--;
+	}
+
+	void WaitQueue::Resume(WaitEntry *Entry)
+	{
+		if (Entry->Thread == nullptr)
+			return;
+
+		Entry->Thread->Info.SleepUntil = 0;
+		Entry->Thread->Unblock();
+	}
+
+	bool WaitQueue::CanSleep()
+	{
+		return TaskManager && !TaskManager->IsPanic() &&
+			   CPU::Interrupts(CPU::Check);
+	}
+
+	void WaitQueue::Block(WaitEntry *Entry, uint64_t Until)
+	{
+		this->Append(Entry);
+		if (Until)
+		{
+			/* The scheduler wakes us up when the time is up */
+			Entry->Thread->Info.SleepUntil = Until;
+			Entry->Thread->SetState(TaskState::Sleeping);
+		}
+		else
+			Entry->Thread->Block();
+	}
+
+	void WaitQueue::Reschedule(bool Sleep)
+	{
+		if (Sleep)
+			TaskManager->Yield();
+		else
+			CPU::Pause();
+	}
+
+	TCB *WaitQueue::CurrentThread()
+	{
+		if (TaskManager == nullptr || TaskManager->IsPanic())
+			return nullptr;
+		return thisThread;
+	}
+
+	uint64_t WaitQueue::Deadline(uint64_t Timeout)
+	{
+		return TimeManager->CalculateTarget(Timeout, Time::Units::Milliseconds);
+	}
+
+	bool WaitQueue::Expired(uint64_t Until)
+	{
+		return TimeManager->GetCounter() >= Until;
+	}
+
+	size_t WaitQueue::Wake(size_t Max)
+	{
+		SmartCriticalSection(QueueLock);
+		size_t Woken = 0;
+		while (Head && Woken < Max)
+		{
+			WaitEntry *Entry = Head;
+			this->Remove(Entry);
+			this->Resume(Entry);
+			Woken++;
+		}
+		return Woken;
+	}
+
+	WaitQueue::~WaitQueue()
+	{
+		assert(Head == nullptr);
+	}
+}
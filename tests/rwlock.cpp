@@ -0,0 +1,63 @@
+/*
+	This file is part of Fennix Kernel.
+
+	Fennix Kernel is free software: you can redistribute it and/or
+	modify it under the terms of the GNU General Public License as
+	published by the Free Software Foundation, either version 3 of
+	the License, or (at your option) any later version.
+
+	Fennix Kernel is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Fennix Kernel. If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifdef DEBUG
+
+#include <lock.hpp>
+#include <assert.h>
+#include <debug.h>
+
+NewRWLock(TestRWLock);
+NewSeqLock(TestSeqLock);
+
+__constructor void TestRWLocks()
+{
+	debug("Testing rw locks...");
+
+	assert(TestRWLock.TryReadLock());
+	assert(TestRWLock.TryReadLock());
+	assert(TestRWLock.Readers() == 2);
+	assert(!TestRWLock.TryWriteLock());
+	TestRWLock.ReadUnlock();
+	TestRWLock.ReadUnlock();
+
+	assert(TestRWLock.TryWriteLock());
+	assert(TestRWLock.WriteLocked());
+	assert(!TestRWLock.TryReadLock());
+	assert(!TestRWLock.TryWriteLock());
+	TestRWLock.WriteUnlock();
+	assert(!TestRWLock.Locked());
+
+	{
+		SmartReadLock(TestRWLock);
+		assert(TestRWLock.Readers() == 1);
+	}
+	{
+		SmartWriteLock(TestRWLock);
+		assert(TestRWLock.WriteLocked());
+	}
+	assert(!TestRWLock.Locked());
+
+	uint64_t seq = TestSeqLock.ReadBegin();
+	assert(!TestSeqLock.ReadRetry(seq));
+	TestSeqLock.WriteLock(__FUNCTION__);
+	TestSeqLock.WriteUnlock();
+	assert(TestSeqLock.ReadRetry(seq));
+
+	debug("rw lock tests passed");
+}
+
+#endif // DEBUG
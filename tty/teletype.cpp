@@ -87,6 +87,16 @@ namespace TTY
 		return -ENOSYS;
 	}
 
+	short TeletypeDriver::Poll(short Events)
+	{
+		short Ready = 0;
+		if (TermBuf.AvailableToRead() > 0)
+			Ready |= POLLIN | POLLRDNORM;
+		if (TermBuf.AvailableToWrite() > 0)
+			Ready |= POLLOUT | POLLWRNORM;
+		return Ready & Events;
+	}
+
 	TeletypeDriver::TeletypeDriver()
 		: TermBuf(1024)
 	{
@@ -188,6 +188,15 @@ namespace KernelConsole
 		}
 	}
 
+	short VirtualTerminal::Poll(short Events)
+	{
+		/* Read() takes its input straight from the keyboard */
+		short Ready = POLLOUT | POLLWRNORM;
+		if (DriverManager->GlobalKeyboardInputReports.Count() > 0)
+			Ready |= POLLIN | POLLRDNORM;
+		return Ready & Events;
+	}
+
 	void VirtualTerminal::Clear(unsigned short StartX, unsigned short StartY, unsigned short EndX, unsigned short EndY)
 	{
 		assert(this->PaintCB != nullptr);